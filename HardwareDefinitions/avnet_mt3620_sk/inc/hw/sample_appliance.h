@@ -33,6 +33,12 @@
 // MT3620 SK: Connect external potentiometer to ADC controller 0, channel 1 using CLICK1 AN. In the app manifest, it is only necessary to request the capability for the ADC Group Controller, SAMPLE_POTENTIOMETER_ADC_CONTROLLER.
 #define SAMPLE_POTENTIOMETER_ADC_CHANNEL MT3620_ADC_CHANNEL1
 
+// MT3620 SK: Connect external analog temperature sensor (10 mV per degree C, 500 mV at 0 degrees C) to ADC controller 0, channel 2. It is sampled in the same sweep as SAMPLE_POTENTIOMETER_ADC_CHANNEL.
+#define SAMPLE_TEMPERATURE_ADC_CHANNEL MT3620_ADC_CHANNEL2
+
+// MT3620 SK: Connect the sensor's reference voltage to ADC controller 0, channel 3. It is sampled in the same sweep as SAMPLE_POTENTIOMETER_ADC_CHANNEL.
+#define SAMPLE_REFERENCE_ADC_CHANNEL MT3620_ADC_CHANNEL3
+
 // MT3620 SK: User LED RED Channel.
 #define SAMPLE_RGBLED_RED AVNET_MT3620_SK_USER_LED_RED
 
@@ -72,3 +78,5 @@
 // MT3620 SK: LSM6DSO accelerometer.
 #define SAMPLE_LSM6DSO_I2C AVNET_MT3620_SK_ISU2_I2C
 
+// MT3620 SK: Connect external insulin pump driver using the PMOD connector: Pin-8. The pump runs while the pin is high.
+#define SAMPLE_INSULIN_PUMP AVNET_MT3620_SK_GPIO17
@@ -0,0 +1,237 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shims of the applibs used by the simulated hardware: logging, GPIO, networking, storage,
+// memory usage and the application API.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <applibs/adc.h>
+#include <applibs/application.h>
+#include <applibs/applications.h>
+#include <applibs/gpio.h>
+#include <applibs/log.h>
+#include <applibs/networking.h>
+#include <applibs/storage.h>
+
+#include "host_simulation.h"
+
+#define MAX_GPIOS 16
+
+typedef struct {
+    int fd; // -1 if the slot is free
+    GPIO_Id id;
+    GPIO_Value_Type value;
+} HostGpio;
+
+static HostGpio gpios[MAX_GPIOS];
+static bool isGpioInitialized = false;
+static bool isAtLineStart = true;
+
+int Log_DebugVarArgs(const char* fmt, va_list args)
+{
+    if (!hostConfig.isLogEnabled) {
+        return 0;
+    }
+
+    // Prefix each line with the virtual time since boot, as days of runtime pass in minutes.
+    if (isAtLineStart) {
+        uint64_t elapsedMs = (HostClock_Now() - HostClock_Boot()) / 1000000;
+        fprintf(stderr, "[%llud %02llu:%02llu:%02llu.%03llu] ",
+            (unsigned long long)(elapsedMs / 86400000),
+            (unsigned long long)(elapsedMs / 3600000 % 24),
+            (unsigned long long)(elapsedMs / 60000 % 60),
+            (unsigned long long)(elapsedMs / 1000 % 60), (unsigned long long)(elapsedMs % 1000));
+    }
+    int result = vfprintf(stderr, fmt, args);
+    size_t length = strlen(fmt);
+    isAtLineStart = length > 0 && fmt[length - 1] == '\n';
+    return result;
+}
+
+int Log_Debug(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int result = Log_DebugVarArgs(fmt, args);
+    va_end(args);
+    return result;
+}
+
+static HostGpio* FindGpio(int fd)
+{
+    if (!isGpioInitialized) {
+        isGpioInitialized = true;
+        for (size_t i = 0; i < MAX_GPIOS; i++) {
+            gpios[i].fd = -1;
+        }
+    }
+
+    for (size_t i = 0; i < MAX_GPIOS; i++) {
+        if (gpios[i].fd == fd) {
+            return &gpios[i];
+        }
+    }
+    return NULL;
+}
+
+// Each GPIO is backed by a descriptor on /dev/null, so that the application can close it. A
+// GPIO whose descriptor has been closed and reused is forgotten.
+static int OpenGpio(GPIO_Id gpioId, GPIO_Value_Type value)
+{
+    int fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+
+    HostGpio* gpio = FindGpio(fd);
+    if (gpio == NULL) {
+        gpio = FindGpio(-1);
+    }
+    if (gpio == NULL) {
+        close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+    gpio->fd = fd;
+    gpio->id = gpioId;
+    gpio->value = value;
+    return fd;
+}
+
+int GPIO_OpenAsInput(GPIO_Id gpioId)
+{
+    return OpenGpio(gpioId, GPIO_Value_High);
+}
+
+int GPIO_OpenAsOutput(GPIO_Id gpioId, GPIO_OutputMode_Type outputMode,
+    GPIO_Value_Type initialValue)
+{
+    return OpenGpio(gpioId, initialValue);
+}
+
+int GPIO_GetValue(int gpioFd, GPIO_Value_Type* outValue)
+{
+    HostGpio* gpio = FindGpio(gpioFd);
+    if (gpio == NULL || gpioFd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    *outValue = gpio->value;
+    return 0;
+}
+
+int GPIO_SetValue(int gpioFd, GPIO_Value_Type value)
+{
+    HostGpio* gpio = FindGpio(gpioFd);
+    if (gpio == NULL || gpioFd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    gpio->value = value;
+    return 0;
+}
+
+int Networking_IsNetworkingReady(bool* outIsNetworkingReady)
+{
+    *outIsNetworkingReady = HostNetwork_IsUp();
+    return 0;
+}
+
+int Networking_GetInterfaceConnectionStatus(const char* networkInterfaceName,
+    Networking_InterfaceConnectionStatus* outStatus)
+{
+    if (strcmp(networkInterfaceName, "wlan0") != 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    *outStatus = Networking_InterfaceConnectionStatus_InterfaceUp;
+    if (HostNetwork_IsUp()) {
+        *outStatus |= Networking_InterfaceConnectionStatus_ConnectedToNetwork |
+                      Networking_InterfaceConnectionStatus_IpAvailable |
+                      Networking_InterfaceConnectionStatus_ConnectedToInternet;
+    }
+    return 0;
+}
+
+int Storage_OpenFileInImagePackage(const char* relativePath)
+{
+    char path[PATH_MAX];
+    if (relativePath[0] == '/' ||
+        snprintf(path, sizeof(path), "%s/%s", hostConfig.imageDir, relativePath) >=
+            (int)sizeof(path)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+int Storage_OpenMutableFile(void)
+{
+    return open(hostConfig.storagePath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+}
+
+int Storage_DeleteMutableFile(void)
+{
+    if (unlink(hostConfig.storagePath) == -1 && errno != ENOENT) {
+        return -1;
+    }
+    return 0;
+}
+
+int Application_Connect(const char* componentId)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int Application_IsDeviceAuthReady(bool* outIsReady)
+{
+    *outIsReady = true;
+    return 0;
+}
+
+size_t Applications_GetTotalMemoryUsageInKB(void)
+{
+    return Applications_GetUserModeMemoryUsageInKB();
+}
+
+size_t Applications_GetUserModeMemoryUsageInKB(void)
+{
+    return (size_t)((hostStats.heapBytes + 1023) / 1024);
+}
+
+size_t Applications_GetPeakUserModeMemoryUsageInKB(void)
+{
+    return (size_t)((hostStats.peakHeapBytes + 1023) / 1024);
+}
+
+int ADC_Open(ADC_ControllerId id)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int ADC_GetSampleBitCount(int fd, ADC_ChannelId channel)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int ADC_SetReferenceVoltage(int fd, ADC_ChannelId channel, float referenceVoltage)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int ADC_Poll(int fd, ADC_ChannelId channel, uint32_t* outSampleValue)
+{
+    errno = ENOSYS;
+    return -1;
+}
@@ -0,0 +1,362 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Micro-benchmarks of the application's hot paths, built against the same shims as the host
+// simulation so that allocations are counted in the same way. Each benchmark prints one line of
+// JSON, so that the output of two firmware drops can be compared line by line. See README.md.
+//
+// Timer figures include the cost of the shim's timers, which are eventfds driven by the virtual
+// clock, so they track the timer utilities rather than the kernel.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_CYCLE_COUNTER 1
+#else
+#define HAS_CYCLE_COUNTER 0
+#endif
+
+#include <applibs/eventloop.h>
+
+#include "calibration_curve.h"
+#include "eventloop_timer_utilities.h"
+#include "host_simulation.h"
+#include "json_arena.h"
+#include "parson.h"
+#include "sensor_channels.h"
+#include "spsc_ring.h"
+#include "telemetry_encoder.h"
+#include "twin_parser.h"
+
+#define DEFAULT_ITERATIONS 100000
+#define LARGE_TWIN_EXTRA_PROPERTIES 48
+
+typedef void (*BenchmarkFunction)(void);
+
+typedef struct {
+    const char* name;
+    BenchmarkFunction run; // One operation
+} Benchmark;
+
+// Results are written here, so that the compiler cannot drop the work that produced them.
+static volatile size_t sink;
+
+static TelemetryReading readings[TELEMETRY_BATCH_CAPACITY];
+static uint8_t encodeBuffer[TELEMETRY_ENCODER_BUFFER_SIZE];
+static char serializeBuffer[1024];
+static EventLoop* eventLoop = NULL;
+static EventLoopTimer* rearmedTimer = NULL;
+
+// A complete twin as IoT Hub delivers it, with the metadata it adds to each property.
+static const char CompleteTwin[] =
+    "{\"desired\":{\"StatusLED\":true,\"LogLevel\":\"Info\",\"TelemetryMinPeriodSeconds\":2,"
+    "\"TelemetryMaxPeriodSeconds\":60,\"AlertLowThreshold\":3.9,\"AlertHighThreshold\":10,"
+    "\"AlertHysteresis\":0.2,\"$metadata\":{\"$lastUpdated\":\"2021-04-01T08:00:00.0000000Z\","
+    "\"$lastUpdatedVersion\":7,\"StatusLED\":{\"$lastUpdated\":\"2021-04-01T08:00:00.0000000Z\","
+    "\"$lastUpdatedVersion\":7},\"LogLevel\":{\"$lastUpdated\":\"2021-04-01T08:00:00.0000000Z\","
+    "\"$lastUpdatedVersion\":7},\"AlertLowThreshold\":{\"$lastUpdated\":"
+    "\"2021-04-01T08:00:00.0000000Z\",\"$lastUpdatedVersion\":7}},\"$version\":7},"
+    "\"reported\":{\"manufacturer\":\"Microsoft\",\"model\":\"Azure Sphere Sample Device\","
+    "\"StatusLED\":true,\"LogLevel\":\"Info\",\"TelemetryMinPeriodSeconds\":2,"
+    "\"TelemetryMaxPeriodSeconds\":60,\"AlertLowThreshold\":3.90,\"AlertHighThreshold\":10.00,"
+    "\"AlertHysteresis\":0.20,\"$metadata\":{\"$lastUpdated\":\"2021-04-01T08:00:01.0000000Z\","
+    "\"StatusLED\":{\"$lastUpdated\":\"2021-04-01T08:00:01.0000000Z\"},\"LogLevel\":{"
+    "\"$lastUpdated\":\"2021-04-01T08:00:01.0000000Z\"}},\"$version\":12}}";
+
+static const char DesiredPatch[] = "{\"AlertLowThreshold\":4.2,\"$version\":8}";
+
+// A complete twin which also carries other properties, as when a fleet's twins are shared with
+// other services. Built by BuildLargeTwin.
+static char largeTwin[sizeof(CompleteTwin) + LARGE_TWIN_EXTRA_PROPERTIES * 64];
+static size_t largeTwinSize = 0;
+
+static void IgnoreTwinValue(const TwinValue* value)
+{
+    sink += value->type;
+}
+
+// Same shape as the application's table.
+static const TwinProperty twinProperties[] = {
+    {.path = "StatusLED", .type = TwinValue_Bool, .handler = IgnoreTwinValue},
+    {.path = "LogLevel", .type = TwinValue_String, .handler = IgnoreTwinValue},
+    {.path = "TelemetryMinPeriodSeconds", .type = TwinValue_Number, .handler = IgnoreTwinValue},
+    {.path = "TelemetryMaxPeriodSeconds", .type = TwinValue_Number, .handler = IgnoreTwinValue},
+    {.path = "AlertLowThreshold", .type = TwinValue_Number, .handler = IgnoreTwinValue},
+    {.path = "AlertHighThreshold", .type = TwinValue_Number, .handler = IgnoreTwinValue},
+    {.path = "AlertHysteresis", .type = TwinValue_Number, .handler = IgnoreTwinValue} };
+
+static void BuildLargeTwin(void)
+{
+    // Insert the extra properties at the start of the desired object.
+    static const char DesiredStart[] = "{\"desired\":{";
+    size_t length = (size_t)snprintf(largeTwin, sizeof(largeTwin), "%s", DesiredStart);
+    for (size_t i = 0; i < LARGE_TWIN_EXTRA_PROPERTIES; i++) {
+        length += (size_t)snprintf(largeTwin + length, sizeof(largeTwin) - length,
+            "\"Fleet%02zu\":{\"Enabled\":true,\"Interval\":%zu,\"Tag\":\"ward-%zu\"},", i,
+            30 + i, i % 7);
+    }
+    length += (size_t)snprintf(largeTwin + length, sizeof(largeTwin) - length, "%s",
+        CompleteTwin + sizeof(DesiredStart) - 1);
+    largeTwinSize = length;
+}
+
+static void EncodeSingleJson(void)
+{
+    sink += TelemetryEncoder_EncodeReadings(TelemetryEncoding_Json, readings, 1, false,
+        encodeBuffer, sizeof(encodeBuffer));
+}
+
+static void EncodeBatchJson(void)
+{
+    sink += TelemetryEncoder_EncodeReadings(TelemetryEncoding_Json, readings,
+        TELEMETRY_BATCH_CAPACITY, true, encodeBuffer, sizeof(encodeBuffer));
+}
+
+static void EncodeBatchCbor(void)
+{
+    sink += TelemetryEncoder_EncodeReadings(TelemetryEncoding_Cbor, readings,
+        TELEMETRY_BATCH_CAPACITY, true, encodeBuffer, sizeof(encodeBuffer));
+}
+
+static void EncodeBatchPacked(void)
+{
+    sink += TelemetryEncoder_EncodeReadings(TelemetryEncoding_Packed, readings,
+        TELEMETRY_BATCH_CAPACITY, true, encodeBuffer, sizeof(encodeBuffer));
+}
+
+// Same shape as the application's table: glucose, temperature and reference.
+static const SensorChannelConfig sensorChannels[] = {
+    {.name = "Glucose", .adcChannel = 1, .unitsPerVoltQ16 = 1 << 16, .offsetHundredths = 0},
+    {.name = "Temperature", .adcChannel = 2, .unitsPerVoltQ16 = 100 << 16,
+        .offsetHundredths = -5000},
+    {.name = "Reference", .adcChannel = 3, .unitsPerVoltQ16 = 1 << 16, .offsetHundredths = 0} };
+#define SENSOR_CHANNEL_COUNT (sizeof(sensorChannels) / sizeof(sensorChannels[0]))
+static uint32_t sweepCounts[SENSOR_CHANNELS_MAX] = { 2314, 355, 1024 };
+
+static void ConvertSweep(void)
+{
+    int32_t hundredths[SENSOR_CHANNELS_MAX];
+    sweepCounts[0] ^= 1; // Vary the input, so that the conversion is not hoisted
+    SensorChannels_Convert(sweepCounts, hundredths, SENSOR_CHANNEL_COUNT);
+    sink += (size_t)hundredths[0] + (size_t)hundredths[1] + (size_t)hundredths[2];
+}
+
+// A curved response with temperature correction, as in the soak simulation's script.
+static const CalibrationCoefficients calibration = {
+    .coefficientsHundredths = { 10, 980, 30, -20 },
+    .temperatureCoefficientHundredths = 200,
+    .referenceTemperatureHundredths = 3700 };
+
+static void CalibrateReading(void)
+{
+    sweepCounts[0] ^= 1;
+    int32_t hundredths = CalibrationCurve_Lookup(sweepCounts[0]);
+    sink += (size_t)CalibrationCurve_CorrectTemperature(hundredths, 3669);
+}
+
+// Pass a sweep through the ring, as the sampler thread and the event loop do, on one thread.
+static SpscRing sweepRing;
+static uint32_t sweepStorage[16][SENSOR_CHANNELS_MAX];
+
+static void SpscRingPushPop(void)
+{
+    uint32_t sweep[SENSOR_CHANNELS_MAX];
+    SpscRing_Push(&sweepRing, sweepCounts);
+    SpscRing_Pop(&sweepRing, sweep);
+    sink += sweep[0];
+}
+
+static void ParseDesiredPatch(void)
+{
+    sink += (size_t)TwinParser_Parse((const uint8_t*)DesiredPatch, sizeof(DesiredPatch) - 1,
+        false, twinProperties, sizeof(twinProperties) / sizeof(twinProperties[0]));
+}
+
+static void ParseCompleteTwin(void)
+{
+    sink += (size_t)TwinParser_Parse((const uint8_t*)CompleteTwin, sizeof(CompleteTwin) - 1,
+        true, twinProperties, sizeof(twinProperties) / sizeof(twinProperties[0]));
+}
+
+static void ParseLargeTwin(void)
+{
+    sink += (size_t)TwinParser_Parse((const uint8_t*)largeTwin, largeTwinSize, true,
+        twinProperties, sizeof(twinProperties) / sizeof(twinProperties[0]));
+}
+
+// Parse a Direct Method payload with parson, as MethodDispatch does.
+static void ParsonParseMethodPayload(void)
+{
+    JsonArena_Reset();
+    JSON_Value* value = json_parse_string("2.5");
+    sink += (size_t)json_value_get_number(value);
+    json_value_free(value);
+}
+
+// Build and serialize a reported properties document of the application's shape with parson.
+static void ParsonSerializeReported(void)
+{
+    JsonArena_Reset();
+    JSON_Value* root = json_value_init_object();
+    JSON_Object* object = json_value_get_object(root);
+    json_object_set_string(object, "manufacturer", "Microsoft");
+    json_object_set_string(object, "model", "Azure Sphere Sample Device");
+    json_object_set_boolean(object, "StatusLED", 1);
+    json_object_set_string(object, "LogLevel", "Info");
+    json_object_set_number(object, "TelemetryMinPeriodSeconds", 2);
+    json_object_set_number(object, "TelemetryMaxPeriodSeconds", 60);
+    json_object_set_number(object, "AlertLowThreshold", 3.9);
+    json_object_set_number(object, "AlertHighThreshold", 10);
+    json_object_set_number(object, "AlertHysteresis", 0.2);
+    if (json_serialize_to_buffer(root, serializeBuffer, sizeof(serializeBuffer)) == JSONSuccess) {
+        sink += (size_t)serializeBuffer[0];
+    }
+    json_value_free(root);
+}
+
+static void CountTimer(EventLoopTimer* timer)
+{
+    sink += (size_t)ConsumeEventLoopTimerEvent(timer) + 1;
+}
+
+// Let a timer which was armed for a millisecond expire, and dispatch it.
+static void ExpireTimer(void)
+{
+    HostClock_AdvanceTo(HostClock_Now() + 1000000);
+    EventLoop_Run(eventLoop, 0, true);
+}
+
+// Create, arm, expire, dispatch and dispose of a one-shot timer, as for each pump dose.
+static void TimerCreateCycle(void)
+{
+    static const struct timespec Delay = {.tv_sec = 0, .tv_nsec = 1000000};
+    EventLoopTimer* timer = CreateEventLoopDisarmedTimer(eventLoop, &CountTimer);
+    if (timer == NULL) {
+        fprintf(stderr, "Cannot create timer: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    SetEventLoopTimerOneShot(timer, &Delay);
+    ExpireTimer();
+    DisposeEventLoopTimer(timer);
+}
+
+// Re-arm, expire and dispatch an existing timer, as for each scheduler deadline.
+static void TimerRearmCycle(void)
+{
+    static const struct timespec Delay = {.tv_sec = 0, .tv_nsec = 1000000};
+    SetEventLoopTimerOneShot(rearmedTimer, &Delay);
+    ExpireTimer();
+}
+
+static const Benchmark benchmarks[] = {
+    {.name = "EncodeSingleJson", .run = EncodeSingleJson},
+    {.name = "EncodeBatchJson", .run = EncodeBatchJson},
+    {.name = "EncodeBatchCbor", .run = EncodeBatchCbor},
+    {.name = "EncodeBatchPacked", .run = EncodeBatchPacked},
+    {.name = "ConvertSweep", .run = ConvertSweep},
+    {.name = "CalibrateReading", .run = CalibrateReading},
+    {.name = "SpscRingPushPop", .run = SpscRingPushPop},
+    {.name = "ParseDesiredPatch", .run = ParseDesiredPatch},
+    {.name = "ParseCompleteTwin", .run = ParseCompleteTwin},
+    {.name = "ParseLargeTwin", .run = ParseLargeTwin},
+    {.name = "ParsonParseMethodPayload", .run = ParsonParseMethodPayload},
+    {.name = "ParsonSerializeReported", .run = ParsonSerializeReported},
+    {.name = "TimerCreateCycle", .run = TimerCreateCycle},
+    {.name = "TimerRearmCycle", .run = TimerRearmCycle} };
+
+static uint64_t WallNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t Cycles(void)
+{
+#if HAS_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void RunBenchmark(const Benchmark* benchmark, unsigned long iterations)
+{
+    // Warm the caches and let any one-off allocations happen before measuring.
+    for (unsigned long i = 0; i < iterations / 10 + 1; i++) {
+        benchmark->run();
+    }
+
+    uint64_t allocations = hostStats.allocations;
+    uint64_t baseHeapBytes = hostStats.heapBytes;
+    hostStats.peakHeapBytes = baseHeapBytes;
+    uint64_t startNs = WallNs();
+    uint64_t startCycles = Cycles();
+    for (unsigned long i = 0; i < iterations; i++) {
+        benchmark->run();
+    }
+    uint64_t cycles = Cycles() - startCycles;
+    uint64_t elapsedNs = WallNs() - startNs;
+    allocations = hostStats.allocations - allocations;
+
+    JsonArenaStats arenaStats;
+    JsonArena_GetStats(&arenaStats);
+    printf("{\"Benchmark\":\"%s\",\"Iterations\":%lu,\"NsPerOp\":%.1f,", benchmark->name,
+        iterations, (double)elapsedNs / (double)iterations);
+    if (HAS_CYCLE_COUNTER) {
+        printf("\"CyclesPerOp\":%.1f,", (double)cycles / (double)iterations);
+    }
+    else {
+        printf("\"CyclesPerOp\":null,");
+    }
+    printf("\"AllocationsPerOp\":%.2f,\"PeakHeapBytes\":%llu,\"ArenaHighWater\":%zu}\n",
+        (double)allocations / (double)iterations,
+        (unsigned long long)(hostStats.peakHeapBytes - baseHeapBytes), arenaStats.highWater);
+}
+
+int main(int argc, char* argv[])
+{
+    HostSimulation_DiscardReport();
+
+    unsigned long iterations = DEFAULT_ITERATIONS;
+    const char* iterationsSetting = getenv("GLUCK_BENCH_ITERATIONS");
+    if (iterationsSetting != NULL && strtoul(iterationsSetting, NULL, 10) > 0) {
+        iterations = strtoul(iterationsSetting, NULL, 10);
+    }
+    const char* filter = argc > 1 ? argv[1] : NULL;
+
+    for (size_t i = 0; i < TELEMETRY_BATCH_CAPACITY; i++) {
+        readings[i].timestamp = 1617235200 + (time_t)(i * 60);
+        readings[i].glucoseHundredths = 480 + (int32_t)(i * 7 % 90);
+    }
+    BuildLargeTwin();
+    SensorChannels_Init(sensorChannels, SENSOR_CHANNEL_COUNT);
+    for (size_t i = 0; i < SensorChannels_Count(); i++) {
+        SensorChannels_SetResolution(i, 12, 10.0f);
+    }
+    CalibrationCurve_Compile(&calibration, 12);
+    SpscRing_Init(&sweepRing, sweepStorage, sizeof(sweepStorage[0]),
+        sizeof(sweepStorage) / sizeof(sweepStorage[0]));
+    JsonArena_Install();
+    eventLoop = EventLoop_Create();
+    rearmedTimer = CreateEventLoopDisarmedTimer(eventLoop, &CountTimer);
+    if (eventLoop == NULL || rearmedTimer == NULL) {
+        fprintf(stderr, "Cannot set up the event loop: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (filter == NULL || strstr(benchmarks[i].name, filter) != NULL) {
+            RunBenchmark(&benchmarks[i], iterations);
+        }
+    }
+
+    DisposeEventLoopTimer(rearmedTimer);
+    EventLoop_Close(eventLoop);
+    return EXIT_SUCCESS;
+}
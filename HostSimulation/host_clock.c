@@ -0,0 +1,402 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Virtual clock. The application is linked with --wrap for the clock and timerfd functions, so
+// that its monotonic and real-time clocks read virtual time, and each of its timerfds is an
+// eventfd which the event loop makes readable when virtual time reaches the timer's deadline.
+// Virtual time only moves when the event loop has nothing else to do, so a day of runtime takes
+// as long as the application's own processing for that day. It stands still while any other
+// thread runs, and those threads' nanosleeps return at once, so that work done off the event
+// loop (DPS provisioning) takes no virtual time and runs are repeatable. A thread which paces
+// itself with clock_nanosleep (the sampler) instead sleeps until virtual time reaches its
+// deadline, and the clock waits for it to sleep again before any timerfd at that time expires.
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host_simulation.h"
+
+#define MAX_TIMERS 32
+
+// Virtual time starts shortly after boot, and real time on a fixed date.
+static const uint64_t BootTimeNs = 10 * NANOSECONDS_PER_SECOND;
+static const time_t RealTimeAtBoot = 1617235200; // 2021-04-01T00:00:00Z
+
+typedef struct {
+    int fd; // -1 if the slot is free
+    bool isArmed;
+    uint64_t deadlineNs;
+    uint64_t intervalNs;
+} VirtualTimer;
+
+static bool isInitialized = false;
+static uint64_t bootNs = 0;
+static uint64_t nowNs = 0;
+static VirtualTimer timers[MAX_TIMERS];
+static unsigned int runningThreads = 0;
+
+// A thread waiting in clock_nanosleep. Each lives on its sleeping thread's stack.
+typedef struct Sleeper {
+    uint64_t deadlineNs;
+    bool isDue; // Set by HostClock_AdvanceTo, which has counted the thread as running again
+    struct Sleeper* next;
+} Sleeper;
+
+static pthread_mutex_t sleepersLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleepersChanged = PTHREAD_COND_INITIALIZER;
+static Sleeper* sleepers = NULL;
+static unsigned int wakingCount = 0;  // Due sleepers which have not yet slept again or exited
+static bool isJoining = false; // While a thread is joined, its sleeps return at once
+static pthread_t joiningThread;
+static __thread bool isWaking = false;
+
+typedef struct {
+    void* (*start)(void*);
+    void* argument;
+} ThreadStart;
+
+int __real_clock_gettime(clockid_t clockId, struct timespec* time);
+int __real_close(int fd);
+int __real_pthread_create(pthread_t* thread, const pthread_attr_t* attributes,
+    void* (*start)(void*), void* argument);
+int __real_pthread_join(pthread_t thread, void** result);
+
+static void Initialize(void)
+{
+    if (isInitialized) {
+        return;
+    }
+    isInitialized = true;
+
+    // Spread the boot time of devices with different seeds over a second, as for real devices.
+    bootNs = BootTimeNs + (uint64_t)(hostConfig.seed * 2654435761u) % NANOSECONDS_PER_SECOND;
+    nowNs = bootNs;
+    for (size_t i = 0; i < MAX_TIMERS; i++) {
+        timers[i].fd = -1;
+    }
+}
+
+static VirtualTimer* FindTimer(int fd)
+{
+    Initialize();
+    for (size_t i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].fd == fd && fd >= 0) {
+            return &timers[i];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t ToNanoseconds(const struct timespec* time)
+{
+    return (uint64_t)time->tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)time->tv_nsec;
+}
+
+static void ToTimespec(uint64_t ns, struct timespec* time)
+{
+    time->tv_sec = (time_t)(ns / NANOSECONDS_PER_SECOND);
+    time->tv_nsec = (long)(ns % NANOSECONDS_PER_SECOND);
+}
+
+uint64_t HostClock_Now(void)
+{
+    Initialize();
+    return __atomic_load_n(&nowNs, __ATOMIC_RELAXED);
+}
+
+uint64_t HostClock_Boot(void)
+{
+    Initialize();
+    return bootNs;
+}
+
+bool HostClock_AreThreadsRunning(void)
+{
+    return __atomic_load_n(&runningThreads, __ATOMIC_ACQUIRE) != 0;
+}
+
+bool HostClock_NextDeadline(uint64_t* outDeadlineNs)
+{
+    bool isAnyArmed = false;
+    for (size_t i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].fd >= 0 && timers[i].isArmed &&
+            (!isAnyArmed || timers[i].deadlineNs < *outDeadlineNs)) {
+            *outDeadlineNs = timers[i].deadlineNs;
+            isAnyArmed = true;
+        }
+    }
+
+    pthread_mutex_lock(&sleepersLock);
+    for (Sleeper* sleeper = sleepers; sleeper != NULL; sleeper = sleeper->next) {
+        if (!isAnyArmed || sleeper->deadlineNs < *outDeadlineNs) {
+            *outDeadlineNs = sleeper->deadlineNs;
+            isAnyArmed = true;
+        }
+    }
+    pthread_mutex_unlock(&sleepersLock);
+    return isAnyArmed;
+}
+
+void HostClock_AdvanceTo(uint64_t timeNs)
+{
+    Initialize();
+    if (timeNs > nowNs) {
+        __atomic_store_n(&nowNs, timeNs, __ATOMIC_RELAXED);
+    }
+
+    // Wake the sleepers which are due, and wait for them to sleep again, so that whatever they
+    // signal is ready before the timers below, however the threads are scheduled.
+    pthread_mutex_lock(&sleepersLock);
+    for (Sleeper** link = &sleepers; *link != NULL;) {
+        Sleeper* sleeper = *link;
+        if (sleeper->deadlineNs > nowNs) {
+            link = &sleeper->next;
+            continue;
+        }
+        *link = sleeper->next;
+        sleeper->isDue = true;
+        wakingCount++;
+        __atomic_add_fetch(&runningThreads, 1, __ATOMIC_RELEASE);
+    }
+    pthread_cond_broadcast(&sleepersChanged);
+    while (wakingCount != 0) {
+        pthread_cond_wait(&sleepersChanged, &sleepersLock);
+    }
+    pthread_mutex_unlock(&sleepersLock);
+
+    for (size_t i = 0; i < MAX_TIMERS; i++) {
+        VirtualTimer* timer = &timers[i];
+        if (timer->fd < 0 || !timer->isArmed || timer->deadlineNs > nowNs) {
+            continue;
+        }
+
+        // Like a timerfd, report how many intervals have expired since it was last read.
+        uint64_t expirations = 1;
+        if (timer->intervalNs == 0) {
+            timer->isArmed = false;
+        }
+        else {
+            expirations += (nowNs - timer->deadlineNs) / timer->intervalNs;
+            timer->deadlineNs += expirations * timer->intervalNs;
+        }
+        if (write(timer->fd, &expirations, sizeof(expirations)) == -1) {
+            perror("Virtual timer");
+        }
+    }
+}
+
+int __wrap_clock_gettime(clockid_t clockId, struct timespec* time)
+{
+    switch (clockId) {
+    case CLOCK_MONOTONIC:
+    case CLOCK_BOOTTIME:
+        ToTimespec(HostClock_Now(), time);
+        return 0;
+    case CLOCK_REALTIME:
+        ToTimespec(
+            (uint64_t)RealTimeAtBoot * NANOSECONDS_PER_SECOND + HostClock_Now() - BootTimeNs, time);
+        return 0;
+    default:
+        return __real_clock_gettime(clockId, time);
+    }
+}
+
+time_t __wrap_time(time_t* outTime)
+{
+    struct timespec now;
+    __wrap_clock_gettime(CLOCK_REALTIME, &now);
+    if (outTime != NULL) {
+        *outTime = now.tv_sec;
+    }
+    return now.tv_sec;
+}
+
+int __wrap_timerfd_create(clockid_t clockId, int flags)
+{
+    Initialize();
+    if (clockId != CLOCK_MONOTONIC && clockId != CLOCK_BOOTTIME) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    VirtualTimer* timer = NULL;
+    for (size_t i = 0; timer == NULL && i < MAX_TIMERS; i++) {
+        if (timers[i].fd < 0) {
+            timer = &timers[i];
+        }
+    }
+    if (timer == NULL) {
+        errno = EMFILE;
+        return -1;
+    }
+
+    // The eventfd is always non-blocking, so that unread expirations can be discarded.
+    int fd = eventfd(0, EFD_NONBLOCK | ((flags & TFD_CLOEXEC) != 0 ? EFD_CLOEXEC : 0));
+    if (fd == -1) {
+        return -1;
+    }
+    timer->fd = fd;
+    timer->isArmed = false;
+    return fd;
+}
+
+int __wrap_timerfd_settime(int fd, int flags, const struct itimerspec* newValue,
+    struct itimerspec* oldValue)
+{
+    VirtualTimer* timer = FindTimer(fd);
+    if (timer == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (oldValue != NULL) {
+        memset(oldValue, 0, sizeof(*oldValue));
+        if (timer->isArmed) {
+            ToTimespec(timer->deadlineNs - nowNs, &oldValue->it_value);
+            ToTimespec(timer->intervalNs, &oldValue->it_interval);
+        }
+    }
+
+    // Setting a timer discards expirations which have not yet been read, just as for a timerfd.
+    uint64_t unread;
+    while (read(fd, &unread, sizeof(unread)) > 0) {
+    }
+
+    uint64_t valueNs = ToNanoseconds(&newValue->it_value);
+    timer->isArmed = valueNs != 0;
+    timer->deadlineNs = (flags & TFD_TIMER_ABSTIME) != 0 ? valueNs : nowNs + valueNs;
+    timer->intervalNs = ToNanoseconds(&newValue->it_interval);
+    return 0;
+}
+
+// Called with sleepersLock held, when a thread woken by HostClock_AdvanceTo sleeps again or
+// exits.
+static void FinishWaking(void)
+{
+    if (isWaking) {
+        isWaking = false;
+        wakingCount--;
+        pthread_cond_broadcast(&sleepersChanged);
+    }
+}
+
+// Called with sleepersLock held.
+static bool IsBeingJoined(void)
+{
+    return isJoining && pthread_equal(joiningThread, pthread_self());
+}
+
+static void* RunThread(void* context)
+{
+    ThreadStart start = *(ThreadStart*)context;
+    __real_free(context);
+    void* result = start.start(start.argument);
+    pthread_mutex_lock(&sleepersLock);
+    FinishWaking();
+    __atomic_sub_fetch(&runningThreads, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sleepersLock);
+    return result;
+}
+
+int __wrap_pthread_create(pthread_t* thread, const pthread_attr_t* attributes,
+    void* (*start)(void*), void* argument)
+{
+    ThreadStart* context = __real_malloc(sizeof(*context));
+    if (context == NULL) {
+        return ENOMEM;
+    }
+    context->start = start;
+    context->argument = argument;
+
+    __atomic_add_fetch(&runningThreads, 1, __ATOMIC_RELEASE);
+    int result = __real_pthread_create(thread, attributes, &RunThread, context);
+    if (result != 0) {
+        __atomic_sub_fetch(&runningThreads, 1, __ATOMIC_RELEASE);
+        __real_free(context);
+    }
+    return result;
+}
+
+int __wrap_pthread_join(pthread_t thread, void** result)
+{
+    // Virtual time cannot move while the event loop waits here, so let the thread run freely.
+    // Only the event loop joins threads, so there is at most one join at a time.
+    pthread_mutex_lock(&sleepersLock);
+    isJoining = true;
+    joiningThread = thread;
+    pthread_cond_broadcast(&sleepersChanged);
+    pthread_mutex_unlock(&sleepersLock);
+
+    int error = __real_pthread_join(thread, result);
+
+    pthread_mutex_lock(&sleepersLock);
+    isJoining = false;
+    pthread_mutex_unlock(&sleepersLock);
+    return error;
+}
+
+int __wrap_nanosleep(const struct timespec* duration, struct timespec* remaining)
+{
+    sched_yield();
+    return 0;
+}
+
+int __wrap_clock_nanosleep(clockid_t clockId, int flags, const struct timespec* request,
+    struct timespec* remaining)
+{
+    if (clockId != CLOCK_MONOTONIC && clockId != CLOCK_BOOTTIME) {
+        return EINVAL;
+    }
+
+    pthread_mutex_lock(&sleepersLock);
+    FinishWaking();
+    uint64_t requestNs = ToNanoseconds(request);
+    Sleeper sleeper = {
+        .deadlineNs = (flags & TIMER_ABSTIME) != 0 ? requestNs : HostClock_Now() + requestNs,
+        .isDue = false,
+        .next = sleepers };
+    if (IsBeingJoined() || sleeper.deadlineNs <= HostClock_Now()) {
+        pthread_mutex_unlock(&sleepersLock);
+        return 0;
+    }
+
+    sleepers = &sleeper;
+    __atomic_sub_fetch(&runningThreads, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&sleepersChanged);
+    while (!sleeper.isDue && !IsBeingJoined()) {
+        pthread_cond_wait(&sleepersChanged, &sleepersLock);
+    }
+
+    if (sleeper.isDue) {
+        isWaking = true;
+    }
+    else {
+        // Woken early for a join, so the clock has not counted the thread as running.
+        for (Sleeper** link = &sleepers; *link != NULL; link = &(*link)->next) {
+            if (*link == &sleeper) {
+                *link = sleeper.next;
+                break;
+            }
+        }
+        __atomic_add_fetch(&runningThreads, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&sleepersLock);
+    return 0;
+}
+
+int __wrap_close(int fd)
+{
+    VirtualTimer* timer = FindTimer(fd);
+    if (timer != NULL) {
+        timer->fd = -1;
+    }
+    return __real_close(fd);
+}
@@ -0,0 +1,231 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Event loop on the virtual clock. Ready descriptors are dispatched first; once none is ready,
+// virtual time jumps to the next timer deadline, unless another thread is running, in which
+// case the loop waits for it in real time.
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#include <applibs/eventloop.h>
+
+#include "host_simulation.h"
+
+#define MAX_REGISTRATIONS 32
+
+struct EventRegistration {
+    bool isActive;
+    int fd;
+    EventLoop_IoEvents events;
+    EventLoopIoCallback* callback;
+    void* context;
+};
+
+struct EventLoop {
+    bool isStopped;
+    size_t nextIndex; // Registration checked first, so that busy descriptors take turns
+    EventRegistration registrations[MAX_REGISTRATIONS];
+};
+
+static EventLoop eventLoop;
+static bool isEventLoopInUse = false;
+static bool isSimulationEnded = false;
+
+static short ToPollEvents(EventLoop_IoEvents events)
+{
+    return (short)(((events & EventLoop_Input) != 0 ? POLLIN : 0) |
+                   ((events & EventLoop_Output) != 0 ? POLLOUT : 0));
+}
+
+static EventLoop_IoEvents FromPollEvents(short events)
+{
+    return ((events & POLLIN) != 0 ? EventLoop_Input : 0) |
+           ((events & POLLOUT) != 0 ? EventLoop_Output : 0) |
+           ((events & (POLLERR | POLLHUP)) != 0 ? EventLoop_Error : 0);
+}
+
+// Dispatch ready registrations, returning how many were dispatched, or -1 if poll failed.
+static int DispatchReady(EventLoop* el, int timeoutMs, bool processOneEvent)
+{
+    struct pollfd fds[MAX_REGISTRATIONS];
+    size_t indices[MAX_REGISTRATIONS];
+    nfds_t count = 0;
+    for (size_t i = 0; i < MAX_REGISTRATIONS; i++) {
+        size_t index = (el->nextIndex + i) % MAX_REGISTRATIONS;
+        EventRegistration* reg = &el->registrations[index];
+        if (reg->isActive && reg->events != EventLoop_None) {
+            fds[count].fd = reg->fd;
+            fds[count].events = ToPollEvents(reg->events);
+            fds[count].revents = 0;
+            indices[count] = index;
+            count++;
+        }
+    }
+
+    int readyCount = poll(fds, count, timeoutMs);
+    if (readyCount <= 0) {
+        return readyCount;
+    }
+
+    int dispatched = 0;
+    for (nfds_t i = 0; i < count && !el->isStopped; i++) {
+        EventRegistration* reg = &el->registrations[indices[i]];
+        // A callback may have unregistered a later registration.
+        if (fds[i].revents == 0 || !reg->isActive || reg->fd != fds[i].fd) {
+            continue;
+        }
+
+        el->nextIndex = (indices[i] + 1) % MAX_REGISTRATIONS;
+        hostStats.eventsDispatched++;
+        dispatched++;
+        reg->callback(el, reg->fd, FromPollEvents(fds[i].revents), reg->context);
+        if (processOneEvent) {
+            break;
+        }
+    }
+    return dispatched;
+}
+
+EventLoop* EventLoop_Create(void)
+{
+    if (isEventLoopInUse) {
+        errno = EBUSY;
+        return NULL;
+    }
+    isEventLoopInUse = true;
+    eventLoop.isStopped = false;
+    eventLoop.nextIndex = 0;
+    for (size_t i = 0; i < MAX_REGISTRATIONS; i++) {
+        eventLoop.registrations[i].isActive = false;
+    }
+    return &eventLoop;
+}
+
+void EventLoop_Close(EventLoop* el)
+{
+    if (el == &eventLoop) {
+        isEventLoopInUse = false;
+    }
+}
+
+EventLoop_Run_Result EventLoop_Run(EventLoop* el, int duration_in_milliseconds,
+    bool process_one_event)
+{
+    if (el != &eventLoop) {
+        errno = EINVAL;
+        return EventLoop_Run_Failed;
+    }
+
+    bool isBounded = duration_in_milliseconds >= 0;
+    uint64_t endNs = HostClock_Now() + (uint64_t)(isBounded ? duration_in_milliseconds : 0) *
+                                           (NANOSECONDS_PER_SECOND / 1000);
+    el->isStopped = false;
+    int dispatchedCount = 0;
+    while (!el->isStopped) {
+        HostScript_RunDueEvents();
+
+        int dispatched = DispatchReady(el, 0, process_one_event);
+        if (dispatched == -1) {
+            return EventLoop_Run_Failed;
+        }
+        dispatchedCount += dispatched;
+        if (dispatched > 0 && process_one_event) {
+            break;
+        }
+        if (dispatched > 0) {
+            continue;
+        }
+
+        if (HostClock_AreThreadsRunning()) {
+            if (DispatchReady(el, 1, false) == -1 && errno != EINTR) {
+                return EventLoop_Run_Failed;
+            }
+            continue;
+        }
+
+        uint64_t deadlineNs;
+        if (!HostClock_NextDeadline(&deadlineNs)) {
+            // Nothing will happen in virtual time, so wait in real time.
+            dispatched = DispatchReady(el, isBounded ? duration_in_milliseconds : -1,
+                process_one_event);
+            if (dispatched == -1) {
+                return EventLoop_Run_Failed;
+            }
+            dispatchedCount += dispatched;
+            break;
+        }
+
+        // At the end of the run, stop the application as the OS would, and let it shut down.
+        uint64_t simulationEndNs = HostClock_Boot() + hostConfig.durationNs;
+        if (!isSimulationEnded && hostConfig.durationNs != 0 && deadlineNs > simulationEndNs) {
+            isSimulationEnded = true;
+            HostClock_AdvanceTo(simulationEndNs);
+            raise(SIGTERM);
+            errno = EINTR;
+            return EventLoop_Run_Failed;
+        }
+
+        if (isBounded && deadlineNs > endNs) {
+            HostClock_AdvanceTo(endNs);
+            break;
+        }
+        HostClock_AdvanceTo(deadlineNs);
+    }
+
+    return dispatchedCount > 0 ? EventLoop_Run_Finished : EventLoop_Run_FinishedEmpty;
+}
+
+int EventLoop_Stop(EventLoop* el)
+{
+    el->isStopped = true;
+    return 0;
+}
+
+int EventLoop_GetWaitDescriptor(EventLoop* el)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+EventRegistration* EventLoop_RegisterIo(EventLoop* el, int fd, EventLoop_IoEvents eventBitmask,
+    EventLoopIoCallback* callback, void* context)
+{
+    for (size_t i = 0; i < MAX_REGISTRATIONS; i++) {
+        EventRegistration* reg = &el->registrations[i];
+        if (!reg->isActive) {
+            reg->isActive = true;
+            reg->fd = fd;
+            reg->events = eventBitmask;
+            reg->callback = callback;
+            reg->context = context;
+            return reg;
+        }
+    }
+
+    errno = ENOMEM;
+    return NULL;
+}
+
+int EventLoop_ModifyIoEvents(EventLoop* el, EventRegistration* reg,
+    EventLoop_IoEvents eventBitmask)
+{
+    if (reg == NULL || !reg->isActive) {
+        errno = EINVAL;
+        return -1;
+    }
+    reg->events = eventBitmask;
+    return 0;
+}
+
+int EventLoop_UnregisterIo(EventLoop* el, EventRegistration* reg)
+{
+    if (reg == NULL || !reg->isActive) {
+        errno = EINVAL;
+        return -1;
+    }
+    reg->isActive = false;
+    return 0;
+}
@@ -0,0 +1,902 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// In-process test hub behind the Azure IoT C SDK and DPS client APIs, and the simulation script
+// which drives it. The hub accepts the device as soon as the network is up, sends it the
+// complete twin on each connection, and acknowledges messages and reported properties on the
+// next DoWork, which is when they are counted and written to the messages log. Like an MQTT
+// client, the device is counted as pinging the hub once per keep-alive period in which it sent
+// nothing, so that connection profiles can be compared.
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iothub.h>
+#include <iothub_client_core_common.h>
+#include <iothub_client_options.h>
+#include <iothub_device_client_ll.h>
+#include <iothub_security_factory.h>
+#include <iothubtransportmqtt.h>
+#include <iothubtransportmqtt_websockets.h>
+#include <azure_prov_client/prov_device_ll_client.h>
+#include <azure_prov_client/prov_security_factory.h>
+#include <azure_prov_client/prov_transport_mqtt_client.h>
+#include <azure_prov_client/prov_transport_mqtt_ws_client.h>
+
+#include "host_simulation.h"
+
+#define MAX_PENDING_CONFIRMATIONS 256
+#define MAX_PENDING_REPORTS 32
+#define MAX_SCRIPT_EVENTS 512
+#define MAX_SCRIPT_LINE 512
+#define MAX_TWIN_SIZE (16 * 1024)
+
+static const char TestHubHostName[] = "sim-hub.azure-devices.net";
+static const int DefaultKeepAliveSeconds = 240; // As in the SDK
+static const char DefaultTwin[] = "{\"desired\":{\"$version\":1},\"reported\":{\"$version\":1}}";
+
+struct IOTHUB_MESSAGE_HANDLE_DATA_TAG {
+    unsigned char* bytes;
+    size_t size;
+    const char* kind; // D2C, D2C-URGENT or D2C-LOW, by priority
+    char contentType[48];
+};
+
+typedef struct {
+    IOTHUB_MESSAGE_HANDLE message; // The hub's own copy
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void* context;
+} PendingConfirmation;
+
+typedef struct {
+    unsigned char* patch;
+    size_t size;
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK callback;
+    void* context;
+} PendingReport;
+
+struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG {
+    bool isInUse;
+    bool isConnected;
+    bool isWebSockets;
+    int keepAliveSeconds;
+    uint64_t lastSendNs; // When the device last sent anything, for keep-alive pings
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK statusCallback;
+    void* statusContext;
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK twinCallback;
+    void* twinContext;
+    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC methodCallback;
+    void* methodContext;
+    PendingConfirmation confirmations[MAX_PENDING_CONFIRMATIONS];
+    size_t confirmationCount;
+    PendingReport reports[MAX_PENDING_REPORTS];
+    size_t reportCount;
+};
+
+struct PROV_INSTANCE_INFO_TAG {
+    bool isInUse;
+    PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK registerCallback;
+    void* registerContext;
+};
+
+typedef enum {
+    ScriptEvent_Method,
+    ScriptEvent_Twin,
+    ScriptEvent_Disconnect,
+    ScriptEvent_NetworkDown,
+    ScriptEvent_NetworkUp,
+    ScriptEvent_Timeout,
+    ScriptEvent_Throttle
+} ScriptEventType;
+
+typedef struct {
+    uint64_t timeNs; // Relative to boot
+    ScriptEventType type;
+    bool isDone;
+    char* name; // Method name
+    char* argument; // Method payload or twin patch; NULL for the other events
+    IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason;
+    unsigned long count; // Messages to time out
+} ScriptEvent;
+
+static struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG client;
+static struct PROV_INSTANCE_INFO_TAG provisioningClient;
+static char transportMarker; // Transport providers only need to return distinct pointers
+static char webSocketTransportMarker;
+static bool isNetworkUp = true;
+static unsigned long messagesToTimeOut = 0;
+static unsigned long reportsToThrottle = 0;
+
+static char* twinDocument = NULL;
+static size_t twinSize = 0;
+
+static ScriptEvent scriptEvents[MAX_SCRIPT_EVENTS];
+static size_t scriptEventCount = 0;
+static size_t firstPendingEvent = 0;
+static bool isScriptLoaded = false;
+
+static char* CopyText(const char* text, size_t length)
+{
+    char* copy = __real_malloc(length + 1);
+    if (copy == NULL) {
+        perror("Test hub");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, text, length);
+    copy[length] = 0;
+    return copy;
+}
+
+typedef struct {
+    const unsigned char* bytes;
+    size_t size;
+    size_t used;
+    bool isValid;
+} PackedReader;
+
+static uint64_t ReadVarint(PackedReader* reader)
+{
+    uint64_t value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (reader->used >= reader->size) {
+            break;
+        }
+        unsigned char byte = reader->bytes[reader->used++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    reader->isValid = false;
+    return 0;
+}
+
+static int64_t ReadZigzag(PackedReader* reader)
+{
+    uint64_t value = ReadVarint(reader);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Decode a TelemetryEncoding_Packed payload into the JSON which the device would have sent in
+// TelemetryEncoding_Json, as the cloud does. This is the reference decoder for the format.
+// Returns a string to free with __real_free, or NULL if the payload is malformed.
+static char* DecodePacked(const unsigned char* bytes, size_t size)
+{
+    PackedReader reader = {.bytes = bytes, .size = size, .used = 1, .isValid = true};
+    if (size == 0 || bytes[0] != 1) {
+        return NULL;
+    }
+    uint64_t count = ReadVarint(&reader);
+    // Every reading takes at least two bytes, which bounds count before allocating.
+    if (!reader.isValid || count > size) {
+        return NULL;
+    }
+
+    size_t capacity = 3 + count * 80;
+    char* json = __real_malloc(capacity);
+    if (json == NULL) {
+        return NULL;
+    }
+    size_t length = (size_t)snprintf(json, capacity, "[");
+    int64_t timestamp = 0;
+    int64_t glucose = 0;
+    int64_t interval = 0;
+    for (uint64_t i = 0; i < count && reader.isValid; i++) {
+        if (i == 0) {
+            timestamp = (int64_t)ReadVarint(&reader);
+            glucose = ReadZigzag(&reader);
+        }
+        else {
+            interval += ReadZigzag(&reader);
+            timestamp += interval;
+            glucose += ReadZigzag(&reader);
+        }
+        int64_t magnitude = glucose < 0 ? -glucose : glucose;
+        length += (size_t)snprintf(json + length, capacity - length,
+            "%s{\"Glucose\":%s%lld.%02lld,\"Time\":%lld}", i == 0 ? "" : ",",
+            glucose < 0 ? "-" : "", (long long)(magnitude / 100), (long long)(magnitude % 100),
+            (long long)timestamp);
+    }
+    if (!reader.isValid || reader.used != size) {
+        __real_free(json);
+        return NULL;
+    }
+    snprintf(json + length, capacity - length, "]");
+    return json;
+}
+
+// Log a payload as text if it is JSON, decoded if it is packed readings, or as hex otherwise
+// (for example CBOR).
+static void LogPayload(const char* kind, const char* contentType, const unsigned char* bytes,
+    size_t size)
+{
+    if (contentType[0] == '\0' || strstr(contentType, "json") != NULL) {
+        HostSimulation_LogMessage(kind, "%s\t%.*s", contentType, (int)size, (const char*)bytes);
+        return;
+    }
+    if (strstr(contentType, "readings-packed") != NULL) {
+        char* json = DecodePacked(bytes, size);
+        if (json != NULL) {
+            HostSimulation_LogMessage(kind, "%s\t%u bytes\t%s", contentType, (unsigned int)size,
+                json);
+            __real_free(json);
+            return;
+        }
+    }
+
+    char* hex = __real_malloc(size * 2 + 1);
+    if (hex == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < size; i++) {
+        snprintf(hex + i * 2, 3, "%02x", bytes[i]);
+    }
+    hex[size * 2] = 0;
+    HostSimulation_LogMessage(kind, "%s\t%s", contentType, hex);
+    __real_free(hex);
+}
+
+static void LoadTwin(void)
+{
+    if (twinDocument != NULL) {
+        return;
+    }
+    if (hostConfig.twinPath == NULL) {
+        twinDocument = CopyText(DefaultTwin, sizeof(DefaultTwin) - 1);
+        twinSize = sizeof(DefaultTwin) - 1;
+        return;
+    }
+
+    int fd = open(hostConfig.twinPath, O_RDONLY);
+    char* buffer = __real_malloc(MAX_TWIN_SIZE);
+    ssize_t size = fd == -1 || buffer == NULL ? -1 : read(fd, buffer, MAX_TWIN_SIZE);
+    if (size == -1) {
+        perror(hostConfig.twinPath);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    twinDocument = buffer;
+    twinSize = (size_t)size;
+}
+
+static bool ParseReason(const char* name, IOTHUB_CLIENT_CONNECTION_STATUS_REASON* outReason)
+{
+    static const struct {
+        const char* name;
+        IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason;
+    } reasons[] = {
+        {"communication", IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR},
+        {"expired", IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN},
+        {"bad-credential", IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL},
+        {"disabled", IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED},
+        {"no-ping", IOTHUB_CLIENT_CONNECTION_NO_PING_RESPONSE},
+        {"retry-expired", IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED} };
+
+    for (size_t i = 0; i < sizeof(reasons) / sizeof(reasons[0]); i++) {
+        if (strcmp(name, reasons[i].name) == 0) {
+            *outReason = reasons[i].reason;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parse one script line: "<seconds> method <name> [payload]", "<seconds> twin <patch>",
+// "<seconds> disconnect [reason]", "<seconds> network up|down" or "<seconds> timeout <count>".
+static bool ParseScriptLine(char* line, ScriptEvent* event)
+{
+    char* end;
+    double seconds = strtod(line, &end);
+    if (end == line || seconds < 0.0) {
+        return false;
+    }
+    event->timeNs = (uint64_t)(seconds * 1e9);
+    event->isDone = false;
+    event->name = NULL;
+    event->argument = NULL;
+    event->reason = IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR;
+
+    char* command = strtok(end, " \t");
+    char* word = strtok(NULL, " \t");
+    char* rest = word != NULL ? strtok(NULL, "") : NULL;
+    if (command == NULL) {
+        return false;
+    }
+
+    if (strcmp(command, "method") == 0 && word != NULL) {
+        event->type = ScriptEvent_Method;
+        event->name = CopyText(word, strlen(word));
+        const char* payload = rest != NULL ? rest : "{}";
+        event->argument = CopyText(payload, strlen(payload));
+        return true;
+    }
+    if (strcmp(command, "twin") == 0 && word != NULL) {
+        // The patch may contain spaces, so rejoin it.
+        event->type = ScriptEvent_Twin;
+        size_t length = strlen(word);
+        if (rest != NULL) {
+            word[length] = ' ';
+            length = strlen(word);
+        }
+        event->argument = CopyText(word, length);
+        return true;
+    }
+    if (strcmp(command, "disconnect") == 0) {
+        event->type = ScriptEvent_Disconnect;
+        return word == NULL || ParseReason(word, &event->reason);
+    }
+    if (strcmp(command, "timeout") == 0 && word != NULL) {
+        event->type = ScriptEvent_Timeout;
+        event->count = strtoul(word, &end, 10);
+        return *end == '\0' && event->count > 0;
+    }
+    if (strcmp(command, "throttle") == 0 && word != NULL) {
+        event->type = ScriptEvent_Throttle;
+        event->count = strtoul(word, &end, 10);
+        return *end == '\0' && event->count > 0;
+    }
+    if (strcmp(command, "network") == 0 && word != NULL) {
+        if (strcmp(word, "down") == 0) {
+            event->type = ScriptEvent_NetworkDown;
+            return true;
+        }
+        if (strcmp(word, "up") == 0) {
+            event->type = ScriptEvent_NetworkUp;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void LoadScript(void)
+{
+    isScriptLoaded = true;
+    if (hostConfig.scriptPath == NULL) {
+        return;
+    }
+
+    FILE* file = fopen(hostConfig.scriptPath, "r");
+    if (file == NULL) {
+        perror(hostConfig.scriptPath);
+        exit(EXIT_FAILURE);
+    }
+
+    char line[MAX_SCRIPT_LINE];
+    unsigned int lineNumber = 0;
+    uint64_t previousNs = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = 0;
+        char* start = line;
+        while (isspace((unsigned char)*start)) {
+            start++;
+        }
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+
+        if (scriptEventCount == MAX_SCRIPT_EVENTS ||
+            !ParseScriptLine(start, &scriptEvents[scriptEventCount]) ||
+            scriptEvents[scriptEventCount].timeNs < previousNs) {
+            fprintf(stderr, "%s:%u: invalid, out of order or too many events.\n",
+                hostConfig.scriptPath, lineNumber);
+            exit(EXIT_FAILURE);
+        }
+        previousNs = scriptEvents[scriptEventCount].timeNs;
+        scriptEventCount++;
+    }
+    fclose(file);
+}
+
+static void Disconnect(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    if (!client.isInUse || !client.isConnected) {
+        return;
+    }
+
+    client.isConnected = false;
+    hostStats.disconnections++;
+    HostSimulation_LogMessage("DISCONNECT", "%d", (int)reason);
+    if (client.statusCallback != NULL) {
+        client.statusCallback(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED, reason,
+            client.statusContext);
+    }
+}
+
+// Deliver a method call or twin patch, returning false if the device cannot receive it yet.
+static bool DeliverToDevice(const ScriptEvent* event)
+{
+    if (!client.isInUse || !client.isConnected) {
+        return false;
+    }
+
+    if (event->type == ScriptEvent_Twin) {
+        if (client.twinCallback == NULL) {
+            return false;
+        }
+        HostSimulation_LogMessage("TWIN", "%s", event->argument);
+        client.twinCallback(DEVICE_TWIN_UPDATE_PARTIAL, (const unsigned char*)event->argument,
+            strlen(event->argument), client.twinContext);
+        return true;
+    }
+
+    if (client.methodCallback == NULL) {
+        return false;
+    }
+    unsigned char* response = NULL;
+    size_t responseSize = 0;
+    int status = client.methodCallback(event->name, (const unsigned char*)event->argument,
+        strlen(event->argument), &response, &responseSize, client.methodContext);
+    hostStats.methodCalls++;
+    if (status >= 400) {
+        hostStats.failedMethodCalls++;
+    }
+    HostSimulation_LogMessage("METHOD", "%s\t%s\t%d\t%.*s", event->name, event->argument, status,
+        (int)responseSize, response != NULL ? (const char*)response : "");
+    // The response was allocated by the application, for the SDK to free.
+    free(response);
+    return true;
+}
+
+bool HostNetwork_IsUp(void)
+{
+    return isNetworkUp;
+}
+
+void HostScript_RunDueEvents(void)
+{
+    if (!isScriptLoaded) {
+        LoadScript();
+    }
+    if (firstPendingEvent == scriptEventCount) {
+        return;
+    }
+
+    uint64_t elapsedNs = HostClock_Now() - HostClock_Boot();
+    if (scriptEvents[firstPendingEvent].timeNs > elapsedNs) {
+        return;
+    }
+
+    // Network events take effect when due; hub events wait until the device is connected.
+    bool isEarlierEventPending = false;
+    for (size_t i = firstPendingEvent; i < scriptEventCount; i++) {
+        ScriptEvent* event = &scriptEvents[i];
+        if (event->timeNs > elapsedNs) {
+            break;
+        }
+        if (event->isDone) {
+            continue;
+        }
+
+        switch (event->type) {
+        case ScriptEvent_NetworkDown:
+            HostSimulation_LogMessage("NETWORK", "down");
+            isNetworkUp = false;
+            event->isDone = true;
+            break;
+        case ScriptEvent_NetworkUp:
+            HostSimulation_LogMessage("NETWORK", "up");
+            isNetworkUp = true;
+            event->isDone = true;
+            break;
+        case ScriptEvent_Disconnect:
+            Disconnect(event->reason);
+            event->isDone = true;
+            break;
+        case ScriptEvent_Timeout:
+            messagesToTimeOut += event->count;
+            event->isDone = true;
+            break;
+        case ScriptEvent_Throttle:
+            reportsToThrottle += event->count;
+            event->isDone = true;
+            break;
+        default:
+            event->isDone = !isEarlierEventPending && DeliverToDevice(event);
+            break;
+        }
+
+        if (!event->isDone) {
+            isEarlierEventPending = true;
+        }
+        else if (i == firstPendingEvent) {
+            firstPendingEvent++;
+        }
+    }
+}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byteArray,
+    size_t size)
+{
+    IOTHUB_MESSAGE_HANDLE message = __real_malloc(sizeof(*message));
+    if (message == NULL) {
+        return NULL;
+    }
+    message->bytes = (unsigned char*)CopyText((const char*)byteArray, size);
+    message->size = size;
+    message->kind = "D2C";
+    message->contentType[0] = 0;
+    return message;
+}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
+{
+    return IoTHubMessage_CreateFromByteArray((const unsigned char*)source, strlen(source));
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentTypeSystemProperty(IOTHUB_MESSAGE_HANDLE handle,
+    const char* contentType)
+{
+    if (handle == NULL || strlen(contentType) >= sizeof(handle->contentType)) {
+        return IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    strcpy(handle->contentType, contentType);
+    return IOTHUB_MESSAGE_OK;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentEncodingSystemProperty(
+    IOTHUB_MESSAGE_HANDLE handle, const char* contentEncoding)
+{
+    return handle != NULL ? IOTHUB_MESSAGE_OK : IOTHUB_MESSAGE_INVALID_ARG;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetMessageId(IOTHUB_MESSAGE_HANDLE handle,
+    const char* messageId)
+{
+    return handle != NULL && messageId != NULL ? IOTHUB_MESSAGE_OK : IOTHUB_MESSAGE_INVALID_ARG;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(IOTHUB_MESSAGE_HANDLE handle, const char* key,
+    const char* value)
+{
+    if (handle == NULL) {
+        return IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    if (strcmp(key, "priority") == 0 && strcmp(value, "urgent") == 0) {
+        handle->kind = "D2C-URGENT";
+    }
+    else if (strcmp(key, "priority") == 0 && strcmp(value, "low") == 0) {
+        handle->kind = "D2C-LOW";
+    }
+    return IOTHUB_MESSAGE_OK;
+}
+
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE handle)
+{
+    if (handle != NULL) {
+        __real_free(handle->bytes);
+        __real_free(handle);
+    }
+}
+
+IOTHUB_DEVICE_CLIENT_LL_HANDLE IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(
+    const char* iothub_uri, IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol)
+{
+    if (client.isInUse) {
+        return NULL;
+    }
+    memset(&client, 0, sizeof(client));
+    client.isInUse = true;
+    client.isWebSockets = protocol == MQTT_WebSocket_Protocol;
+    client.keepAliveSeconds = DefaultKeepAliveSeconds;
+    return &client;
+}
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle)
+{
+    if (handle != &client || !client.isInUse) {
+        return;
+    }
+
+    for (size_t i = 0; i < client.confirmationCount; i++) {
+        PendingConfirmation* pending = &client.confirmations[i];
+        pending->callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, pending->context);
+        IoTHubMessage_Destroy(pending->message);
+    }
+    for (size_t i = 0; i < client.reportCount; i++) {
+        __real_free(client.reports[i].patch);
+    }
+    if (client.isConnected) {
+        hostStats.disconnections++;
+    }
+    client.isInUse = false;
+}
+
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle)
+{
+    if (handle != &client || !client.isInUse) {
+        return;
+    }
+
+    if (!isNetworkUp) {
+        Disconnect(IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
+        return;
+    }
+
+    if (!client.isConnected) {
+        client.isConnected = true;
+        client.lastSendNs = HostClock_Now();
+        hostStats.connections++;
+        HostSimulation_LogMessage("CONNECT", "%s%s", TestHubHostName,
+            client.isWebSockets ? ":443" : "");
+        if (client.statusCallback != NULL) {
+            client.statusCallback(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,
+                IOTHUB_CLIENT_CONNECTION_OK, client.statusContext);
+        }
+        if (client.twinCallback != NULL && client.isConnected) {
+            LoadTwin();
+            client.twinCallback(DEVICE_TWIN_UPDATE_COMPLETE, (const unsigned char*)twinDocument,
+                twinSize, client.twinContext);
+        }
+    }
+
+    uint64_t nowNs = HostClock_Now();
+    uint64_t keepAliveNs = (uint64_t)client.keepAliveSeconds * NANOSECONDS_PER_SECOND;
+    if (keepAliveNs != 0 && nowNs - client.lastSendNs >= keepAliveNs) {
+        uint64_t pings = (nowNs - client.lastSendNs) / keepAliveNs;
+        hostStats.keepAlivePings += pings;
+        client.lastSendNs += pings * keepAliveNs;
+    }
+    if (client.confirmationCount != 0 || client.reportCount != 0) {
+        client.lastSendNs = nowNs;
+    }
+
+    // Acknowledge what was queued before this DoWork. Callbacks may queue more, for next time.
+    size_t confirmationCount = client.confirmationCount;
+    for (size_t i = 0; i < confirmationCount && client.isConnected; i++) {
+        PendingConfirmation pending = client.confirmations[0];
+        memmove(&client.confirmations[0], &client.confirmations[1],
+            (client.confirmationCount - 1) * sizeof(client.confirmations[0]));
+        client.confirmationCount--;
+
+        if (messagesToTimeOut > 0) {
+            // Lost on the way: the SDK gives up on the message after its timeout.
+            messagesToTimeOut--;
+            hostStats.timedOutMessages++;
+            LogPayload("D2C-TIMEOUT", pending.message->contentType, pending.message->bytes,
+                pending.message->size);
+            IoTHubMessage_Destroy(pending.message);
+            pending.callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, pending.context);
+            continue;
+        }
+
+        hostStats.messages++;
+        hostStats.messageBytes += pending.message->size;
+        if (strcmp(pending.message->kind, "D2C-URGENT") == 0) {
+            hostStats.urgentMessages++;
+        }
+        LogPayload(pending.message->kind, pending.message->contentType, pending.message->bytes,
+            pending.message->size);
+        IoTHubMessage_Destroy(pending.message);
+        pending.callback(IOTHUB_CLIENT_CONFIRMATION_OK, pending.context);
+    }
+
+    size_t reportCount = client.reportCount;
+    for (size_t i = 0; i < reportCount && client.isConnected; i++) {
+        PendingReport pending = client.reports[0];
+        memmove(&client.reports[0], &client.reports[1],
+            (client.reportCount - 1) * sizeof(client.reports[0]));
+        client.reportCount--;
+
+        if (reportsToThrottle > 0) {
+            // Rejected by the hub, as it does when a device exceeds its twin update quota.
+            reportsToThrottle--;
+            hostStats.throttledReports++;
+            LogPayload("REPORTED-THROTTLED", "", pending.patch, pending.size);
+            __real_free(pending.patch);
+            pending.callback(429, pending.context);
+            continue;
+        }
+
+        hostStats.reportedStates++;
+        hostStats.reportedStateBytes += pending.size;
+        LogPayload("REPORTED", "", pending.patch, pending.size);
+        __real_free(pending.patch);
+        pending.callback(204, pending.context);
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+    IOTHUB_MESSAGE_HANDLE message, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback,
+    void* context)
+{
+    if (handle != &client || !client.isInUse || message == NULL || callback == NULL) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    if (client.confirmationCount == MAX_PENDING_CONFIRMATIONS) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    // Like the SDK, keep a copy, as the application destroys its message straight away.
+    IOTHUB_MESSAGE_HANDLE copy = IoTHubMessage_CreateFromByteArray(message->bytes, message->size);
+    if (copy == NULL) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+    copy->kind = message->kind;
+    strcpy(copy->contentType, message->contentType);
+
+    PendingConfirmation* pending = &client.confirmations[client.confirmationCount++];
+    pending->message = copy;
+    pending->callback = callback;
+    pending->context = context;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, const unsigned char* reportedState, size_t size,
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK callback, void* context)
+{
+    if (handle != &client || !client.isInUse || reportedState == NULL || callback == NULL) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    if (client.reportCount == MAX_PENDING_REPORTS) {
+        return IOTHUB_CLIENT_ERROR;
+    }
+
+    PendingReport* pending = &client.reports[client.reportCount++];
+    pending->patch = (unsigned char*)CopyText((const char*)reportedState, size);
+    pending->size = size;
+    pending->callback = callback;
+    pending->context = context;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK callback,
+    void* context)
+{
+    if (handle != &client || !client.isInUse) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    client.twinCallback = callback;
+    client.twinContext = context;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceMethodCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC callback,
+    void* context)
+{
+    if (handle != &client || !client.isInUse) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    client.methodCallback = callback;
+    client.methodContext = context;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK callback,
+    void* context)
+{
+    if (handle != &client || !client.isInUse) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    client.statusCallback = callback;
+    client.statusContext = context;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetOption(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+    const char* optionName, const void* value)
+{
+    if (handle != &client || !client.isInUse) {
+        return IOTHUB_CLIENT_INVALID_ARG;
+    }
+    if (strcmp(optionName, OPTION_KEEP_ALIVE) == 0) {
+        client.keepAliveSeconds = *(const int*)value;
+    }
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetRetryPolicy(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+    IOTHUB_CLIENT_RETRY_POLICY retryPolicy, size_t retryTimeoutLimitInSeconds)
+{
+    return handle == &client && client.isInUse ? IOTHUB_CLIENT_OK : IOTHUB_CLIENT_INVALID_ARG;
+}
+
+int IoTHub_Init(void)
+{
+    return 0;
+}
+
+void IoTHub_Deinit(void)
+{
+}
+
+int iothub_security_init(IOTHUB_SECURITY_TYPE sec_type)
+{
+    return 0;
+}
+
+void iothub_security_deinit(void)
+{
+}
+
+const void* MQTT_Protocol(void)
+{
+    return &transportMarker;
+}
+
+const void* MQTT_WebSocket_Protocol(void)
+{
+    return &webSocketTransportMarker;
+}
+
+PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char* uri, const char* scope_id,
+    PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol)
+{
+    if (provisioningClient.isInUse) {
+        return NULL;
+    }
+    memset(&provisioningClient, 0, sizeof(provisioningClient));
+    provisioningClient.isInUse = true;
+    return &provisioningClient;
+}
+
+void Prov_Device_LL_Destroy(PROV_DEVICE_LL_HANDLE handle)
+{
+    if (handle == &provisioningClient) {
+        provisioningClient.isInUse = false;
+    }
+}
+
+PROV_DEVICE_RESULT Prov_Device_LL_Register_Device(PROV_DEVICE_LL_HANDLE handle,
+    PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK register_callback, void* user_context,
+    PROV_DEVICE_CLIENT_REGISTER_STATUS_CALLBACK status_cb, void* status_ctx)
+{
+    if (handle != &provisioningClient || register_callback == NULL) {
+        return PROV_DEVICE_RESULT_INVALID_ARG;
+    }
+    provisioningClient.registerCallback = register_callback;
+    provisioningClient.registerContext = user_context;
+    return PROV_DEVICE_RESULT_OK;
+}
+
+// Every device is assigned to the test hub, on the first DoWork after registering.
+void Prov_Device_LL_DoWork(PROV_DEVICE_LL_HANDLE handle)
+{
+    if (handle != &provisioningClient || provisioningClient.registerCallback == NULL) {
+        return;
+    }
+
+    PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK callback = provisioningClient.registerCallback;
+    provisioningClient.registerCallback = NULL;
+    if (isNetworkUp) {
+        callback(PROV_DEVICE_RESULT_OK, TestHubHostName, hostConfig.deviceId,
+            provisioningClient.registerContext);
+    }
+    else {
+        callback(PROV_DEVICE_RESULT_TRANSPORT, NULL, NULL, provisioningClient.registerContext);
+    }
+}
+
+PROV_DEVICE_RESULT Prov_Device_LL_SetOption(PROV_DEVICE_LL_HANDLE handle, const char* optionName,
+    const void* value)
+{
+    return handle == &provisioningClient ? PROV_DEVICE_RESULT_OK : PROV_DEVICE_RESULT_INVALID_ARG;
+}
+
+int prov_dev_security_init(SECURE_DEVICE_TYPE hsm_type)
+{
+    return 0;
+}
+
+void prov_dev_security_deinit(void)
+{
+}
+
+const void* Prov_Device_MQTT_Protocol(void)
+{
+    return &transportMarker;
+}
+
+const void* Prov_Device_MQTT_WS_Protocol(void)
+{
+    return &webSocketTransportMarker;
+}
@@ -0,0 +1,188 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Run settings, allocation counting and the end-of-run report.
+
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_simulation.h"
+
+HostSimulationConfig hostConfig;
+HostSimulationStats hostStats;
+
+static FILE* messagesFile = NULL;
+static struct timespec wallStart;
+static bool isReportDiscarded = false;
+
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+static const char* GetSetting(const char* name, const char* defaultValue)
+{
+    const char* value = getenv(name);
+    return value != NULL && value[0] != '\0' ? value : defaultValue;
+}
+
+static void CountAllocation(void* pointer)
+{
+    if (pointer == NULL) {
+        return;
+    }
+    uint64_t heapBytes = __atomic_add_fetch(&hostStats.heapBytes,
+        (uint64_t)malloc_usable_size(pointer), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hostStats.allocations, 1, __ATOMIC_RELAXED);
+    if (heapBytes > hostStats.peakHeapBytes) {
+        hostStats.peakHeapBytes = heapBytes;
+    }
+}
+
+static void CountFree(void* pointer)
+{
+    if (pointer == NULL) {
+        return;
+    }
+    __atomic_sub_fetch(&hostStats.heapBytes, (uint64_t)malloc_usable_size(pointer),
+        __ATOMIC_RELAXED);
+    __atomic_add_fetch(&hostStats.frees, 1, __ATOMIC_RELAXED);
+}
+
+// The application is linked with --wrap for the allocator, so that these see each of its calls.
+void* __wrap_malloc(size_t size)
+{
+    void* pointer = __real_malloc(size);
+    CountAllocation(pointer);
+    return pointer;
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    void* pointer = __real_calloc(count, size);
+    CountAllocation(pointer);
+    return pointer;
+}
+
+void* __wrap_realloc(void* pointer, size_t size)
+{
+    CountFree(pointer);
+    void* newPointer = __real_realloc(pointer, size);
+    CountAllocation(newPointer != NULL ? newPointer : (size != 0 ? pointer : NULL));
+    return newPointer;
+}
+
+void __wrap_free(void* pointer)
+{
+    CountFree(pointer);
+    __real_free(pointer);
+}
+
+void HostSimulation_DiscardReport(void)
+{
+    isReportDiscarded = true;
+}
+
+void HostSimulation_LogMessage(const char* kind, const char* format, ...)
+{
+    if (messagesFile == NULL) {
+        return;
+    }
+
+    uint64_t now = HostClock_Now() - HostClock_Boot();
+    fprintf(messagesFile, "%llu.%03llu\t%s\t", (unsigned long long)(now / NANOSECONDS_PER_SECOND),
+        (unsigned long long)(now % NANOSECONDS_PER_SECOND / 1000000), kind);
+    va_list args;
+    va_start(args, format);
+    vfprintf(messagesFile, format, args);
+    va_end(args);
+    fputc('\n', messagesFile);
+}
+
+// Append one line of JSON, so that the reports of many devices can be collected in one file.
+static void WriteReport(void)
+{
+    if (isReportDiscarded) {
+        return;
+    }
+
+    struct timespec wallEnd;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &wallEnd);
+    double wallSeconds = (double)(wallEnd.tv_sec - wallStart.tv_sec) +
+                         (double)(wallEnd.tv_nsec - wallStart.tv_nsec) / 1e9;
+    double hours =
+        (double)(HostClock_Now() - HostClock_Boot()) / (double)NANOSECONDS_PER_SECOND / 3600.0;
+
+    FILE* reportFile = stderr;
+    if (hostConfig.reportPath != NULL) {
+        reportFile = fopen(hostConfig.reportPath, "a");
+        if (reportFile == NULL) {
+            perror(hostConfig.reportPath);
+            reportFile = stderr;
+        }
+    }
+
+    fprintf(reportFile,
+        "{\"Device\":\"%s\",\"SimulatedHours\":%.2f,\"WallSeconds\":%.2f,\"Speedup\":%.0f,"
+        "\"Messages\":%llu,\"MessageBytes\":%llu,\"MessagesPerHour\":%.1f,"
+        "\"UrgentMessages\":%llu,\"TimedOutMessages\":%llu,\"ReportedStates\":%llu,"
+        "\"ReportedStateBytes\":%llu,\"ThrottledReports\":%llu,"
+        "\"Connections\":%llu,\"Disconnections\":%llu,\"KeepAlivePings\":%llu,"
+        "\"MethodCalls\":%llu,"
+        "\"FailedMethodCalls\":%llu,\"EventsDispatched\":%llu,\"Allocations\":%llu,"
+        "\"AllocationsPerHour\":%.1f,\"Frees\":%llu,\"PeakHeapBytes\":%llu,"
+        "\"HeapBytesAtExit\":%llu}\n",
+        hostConfig.deviceId, hours, wallSeconds,
+        wallSeconds > 0.0 ? hours * 3600.0 / wallSeconds : 0.0,
+        (unsigned long long)hostStats.messages, (unsigned long long)hostStats.messageBytes,
+        hours > 0.0 ? (double)hostStats.messages / hours : 0.0,
+        (unsigned long long)hostStats.urgentMessages,
+        (unsigned long long)hostStats.timedOutMessages,
+        (unsigned long long)hostStats.reportedStates,
+        (unsigned long long)hostStats.reportedStateBytes,
+        (unsigned long long)hostStats.throttledReports,
+        (unsigned long long)hostStats.connections, (unsigned long long)hostStats.disconnections,
+        (unsigned long long)hostStats.keepAlivePings,
+        (unsigned long long)hostStats.methodCalls,
+        (unsigned long long)hostStats.failedMethodCalls,
+        (unsigned long long)hostStats.eventsDispatched,
+        (unsigned long long)hostStats.allocations,
+        hours > 0.0 ? (double)hostStats.allocations / hours : 0.0,
+        (unsigned long long)hostStats.frees, (unsigned long long)hostStats.peakHeapBytes,
+        (unsigned long long)hostStats.heapBytes);
+
+    if (reportFile != stderr) {
+        fclose(reportFile);
+    }
+    if (messagesFile != NULL) {
+        fclose(messagesFile);
+        messagesFile = NULL;
+    }
+}
+
+__attribute__((constructor)) static void ReadSettings(void)
+{
+    hostConfig.deviceId = GetSetting("GLUCK_SIM_DEVICE", "sim-device");
+    double hours = strtod(GetSetting("GLUCK_SIM_HOURS", "24"), NULL);
+    hostConfig.durationNs = hours > 0.0 ? (uint64_t)(hours * 3600.0 * 1e9) : 0;
+    hostConfig.seed = (uint32_t)strtoul(GetSetting("GLUCK_SIM_SEED", "0"), NULL, 10);
+    hostConfig.isLogEnabled = strcmp(GetSetting("GLUCK_SIM_LOG", "1"), "0") != 0;
+    hostConfig.storagePath = GetSetting("GLUCK_SIM_STORAGE", "mutable_storage.bin");
+    hostConfig.imageDir = GetSetting("GLUCK_SIM_IMAGE_DIR", ".");
+    hostConfig.twinPath = GetSetting("GLUCK_SIM_TWIN", NULL);
+    hostConfig.scriptPath = GetSetting("GLUCK_SIM_SCRIPT", NULL);
+    hostConfig.messagesPath = GetSetting("GLUCK_SIM_MESSAGES", NULL);
+    hostConfig.reportPath = GetSetting("GLUCK_SIM_REPORT", NULL);
+
+    if (hostConfig.messagesPath != NULL) {
+        messagesFile = fopen(hostConfig.messagesPath, "w");
+        if (messagesFile == NULL) {
+            perror(hostConfig.messagesPath);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &wallStart);
+    atexit(WriteReport);
+}
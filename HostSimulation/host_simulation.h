@@ -0,0 +1,110 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Shared state of the host shims. The shims stand in for one device, which is why, like the
+// application modules, they keep their state in statics.
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NANOSECONDS_PER_SECOND 1000000000ull
+
+/// <summary>
+/// Settings of a simulation run, read from the environment at startup. See README.md.
+/// </summary>
+typedef struct {
+    const char* deviceId;     // GLUCK_SIM_DEVICE: name of the device in the report
+    uint64_t durationNs;      // GLUCK_SIM_HOURS: virtual time after which SIGTERM is raised
+    uint32_t seed;            // GLUCK_SIM_SEED: offsets the boot time, as devices differ
+    bool isLogEnabled;        // GLUCK_SIM_LOG: 0 drops application log output
+    const char* storagePath;  // GLUCK_SIM_STORAGE: file backing mutable storage
+    const char* imageDir;     // GLUCK_SIM_IMAGE_DIR: directory standing in for the image package
+    const char* twinPath;     // GLUCK_SIM_TWIN: complete twin sent on each connection
+    const char* scriptPath;   // GLUCK_SIM_SCRIPT: timed hub and network events
+    const char* messagesPath; // GLUCK_SIM_MESSAGES: log of everything sent to the hub
+    const char* reportPath;   // GLUCK_SIM_REPORT: where the end-of-run report is appended
+} HostSimulationConfig;
+
+extern HostSimulationConfig hostConfig;
+
+/// <summary>
+/// Counters reported at the end of the run.
+/// </summary>
+typedef struct {
+    uint64_t allocations; // Calls to malloc, calloc and realloc made by the application
+    uint64_t frees;
+    uint64_t heapBytes; // Usable size of the application's live allocations
+    uint64_t peakHeapBytes;
+    uint64_t messages; // Device-to-cloud messages sent through SendEventAsync
+    uint64_t messageBytes;
+    uint64_t urgentMessages;
+    uint64_t timedOutMessages; // Messages which the test hub did not confirm
+    uint64_t throttledReports; // Reported states which the test hub rejected with 429
+    uint64_t reportedStates; // Reported property patches
+    uint64_t reportedStateBytes;
+    uint64_t connections; // Successful connections to the test hub
+    uint64_t disconnections;
+    uint64_t keepAlivePings; // Counted once per keep-alive period in which nothing was sent
+    uint64_t methodCalls;
+    uint64_t failedMethodCalls; // Methods which returned a status of 400 or above
+    uint64_t eventsDispatched; // Event loop callbacks
+} HostSimulationStats;
+
+extern HostSimulationStats hostStats;
+
+/// <summary>
+/// Skip the end-of-run report, for programs other than the simulation which use the shims.
+/// </summary>
+void HostSimulation_DiscardReport(void);
+
+/// <summary>
+/// Virtual monotonic time, in nanoseconds. CLOCK_REALTIME, time() and timerfds all follow it.
+/// </summary>
+uint64_t HostClock_Now(void);
+
+/// <summary>
+/// Virtual monotonic time at which the run started.
+/// </summary>
+uint64_t HostClock_Boot(void);
+
+/// <summary>
+/// Whether any thread started by the application is still running, in which case virtual time
+/// must not move.
+/// </summary>
+bool HostClock_AreThreadsRunning(void);
+
+/// <summary>
+/// Earliest deadline of any armed timerfd, or of any thread sleeping in clock_nanosleep.
+/// </summary>
+/// <returns>True, with the deadline in outDeadlineNs, if any timer is armed.</returns>
+bool HostClock_NextDeadline(uint64_t* outDeadlineNs);
+
+/// <summary>
+/// Move virtual time forward, making every timerfd which expires by then readable. Threads whose
+/// clock_nanosleep ends by then are woken first, and have slept again by the time it returns.
+/// </summary>
+void HostClock_AdvanceTo(uint64_t timeNs);
+
+/// <summary>
+/// Whether the network is up, as set by the simulation script.
+/// </summary>
+bool HostNetwork_IsUp(void);
+
+/// <summary>
+/// Apply the simulation script's events which are due, and deliver any hub events which were
+/// held back while the device was not connected. Called by the event loop before it waits.
+/// </summary>
+void HostScript_RunDueEvents(void);
+
+/// <summary>
+/// Append a line, prefixed with the virtual time, to the messages log if there is one.
+/// </summary>
+void HostSimulation_LogMessage(const char* kind, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// The allocator itself, for the shims' own allocations, which are not the application's and are
+// not counted.
+void* __real_malloc(size_t size);
+void __real_free(void* pointer);
@@ -0,0 +1,16 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the ADC API. The host simulation uses the simulated hardware, which has no ADC,
+// so these always fail with ENOSYS.
+
+#pragma once
+#include <stdint.h>
+
+typedef int ADC_ControllerId;
+typedef int ADC_ChannelId;
+
+int ADC_Open(ADC_ControllerId id);
+int ADC_GetSampleBitCount(int fd, ADC_ChannelId channel);
+int ADC_SetReferenceVoltage(int fd, ADC_ChannelId channel, float referenceVoltage);
+int ADC_Poll(int fd, ADC_ChannelId channel, uint32_t* outSampleValue);
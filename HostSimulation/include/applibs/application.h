@@ -0,0 +1,11 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the application API. There is no real-time core on the host, and device
+// authentication is always ready.
+
+#pragma once
+#include <stdbool.h>
+
+int Application_Connect(const char* componentId);
+int Application_IsDeviceAuthReady(bool* outIsReady);
@@ -0,0 +1,12 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the memory usage API. Usage is the heap allocated by the application, as
+// counted by the allocator wrappers.
+
+#pragma once
+#include <stddef.h>
+
+size_t Applications_GetTotalMemoryUsageInKB(void);
+size_t Applications_GetUserModeMemoryUsageInKB(void);
+size_t Applications_GetPeakUserModeMemoryUsageInKB(void);
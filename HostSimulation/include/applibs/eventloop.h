@@ -0,0 +1,37 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure Sphere event loop, run on the virtual clock. See ../../README.md.
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct EventLoop EventLoop;
+typedef struct EventRegistration EventRegistration;
+
+typedef uint32_t EventLoop_IoEvents;
+#define EventLoop_None ((EventLoop_IoEvents)0x0)
+#define EventLoop_Input ((EventLoop_IoEvents)0x1)
+#define EventLoop_Output ((EventLoop_IoEvents)0x4)
+#define EventLoop_Error ((EventLoop_IoEvents)0x8)
+
+typedef enum {
+    EventLoop_Run_Failed = -1,
+    EventLoop_Run_FinishedEmpty = 0,
+    EventLoop_Run_Finished = 1
+} EventLoop_Run_Result;
+
+typedef void EventLoopIoCallback(EventLoop* el, int fd, EventLoop_IoEvents events, void* context);
+
+EventLoop* EventLoop_Create(void);
+void EventLoop_Close(EventLoop* el);
+EventLoop_Run_Result EventLoop_Run(EventLoop* el, int duration_in_milliseconds,
+    bool process_one_event);
+int EventLoop_Stop(EventLoop* el);
+int EventLoop_GetWaitDescriptor(EventLoop* el);
+EventRegistration* EventLoop_RegisterIo(EventLoop* el, int fd, EventLoop_IoEvents eventBitmask,
+    EventLoopIoCallback* callback, void* context);
+int EventLoop_ModifyIoEvents(EventLoop* el, EventRegistration* reg,
+    EventLoop_IoEvents eventBitmask);
+int EventLoop_UnregisterIo(EventLoop* el, EventRegistration* reg);
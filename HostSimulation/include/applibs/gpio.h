@@ -0,0 +1,28 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the GPIO API. Outputs remember their value, and inputs read high (buttons
+// released).
+
+#pragma once
+
+typedef int GPIO_Id;
+
+typedef unsigned char GPIO_Value_Type;
+enum {
+    GPIO_Value_Low = 0,
+    GPIO_Value_High = 1
+};
+
+typedef unsigned char GPIO_OutputMode_Type;
+enum {
+    GPIO_OutputMode_PushPull = 0,
+    GPIO_OutputMode_OpenDrain = 1,
+    GPIO_OutputMode_OpenSource = 2
+};
+
+int GPIO_OpenAsInput(GPIO_Id gpioId);
+int GPIO_OpenAsOutput(GPIO_Id gpioId, GPIO_OutputMode_Type outputMode,
+    GPIO_Value_Type initialValue);
+int GPIO_GetValue(int gpioFd, GPIO_Value_Type* outValue);
+int GPIO_SetValue(int gpioFd, GPIO_Value_Type value);
@@ -0,0 +1,11 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the log API. Messages go to stderr, prefixed with the virtual time, unless
+// GLUCK_SIM_LOG is 0.
+
+#pragma once
+#include <stdarg.h>
+
+int Log_Debug(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+int Log_DebugVarArgs(const char* fmt, va_list args);
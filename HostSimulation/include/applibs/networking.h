@@ -0,0 +1,21 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the networking API. wlan0 is connected to the internet unless the simulation
+// script takes the network down; no other interface exists.
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint32_t Networking_InterfaceConnectionStatus;
+enum {
+    Networking_InterfaceConnectionStatus_InterfaceUp = 1 << 0,
+    Networking_InterfaceConnectionStatus_ConnectedToNetwork = 1 << 1,
+    Networking_InterfaceConnectionStatus_IpAvailable = 1 << 2,
+    Networking_InterfaceConnectionStatus_ConnectedToInternet = 1 << 3
+};
+
+int Networking_IsNetworkingReady(bool* outIsNetworkingReady);
+int Networking_GetInterfaceConnectionStatus(const char* networkInterfaceName,
+    Networking_InterfaceConnectionStatus* outStatus);
@@ -0,0 +1,11 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the storage API. Mutable storage is the file named by GLUCK_SIM_STORAGE, and the
+// image package is the directory named by GLUCK_SIM_IMAGE_DIR.
+
+#pragma once
+
+int Storage_OpenFileInImagePackage(const char* relativePath);
+int Storage_OpenMutableFile(void);
+int Storage_DeleteMutableFile(void);
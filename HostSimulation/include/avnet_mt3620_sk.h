@@ -0,0 +1,32 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Avnet MT3620 Starter Kit hardware definition, giving the peripherals used by
+// hw/sample_appliance.h distinct IDs.
+
+#pragma once
+
+#define AVNET_MT3620_SK_GPIO0 0
+#define AVNET_MT3620_SK_GPIO2 2
+#define AVNET_MT3620_SK_USER_LED_RED 8
+#define AVNET_MT3620_SK_USER_LED_GREEN 9
+#define AVNET_MT3620_SK_USER_LED_BLUE 10
+#define AVNET_MT3620_SK_USER_BUTTON_A 12
+#define AVNET_MT3620_SK_USER_BUTTON_B 13
+#define AVNET_MT3620_SK_GPIO17 17
+#define AVNET_MT3620_SK_APP_STATUS_LED_YELLOW 21
+
+#define AVNET_MT3620_SK_ISU0_UART 4
+#define AVNET_MT3620_SK_ISU1_I2C 5
+#define AVNET_MT3620_SK_ISU1_SPI 5
+#define AVNET_MT3620_SK_ISU2_I2C 6
+#define MT3620_SPI_CS_B 1
+
+#define AVNET_MT3620_SK_PWM_CONTROLLER2 2
+#define MT3620_PWM_CHANNEL1 1
+
+#define AVNET_MT3620_SK_ADC_CONTROLLER0 0
+#define MT3620_ADC_CHANNEL0 0
+#define MT3620_ADC_CHANNEL1 1
+#define MT3620_ADC_CHANNEL2 2
+#define MT3620_ADC_CHANNEL3 3
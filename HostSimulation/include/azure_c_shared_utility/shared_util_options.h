@@ -0,0 +1,8 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure C shared utility option names.
+
+#pragma once
+
+#define OPTION_TRUSTED_CERT "TrustedCerts"
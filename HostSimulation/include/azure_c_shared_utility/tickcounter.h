@@ -0,0 +1,9 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure C shared utility tick counter type.
+
+#pragma once
+#include <stdint.h>
+
+typedef uint_fast64_t tickcounter_ms_t;
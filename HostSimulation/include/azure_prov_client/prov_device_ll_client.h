@@ -0,0 +1,41 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure IoT DPS client, which assigns every device to the test hub.
+
+#pragma once
+#include <stddef.h>
+
+typedef struct PROV_INSTANCE_INFO_TAG* PROV_DEVICE_LL_HANDLE;
+
+typedef enum {
+    PROV_DEVICE_RESULT_OK,
+    PROV_DEVICE_RESULT_INVALID_ARG,
+    PROV_DEVICE_RESULT_SUCCESS,
+    PROV_DEVICE_RESULT_MEMORY,
+    PROV_DEVICE_RESULT_PARSING,
+    PROV_DEVICE_RESULT_TRANSPORT,
+    PROV_DEVICE_RESULT_INVALID_STATE,
+    PROV_DEVICE_RESULT_DEV_AUTH_ERROR,
+    PROV_DEVICE_RESULT_TIMEOUT,
+    PROV_DEVICE_RESULT_KEY_ERROR,
+    PROV_DEVICE_RESULT_ERROR,
+    PROV_DEVICE_RESULT_HUB_NOT_SPECIFIED,
+    PROV_DEVICE_RESULT_UNAUTHORIZED,
+    PROV_DEVICE_RESULT_DISABLED
+} PROV_DEVICE_RESULT;
+
+typedef const void* (*PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION)(void);
+typedef void (*PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK)(PROV_DEVICE_RESULT register_result,
+    const char* iothub_uri, const char* device_id, void* user_context);
+typedef void (*PROV_DEVICE_CLIENT_REGISTER_STATUS_CALLBACK)(int reg_status, void* user_context);
+
+PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char* uri, const char* scope_id,
+    PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol);
+void Prov_Device_LL_Destroy(PROV_DEVICE_LL_HANDLE handle);
+PROV_DEVICE_RESULT Prov_Device_LL_Register_Device(PROV_DEVICE_LL_HANDLE handle,
+    PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK register_callback, void* user_context,
+    PROV_DEVICE_CLIENT_REGISTER_STATUS_CALLBACK status_cb, void* status_ctx);
+void Prov_Device_LL_DoWork(PROV_DEVICE_LL_HANDLE handle);
+PROV_DEVICE_RESULT Prov_Device_LL_SetOption(PROV_DEVICE_LL_HANDLE handle, const char* optionName,
+    const void* value);
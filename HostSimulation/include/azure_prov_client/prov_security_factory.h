@@ -0,0 +1,15 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure IoT DPS security factory. Initialisation always succeeds.
+
+#pragma once
+
+typedef enum {
+    SECURE_DEVICE_TYPE_UNKNOWN,
+    SECURE_DEVICE_TYPE_TPM,
+    SECURE_DEVICE_TYPE_X509
+} SECURE_DEVICE_TYPE;
+
+int prov_dev_security_init(SECURE_DEVICE_TYPE hsm_type);
+void prov_dev_security_deinit(void);
@@ -0,0 +1,8 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure IoT DPS MQTT over WebSockets transport.
+
+#pragma once
+
+const void* Prov_Device_MQTT_WS_Protocol(void);
@@ -0,0 +1,20 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure Sphere provisioning result types.
+
+#pragma once
+
+typedef enum {
+    AZURE_SPHERE_PROV_RESULT_OK,
+    AZURE_SPHERE_PROV_RESULT_INVALID_PARAM,
+    AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY,
+    AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY,
+    AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR,
+    AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR
+} AZURE_SPHERE_PROV_RESULT;
+
+typedef struct {
+    AZURE_SPHERE_PROV_RESULT result;
+    int prov_device_error;
+} AZURE_SPHERE_PROV_RETURN_VALUE;
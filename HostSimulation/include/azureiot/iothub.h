@@ -0,0 +1,9 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure IoT C SDK platform initialisation.
+
+#pragma once
+
+int IoTHub_Init(void);
+void IoTHub_Deinit(void);
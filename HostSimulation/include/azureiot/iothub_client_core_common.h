@@ -0,0 +1,91 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure IoT C SDK types used by the application. Values are the SDK's own, so
+// that logs and reason strings match a device's.
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG* IOTHUB_DEVICE_CLIENT_LL_HANDLE;
+typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG* IOTHUB_MESSAGE_HANDLE;
+
+typedef enum {
+    IOTHUB_CLIENT_OK,
+    IOTHUB_CLIENT_INVALID_ARG,
+    IOTHUB_CLIENT_ERROR,
+    IOTHUB_CLIENT_INVALID_SIZE,
+    IOTHUB_CLIENT_INDEFINITE_TIME
+} IOTHUB_CLIENT_RESULT;
+
+typedef enum {
+    IOTHUB_MESSAGE_OK,
+    IOTHUB_MESSAGE_INVALID_ARG,
+    IOTHUB_MESSAGE_INVALID_TYPE,
+    IOTHUB_MESSAGE_ERROR
+} IOTHUB_MESSAGE_RESULT;
+
+typedef enum {
+    IOTHUB_CLIENT_CONFIRMATION_OK,
+    IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,
+    IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT,
+    IOTHUB_CLIENT_CONFIRMATION_ERROR
+} IOTHUB_CLIENT_CONFIRMATION_RESULT;
+
+typedef enum {
+    IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,
+    IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED
+} IOTHUB_CLIENT_CONNECTION_STATUS;
+
+typedef enum {
+    IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN,
+    IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED,
+    IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL,
+    IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED,
+    IOTHUB_CLIENT_CONNECTION_NO_NETWORK,
+    IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR,
+    IOTHUB_CLIENT_CONNECTION_OK,
+    IOTHUB_CLIENT_CONNECTION_NO_PING_RESPONSE
+} IOTHUB_CLIENT_CONNECTION_STATUS_REASON;
+
+typedef enum {
+    DEVICE_TWIN_UPDATE_COMPLETE,
+    DEVICE_TWIN_UPDATE_PARTIAL
+} DEVICE_TWIN_UPDATE_STATE;
+
+typedef enum {
+    IOTHUB_CLIENT_RETRY_NONE,
+    IOTHUB_CLIENT_RETRY_IMMEDIATE,
+    IOTHUB_CLIENT_RETRY_INTERVAL,
+    IOTHUB_CLIENT_RETRY_LINEAR_BACKOFF,
+    IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF,
+    IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER,
+    IOTHUB_CLIENT_RETRY_RANDOM
+} IOTHUB_CLIENT_RETRY_POLICY;
+
+typedef const void* (*IOTHUB_CLIENT_TRANSPORT_PROVIDER)(void);
+
+typedef void (*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)(
+    IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback);
+typedef void (*IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)(IOTHUB_CLIENT_CONNECTION_STATUS result,
+    IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* userContextCallback);
+typedef void (*IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK)(DEVICE_TWIN_UPDATE_STATE update_state,
+    const unsigned char* payLoad, size_t size, void* userContextCallback);
+typedef void (*IOTHUB_CLIENT_REPORTED_STATE_CALLBACK)(int status_code, void* userContextCallback);
+typedef int (*IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC)(const char* method_name,
+    const unsigned char* payload, size_t size, unsigned char** response, size_t* response_size,
+    void* userContextCallback);
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source);
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byteArray,
+    size_t size);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentTypeSystemProperty(IOTHUB_MESSAGE_HANDLE handle,
+    const char* contentType);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentEncodingSystemProperty(
+    IOTHUB_MESSAGE_HANDLE handle, const char* contentEncoding);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetMessageId(IOTHUB_MESSAGE_HANDLE handle,
+    const char* messageId);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(IOTHUB_MESSAGE_HANDLE handle, const char* key,
+    const char* value);
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE handle);
@@ -0,0 +1,13 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure IoT C SDK client option names. The test hub accepts every option.
+
+#pragma once
+
+#define OPTION_KEEP_ALIVE "keepalive"
+#define OPTION_MESSAGE_TIMEOUT "messageTimeout"
+#define OPTION_DO_WORK_FREQUENCY_IN_MS "do_work_freq_ms"
+#define OPTION_CONNECTION_TIMEOUT "connect_timeout"
+#define OPTION_LOG_TRACE "logtrace"
+#define OPTION_AUTO_URL_ENCODE_DECODE "auto_url_encode_decode"
@@ -0,0 +1,15 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure IoT C SDK security factory. Initialisation always succeeds.
+
+#pragma once
+
+typedef enum {
+    IOTHUB_SECURITY_TYPE_UNKNOWN,
+    IOTHUB_SECURITY_TYPE_SAS,
+    IOTHUB_SECURITY_TYPE_X509
+} IOTHUB_SECURITY_TYPE;
+
+int iothub_security_init(IOTHUB_SECURITY_TYPE sec_type);
+void iothub_security_deinit(void);
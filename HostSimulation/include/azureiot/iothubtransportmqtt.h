@@ -0,0 +1,8 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Host shim of the Azure IoT C SDK MQTT transport.
+
+#pragma once
+
+const void* MQTT_Protocol(void);
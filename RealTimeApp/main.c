@@ -0,0 +1,310 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Real-time companion of the Gluck high-level app. It owns the glucose sensor ADC and the
+// insulin pump, so that neither sampling nor dose timing depends on Linux scheduling:
+// - Samples are taken at the configured rate, from a fixed schedule rather than from when the
+//   previous sample finished, and are sent to the high-level app in batches.
+// - Doses are queued and run back to back, each timed from the previous dose's deadline, with the
+//   pump left on in between, as the high-level app's pump controller does.
+// Messages are defined in ../intercore_protocol.h. There is no OS: the main loop polls the
+// mailbox and the clock, and nothing else runs on this core.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mt3620-intercore.h"
+#include "nvic.h"
+
+#include "intercore_protocol.h"
+#include "rt_board.h"
+
+#define MICROSECONDS_PER_SECOND 1000000ull
+#define MICROUNITS_PER_HUNDREDTH 10000ull
+
+// Each mailbox message starts with the sender's (inbound) or receiver's (outbound) component ID,
+// followed by reserved bytes.
+#define COMPONENT_ID_SIZE 16
+#define MAILBOX_HEADER_SIZE 20
+
+// Samples are batched so that about this many messages are sent per second.
+#define BATCHES_PER_SECOND 10
+
+#define MAX_DOSES 8 // As PUMP_CONTROLLER_MAX_DOSES in the high-level app
+#define MAX_SAMPLE_RATE_HZ 1000
+
+typedef struct {
+    uint32_t id;
+    int32_t doseHundredths;
+    uint64_t durationUs;
+} Dose;
+
+// A DoseCompleted or DoseRejected message waiting for room in the mailbox.
+typedef struct {
+    IntercoreMessageType type;
+    size_t size;
+    union {
+        IntercoreDoseCompletedMessage completed;
+        IntercoreDoseRejectedMessage rejected;
+    } message;
+} DoseResult;
+
+static BufferHeader* outbound = NULL;
+static BufferHeader* inbound = NULL;
+static uint32_t sharedBufferSize = 0;
+static uint8_t highLevelComponentId[COMPONENT_ID_SIZE];
+static bool isConfigured = false;
+
+// Sampling.
+static uint32_t samplePeriodUs = 0;
+static uint64_t nextSampleUs = 0;
+static uint32_t sampleIndex = 0;
+static uint16_t samplesPerBatch = 1;
+static IntercoreSampleBatchMessage batch;
+
+// Dosing.
+static uint32_t microunitsPerMs = 0;
+static Dose doses[MAX_DOSES];
+static unsigned int firstDose = 0;
+static unsigned int doseCount = 0;
+static uint64_t doseDeadlineUs = 0;
+
+// Dose results not yet accepted by the mailbox, oldest first. The high-level app has at most
+// MAX_DOSES doses in flight, and each gets exactly one result, so this cannot overflow.
+static DoseResult pendingResults[MAX_DOSES];
+static unsigned int firstPendingResult = 0;
+static unsigned int pendingResultCount = 0;
+
+// Send one message to the high-level app. Returns -1 if the mailbox is full and the message
+// was not sent.
+static int SendMessage(void* message, IntercoreMessageType type, size_t size)
+{
+    static uint8_t buffer[MAILBOX_HEADER_SIZE + sizeof(IntercoreSampleBatchMessage)];
+
+    IntercoreHeader* header = message;
+    header->type = (uint8_t)type;
+    header->version = INTERCORE_PROTOCOL_VERSION;
+    header->reserved = 0;
+
+    memcpy(buffer, highLevelComponentId, COMPONENT_ID_SIZE);
+    memset(buffer + COMPONENT_ID_SIZE, 0, MAILBOX_HEADER_SIZE - COMPONENT_ID_SIZE);
+    memcpy(buffer + MAILBOX_HEADER_SIZE, message, size);
+    return EnqueueData(inbound, outbound, sharedBufferSize, buffer,
+        (uint32_t)(MAILBOX_HEADER_SIZE + size));
+}
+
+// Send as many pending dose results as the mailbox takes, in order.
+static void SendPendingResults(void)
+{
+    while (pendingResultCount > 0) {
+        DoseResult* result = &pendingResults[firstPendingResult];
+        if (SendMessage(&result->message, result->type, result->size) == -1) {
+            return;
+        }
+        firstPendingResult = (firstPendingResult + 1) % MAX_DOSES;
+        pendingResultCount--;
+    }
+}
+
+// Send a dose result. The high-level app counts doses in flight until it sees their result, so
+// unlike samples, a result must not be lost when the mailbox is full: it is kept and resent on
+// every loop pass until the mailbox accepts it.
+static void SendDoseResult(const void* message, IntercoreMessageType type, size_t size)
+{
+    if (pendingResultCount < MAX_DOSES) {
+        DoseResult* result =
+            &pendingResults[(firstPendingResult + pendingResultCount) % MAX_DOSES];
+        result->type = type;
+        result->size = size;
+        memcpy(&result->message, message, size);
+        pendingResultCount++;
+    }
+    SendPendingResults();
+}
+
+// Samples are dropped if the mailbox is full; the high-level app sees the gap in sample indices.
+static void SendSampleBatch(void)
+{
+    (void)SendMessage(&batch, IntercoreMessage_SampleBatch,
+        offsetof(IntercoreSampleBatchMessage, samples) + batch.count * sizeof(uint16_t));
+    batch.firstSampleIndex += batch.count;
+    batch.count = 0;
+}
+
+static void Configure(const IntercoreConfigureMessage* message)
+{
+    uint32_t rateHz = message->sampleRateHz;
+    if (rateHz == 0 || rateHz > MAX_SAMPLE_RATE_HZ || message->pumpMicrounitsPerMs == 0) {
+        return;
+    }
+
+    uint32_t perBatch = rateHz / BATCHES_PER_SECOND;
+    samplesPerBatch = (uint16_t)(perBatch == 0 ? 1
+                                 : perBatch > INTERCORE_MAX_SAMPLES_PER_BATCH
+                                     ? INTERCORE_MAX_SAMPLES_PER_BATCH
+                                     : perBatch);
+    samplePeriodUs = (uint32_t)(MICROSECONDS_PER_SECOND / rateHz);
+    microunitsPerMs = message->pumpMicrounitsPerMs;
+
+    // Restart the sample schedule, but keep counting sample indices across reconfigurations.
+    if (batch.count > 0) {
+        SendSampleBatch();
+    }
+    nextSampleUs = Board_NowUs();
+    isConfigured = true;
+}
+
+// Start the first queued dose, from 'startUs'.
+static void StartDose(uint64_t startUs)
+{
+    Dose* dose = &doses[firstDose];
+    uint64_t microunits = (uint64_t)dose->doseHundredths * MICROUNITS_PER_HUNDREDTH;
+    dose->durationUs = microunits * 1000u / microunitsPerMs;
+    doseDeadlineUs = startUs + dose->durationUs;
+    Board_SetPump(true);
+}
+
+static void QueueDose(const IntercoreQueueDoseMessage* message)
+{
+    if (!isConfigured || message->doseHundredths <= 0 || doseCount >= MAX_DOSES) {
+        IntercoreDoseRejectedMessage rejected = { .doseId = message->doseId };
+        SendDoseResult(&rejected, IntercoreMessage_DoseRejected, sizeof(rejected));
+        return;
+    }
+
+    Dose* dose = &doses[(firstDose + doseCount) % MAX_DOSES];
+    dose->id = message->doseId;
+    dose->doseHundredths = message->doseHundredths;
+    doseCount++;
+    if (doseCount == 1) {
+        StartDose(Board_NowUs());
+    }
+}
+
+static void HandleInboundMessages(void)
+{
+    static union {
+        uint8_t bytes[MAILBOX_HEADER_SIZE + sizeof(IntercoreConfigureMessage) +
+                      sizeof(IntercoreQueueDoseMessage)];
+        uint32_t alignment;
+    } buffer;
+
+    for (;;) {
+        uint32_t size = sizeof(buffer.bytes);
+        if (DequeueData(outbound, inbound, sharedBufferSize, buffer.bytes, &size) == -1) {
+            return;
+        }
+        if (size < MAILBOX_HEADER_SIZE + sizeof(IntercoreHeader)) {
+            continue;
+        }
+
+        // Replies go back to whichever high-level app last sent a message.
+        memcpy(highLevelComponentId, buffer.bytes, COMPONENT_ID_SIZE);
+
+        const uint8_t* payload = buffer.bytes + MAILBOX_HEADER_SIZE;
+        size -= MAILBOX_HEADER_SIZE;
+        const IntercoreHeader* header = (const IntercoreHeader*)payload;
+        if (header->version != INTERCORE_PROTOCOL_VERSION) {
+            continue;
+        }
+
+        if (header->type == IntercoreMessage_Configure &&
+            size >= sizeof(IntercoreConfigureMessage)) {
+            IntercoreConfigureMessage message;
+            memcpy(&message, payload, sizeof(message));
+            Configure(&message);
+        }
+        else if (header->type == IntercoreMessage_QueueDose &&
+                 size >= sizeof(IntercoreQueueDoseMessage)) {
+            IntercoreQueueDoseMessage message;
+            memcpy(&message, payload, sizeof(message));
+            QueueDose(&message);
+        }
+    }
+}
+
+// Take every sample which is due. Samples are scheduled from the previous deadline, so the rate
+// does not drift with loop latency; if the loop has fallen more than a batch behind, the
+// schedule is reset rather than taking a burst of samples at the wrong times.
+static void TakeDueSamples(uint64_t now)
+{
+    if (!isConfigured || now < nextSampleUs) {
+        return;
+    }
+    if (now - nextSampleUs > (uint64_t)samplePeriodUs * samplesPerBatch) {
+        sampleIndex += (uint32_t)((now - nextSampleUs) / samplePeriodUs);
+        nextSampleUs = now;
+        if (batch.count > 0) {
+            SendSampleBatch();
+        }
+    }
+
+    while (now >= nextSampleUs) {
+        uint16_t value;
+        if (Board_ReadAdc(&value) == 0) {
+            if (batch.count == 0) {
+                batch.firstSampleIndex = sampleIndex;
+            }
+            batch.samples[batch.count++] = value;
+        }
+        else if (batch.count > 0) {
+            // Samples in a batch must be consecutive, so a failed read ends the batch.
+            SendSampleBatch();
+        }
+        sampleIndex++;
+        nextSampleUs += samplePeriodUs;
+
+        if (batch.count >= samplesPerBatch) {
+            SendSampleBatch();
+        }
+    }
+}
+
+// Finish the current dose at its deadline, and run the next one on from it.
+static void CompleteDueDoses(uint64_t now)
+{
+    while (doseCount > 0 && now >= doseDeadlineUs) {
+        Dose completed = doses[firstDose];
+        firstDose = (firstDose + 1) % MAX_DOSES;
+        doseCount--;
+
+        if (doseCount > 0) {
+            StartDose(doseDeadlineUs);
+        }
+        else {
+            Board_SetPump(false);
+        }
+
+        IntercoreDoseCompletedMessage message = { .doseId = completed.id,
+                                                  .doseHundredths = completed.doseHundredths,
+                                                  .durationMs = (uint32_t)(completed.durationUs / 1000u) };
+        SendDoseResult(&message, IntercoreMessage_DoseCompleted, sizeof(message));
+    }
+}
+
+_Noreturn void RTCoreMain(void)
+{
+    NVIC_SetupVectorTable();
+
+    if (Board_Init() != 0 ||
+        GetIntercoreBuffers(&outbound, &inbound, &sharedBufferSize) == -1) {
+        Board_SetPump(false);
+        for (;;) {
+            // Nothing can be done without the mailbox or the peripherals; the high-level app
+            // sees that no samples arrive.
+        }
+    }
+    batch.bitCount = (uint8_t)Board_AdcBitCount();
+
+    for (;;) {
+        HandleInboundMessages();
+
+        SendPendingResults();
+
+        uint64_t now = Board_NowUs();
+        CompleteDueDoses(now);
+        TakeDueSamples(now);
+    }
+}
@@ -0,0 +1,38 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Peripherals used by the real-time app. main.c only uses these functions, so that the
+// sampling and dose timing can be ported to another board by replacing rt_board_mt3620.c.
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/// <summary>
+/// Set up the glucose sensor ADC channel, the pump output (left off) and the microsecond clock.
+/// </summary>
+/// <returns>0 on success, -1 on failure.</returns>
+int Board_Init(void);
+
+/// <summary>
+/// Returns the resolution of <see cref="Board_ReadAdc" />, in bits.
+/// </summary>
+unsigned int Board_AdcBitCount(void);
+
+/// <summary>
+/// Take one sample of the glucose sensor.
+/// </summary>
+/// <param name="outValue">Receives the raw ADC count.</param>
+/// <returns>0 on success, -1 on failure.</returns>
+int Board_ReadAdc(uint16_t* outValue);
+
+/// <summary>
+/// Drive the pump output: the pump runs while it is on.
+/// </summary>
+void Board_SetPump(bool on);
+
+/// <summary>
+/// Returns a monotonic clock, in microseconds. It must be called at least once per wrap of the
+/// underlying hardware counter, which the main loop's polling guarantees.
+/// </summary>
+uint64_t Board_NowUs(void);
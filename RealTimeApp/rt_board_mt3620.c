@@ -0,0 +1,82 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// MT3620 M4 port of rt_board.h, using the MediaTek OS-HAL from the MT3620 M4 driver package.
+// The pins match SAMPLE_POTENTIOMETER_ADC_CHANNEL and SAMPLE_INSULIN_PUMP in the high-level
+// app's hardware definition, and must be listed in this app's manifest instead of that one.
+
+#include "os_hal_adc.h"
+#include "os_hal_gpio.h"
+
+#include "rt_board.h"
+
+#ifndef BOARD_CPU_HZ
+#define BOARD_CPU_HZ 197600000u // M4 core clock once switched to the PLL
+#endif
+
+#define GLUCOSE_ADC_CHANNEL ADC_CHANNEL_1
+#define PUMP_GPIO OS_HAL_GPIO_17
+#define ADC_BIT_COUNT 12
+
+// Cortex-M4 data watchpoint and trace unit, whose cycle counter is the clock source.
+#define DEMCR (*(volatile uint32_t*)0xE000EDFCu)
+#define DEMCR_TRCENA (1u << 24)
+#define DWT_CTRL (*(volatile uint32_t*)0xE0001000u)
+#define DWT_CTRL_CYCCNTENA (1u << 0)
+#define DWT_CYCCNT (*(volatile uint32_t*)0xE0001004u)
+
+static uint32_t lastCycles = 0;
+static uint64_t elapsedCycles = 0;
+
+int Board_Init(void)
+{
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+    if (mtk_os_hal_gpio_request(PUMP_GPIO) != 0 ||
+        mtk_os_hal_gpio_set_direction(PUMP_GPIO, OS_HAL_GPIO_DIR_OUTPUT) != 0) {
+        return -1;
+    }
+    Board_SetPump(false);
+
+    uint16_t channelMask = (uint16_t)(1u << GLUCOSE_ADC_CHANNEL);
+    if (mtk_os_hal_adc_ctlr_init(ADC_PMODE_ONE_TIME, ADC_FIFO_DIRECT, channelMask) != 0 ||
+        mtk_os_hal_adc_start_ch(channelMask) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+unsigned int Board_AdcBitCount(void)
+{
+    return ADC_BIT_COUNT;
+}
+
+int Board_ReadAdc(uint16_t* outValue)
+{
+    uint32_t data;
+    if (mtk_os_hal_adc_one_shot_get_data(GLUCOSE_ADC_CHANNEL, &data) != 0) {
+        return -1;
+    }
+
+    *outValue = (uint16_t)(data & ((1u << ADC_BIT_COUNT) - 1));
+    return 0;
+}
+
+void Board_SetPump(bool on)
+{
+    mtk_os_hal_gpio_set_output(PUMP_GPIO, on ? OS_HAL_GPIO_DATA_HIGH : OS_HAL_GPIO_DATA_LOW);
+}
+
+uint64_t Board_NowUs(void)
+{
+    // The 32-bit cycle counter wraps every 21 s at 197.6 MHz, so accumulate it into 64 bits.
+    uint32_t cycles = DWT_CYCCNT;
+    elapsedCycles += (uint32_t)(cycles - lastCycles);
+    lastCycles = cycles;
+    // Split the conversion so that it is exact and the intermediate product cannot overflow.
+    return elapsedCycles / BOARD_CPU_HZ * 1000000u +
+           elapsedCycles % BOARD_CPU_HZ * 1000000u / BOARD_CPU_HZ;
+}
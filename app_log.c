@@ -0,0 +1,45 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <string.h>
+
+#include "app_log.h"
+
+static const char* const levelNames[] = { "None", "Error", "Warning", "Info", "Debug" };
+
+int appLogLevel = APP_LOG_DEFAULT_LEVEL < APP_LOG_COMPILE_LEVEL ? APP_LOG_DEFAULT_LEVEL
+                                                                 : APP_LOG_COMPILE_LEVEL;
+
+int AppLog_SetLevel(int level)
+{
+    if (level < APP_LOG_LEVEL_NONE) {
+        level = APP_LOG_LEVEL_NONE;
+    }
+    else if (level > APP_LOG_COMPILE_LEVEL) {
+        level = APP_LOG_COMPILE_LEVEL;
+    }
+
+    appLogLevel = level;
+    return appLogLevel;
+}
+
+bool AppLog_ParseLevel(const char* name, int* outLevel)
+{
+    for (int level = APP_LOG_LEVEL_NONE; level <= APP_LOG_LEVEL_DEBUG; level++) {
+        if (strcmp(name, levelNames[level]) == 0) {
+            *outLevel = level;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* AppLog_LevelName(int level)
+{
+    if (level < APP_LOG_LEVEL_NONE || level > APP_LOG_LEVEL_DEBUG) {
+        return "Unknown";
+    }
+
+    return levelNames[level];
+}
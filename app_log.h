@@ -0,0 +1,99 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+
+#include <applibs/log.h>
+
+/// <summary>
+/// Log levels, from most to least severe. A message is written only if its level is at or below
+/// both the compile-time level APP_LOG_COMPILE_LEVEL and the runtime level.
+/// </summary>
+#define APP_LOG_LEVEL_NONE 0
+#define APP_LOG_LEVEL_ERROR 1
+#define APP_LOG_LEVEL_WARNING 2
+#define APP_LOG_LEVEL_INFO 3
+#define APP_LOG_LEVEL_DEBUG 4
+
+/// <summary>
+/// Most verbose level compiled into the image. Messages above this level are removed by the
+/// compiler, arguments and formatting included. Set from cmakelists.txt.
+/// </summary>
+#ifndef APP_LOG_COMPILE_LEVEL
+#define APP_LOG_COMPILE_LEVEL APP_LOG_LEVEL_DEBUG
+#endif
+
+/// <summary>
+/// Runtime level used until <see cref="AppLog_SetLevel" /> is called. Set from cmakelists.txt.
+/// </summary>
+#ifndef APP_LOG_DEFAULT_LEVEL
+#define APP_LOG_DEFAULT_LEVEL APP_LOG_COMPILE_LEVEL
+#endif
+
+/// <summary>
+/// Current runtime level. Read through the LOG_* macros; change it with
+/// <see cref="AppLog_SetLevel" />.
+/// </summary>
+extern int appLogLevel;
+
+#define APP_LOG(level, ...)              \
+    do {                                 \
+        if ((level) <= appLogLevel) {    \
+            Log_Debug(__VA_ARGS__);      \
+        }                                \
+    } while (0)
+
+// Compiled-out messages are still type-checked, but the dead branch and its formatting are
+// removed by the compiler.
+#define APP_LOG_DISCARD(...)             \
+    do {                                 \
+        if (0) {                         \
+            Log_Debug(__VA_ARGS__);      \
+        }                                \
+    } while (0)
+
+#if APP_LOG_COMPILE_LEVEL >= APP_LOG_LEVEL_ERROR
+#define LOG_ERROR(...) APP_LOG(APP_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) APP_LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if APP_LOG_COMPILE_LEVEL >= APP_LOG_LEVEL_WARNING
+#define LOG_WARNING(...) APP_LOG(APP_LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) APP_LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if APP_LOG_COMPILE_LEVEL >= APP_LOG_LEVEL_INFO
+#define LOG_INFO(...) APP_LOG(APP_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) APP_LOG_DISCARD(__VA_ARGS__)
+#endif
+
+#if APP_LOG_COMPILE_LEVEL >= APP_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) APP_LOG(APP_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) APP_LOG_DISCARD(__VA_ARGS__)
+#endif
+
+/// <summary>
+/// Set the runtime log level. Levels more verbose than APP_LOG_COMPILE_LEVEL are clamped to it,
+/// since those messages are not in the image.
+/// </summary>
+/// <param name="level">One of the APP_LOG_LEVEL_* values.</param>
+/// <returns>The level now in effect.</returns>
+int AppLog_SetLevel(int level);
+
+/// <summary>
+/// Parse a level name: "None", "Error", "Warning", "Info" or "Debug".
+/// </summary>
+/// <param name="name">Level name.</param>
+/// <param name="outLevel">Receives the level on success.</param>
+/// <returns>true if the name was recognized; false otherwise.</returns>
+bool AppLog_ParseLevel(const char* name, int* outLevel);
+
+/// <summary>
+/// Returns the name of a level, as accepted by <see cref="AppLog_ParseLevel" />.
+/// </summary>
+const char* AppLog_LevelName(int level);
@@ -0,0 +1,128 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <applibs/gpio.h>
+
+#include "app_log.h"
+#include "button_monitor.h"
+#include "eventloop_timer_utilities.h"
+
+// Poll period while no button is changing state.
+static const struct timespec IdlePollPeriod = { .tv_sec = 0, .tv_nsec = 100 * 1000 * 1000 };
+
+// Poll period while an edge is being debounced.
+static const struct timespec DebouncePollPeriod = { .tv_sec = 0, .tv_nsec = 5 * 1000 * 1000 };
+
+// Number of consecutive fast polls a new state must persist for before it is accepted.
+static const int DebounceSamples = 3;
+
+typedef struct {
+    int fd;
+    ButtonPressedHandler handler;
+    GPIO_Value_Type stableState; // Last debounced state
+    int changedSamples;          // Consecutive polls which disagreed with stableState
+} MonitoredButton;
+
+static MonitoredButton buttons[BUTTON_MONITOR_MAX_BUTTONS];
+static int buttonCount = 0;
+static EventLoopTimer* pollTimer = NULL;
+static bool isDebouncing = false;
+static ButtonMonitorErrorHandler failureHandler = NULL;
+
+// Update one button's debounced state. Returns true while the button's state is unsettled.
+static bool PollButton(MonitoredButton* button)
+{
+    GPIO_Value_Type newState;
+    if (GPIO_GetValue(button->fd, &newState) != 0) {
+        LOG_ERROR("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
+        failureHandler(ButtonMonitorError_GetValue);
+        return false;
+    }
+
+    if (newState == button->stableState) {
+        button->changedSamples = 0;
+        return false;
+    }
+
+    button->changedSamples++;
+    if (button->changedSamples < DebounceSamples) {
+        return true;
+    }
+
+    button->stableState = newState;
+    button->changedSamples = 0;
+    if (newState == GPIO_Value_Low) {
+        button->handler();
+    }
+    return false;
+}
+
+static void ButtonPollTimerEventHandler(EventLoopTimer* timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        failureHandler(ButtonMonitorError_TimerConsume);
+        return;
+    }
+
+    bool anyUnsettled = false;
+    for (int i = 0; i < buttonCount; i++) {
+        anyUnsettled |= PollButton(&buttons[i]);
+    }
+
+    // Only poll quickly while there is an edge to debounce.
+    if (anyUnsettled != isDebouncing) {
+        isDebouncing = anyUnsettled;
+        SetEventLoopTimerPeriod(pollTimer, isDebouncing ? &DebouncePollPeriod : &IdlePollPeriod);
+    }
+}
+
+int ButtonMonitor_Init(EventLoop* eventLoop, ButtonMonitorErrorHandler errorHandler)
+{
+    if (errorHandler == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    failureHandler = errorHandler;
+    buttonCount = 0;
+    isDebouncing = false;
+
+    pollTimer = CreateEventLoopPeriodicTimer(eventLoop, &ButtonPollTimerEventHandler,
+        &IdlePollPeriod);
+    if (pollTimer == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int ButtonMonitor_AddButton(int gpioFd, ButtonPressedHandler handler)
+{
+    if (gpioFd < 0 || handler == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (buttonCount == BUTTON_MONITOR_MAX_BUTTONS) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    buttons[buttonCount].fd = gpioFd;
+    buttons[buttonCount].handler = handler;
+    buttons[buttonCount].stableState = GPIO_Value_High;
+    buttons[buttonCount].changedSamples = 0;
+    buttonCount++;
+
+    return 0;
+}
+
+void ButtonMonitor_Dispose(void)
+{
+    DisposeEventLoopTimer(pollTimer);
+    pollTimer = NULL;
+    buttonCount = 0;
+}
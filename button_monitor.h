@@ -0,0 +1,55 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <applibs/eventloop.h>
+
+/// <summary>
+/// Maximum number of buttons which can be added with <see cref="ButtonMonitor_AddButton" />.
+/// </summary>
+#define BUTTON_MONITOR_MAX_BUTTONS 4
+
+/// <summary>
+/// Errors reported through <see cref="ButtonMonitorErrorHandler" />.
+/// </summary>
+typedef enum {
+    ButtonMonitorError_TimerConsume = 0, // The poll timer event could not be consumed
+    ButtonMonitorError_GetValue = 1      // A button GPIO could not be read
+} ButtonMonitorError;
+
+/// <summary>
+/// Invoked on the event loop when a button has been pressed, after debouncing.
+/// </summary>
+typedef void (*ButtonPressedHandler)(void);
+
+/// <summary>
+/// Invoked on the event loop when the button monitor encounters an unrecoverable error.
+/// errno contains more information.
+/// </summary>
+typedef void (*ButtonMonitorErrorHandler)(ButtonMonitorError error);
+
+/// <summary>
+/// Start monitoring buttons. The Azure Sphere high-level core cannot receive GPIO interrupts, so
+/// buttons are polled adaptively: slowly while every button is idle, and quickly only while an
+/// edge is being debounced. This keeps event loop wakeups to a minimum without adding noticeable
+/// press latency.
+/// </summary>
+/// <param name="eventLoop">Event loop on which buttons are polled and handlers invoked.</param>
+/// <param name="errorHandler">Callback to invoke on failure.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int ButtonMonitor_Init(EventLoop* eventLoop, ButtonMonitorErrorHandler errorHandler);
+
+/// <summary>
+/// Add a button to be monitored. The button is assumed to be released when added.
+/// </summary>
+/// <param name="gpioFd">GPIO opened as an input, which reads low while the button is pressed.
+/// The monitor does not take ownership of the file descriptor.</param>
+/// <param name="handler">Callback to invoke when the button is pressed.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int ButtonMonitor_AddButton(int gpioFd, ButtonPressedHandler handler);
+
+/// <summary>
+/// Stop monitoring buttons and free the poll timer. It is safe to call this function if
+/// <see cref="ButtonMonitor_Init" /> was not called or failed.
+/// </summary>
+void ButtonMonitor_Dispose(void);
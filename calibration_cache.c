@@ -0,0 +1,80 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "calibration_cache.h"
+
+// Mixed into the check value, so that zero-filled (never written) storage is invalid.
+#define CACHE_MAGIC 0x474C4B43u // "GLKC"
+
+typedef struct {
+    CalibrationCoefficients coefficients;
+    uint32_t check;
+} StoredCalibration;
+
+_Static_assert(sizeof(StoredCalibration) <= CALIBRATION_CACHE_SIZE,
+    "CALIBRATION_CACHE_SIZE is too small");
+
+// FNV-1a over the record's coefficients.
+static uint32_t CalibrationCheck(const StoredCalibration* record)
+{
+    uint32_t hash = 2166136261u;
+    const uint8_t* bytes = (const uint8_t*)record;
+    for (size_t i = 0; i < offsetof(StoredCalibration, check); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash ^ CACHE_MAGIC;
+}
+
+int CalibrationCache_Load(int fd, off_t offset, CalibrationCoefficients* outCoefficients)
+{
+    StoredCalibration record;
+    memset(&record, 0, sizeof(record));
+    if (fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (lseek(fd, offset, SEEK_SET) == -1 || read(fd, &record, sizeof(record)) == -1) {
+        return -1;
+    }
+
+    // Bytes beyond the end of the file read as zero, and so fail the check.
+    if (record.check != CalibrationCheck(&record)) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    *outCoefficients = record.coefficients;
+    return 0;
+}
+
+int CalibrationCache_Save(int fd, off_t offset, const CalibrationCoefficients* coefficients)
+{
+    StoredCalibration record;
+    if (fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.coefficients = *coefficients;
+    record.check = CalibrationCheck(&record);
+
+    if (lseek(fd, offset, SEEK_SET) == -1) {
+        return -1;
+    }
+    ssize_t writeSize = write(fd, &record, sizeof(record));
+    if (writeSize == -1) {
+        return -1;
+    }
+    if ((size_t)writeSize != sizeof(record)) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <sys/types.h>
+
+#include "calibration_curve.h"
+
+/// <summary>
+/// Size of the mutable storage region used by the cache.
+/// </summary>
+#define CALIBRATION_CACHE_SIZE 32
+
+/// <summary>
+/// Read the glucose calibration which was last accepted from the device twin, from a region of
+/// the application's mutable storage file, so that readings are calibrated from startup rather
+/// than from when the twin arrives. The record carries a check value, so a torn or never
+/// written record reads as absent.
+/// </summary>
+/// <param name="fd">File descriptor returned by Storage_OpenMutableFile.</param>
+/// <param name="offset">Start of the region within the file.</param>
+/// <param name="outCoefficients">Receives the calibration.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information. errno
+/// is ENOENT if no calibration is cached.</returns>
+int CalibrationCache_Load(int fd, off_t offset, CalibrationCoefficients* outCoefficients);
+
+/// <summary>
+/// Cache a calibration which has been compiled successfully.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int CalibrationCache_Save(int fd, off_t offset, const CalibrationCoefficients* coefficients);
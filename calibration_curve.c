@@ -0,0 +1,104 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+
+#include "calibration_curve.h"
+
+#define TABLE_CAPACITY ((1u << CALIBRATION_CURVE_INDEX_BITS) + 1)
+
+// Sensitivity is 1 + k·ΔT in parts per million; k in hundredths of a percent per degree times
+// ΔT in hundredths of a degree is already in parts per million.
+#define PARTS_PER_MILLION 1000000
+
+// Below this, a correction would multiply the reading more than tenfold.
+#define MIN_SENSITIVITY_PPM (PARTS_PER_MILLION / 10)
+
+static int32_t table[TABLE_CAPACITY];
+static int compiledBitCount = 0;
+static unsigned int interpolationBits = 0; // Low bits of a count which are interpolated
+static uint32_t maxCounts = 0;
+static CalibrationCoefficients calibration;
+
+int CalibrationCurve_Compile(const CalibrationCoefficients* coefficients, int bitCount)
+{
+    if (bitCount < 1 || bitCount > 31) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Evaluate into a scratch table, so that a curve which does not fit leaves the current one.
+    static int32_t scratch[TABLE_CAPACITY];
+    unsigned int indexBits = bitCount < CALIBRATION_CURVE_INDEX_BITS
+                                 ? (unsigned int)bitCount
+                                 : CALIBRATION_CURVE_INDEX_BITS;
+    unsigned int shift = (unsigned int)bitCount - indexBits;
+    size_t entryCount = ((size_t)1 << indexBits) + 1;
+    double fullScale = (double)(((uint64_t)1 << bitCount) - 1);
+
+    for (size_t i = 0; i < entryCount; i++) {
+        double u = (double)((uint64_t)i << shift) / fullScale;
+        double value = 0.0;
+        for (int power = CALIBRATION_CURVE_ORDER; power >= 0; power--) {
+            value = value * u + coefficients->coefficientsHundredths[power];
+        }
+        value += value < 0.0 ? -0.5 : 0.5;
+        if (!(value > INT32_MIN - 1.0 && value < INT32_MAX + 1.0)) { // Also rejects NaN
+            errno = EINVAL;
+            return -1;
+        }
+        scratch[i] = (int32_t)value;
+    }
+
+    for (size_t i = 0; i < entryCount; i++) {
+        table[i] = scratch[i];
+    }
+    compiledBitCount = bitCount;
+    interpolationBits = shift;
+    maxCounts = (uint32_t)fullScale;
+    calibration = *coefficients;
+    return 0;
+}
+
+bool CalibrationCurve_IsCompiled(void)
+{
+    return compiledBitCount != 0;
+}
+
+int CalibrationCurve_BitCount(void)
+{
+    return compiledBitCount;
+}
+
+int32_t CalibrationCurve_Lookup(uint32_t counts)
+{
+    if (counts > maxCounts) {
+        counts = maxCounts;
+    }
+
+    // index + 1 is always in the table, as it has an entry beyond full scale.
+    uint32_t index = counts >> interpolationBits;
+    int64_t fraction = counts & ((1u << interpolationBits) - 1);
+    int64_t step = (int64_t)table[index + 1] - table[index];
+    int64_t rounding = interpolationBits == 0 ? 0 : (int64_t)1 << (interpolationBits - 1);
+    return table[index] + (int32_t)((step * fraction + rounding) >> interpolationBits);
+}
+
+int32_t CalibrationCurve_CorrectTemperature(int32_t hundredths, int32_t temperatureHundredths)
+{
+    int64_t deltaHundredths =
+        (int64_t)temperatureHundredths - calibration.referenceTemperatureHundredths;
+    int64_t sensitivityPpm =
+        PARTS_PER_MILLION + calibration.temperatureCoefficientHundredths * deltaHundredths;
+    if (sensitivityPpm < MIN_SENSITIVITY_PPM) {
+        return hundredths;
+    }
+
+    int64_t scaled = (int64_t)hundredths * PARTS_PER_MILLION;
+    int64_t rounding = (scaled < 0 ? -sensitivityPpm : sensitivityPpm) / 2;
+    int64_t corrected = (scaled + rounding) / sensitivityPpm;
+    if (corrected > INT32_MAX || corrected < INT32_MIN) {
+        return hundredths;
+    }
+    return (int32_t)corrected;
+}
@@ -0,0 +1,74 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Highest power of the calibration polynomial.
+/// </summary>
+#define CALIBRATION_CURVE_ORDER 3
+
+/// <summary>
+/// Most significant bits of a raw count which index the lookup table; any lower bits
+/// interpolate between neighbouring entries. The table has (1 << this) + 1 entries at most.
+/// </summary>
+#define CALIBRATION_CURVE_INDEX_BITS 8
+
+/// <summary>
+/// A sensor's calibration, as delivered through the device twin. The curve is a polynomial in
+/// the fraction of full scale, u = counts / maximum count, so that coefficients in hundredths
+/// give readings to the nearest hundredth:
+///
+///     reading = c0 + c1·u + c2·u² + c3·u³
+///
+/// The reading is then corrected for the sensor's sensitivity changing with temperature, by
+/// dividing it by 1 + k·(T − referenceTemperature).
+/// </summary>
+typedef struct {
+    int32_t coefficientsHundredths[CALIBRATION_CURVE_ORDER + 1]; // c0 first
+    int32_t temperatureCoefficientHundredths; // k, in hundredths of a percent per degree Celsius
+    int32_t referenceTemperatureHundredths;   // In hundredths of a degree Celsius
+} CalibrationCoefficients;
+
+/// <summary>
+/// Compile a calibration into the lookup table, replacing any table compiled before. The
+/// polynomial is evaluated once per table entry here, so that conversions need no floating
+/// point. If compiling fails, the previous table is kept.
+/// </summary>
+/// <param name="coefficients">Calibration to compile. Copied.</param>
+/// <param name="bitCount">Sample size of the ADC in bits, from 1 to 31, which sizes the
+/// table.</param>
+/// <returns>0 on success, or -1 with errno set to EINVAL if the bit count is out of range or
+/// the curve leaves the range of an int32 over full scale.</returns>
+int CalibrationCurve_Compile(const CalibrationCoefficients* coefficients, int bitCount);
+
+/// <summary>
+/// Returns whether a table has been compiled.
+/// </summary>
+bool CalibrationCurve_IsCompiled(void);
+
+/// <summary>
+/// Returns the sample size which the compiled table was sized for, or 0 if none has been.
+/// </summary>
+int CalibrationCurve_BitCount(void);
+
+/// <summary>
+/// Convert a raw (or decimated) count with the compiled table: one lookup and a linear
+/// interpolation. A table must have been compiled.
+/// </summary>
+/// <param name="counts">Raw count, clamped to full scale.</param>
+/// <returns>Calibrated reading, in hundredths, before temperature correction.</returns>
+int32_t CalibrationCurve_Lookup(uint32_t counts);
+
+/// <summary>
+/// Correct a calibrated reading for the sensor's temperature, using integer arithmetic.
+/// </summary>
+/// <param name="hundredths">Reading from <see cref="CalibrationCurve_Lookup" />.</param>
+/// <param name="temperatureHundredths">Sensor temperature, in hundredths of a degree
+/// Celsius.</param>
+/// <returns>Corrected reading, or the reading unchanged if the correction would not make
+/// sense at this temperature.</returns>
+int32_t CalibrationCurve_CorrectTemperature(int32_t hundredths, int32_t temperatureHundredths);
@@ -0,0 +1,76 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+
+#include <iothub_client_options.h>
+#include <iothubtransportmqtt.h>
+#include <iothubtransportmqtt_websockets.h>
+#include <tickcounter.h>
+
+#include "app_log.h"
+#include "connection_profile.h"
+
+static bool NameEquals(const char* name, const char* candidate, size_t nameLength)
+{
+    if (strlen(candidate) != nameLength) {
+        return false;
+    }
+    for (size_t i = 0; i < nameLength; i++) {
+        if (tolower((unsigned char)name[i]) != tolower((unsigned char)candidate[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const ConnectionProfile* ConnectionProfile_Find(const ConnectionProfile* profiles, size_t count,
+    const char* name, size_t nameLength)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (NameEquals(name, profiles[i].name, nameLength)) {
+            return &profiles[i];
+        }
+    }
+    return NULL;
+}
+
+IOTHUB_CLIENT_TRANSPORT_PROVIDER ConnectionProfile_Transport(const ConnectionProfile* profile)
+{
+    return profile->transport == ConnectionTransport_MqttWebSockets ? MQTT_WebSocket_Protocol
+                                                                     : MQTT_Protocol;
+}
+
+int ConnectionProfile_Apply(IOTHUB_DEVICE_CLIENT_LL_HANDLE client,
+    const ConnectionProfile* profile)
+{
+    // The keep-alive is sent in the MQTT CONNECT packet, so it must be set before DoWork runs.
+    int keepAliveSeconds = profile->keepAliveSeconds;
+    if (IoTHubDeviceClient_LL_SetOption(client, OPTION_KEEP_ALIVE, &keepAliveSeconds) !=
+        IOTHUB_CLIENT_OK) {
+        LOG_ERROR("ERROR: Failure setting Azure IoT Hub client option \"keepalive\".\n");
+        errno = EIO;
+        return -1;
+    }
+
+    if (IoTHubDeviceClient_LL_SetRetryPolicy(client, profile->retryPolicy,
+        profile->retryTimeoutLimitSeconds) != IOTHUB_CLIENT_OK) {
+        LOG_ERROR("ERROR: Failure setting Azure IoT Hub client retry policy.\n");
+        errno = EIO;
+        return -1;
+    }
+
+    // Give up on messages which are not confirmed in time, so that their readings are stored
+    // and their delivery window slots freed.
+    tickcounter_ms_t messageTimeoutMs = profile->messageTimeoutMs;
+    if (IoTHubDeviceClient_LL_SetOption(client, OPTION_MESSAGE_TIMEOUT, &messageTimeoutMs) !=
+        IOTHUB_CLIENT_OK) {
+        LOG_ERROR("ERROR: Failure setting Azure IoT Hub client option \"messageTimeout\".\n");
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
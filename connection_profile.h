@@ -0,0 +1,56 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stddef.h>
+
+#include <iothub_client_core_common.h>
+#include <iothub_device_client_ll.h>
+
+/// <summary>
+/// Transports over which the IoT Hub client can connect.
+/// </summary>
+typedef enum {
+    ConnectionTransport_Mqtt = 0,          // MQTT on port 8883
+    ConnectionTransport_MqttWebSockets = 1 // MQTT over WebSockets on port 443, for networks
+                                           // which only let HTTPS through
+} ConnectionTransport;
+
+/// <summary>
+/// How the IoT Hub client connects, trading idle radio traffic against how soon a dead link is
+/// noticed and a message is given up on.
+/// </summary>
+typedef struct {
+    const char* name;
+    ConnectionTransport transport;
+    int keepAliveSeconds;                   // Idle time after which the client pings the hub
+    IOTHUB_CLIENT_RETRY_POLICY retryPolicy; // How the SDK itself reconnects a dropped link
+    size_t retryTimeoutLimitSeconds;        // How long the SDK retries; 0 is forever
+    unsigned int messageTimeoutMs;          // Time after which an unconfirmed message fails
+} ConnectionProfile;
+
+/// <summary>
+/// Look up a profile by name, ignoring case.
+/// </summary>
+/// <param name="profiles">Profiles to search.</param>
+/// <param name="count">Number of profiles.</param>
+/// <param name="name">Name to look for, which need not be null-terminated.</param>
+/// <param name="nameLength">Length of name.</param>
+/// <returns>The profile, or NULL if there is none of that name.</returns>
+const ConnectionProfile* ConnectionProfile_Find(const ConnectionProfile* profiles, size_t count,
+    const char* name, size_t nameLength);
+
+/// <summary>
+/// Returns the transport provider to create the IoT Hub client with.
+/// </summary>
+IOTHUB_CLIENT_TRANSPORT_PROVIDER ConnectionProfile_Transport(const ConnectionProfile* profile);
+
+/// <summary>
+/// Set the profile's keep-alive, retry policy and message timeout on a newly created client,
+/// before it first connects. Failures are logged.
+/// </summary>
+/// <param name="client">Client created with <see cref="ConnectionProfile_Transport" />.</param>
+/// <param name="profile">Profile to apply.</param>
+/// <returns>0 on success, or -1 with errno set to EIO if the client rejected an option.</returns>
+int ConnectionProfile_Apply(IOTHUB_DEVICE_CLIENT_LL_HANDLE client,
+    const ConnectionProfile* profile);
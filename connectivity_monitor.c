@@ -0,0 +1,144 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <string.h>
+
+#include <applibs/networking.h>
+
+#include "app_log.h"
+#include "connectivity_monitor.h"
+#include "eventloop_timer_utilities.h"
+
+// Heartbeat period while no interface is connected to the internet.
+static const struct timespec OfflinePollPeriod = { .tv_sec = 1, .tv_nsec = 0 };
+
+// Heartbeat period while an interface is connected. Losing the connection usually shows up
+// sooner as a failed send or connection, which refreshes the cache straight away.
+static const struct timespec OnlinePollPeriod = { .tv_sec = 30, .tv_nsec = 0 };
+
+static const char* const* interfaces = NULL;
+static size_t interfaceCount = 0;
+static int activeIndex = -1; // Index into interfaces, or -1 while offline
+static EventLoopTimer* heartbeatTimer = NULL;
+static ConnectivityChangedHandler changeHandler = NULL;
+static ConnectivityMonitorErrorHandler failureHandler = NULL;
+
+// Read whether one interface is connected to the internet. An interface which does not exist on
+// this board, or a networking stack which is not ready yet, reads as disconnected.
+static int IsInterfaceConnected(const char* interfaceName, bool* outIsConnected)
+{
+    Networking_InterfaceConnectionStatus status;
+    if (Networking_GetInterfaceConnectionStatus(interfaceName, &status) == -1) {
+        *outIsConnected = false;
+        if (errno == EAGAIN || errno == ENOENT) {
+            return 0;
+        }
+        LOG_ERROR("ERROR: Networking_GetInterfaceConnectionStatus(%s): %s (%d).\n", interfaceName,
+            strerror(errno), errno);
+        return -1;
+    }
+
+    *outIsConnected = (status & Networking_InterfaceConnectionStatus_ConnectedToInternet) != 0;
+    return 0;
+}
+
+// Find the most preferred connected interface. Returns -1 on failure.
+static int FindActiveInterface(int* outIndex)
+{
+    *outIndex = -1;
+    for (size_t i = 0; i < interfaceCount; i++) {
+        bool isConnected;
+        if (IsInterfaceConnected(interfaces[i], &isConnected) == -1) {
+            return -1;
+        }
+        if (isConnected) {
+            *outIndex = (int)i;
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static void UpdateActiveInterface(void)
+{
+    int newIndex;
+    if (FindActiveInterface(&newIndex) == -1) {
+        failureHandler(ConnectivityMonitorError_GetStatus);
+        return;
+    }
+    if (newIndex == activeIndex) {
+        return;
+    }
+
+    // Restarting the heartbeat also defers the next poll, which has just been done.
+    bool wasConnected = activeIndex != -1;
+    activeIndex = newIndex;
+    if (wasConnected != (activeIndex != -1)) {
+        SetEventLoopTimerPeriod(heartbeatTimer,
+            activeIndex != -1 ? &OnlinePollPeriod : &OfflinePollPeriod);
+    }
+    changeHandler(ConnectivityMonitor_ActiveInterface());
+}
+
+static void HeartbeatTimerEventHandler(EventLoopTimer* timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        failureHandler(ConnectivityMonitorError_TimerConsume);
+        return;
+    }
+
+    UpdateActiveInterface();
+}
+
+int ConnectivityMonitor_Init(EventLoop* eventLoop, const char* const* interfaceNames, size_t count,
+    ConnectivityChangedHandler changedHandler, ConnectivityMonitorErrorHandler errorHandler)
+{
+    if (interfaceNames == NULL || count == 0 || count > CONNECTIVITY_MONITOR_MAX_INTERFACES ||
+        changedHandler == NULL || errorHandler == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    interfaces = interfaceNames;
+    interfaceCount = count;
+    changeHandler = changedHandler;
+    failureHandler = errorHandler;
+
+    // Take the initial state without reporting it as a change.
+    if (FindActiveInterface(&activeIndex) == -1) {
+        return -1;
+    }
+
+    heartbeatTimer = CreateEventLoopPeriodicTimer(eventLoop, &HeartbeatTimerEventHandler,
+        activeIndex != -1 ? &OnlinePollPeriod : &OfflinePollPeriod);
+    if (heartbeatTimer == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+void ConnectivityMonitor_Refresh(void)
+{
+    if (heartbeatTimer != NULL) {
+        UpdateActiveInterface();
+    }
+}
+
+bool ConnectivityMonitor_IsConnected(void)
+{
+    return activeIndex != -1;
+}
+
+const char* ConnectivityMonitor_ActiveInterface(void)
+{
+    return activeIndex != -1 ? interfaces[activeIndex] : NULL;
+}
+
+void ConnectivityMonitor_Dispose(void)
+{
+    DisposeEventLoopTimer(heartbeatTimer);
+    heartbeatTimer = NULL;
+    activeIndex = -1;
+}
@@ -0,0 +1,77 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <applibs/eventloop.h>
+
+/// <summary>
+/// Maximum number of network interfaces which can be monitored.
+/// </summary>
+#define CONNECTIVITY_MONITOR_MAX_INTERFACES 4
+
+/// <summary>
+/// Errors reported through <see cref="ConnectivityMonitorErrorHandler" />.
+/// </summary>
+typedef enum {
+    ConnectivityMonitorError_TimerConsume = 0, // The heartbeat timer event could not be consumed
+    ConnectivityMonitorError_GetStatus = 1     // An interface's status could not be read
+} ConnectivityMonitorError;
+
+/// <summary>
+/// Invoked on the event loop when the device goes on or offline, or fails over to another
+/// interface.
+/// </summary>
+/// <param name="activeInterface">Name of the interface now connected to the internet, or NULL
+/// if none is.</param>
+typedef void (*ConnectivityChangedHandler)(const char* activeInterface);
+
+/// <summary>
+/// Invoked on the event loop when the connectivity monitor encounters an unrecoverable error.
+/// errno contains more information.
+/// </summary>
+typedef void (*ConnectivityMonitorErrorHandler)(ConnectivityMonitorError error);
+
+/// <summary>
+/// Start monitoring network interfaces. Applications are not notified of network changes, so the
+/// interfaces' status is cached and refreshed on a heartbeat: quickly while offline, so that a
+/// connection is noticed promptly, and slowly while online. Callers which see evidence of a change,
+/// such as a failed send, can refresh the cache early with
+/// <see cref="ConnectivityMonitor_Refresh" />. The first interface in the list which is connected
+/// to the internet is the active one, so listing a wired interface before a wireless one fails
+/// over to the wireless one only while the wired one is down.
+/// </summary>
+/// <param name="eventLoop">Event loop on which interfaces are polled and handlers invoked.</param>
+/// <param name="interfaceNames">Interface names, in order of preference. Not copied, so they must
+/// outlive the monitor.</param>
+/// <param name="count">Number of interface names.</param>
+/// <param name="changedHandler">Callback to invoke when the active interface changes.</param>
+/// <param name="errorHandler">Callback to invoke on failure.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int ConnectivityMonitor_Init(EventLoop* eventLoop, const char* const* interfaceNames, size_t count,
+    ConnectivityChangedHandler changedHandler, ConnectivityMonitorErrorHandler errorHandler);
+
+/// <summary>
+/// Read every interface's status now, rather than waiting for the next heartbeat.
+/// The changed handler is invoked before this returns if the active interface has changed.
+/// </summary>
+void ConnectivityMonitor_Refresh(void);
+
+/// <summary>
+/// Returns whether any monitored interface was connected to the internet when last checked.
+/// This does not make a system call, so it is cheap enough to check before every message.
+/// </summary>
+bool ConnectivityMonitor_IsConnected(void);
+
+/// <summary>
+/// Returns the name of the active interface when last checked, or NULL if none is connected.
+/// </summary>
+const char* ConnectivityMonitor_ActiveInterface(void);
+
+/// <summary>
+/// Stop monitoring and free the heartbeat timer. It is safe to call this function if
+/// <see cref="ConnectivityMonitor_Init" /> was not called or failed.
+/// </summary>
+void ConnectivityMonitor_Dispose(void);
@@ -0,0 +1,299 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "app_log.h"
+#include "deadline_scheduler.h"
+#include "eventloop_timer_utilities.h"
+#include "health_monitor.h"
+
+#define NANOSECONDS_PER_SECOND 1000000000ull
+
+typedef struct {
+    const char* name;
+    SchedulerJobHandler handler;
+    uint64_t periodNs;   // 0 for one-shot jobs
+    uint64_t deadlineNs; // Monotonic time at which the job is next due
+    int heapIndex;       // Position in deadlineHeap, or -1 if not scheduled
+    bool wasChanged;     // Set when the job is rescheduled or disabled
+} Job;
+
+static Job jobs[SCHEDULER_MAX_JOBS];
+static int jobCount = 0;
+
+// Binary min-heap of job indices, ordered by deadline.
+static int deadlineHeap[SCHEDULER_MAX_JOBS];
+static int heapSize = 0;
+
+static EventLoopTimer* schedulerTimer = NULL;
+static SchedulerErrorHandler failureHandler = NULL;
+static bool isDispatching = false;
+
+static uint64_t NowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t TimespecToNs(const struct timespec* value)
+{
+    return (uint64_t)value->tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)value->tv_nsec;
+}
+
+static bool IsValidJob(SchedulerJobId job)
+{
+    if (job < 0 || job >= jobCount) {
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+static void SwapHeapEntries(int a, int b)
+{
+    int jobA = deadlineHeap[a];
+    deadlineHeap[a] = deadlineHeap[b];
+    deadlineHeap[b] = jobA;
+    jobs[deadlineHeap[a]].heapIndex = a;
+    jobs[deadlineHeap[b]].heapIndex = b;
+}
+
+static uint64_t HeapDeadline(int index)
+{
+    return jobs[deadlineHeap[index]].deadlineNs;
+}
+
+static void SiftUp(int index)
+{
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (HeapDeadline(parent) <= HeapDeadline(index)) {
+            break;
+        }
+        SwapHeapEntries(parent, index);
+        index = parent;
+    }
+}
+
+static void SiftDown(int index)
+{
+    for (;;) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < heapSize && HeapDeadline(left) < HeapDeadline(smallest)) {
+            smallest = left;
+        }
+        if (right < heapSize && HeapDeadline(right) < HeapDeadline(smallest)) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            break;
+        }
+        SwapHeapEntries(index, smallest);
+        index = smallest;
+    }
+}
+
+static void RemoveFromHeap(Job* job)
+{
+    int index = job->heapIndex;
+    if (index < 0) {
+        return;
+    }
+
+    heapSize--;
+    job->heapIndex = -1;
+    if (index != heapSize) {
+        deadlineHeap[index] = deadlineHeap[heapSize];
+        jobs[deadlineHeap[index]].heapIndex = index;
+        SiftDown(index);
+        SiftUp(index);
+    }
+}
+
+static void ScheduleAt(Job* job, uint64_t deadlineNs)
+{
+    RemoveFromHeap(job);
+    job->wasChanged = true;
+    job->deadlineNs = deadlineNs;
+    job->heapIndex = heapSize;
+    deadlineHeap[heapSize++] = (int)(job - jobs);
+    SiftUp(job->heapIndex);
+}
+
+// Arm the shared timer for the earliest deadline, or disarm it if nothing is scheduled.
+static void ArmTimer(void)
+{
+    if (isDispatching || schedulerTimer == NULL) {
+        return;
+    }
+
+    if (heapSize == 0) {
+        DisarmEventLoopTimer(schedulerTimer);
+        return;
+    }
+
+    uint64_t now = NowNs();
+    uint64_t deadline = HeapDeadline(0);
+    // A zero timer value would disarm the timer, so always wait at least one nanosecond.
+    uint64_t delay = deadline > now ? deadline - now : 1;
+    struct timespec delaySpec = { .tv_sec = (time_t)(delay / NANOSECONDS_PER_SECOND),
+                                  .tv_nsec = (long)(delay % NANOSECONDS_PER_SECOND) };
+    SetEventLoopTimerOneShot(schedulerTimer, &delaySpec);
+}
+
+static void SchedulerTimerEventHandler(EventLoopTimer* timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        failureHandler();
+        return;
+    }
+
+    isDispatching = true;
+    uint64_t now = NowNs();
+    if (heapSize > 0 && HeapDeadline(0) <= now) {
+        HealthMonitor_RecordLoopLag(now - HeapDeadline(0));
+    }
+    while (heapSize > 0 && HeapDeadline(0) <= now) {
+        Job* job = &jobs[deadlineHeap[0]];
+        uint64_t deadline = job->deadlineNs;
+        RemoveFromHeap(job);
+
+        job->wasChanged = false;
+        job->handler();
+
+        // Reschedule periodic jobs, unless the handler already rescheduled or disabled the job.
+        // If the event loop fell behind, skip missed runs rather than running them back to back.
+        if (!job->wasChanged && job->periodNs != 0) {
+            uint64_t next = deadline + job->periodNs;
+            if (next <= now) {
+                next = now + job->periodNs;
+            }
+            ScheduleAt(job, next);
+        }
+    }
+    isDispatching = false;
+
+    ArmTimer();
+}
+
+int Scheduler_Init(EventLoop* eventLoop, SchedulerErrorHandler errorHandler)
+{
+    if (errorHandler == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    failureHandler = errorHandler;
+    jobCount = 0;
+    heapSize = 0;
+
+    schedulerTimer = CreateEventLoopDisarmedTimer(eventLoop, &SchedulerTimerEventHandler);
+    if (schedulerTimer == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+SchedulerJobId Scheduler_AddJob(const char* name, SchedulerJobHandler handler,
+    const struct timespec* period)
+{
+    if (handler == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (jobCount == SCHEDULER_MAX_JOBS) {
+        LOG_ERROR("ERROR: Cannot add job %s: scheduler is full.\n", name);
+        errno = ENOSPC;
+        return -1;
+    }
+
+    Job* job = &jobs[jobCount];
+    job->name = name;
+    job->handler = handler;
+    job->periodNs = 0;
+    job->heapIndex = -1;
+    job->wasChanged = false;
+
+    SchedulerJobId id = jobCount++;
+    if (period != NULL && Scheduler_SetJobPeriod(id, period) == -1) {
+        jobCount--;
+        return -1;
+    }
+
+    return id;
+}
+
+int Scheduler_SetJobPeriod(SchedulerJobId id, const struct timespec* period)
+{
+    if (!IsValidJob(id)) {
+        return -1;
+    }
+
+    Job* job = &jobs[id];
+    if (period == NULL) {
+        job->periodNs = 0;
+        job->wasChanged = true;
+        RemoveFromHeap(job);
+    }
+    else {
+        uint64_t periodNs = TimespecToNs(period);
+        if (periodNs == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        job->periodNs = periodNs;
+        ScheduleAt(job, NowNs() + periodNs);
+    }
+
+    ArmTimer();
+    return 0;
+}
+
+int Scheduler_RunJobAfter(SchedulerJobId id, const struct timespec* delay)
+{
+    if (!IsValidJob(id)) {
+        return -1;
+    }
+
+    ScheduleAt(&jobs[id], NowNs() + TimespecToNs(delay));
+    ArmTimer();
+    return 0;
+}
+
+int Scheduler_RunJobSoon(SchedulerJobId id)
+{
+    static const struct timespec noDelay = { .tv_sec = 0, .tv_nsec = 0 };
+    return Scheduler_RunJobAfter(id, &noDelay);
+}
+
+int Scheduler_DisableJob(SchedulerJobId id)
+{
+    if (!IsValidJob(id)) {
+        return -1;
+    }
+
+    jobs[id].wasChanged = true;
+    RemoveFromHeap(&jobs[id]);
+    ArmTimer();
+    return 0;
+}
+
+bool Scheduler_IsJobScheduled(SchedulerJobId id)
+{
+    return IsValidJob(id) && jobs[id].heapIndex != -1;
+}
+
+void Scheduler_Dispose(void)
+{
+    DisposeEventLoopTimer(schedulerTimer);
+    schedulerTimer = NULL;
+    jobCount = 0;
+    heapSize = 0;
+}
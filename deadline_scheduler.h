@@ -0,0 +1,90 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <time.h>
+
+#include <applibs/eventloop.h>
+
+/// <summary>
+/// Maximum number of jobs which can be added with <see cref="Scheduler_AddJob" />.
+/// </summary>
+#define SCHEDULER_MAX_JOBS 16
+
+/// <summary>
+/// Identifies a job added with <see cref="Scheduler_AddJob" />. Negative values are invalid.
+/// </summary>
+typedef int SchedulerJobId;
+
+/// <summary>
+/// Applications implement a function with this signature to run a scheduled job.
+/// The job may reschedule itself or any other job.
+/// </summary>
+typedef void (*SchedulerJobHandler)(void);
+
+/// <summary>
+/// Invoked when the scheduler's timer event cannot be consumed. errno contains more information.
+/// </summary>
+typedef void (*SchedulerErrorHandler)(void);
+
+/// <summary>
+/// Create the scheduler. All jobs share a single one-shot event loop timer which is armed for
+/// the earliest pending deadline, held in a min-heap, so the event loop only wakes when a job is
+/// actually due.
+/// </summary>
+/// <param name="eventLoop">Event loop on which jobs are run.</param>
+/// <param name="errorHandler">Callback to invoke on failure.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Scheduler_Init(EventLoop* eventLoop, SchedulerErrorHandler errorHandler);
+
+/// <summary>
+/// Add a job. Periodic jobs first run one period after being added; one-shot jobs start
+/// disabled and are run with <see cref="Scheduler_RunJobAfter" />.
+/// </summary>
+/// <param name="name">Name used in log messages.</param>
+/// <param name="handler">Callback to invoke when the job is due.</param>
+/// <param name="period">Period of a periodic job, or NULL for a one-shot job.</param>
+/// <returns>Job identifier on success, or -1 on failure, in which case errno contains more
+/// information.</returns>
+SchedulerJobId Scheduler_AddJob(const char* name, SchedulerJobHandler handler,
+    const struct timespec* period);
+
+/// <summary>
+/// Change a job's period and schedule its next run one new period from now. Passing NULL makes
+/// the job one-shot and disables it.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Scheduler_SetJobPeriod(SchedulerJobId job, const struct timespec* period);
+
+/// <summary>
+/// Run a job after the given delay instead of at its next scheduled time. A periodic job
+/// continues with its usual period afterwards. Passing a zero delay runs the job on the next
+/// event loop iteration.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Scheduler_RunJobAfter(SchedulerJobId job, const struct timespec* delay);
+
+/// <summary>
+/// Run a job on the next event loop iteration.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Scheduler_RunJobSoon(SchedulerJobId job);
+
+/// <summary>
+/// Stop running a job until it is rescheduled with <see cref="Scheduler_SetJobPeriod" /> or
+/// <see cref="Scheduler_RunJobAfter" />.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int Scheduler_DisableJob(SchedulerJobId job);
+
+/// <summary>
+/// Returns whether the job is scheduled to run.
+/// </summary>
+bool Scheduler_IsJobScheduled(SchedulerJobId job);
+
+/// <summary>
+/// Dispose of the scheduler and all of its jobs. It is safe to call this function if
+/// <see cref="Scheduler_Init" /> was not called or failed.
+/// </summary>
+void Scheduler_Dispose(void);
@@ -0,0 +1,78 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <string.h>
+
+#include "delivery_window.h"
+
+static DeliverySlot slots[DELIVERY_WINDOW_SIZE];
+static size_t inFlightCount = 0;
+static uint32_t nextSequence = 0;
+
+void DeliveryWindow_Init(uint32_t firstSequence)
+{
+    for (size_t i = 0; i < DELIVERY_WINDOW_SIZE; i++) {
+        slots[i].isInUse = false;
+    }
+    inFlightCount = 0;
+    nextSequence = firstSequence;
+}
+
+DeliverySlot* DeliveryWindow_Acquire(bool isUrgent)
+{
+    size_t limit = isUrgent ? DELIVERY_WINDOW_SIZE
+                            : DELIVERY_WINDOW_SIZE - DELIVERY_WINDOW_URGENT_RESERVE;
+    if (inFlightCount >= limit) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < DELIVERY_WINDOW_SIZE; i++) {
+        DeliverySlot* slot = &slots[i];
+        if (!slot->isInUse) {
+            slot->isInUse = true;
+            slot->sequence = nextSequence++;
+            slot->kind = DeliveryKind_Event;
+            slot->healthContext = NULL;
+            slot->replayEndSequence = 0;
+            slot->readingCount = 0;
+            inFlightCount++;
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+void DeliveryWindow_HoldReadings(DeliverySlot* slot, const TelemetryReading* readings,
+    size_t count)
+{
+    if (count > TELEMETRY_BATCH_CAPACITY) {
+        count = TELEMETRY_BATCH_CAPACITY;
+    }
+    slot->kind = DeliveryKind_Readings;
+    memcpy(slot->readings, readings, count * sizeof(readings[0]));
+    slot->readingCount = count;
+}
+
+void DeliveryWindow_Release(DeliverySlot* slot)
+{
+    if (slot == NULL || !slot->isInUse) {
+        return;
+    }
+    slot->isInUse = false;
+    inFlightCount--;
+}
+
+bool DeliveryWindow_IsReplayInFlight(void)
+{
+    for (size_t i = 0; i < DELIVERY_WINDOW_SIZE; i++) {
+        if (slots[i].isInUse && slots[i].kind == DeliveryKind_Replay) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t DeliveryWindow_InFlightCount(void)
+{
+    return inFlightCount;
+}
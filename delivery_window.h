@@ -0,0 +1,84 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "telemetry_batch.h"
+
+/// <summary>
+/// Most telemetry messages which can await confirmation at once. This bounds the IoT Hub
+/// client's queue however slow the link is.
+/// </summary>
+#define DELIVERY_WINDOW_SIZE 8
+
+/// <summary>
+/// Slots which only urgent messages may use, so that an alert can always be sent.
+/// </summary>
+#define DELIVERY_WINDOW_URGENT_RESERVE 1
+
+/// <summary>
+/// What a slot's message carries, which decides what happens if it is not delivered.
+/// </summary>
+typedef enum {
+    DeliveryKind_Event = 0,    // Nothing to retry
+    DeliveryKind_Alert = 1,    // A glucose alert, resent if it is still the latest
+    DeliveryKind_Readings = 2, // Live readings, held in the slot and stored if not delivered
+    DeliveryKind_Replay = 3,   // Readings from the store, removed from it only once delivered
+    DeliveryKind_DoseEvent = 4 // The oldest dose event, resent until delivered
+} DeliveryKind;
+
+/// <summary>
+/// A message awaiting confirmation. Pass the slot as the context of
+/// IoTHubDeviceClient_LL_SendEventAsync, and release it in the confirmation callback.
+/// </summary>
+typedef struct {
+    bool isInUse;
+    uint32_t sequence; // Sent as the message ID
+    DeliveryKind kind;
+    void* healthContext;
+    uint32_t replayEndSequence; // Replay: store sequence after the readings covered
+    size_t readingCount;
+    TelemetryReading readings[TELEMETRY_BATCH_CAPACITY]; // Readings: copy for retry
+} DeliverySlot;
+
+/// <summary>
+/// Start with an empty window.
+/// </summary>
+/// <param name="firstSequence">Sequence number of the first message. Choose it at random, so
+/// that message IDs are unlikely to repeat those sent before a restart.</param>
+void DeliveryWindow_Init(uint32_t firstSequence);
+
+/// <summary>
+/// Take a slot for a message, giving it the next sequence number.
+/// </summary>
+/// <param name="isUrgent">Whether the message may use the reserved slots.</param>
+/// <returns>Slot of kind DeliveryKind_Event, or NULL if the window is full.</returns>
+DeliverySlot* DeliveryWindow_Acquire(bool isUrgent);
+
+/// <summary>
+/// Keep a copy of live readings in a slot, making it DeliveryKind_Readings.
+/// </summary>
+/// <param name="slot">Slot returned by <see cref="DeliveryWindow_Acquire" />.</param>
+/// <param name="readings">Readings which the message carries.</param>
+/// <param name="count">Number of readings, at most TELEMETRY_BATCH_CAPACITY.</param>
+void DeliveryWindow_HoldReadings(DeliverySlot* slot, const TelemetryReading* readings,
+    size_t count);
+
+/// <summary>
+/// Free a slot once its message has been confirmed, or could not be queued.
+/// </summary>
+void DeliveryWindow_Release(DeliverySlot* slot);
+
+/// <summary>
+/// Returns whether a DeliveryKind_Replay message awaits confirmation. Replays are sent one at a
+/// time, as the store can only be consumed from its oldest reading.
+/// </summary>
+bool DeliveryWindow_IsReplayInFlight(void);
+
+/// <summary>
+/// Returns the number of messages awaiting confirmation.
+/// </summary>
+size_t DeliveryWindow_InFlightCount(void);
@@ -0,0 +1,59 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "dose_events.h"
+
+static DoseEvent events[DOSE_EVENTS_CAPACITY];
+static size_t firstEvent = 0;
+static size_t eventCount = 0;
+static bool isFirstEventInFlight = false;
+static uint32_t firstEventSequence = 0;
+
+bool DoseEvents_Add(const DoseEvent* event)
+{
+    bool isDropped = eventCount == DOSE_EVENTS_CAPACITY;
+    if (isDropped) {
+        firstEvent = (firstEvent + 1) % DOSE_EVENTS_CAPACITY;
+        eventCount--;
+        isFirstEventInFlight = false;
+    }
+
+    events[(firstEvent + eventCount) % DOSE_EVENTS_CAPACITY] = *event;
+    eventCount++;
+    return !isDropped;
+}
+
+const DoseEvent* DoseEvents_NextToSend(void)
+{
+    if (eventCount == 0 || isFirstEventInFlight) {
+        return NULL;
+    }
+    return &events[firstEvent];
+}
+
+void DoseEvents_Sent(uint32_t sequence)
+{
+    if (eventCount == 0) {
+        return;
+    }
+    isFirstEventInFlight = true;
+    firstEventSequence = sequence;
+}
+
+void DoseEvents_Confirmed(uint32_t sequence, bool isDelivered)
+{
+    if (!isFirstEventInFlight || sequence != firstEventSequence) {
+        return;
+    }
+
+    isFirstEventInFlight = false;
+    if (isDelivered) {
+        firstEvent = (firstEvent + 1) % DOSE_EVENTS_CAPACITY;
+        eventCount--;
+    }
+}
+
+size_t DoseEvents_PendingCount(void)
+{
+    return eventCount;
+}
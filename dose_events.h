@@ -0,0 +1,64 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Most dose events which can await delivery. The pump holds at most
+/// PUMP_CONTROLLER_MAX_DOSES doses, each with one event, so this leaves room for events raised
+/// while earlier ones are still unconfirmed.
+/// </summary>
+#define DOSE_EVENTS_CAPACITY 16
+
+typedef enum {
+    DoseEvent_Completed = 0, // The dose has been delivered
+    DoseEvent_Rejected = 1   // The dose was accepted, but then refused by the real-time core
+} DoseEventType;
+
+/// <summary>
+/// The outcome of an insulin dose, which must reach the IoT Hub: it is the only upstream record
+/// of what the pump delivered.
+/// </summary>
+typedef struct {
+    DoseEventType type;
+    uint32_t doseId;
+    int32_t doseHundredths; // Completed only
+    uint32_t durationMs;    // Completed only
+} DoseEvent;
+
+/// <summary>
+/// Queue an event for delivery, after any already queued. If the queue is full the oldest event
+/// is dropped to make room.
+/// </summary>
+/// <returns>false if an event was dropped; true otherwise.</returns>
+bool DoseEvents_Add(const DoseEvent* event);
+
+/// <summary>
+/// Returns the oldest queued event if it should be sent now, or NULL if the queue is empty or
+/// that event is already awaiting confirmation. Events are sent one at a time, in order.
+/// </summary>
+const DoseEvent* DoseEvents_NextToSend(void);
+
+/// <summary>
+/// Record that the event returned by <see cref="DoseEvents_NextToSend" /> was accepted for
+/// delivery.
+/// </summary>
+/// <param name="sequence">Delivery window sequence number of its message.</param>
+void DoseEvents_Sent(uint32_t sequence);
+
+/// <summary>
+/// Handle the IoT Hub's confirmation of a dose event message. A delivered event is removed from
+/// the queue; otherwise it is sent again by the next <see cref="DoseEvents_NextToSend" />.
+/// Confirmations of events which have since been dropped are ignored.
+/// </summary>
+/// <param name="sequence">Delivery window sequence number of the message.</param>
+/// <param name="isDelivered">Whether the IoT Hub confirmed the message.</param>
+void DoseEvents_Confirmed(uint32_t sequence, bool isDelivered);
+
+/// <summary>
+/// Returns the number of events awaiting delivery.
+/// </summary>
+size_t DoseEvents_PendingCount(void);
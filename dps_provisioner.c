@@ -0,0 +1,210 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <applibs/application.h>
+#include <applibs/networking.h>
+
+#include <azure_prov_client/prov_device_ll_client.h>
+#include <azure_prov_client/prov_security_factory.h>
+#include <azure_prov_client/prov_transport_mqtt_client.h>
+#include <azure_prov_client/prov_transport_mqtt_ws_client.h>
+
+#include "app_log.h"
+#include "dps_provisioner.h"
+
+#define NANOSECONDS_PER_MILLISECOND 1000000l
+
+static const char DpsEndpoint[] = "global.azure-devices-provisioning.net";
+static const int DeviceIdForDaaCertUsage = 1; // Use the DAA certificate to authenticate
+static const long DoWorkPeriodMs = 100;
+
+static EventLoop* provisionerEventLoop = NULL;
+static EventRegistration* completionEventReg = NULL;
+static int completionEventFd = -1;
+static DpsProvisioningCompletedHandler completionHandler = NULL;
+
+// Written by the worker thread before it signals completionEventFd, and only read by the event
+// loop after it has joined the thread, so they need no lock.
+static pthread_t workerThread;
+static bool isRunning = false;
+static const char* workerScopeId = NULL;
+static unsigned int workerTimeoutMs = 0;
+static bool isWorkerWebSockets = false;
+static AZURE_SPHERE_PROV_RETURN_VALUE workerResult;
+static char workerHubHostName[DPS_PROVISIONER_MAX_HOST_NAME_LENGTH + 1];
+
+// Only used on the worker thread, while Prov_Device_LL_DoWork runs.
+static bool isRegistrationComplete = false;
+static PROV_DEVICE_RESULT registrationResult = PROV_DEVICE_RESULT_ERROR;
+
+static void RegisterDeviceCallback(PROV_DEVICE_RESULT result, const char* hubHostName,
+    const char* deviceId, void* context)
+{
+    isRegistrationComplete = true;
+    registrationResult = result;
+    if (result == PROV_DEVICE_RESULT_OK) {
+        if (hubHostName == NULL || strlen(hubHostName) > DPS_PROVISIONER_MAX_HOST_NAME_LENGTH) {
+            registrationResult = PROV_DEVICE_RESULT_HUB_NOT_SPECIFIED;
+            return;
+        }
+        strcpy(workerHubHostName, hubHostName);
+    }
+}
+
+// Register with DPS, driving the provisioning client until it completes or times out.
+static AZURE_SPHERE_PROV_RETURN_VALUE Provision(void)
+{
+    AZURE_SPHERE_PROV_RETURN_VALUE result = { .result = AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR,
+                                              .prov_device_error = PROV_DEVICE_RESULT_OK };
+    bool isReady = false;
+    if (Networking_IsNetworkingReady(&isReady) == -1 || !isReady) {
+        result.result = AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY;
+        return result;
+    }
+    if (Application_IsDeviceAuthReady(&isReady) == -1 || !isReady) {
+        result.result = AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY;
+        return result;
+    }
+
+    if (prov_dev_security_init(SECURE_DEVICE_TYPE_X509) != 0) {
+        return result;
+    }
+
+    PROV_DEVICE_LL_HANDLE provHandle = Prov_Device_LL_Create(DpsEndpoint, workerScopeId,
+        isWorkerWebSockets ? Prov_Device_MQTT_WS_Protocol : Prov_Device_MQTT_Protocol);
+    if (provHandle == NULL) {
+        goto cleanup;
+    }
+
+    PROV_DEVICE_RESULT provResult =
+        Prov_Device_LL_SetOption(provHandle, "SetDeviceId", &DeviceIdForDaaCertUsage);
+    if (provResult == PROV_DEVICE_RESULT_OK) {
+        isRegistrationComplete = false;
+        provResult = Prov_Device_LL_Register_Device(provHandle, &RegisterDeviceCallback, NULL,
+            NULL, NULL);
+    }
+    if (provResult == PROV_DEVICE_RESULT_OK) {
+        const struct timespec doWorkPeriod = { .tv_sec = 0,
+                                               .tv_nsec = DoWorkPeriodMs *
+                                                          NANOSECONDS_PER_MILLISECOND };
+        for (long elapsedMs = 0; !isRegistrationComplete && elapsedMs < (long)workerTimeoutMs;
+             elapsedMs += DoWorkPeriodMs) {
+            Prov_Device_LL_DoWork(provHandle);
+            nanosleep(&doWorkPeriod, NULL);
+        }
+        provResult = isRegistrationComplete ? registrationResult : PROV_DEVICE_RESULT_TIMEOUT;
+    }
+
+    if (provResult == PROV_DEVICE_RESULT_OK) {
+        result.result = AZURE_SPHERE_PROV_RESULT_OK;
+    }
+    else {
+        result.result = AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR;
+        result.prov_device_error = provResult;
+    }
+
+    Prov_Device_LL_Destroy(provHandle);
+
+cleanup:
+    prov_dev_security_deinit();
+    return result;
+}
+
+static void* ProvisioningThread(void* context)
+{
+    workerResult = Provision();
+
+    // Wake the event loop. The counter cannot overflow, as there is one attempt at a time.
+    uint64_t one = 1;
+    if (write(completionEventFd, &one, sizeof(one)) == -1) {
+        LOG_ERROR("ERROR: Could not signal provisioning completion: %s (%d).\n", strerror(errno),
+            errno);
+    }
+    return NULL;
+}
+
+static void CompletionEventHandler(EventLoop* el, int fd, EventLoop_IoEvents events,
+    void* context)
+{
+    uint64_t count;
+    if (read(completionEventFd, &count, sizeof(count)) == -1 || !isRunning) {
+        return;
+    }
+
+    // Join first, so that a new attempt can be started from the handler.
+    pthread_join(workerThread, NULL);
+    isRunning = false;
+    completionHandler(workerResult,
+        workerResult.result == AZURE_SPHERE_PROV_RESULT_OK ? workerHubHostName : NULL);
+}
+
+int DpsProvisioner_Init(EventLoop* eventLoop, DpsProvisioningCompletedHandler completedHandler)
+{
+    provisionerEventLoop = eventLoop;
+    completionHandler = completedHandler;
+
+    completionEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (completionEventFd == -1) {
+        return -1;
+    }
+
+    completionEventReg = EventLoop_RegisterIo(provisionerEventLoop, completionEventFd,
+        EventLoop_Input, &CompletionEventHandler, NULL);
+    if (completionEventReg == NULL) {
+        int error = errno;
+        DpsProvisioner_Dispose();
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+int DpsProvisioner_Start(const char* scopeId, unsigned int timeoutMs, bool isWebSockets)
+{
+    if (completionEventReg == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (isRunning) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    workerScopeId = scopeId;
+    workerTimeoutMs = timeoutMs;
+    isWorkerWebSockets = isWebSockets;
+    int result = pthread_create(&workerThread, NULL, &ProvisioningThread, NULL);
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+
+    isRunning = true;
+    return 0;
+}
+
+void DpsProvisioner_Dispose(void)
+{
+    if (isRunning) {
+        pthread_join(workerThread, NULL);
+        isRunning = false;
+    }
+
+    if (completionEventReg != NULL) {
+        EventLoop_UnregisterIo(provisionerEventLoop, completionEventReg);
+        completionEventReg = NULL;
+    }
+    if (completionEventFd != -1) {
+        close(completionEventFd);
+        completionEventFd = -1;
+    }
+}
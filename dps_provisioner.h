@@ -0,0 +1,53 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+
+#include <applibs/eventloop.h>
+
+#include <azure_sphere_provisioning.h>
+
+/// <summary>
+/// Longest IoT Hub hostname which provisioning can return.
+/// </summary>
+#define DPS_PROVISIONER_MAX_HOST_NAME_LENGTH 127
+
+/// <summary>
+/// Invoked on the event loop when provisioning has finished.
+/// </summary>
+/// <param name="result">Result of provisioning, reported in the same way as
+/// IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning.</param>
+/// <param name="hubHostName">Hostname of the IoT Hub to which DPS assigned the device if
+/// provisioning succeeded, otherwise NULL. Only valid during the call.</param>
+typedef void (*DpsProvisioningCompletedHandler)(AZURE_SPHERE_PROV_RETURN_VALUE result,
+    const char* hubHostName);
+
+/// <summary>
+/// Set up the provisioner. Registering with the Device Provisioning Service can block for many
+/// seconds, so it is run on a worker thread, and its result is posted back to the event loop
+/// through an eventfd. Only the assigned hub's hostname is returned, so that the caller can
+/// connect to that hub directly, and remember it to skip provisioning next time.
+/// </summary>
+/// <param name="eventLoop">Event loop on which the completion handler is invoked.</param>
+/// <param name="completedHandler">Callback to invoke when each provisioning attempt
+/// finishes.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int DpsProvisioner_Init(EventLoop* eventLoop, DpsProvisioningCompletedHandler completedHandler);
+
+/// <summary>
+/// Start provisioning on the worker thread, and return straight away.
+/// </summary>
+/// <param name="scopeId">DPS scope ID. Must remain valid until the attempt completes.</param>
+/// <param name="timeoutMs">Time the registration may take.</param>
+/// <param name="isWebSockets">Whether to register over MQTT over WebSockets, on port 443,
+/// rather than MQTT.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information. errno
+/// is EBUSY if an attempt is already in progress.</returns>
+int DpsProvisioner_Start(const char* scopeId, unsigned int timeoutMs, bool isWebSockets);
+
+/// <summary>
+/// Wait for any attempt in progress without invoking the handler, and free the eventfd. It is
+/// safe to call this function if <see cref="DpsProvisioner_Init" /> was not called or failed.
+/// </summary>
+void DpsProvisioner_Dispose(void);
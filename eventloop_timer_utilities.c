@@ -2,6 +2,7 @@
    Licensed under the MIT License. */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <errno.h>
@@ -14,37 +15,392 @@
 
 #include "eventloop_timer_utilities.h"
 
-static int SetTimerPeriod(int timerFd, const struct timespec* initial,
-    const struct timespec* repeat);
+// All timers share one timerfd, which is armed for the earliest expiry in a hierarchical timer
+// wheel. Each level has WHEEL_SLOTS slots, and each slot spans WHEEL_SLOTS times as many ticks as
+// a slot in the level below: a timer is kept in the lowest level whose window reaches its expiry,
+// and moves down a level whenever the wheel reaches the start of its slot. Adding, re-arming and
+// removing a timer therefore take constant time, however many timers there are.
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1u << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
 
-static int SetTimerPeriod(int timerFd, const struct timespec* initial,
-    const struct timespec* repeat)
+#define NANOSECONDS_PER_TICK 1000000ull // Timers expire on millisecond boundaries
+#define NANOSECONDS_PER_SECOND 1000000000ull
+#define NO_TICK UINT64_MAX
+#define UNKNOWN_TICK (UINT64_MAX - 1)
+
+typedef struct TimerLink {
+    struct TimerLink* prev;
+    struct TimerLink* next;
+} TimerLink;
+
+struct EventLoopTimer {
+    TimerLink link; // In a wheel slot or the due list while armed; must be first
+    EventLoopTimerHandler handler;
+    uint64_t expiryTick;
+    uint64_t periodTicks; // 0 for a one-shot timer
+    uint8_t level;
+    uint8_t slot;
+    bool isInUse;
+    bool isArmed;
+};
+
+static EventLoopTimer pool[EVENTLOOP_TIMER_POOL_SIZE];
+static size_t inUseCount = 0;
+
+static TimerLink wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint64_t occupiedSlots[WHEEL_LEVELS]; // Bit n is set if slot n is not empty
+static TimerLink dueList;                    // Expired timers whose handlers have not yet run
+static uint64_t wheelTick = 0;               // Tick up to which the wheel has been advanced
+
+static EventLoop* timerEventLoop = NULL;
+static int timerFd = -1;
+static EventRegistration* timerRegistration = NULL;
+static uint64_t armedTick = NO_TICK; // Tick for which timerFd is armed
+static bool isDispatching = false;
+
+static uint64_t NowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t ToNanoseconds(const struct timespec* value)
+{
+    return (uint64_t)value->tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)value->tv_nsec;
+}
+
+// A timer expires at the first tick boundary at or after its deadline.
+static uint64_t TicksAfter(uint64_t ns)
+{
+    return (ns + NANOSECONDS_PER_TICK - 1) / NANOSECONDS_PER_TICK;
+}
+
+static void InitList(TimerLink* head)
+{
+    head->prev = head;
+    head->next = head;
+}
+
+static bool IsListEmpty(const TimerLink* head)
+{
+    return head->next == head;
+}
+
+static void Append(TimerLink* head, TimerLink* link)
+{
+    link->prev = head->prev;
+    link->next = head;
+    head->prev->next = link;
+    head->prev = link;
+}
+
+// Move every timer from one list to the end of another, leaving the first empty.
+static void Splice(TimerLink* from, TimerLink* to)
+{
+    if (IsListEmpty(from)) {
+        return;
+    }
+    from->next->prev = to->prev;
+    from->prev->next = to;
+    to->prev->next = from->next;
+    to->prev = from->prev;
+    InitList(from);
+}
+
+static void InitWheel(void)
+{
+    for (size_t level = 0; level < WHEEL_LEVELS; level++) {
+        for (size_t slot = 0; slot < WHEEL_SLOTS; slot++) {
+            InitList(&wheel[level][slot]);
+        }
+        occupiedSlots[level] = 0;
+    }
+    InitList(&dueList);
+    wheelTick = NowNs() / NANOSECONDS_PER_TICK;
+}
+
+// Slot which holds a level's ticks from wheelTick onwards.
+static size_t CurrentSlot(size_t level)
+{
+    return (size_t)(wheelTick >> (level * WHEEL_SLOT_BITS)) & WHEEL_SLOT_MASK;
+}
+
+// Returns how many of a level's slots lie between wheelTick and the given tick.
+static uint64_t SlotsUntil(uint64_t tick, size_t level)
+{
+    size_t shift = level * WHEEL_SLOT_BITS;
+    return (tick >> shift) - (wheelTick >> shift);
+}
+
+// Returns the distance from a level's current slot to the next occupied slot, or WHEEL_SLOTS if
+// the level is empty.
+static size_t NextOccupiedDistance(size_t level)
+{
+    uint64_t occupied = occupiedSlots[level];
+    if (occupied == 0) {
+        return WHEEL_SLOTS;
+    }
+    size_t current = CurrentSlot(level);
+    uint64_t rotated =
+        current == 0 ? occupied : (occupied >> current) | (occupied << (WHEEL_SLOTS - current));
+    return (size_t)__builtin_ctzll(rotated);
+}
+
+static void Unlink(EventLoopTimer* timer)
+{
+    if (!timer->isArmed) {
+        return;
+    }
+    timer->link.prev->next = timer->link.next;
+    timer->link.next->prev = timer->link.prev;
+    timer->isArmed = false;
+
+    TimerLink* slot = &wheel[timer->level][timer->slot];
+    if (IsListEmpty(slot)) {
+        occupiedSlots[timer->level] &= ~(1ull << timer->slot);
+    }
+}
+
+// Put an armed timer in the lowest level whose window, relative to wheelTick, reaches its expiry.
+static void Insert(EventLoopTimer* timer)
+{
+    uint64_t expiry = timer->expiryTick > wheelTick ? timer->expiryTick : wheelTick;
+    size_t level = 0;
+    while (level < WHEEL_LEVELS - 1 && SlotsUntil(expiry, level) >= WHEEL_SLOTS) {
+        level++;
+    }
+
+    size_t slot;
+    if (SlotsUntil(expiry, level) >= WHEEL_SLOTS) {
+        // Beyond the top level: park in its furthest slot, and reinsert from there.
+        slot = (CurrentSlot(level) + WHEEL_SLOTS - 1) & WHEEL_SLOT_MASK;
+    }
+    else {
+        slot = (size_t)(expiry >> (level * WHEEL_SLOT_BITS)) & WHEEL_SLOT_MASK;
+    }
+
+    timer->level = (uint8_t)level;
+    timer->slot = (uint8_t)slot;
+    timer->isArmed = true;
+    Append(&wheel[level][slot], &timer->link);
+    occupiedSlots[level] |= 1ull << slot;
+}
+
+// Returns the next tick at which the wheel has work to do: a level 0 slot expiring, or a higher
+// level slot moving down.
+static uint64_t NextWheelTick(void)
+{
+    uint64_t next = NO_TICK;
+    for (size_t level = 0; level < WHEEL_LEVELS; level++) {
+        size_t distance = NextOccupiedDistance(level);
+        if (distance == WHEEL_SLOTS) {
+            continue;
+        }
+        size_t shift = level * WHEEL_SLOT_BITS;
+        uint64_t tick = distance == 0 ? wheelTick : ((wheelTick >> shift) + distance) << shift;
+        if (tick < next) {
+            next = tick;
+        }
+    }
+    return next;
+}
+
+// Returns the earliest expiry of any armed timer. Only the first occupied slot of each level
+// needs to be searched, as later slots hold later expiries.
+static uint64_t NextExpiryTick(void)
+{
+    if (!IsListEmpty(&dueList)) {
+        return wheelTick;
+    }
+
+    uint64_t next = NO_TICK;
+    for (size_t level = 0; level < WHEEL_LEVELS; level++) {
+        size_t distance = NextOccupiedDistance(level);
+        if (distance == WHEEL_SLOTS) {
+            continue;
+        }
+        TimerLink* head = &wheel[level][(CurrentSlot(level) + distance) & WHEEL_SLOT_MASK];
+        for (TimerLink* link = head->next; link != head; link = link->next) {
+            uint64_t expiry = ((EventLoopTimer*)link)->expiryTick;
+            if (expiry < next) {
+                next = expiry;
+            }
+        }
+    }
+    return next;
+}
+
+// Advance the wheel to the given tick, moving timers down the levels as their slots are reached,
+// and expired timers to the due list.
+static void AdvanceTo(uint64_t tick)
 {
-    static const struct timespec nullTimeSpec = { .tv_sec = 0, .tv_nsec = 0 };
-    struct itimerspec newValue = { .it_value = initial ? *initial : nullTimeSpec,
-                                  .it_interval = repeat ? *repeat : nullTimeSpec };
+    for (;;) {
+        uint64_t next = NextWheelTick();
+        if (next == NO_TICK || next > tick) {
+            break;
+        }
+        wheelTick = next;
 
-    if (timerfd_settime(timerFd, /* flags */ 0, &newValue, /* old_value */ NULL) == -1) {
+        for (size_t level = WHEEL_LEVELS - 1; level > 0; level--) {
+            size_t slot = CurrentSlot(level);
+            if ((occupiedSlots[level] & (1ull << slot)) == 0) {
+                continue;
+            }
+            TimerLink cascading;
+            InitList(&cascading);
+            Splice(&wheel[level][slot], &cascading);
+            occupiedSlots[level] &= ~(1ull << slot);
+            while (!IsListEmpty(&cascading)) {
+                EventLoopTimer* timer = (EventLoopTimer*)cascading.next;
+                cascading.next = timer->link.next;
+                cascading.next->prev = &cascading;
+                Insert(timer);
+            }
+        }
+
+        size_t slot = CurrentSlot(0);
+        Splice(&wheel[0][slot], &dueList);
+        occupiedSlots[0] &= ~(1ull << slot);
+    }
+    if (tick > wheelTick) {
+        wheelTick = tick;
+    }
+}
+
+// Arm the shared timerfd for the earliest expiry, or disarm it if no timer is armed.
+static int ArmTimerFd(void)
+{
+    if (isDispatching || timerFd == -1) {
+        return 0;
+    }
+
+    uint64_t tick = NextExpiryTick();
+    if (tick == armedTick) {
+        return 0;
+    }
+
+    // The deadline is absolute, so that it does not drift however long this call takes. A zero
+    // value would disarm the timer.
+    uint64_t deadlineNs = tick == NO_TICK ? 0 : tick * NANOSECONDS_PER_TICK;
+    struct itimerspec newValue = {
+        .it_value = { .tv_sec = (time_t)(deadlineNs / NANOSECONDS_PER_SECOND),
+                      .tv_nsec = (long)(deadlineNs % NANOSECONDS_PER_SECOND) },
+        .it_interval = { .tv_sec = 0, .tv_nsec = 0 } };
+    if (tick != NO_TICK && deadlineNs == 0) {
+        newValue.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &newValue, /* old_value */ NULL) == -1) {
         Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
+        armedTick = UNKNOWN_TICK;
         return -1;
     }
-
+    armedTick = tick;
     return 0;
 }
 
-struct EventLoopTimer {
-    EventLoop* eventLoop;
-    EventLoopTimerHandler handler;
-    int fd;
-    EventRegistration* registration;
-};
-
 // This satisfies the EventLoopIoCallback signature.
 static void TimerCallback(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
 {
-    EventLoopTimer* timer = (EventLoopTimer*)context;
+    uint64_t timerData = 0;
+    if (read(fd, &timerData, sizeof(timerData)) == -1 && errno != EAGAIN) {
+        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+    }
+    armedTick = UNKNOWN_TICK; // The timerfd has expired, so it is no longer armed
+
+    uint64_t nowTick = NowNs() / NANOSECONDS_PER_TICK;
+    AdvanceTo(nowTick);
 
-    timer->handler(timer);
+    // Handlers may arm, disarm or dispose of any timer, including those still due.
+    isDispatching = true;
+    while (!IsListEmpty(&dueList)) {
+        EventLoopTimer* timer = (EventLoopTimer*)dueList.next;
+        timer->link.prev->next = timer->link.next;
+        timer->link.next->prev = timer->link.prev;
+        timer->isArmed = false;
+
+        // Like a timerfd, a periodic timer which fell behind fires once for the missed periods.
+        if (timer->periodTicks != 0) {
+            uint64_t missed = (nowTick - timer->expiryTick) / timer->periodTicks;
+            timer->expiryTick += (missed + 1) * timer->periodTicks;
+            Insert(timer);
+        }
+        timer->handler(timer);
+    }
+    isDispatching = false;
+
+    ArmTimerFd();
+}
+
+static int OpenTimerFd(EventLoop* eventLoop)
+{
+    if (timerFd != -1) {
+        if (eventLoop != timerEventLoop) {
+            // All timers share one timerfd, which can only be registered with one event loop.
+            errno = EINVAL;
+            return -1;
+        }
+        return 0;
+    }
+
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timerFd == -1) {
+        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    timerRegistration =
+        EventLoop_RegisterIo(eventLoop, timerFd, EventLoop_Input, TimerCallback, NULL);
+    if (timerRegistration == NULL) {
+        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
+        close(timerFd);
+        timerFd = -1;
+        return -1;
+    }
+
+    timerEventLoop = eventLoop;
+    armedTick = NO_TICK;
+    InitWheel();
+    return 0;
+}
+
+static void CloseTimerFd(void)
+{
+    if (timerFd == -1) {
+        return;
+    }
+    EventLoop_UnregisterIo(timerEventLoop, timerRegistration);
+    close(timerFd);
+    timerFd = -1;
+    timerRegistration = NULL;
+    timerEventLoop = NULL;
+}
+
+// Arm a timer to expire after initial, then every repeat, or disarm it if initial is NULL or
+// zero, as timerfd_settime does.
+static int SetTimerPeriod(EventLoopTimer* timer, const struct timespec* initial,
+    const struct timespec* repeat)
+{
+    Unlink(timer);
+    if (initial == NULL || ToNanoseconds(initial) == 0) {
+        return ArmTimerFd();
+    }
+
+    // Keep the wheel current, so that the timer goes in the lowest level it can. Outside
+    // dispatch, any timers which this finds expired are run by the next TimerCallback.
+    uint64_t nowNs = NowNs();
+    if (!isDispatching) {
+        AdvanceTo(nowNs / NANOSECONDS_PER_TICK);
+    }
+
+    uint64_t repeatNs = repeat != NULL ? ToNanoseconds(repeat) : 0;
+    timer->expiryTick = TicksAfter(nowNs + ToNanoseconds(initial));
+    timer->periodTicks = repeatNs != 0 ? TicksAfter(repeatNs) : 0;
+    Insert(timer);
+    return ArmTimerFd();
 }
 
 EventLoopTimer* CreateEventLoopPeriodicTimer(EventLoop* eventLoop, EventLoopTimerHandler handler,
@@ -55,40 +411,34 @@ EventLoopTimer* CreateEventLoopPeriodicTimer(EventLoop* eventLoop, EventLoopTime
         return NULL;
     }
 
-    EventLoopTimer* timer = malloc(sizeof(EventLoopTimer));
+    EventLoopTimer* timer = NULL;
+    for (size_t i = 0; timer == NULL && i < EVENTLOOP_TIMER_POOL_SIZE; i++) {
+        if (!pool[i].isInUse) {
+            timer = &pool[i];
+        }
+    }
     if (timer == NULL) {
+        Log_Debug("ERROR: All %d event loop timers are in use.\n", EVENTLOOP_TIMER_POOL_SIZE);
+        errno = ENOMEM;
         return NULL;
     }
 
-    timer->eventLoop = eventLoop;
-    timer->handler = handler;
-
-    // Initialize to unused values in case have to clean up partially initialized object.
-    timer->fd = -1;
-    timer->registration = NULL;
-
-    timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    if (timer->fd == -1) {
-        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
-        goto failed;
+    if (OpenTimerFd(eventLoop) == -1) {
+        return NULL;
     }
 
-    if (SetTimerPeriod(timer->fd, /* initial */ period, /* repeat */ period) == -1) {
-        goto failed;
-    }
+    timer->isInUse = true;
+    timer->isArmed = false;
+    timer->handler = handler;
+    timer->periodTicks = 0;
+    inUseCount++;
 
-    timer->registration =
-        EventLoop_RegisterIo(eventLoop, timer->fd, EventLoop_Input, TimerCallback, timer);
-    if (timer->registration == NULL) {
-        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
-        goto failed;
+    if (SetTimerPeriod(timer, /* initial */ period, /* repeat */ period) == -1) {
+        DisposeEventLoopTimer(timer);
+        return NULL;
     }
 
     return timer;
-
-failed:
-    DisposeEventLoopTimer(timer);
-    return NULL;
 }
 
 EventLoopTimer* CreateEventLoopDisarmedTimer(EventLoop* eventLoop, EventLoopTimerHandler handler)
@@ -98,25 +448,25 @@ EventLoopTimer* CreateEventLoopDisarmedTimer(EventLoop* eventLoop, EventLoopTime
 
 void DisposeEventLoopTimer(EventLoopTimer* timer)
 {
-    if (timer == NULL) {
+    if (timer == NULL || !timer->isInUse) {
         return;
     }
 
-    EventLoop_UnregisterIo(timer->eventLoop, timer->registration);
-
-    if (timer->fd != -1) {
-        close(timer->fd);
+    Unlink(timer);
+    timer->isInUse = false;
+    if (--inUseCount == 0) {
+        CloseTimerFd();
+    }
+    else {
+        ArmTimerFd();
     }
-
-    free(timer);
 }
 
 int ConsumeEventLoopTimerEvent(EventLoopTimer* timer)
 {
-    uint64_t timerData = 0;
-
-    if (read(timer->fd, &timerData, sizeof(timerData)) == -1) {
-        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+    // The shared timerfd is read before handlers run, so there is nothing left to consume.
+    if (timer == NULL || !timer->isInUse) {
+        errno = EINVAL;
         return -1;
     }
 
@@ -125,15 +475,15 @@ int ConsumeEventLoopTimerEvent(EventLoopTimer* timer)
 
 int SetEventLoopTimerPeriod(EventLoopTimer* timer, const struct timespec* period)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ period, /* repeat */ period);
+    return SetTimerPeriod(timer, /* initial */ period, /* repeat */ period);
 }
 
 int SetEventLoopTimerOneShot(EventLoopTimer* timer, const struct timespec* delay)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ delay, /* repeat */ NULL);
+    return SetTimerPeriod(timer, /* initial */ delay, /* repeat */ NULL);
 }
 
 int DisarmEventLoopTimer(EventLoopTimer* timer)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ NULL, /* repeat */ NULL);
-}
\ No newline at end of file
+    return SetTimerPeriod(timer, /* initial */ NULL, /* repeat */ NULL);
+}
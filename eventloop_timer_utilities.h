@@ -5,6 +5,14 @@
 
 #include <applibs/eventloop.h>
 
+/// <summary>
+/// Number of timers which can exist at once. Timers come from a static pool and share a single
+/// timerfd, which is armed for the earliest expiry in a hierarchical timer wheel, so each timer
+/// costs neither a heap allocation nor a file descriptor, and one wake serves all the timers
+/// which expire together. Timers expire on millisecond boundaries.
+/// </summary>
+#define EVENTLOOP_TIMER_POOL_SIZE 8
+
 /// <summary>
 /// Opaque handle. Obtain via <see cref="CreateEventLoopPeriodicTimer" />
 /// or <see cref="CreateEventLoopDisarmedTimer" /> and dispose of via
@@ -25,12 +33,14 @@ typedef void (*EventLoopTimerHandler)(EventLoopTimer* timer);
 /// Create a periodic timer which is invoked on the event loop. The timer
 /// will begin firing immediately.
 /// </summary>
-/// <param name="eventLoop">Event loop to which the timer will be added.</param>
+/// <param name="eventLoop">Event loop to which the timer will be added. All timers which exist
+/// at once must use the same event loop.</param>
 /// <param name="handler">Callback to invoke when the timer expires.</param>
 /// <param name="period">Timer period.</param>
 /// <returns>On success, pointer to new EventLoopTimer, which should be disposed of
 /// with <see cref="DisposeEventLoopTimer" />. On failure, returns NULL, with more
-/// information available in errno.</returns>.
+/// information available in errno: ENOMEM if all EVENTLOOP_TIMER_POOL_SIZE timers are in
+/// use.</returns>.
 EventLoopTimer* CreateEventLoopPeriodicTimer(EventLoop* eventLoop, EventLoopTimerHandler handler,
     const struct timespec* period);
 
@@ -55,7 +65,9 @@ EventLoopTimer* CreateEventLoopDisarmedTimer(EventLoop* eventLoop, EventLoopTime
 void DisposeEventLoopTimer(EventLoopTimer* timer);
 
 /// <summary>
-/// The timer callback should call this function to consume the timer event.
+/// The timer callback should call this function to consume the timer event. The shared timerfd
+/// is consumed before callbacks are invoked, so this only checks the timer; it is kept so that
+/// callbacks written for one timerfd per timer still work.
 /// </summary>
 /// <param name="timer">Successfully allocated timer.</param>
 /// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
@@ -0,0 +1,97 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "glucose_alerts.h"
+
+static GlucoseAlertThresholds alertThresholds;
+static GlucoseAlertLevel alertLevel = GlucoseAlert_None;
+static GlucoseAlertChangedHandler changeHandler = NULL;
+
+static bool AreThresholdsValid(const GlucoseAlertThresholds* thresholds)
+{
+    // Widen, so that extreme thresholds cannot overflow.
+    int64_t lowClear = (int64_t)thresholds->lowHundredths + thresholds->hysteresisHundredths;
+    int64_t highClear = (int64_t)thresholds->highHundredths - thresholds->hysteresisHundredths;
+    return thresholds->hysteresisHundredths >= 0 && lowClear < highClear;
+}
+
+int GlucoseAlerts_Init(const GlucoseAlertThresholds* thresholds,
+    GlucoseAlertChangedHandler changedHandler)
+{
+    if (changedHandler == NULL || !AreThresholdsValid(thresholds)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    alertThresholds = *thresholds;
+    alertLevel = GlucoseAlert_None;
+    changeHandler = changedHandler;
+    return 0;
+}
+
+int GlucoseAlerts_SetThresholds(const GlucoseAlertThresholds* thresholds)
+{
+    if (!AreThresholdsValid(thresholds)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    alertThresholds = *thresholds;
+    return 0;
+}
+
+void GlucoseAlerts_Evaluate(int32_t glucoseHundredths)
+{
+    int64_t level = glucoseHundredths;
+    GlucoseAlertLevel newLevel = alertLevel;
+
+    switch (alertLevel) {
+    case GlucoseAlert_Low:
+        if (level >= (int64_t)alertThresholds.lowHundredths + alertThresholds.hysteresisHundredths) {
+            newLevel = GlucoseAlert_None;
+        }
+        break;
+    case GlucoseAlert_High:
+        if (level <=
+            (int64_t)alertThresholds.highHundredths - alertThresholds.hysteresisHundredths) {
+            newLevel = GlucoseAlert_None;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // A level can also move straight from one alert to the other, or into one on clearing.
+    if (level < alertThresholds.lowHundredths) {
+        newLevel = GlucoseAlert_Low;
+    }
+    else if (level > alertThresholds.highHundredths) {
+        newLevel = GlucoseAlert_High;
+    }
+
+    if (newLevel != alertLevel) {
+        alertLevel = newLevel;
+        changeHandler(alertLevel, glucoseHundredths);
+    }
+}
+
+GlucoseAlertLevel GlucoseAlerts_Level(void)
+{
+    return alertLevel;
+}
+
+const char* GlucoseAlerts_LevelName(GlucoseAlertLevel level)
+{
+    switch (level) {
+    case GlucoseAlert_Low:
+        return "Low";
+    case GlucoseAlert_High:
+        return "High";
+    default:
+        return "None";
+    }
+}
@@ -0,0 +1,66 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdint.h>
+
+/// <summary>
+/// Alert raised by <see cref="GlucoseAlerts_Evaluate" />.
+/// </summary>
+typedef enum {
+    GlucoseAlert_None = 0, // Within range
+    GlucoseAlert_Low = 1,  // Below the low threshold: hypoglycemia
+    GlucoseAlert_High = 2  // Above the high threshold: hyperglycemia
+} GlucoseAlertLevel;
+
+/// <summary>
+/// Alert thresholds, in hundredths. An alert is raised as soon as a level crosses its threshold,
+/// and only cleared once the level is back inside the threshold by the hysteresis, so that a
+/// level hovering at a threshold does not raise and clear it repeatedly.
+/// </summary>
+typedef struct {
+    int32_t lowHundredths;
+    int32_t highHundredths;
+    int32_t hysteresisHundredths;
+} GlucoseAlertThresholds;
+
+/// <summary>
+/// Invoked when the alert level changes.
+/// </summary>
+/// <param name="level">New alert level.</param>
+/// <param name="glucoseHundredths">Level which caused the change.</param>
+typedef void (*GlucoseAlertChangedHandler)(GlucoseAlertLevel level, int32_t glucoseHundredths);
+
+/// <summary>
+/// Set up alerting with no alert raised.
+/// </summary>
+/// <param name="thresholds">Initial thresholds. Copied.</param>
+/// <param name="changedHandler">Callback to invoke when the alert level changes.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int GlucoseAlerts_Init(const GlucoseAlertThresholds* thresholds,
+    GlucoseAlertChangedHandler changedHandler);
+
+/// <summary>
+/// Change the thresholds. A raised alert stays raised until a level clears the new thresholds.
+/// </summary>
+/// <param name="thresholds">New thresholds. Copied.</param>
+/// <returns>0 on success, or -1 with errno set to EINVAL if the hysteresis is negative, or the
+/// bands within the hysteresis of the two thresholds overlap.</returns>
+int GlucoseAlerts_SetThresholds(const GlucoseAlertThresholds* thresholds);
+
+/// <summary>
+/// Check a level against the thresholds, and invoke the changed handler if it changes the alert.
+/// This is cheap enough to call for every decimated sample.
+/// </summary>
+/// <param name="glucoseHundredths">Level, in hundredths.</param>
+void GlucoseAlerts_Evaluate(int32_t glucoseHundredths);
+
+/// <summary>
+/// Returns the alert currently raised.
+/// </summary>
+GlucoseAlertLevel GlucoseAlerts_Level(void);
+
+/// <summary>
+/// Returns the name of an alert level, as sent in alert telemetry.
+/// </summary>
+const char* GlucoseAlerts_LevelName(GlucoseAlertLevel level);
@@ -1,19 +1,24 @@
 /* Copyright (c) Group Romeo 2021. All rights reserved.
    Licensed under the MIT License. */
 
-#define PumpOutputPin SAMPLE_NRF52_UART
-
 static void TerminationHandler(int signalNumber);
+static ExitCode InitRealTimeCore(void);
+static void RealTimeSamplesReceived(uint32_t firstSampleIndex, const uint16_t* samples,
+    size_t count, unsigned int bitCount);
+static void RealTimeDoseCompleted(uint32_t doseId, int32_t doseHundredths, uint32_t durationMs);
+static void RealTimeDoseRejected(uint32_t doseId);
+static void RealTimeCoreFailed(void);
 static int adcControllerFd = -1;
-static EventLoopTimer* insulinToInject = NULL;
+static int pumpGpioFd = -1;
+static uint32_t nextRealTimeSampleIndex = 0;
+static const IntercoreHandlers realTimeHandlers = {
+    .samplesReceived = RealTimeSamplesReceived,
+    .doseCompleted = RealTimeDoseCompleted,
+    .doseRejected = RealTimeDoseRejected,
+    .failed = RealTimeCoreFailed };
 
 int main(int argc, char* argv[]) {
-    Log_Debug("Azure IoT Application starting.\n");
-
-    bool isNetworkingReady = false;
-    if ((Networking_IsNetworkingReady(&isNetworkingReady) == -1) || !isNetworkingReady) {
-        Log_Debug("WARNING: Network is not ready. Device cannot connect until network is ready.\n");
-    }
+    LOG_INFO("Azure IoT Application starting.\n");
 
     ParseCommandLineArguments(argc, argv);
 
@@ -22,13 +27,8 @@ int main(int argc, char* argv[]) {
         return exitCode;
     }
 
-    if (connectionType == ConnectionType_IoTEdge) {
-        exitCode = ReadIoTEdgeCaCertContent();
-        if (exitCode != ExitCode_Success) {
-            return exitCode;
-        }
-    }
-
+    // Only what sampling, dosing and alerts need is set up before the main loop; the startup job
+    // brings up the rest once the first reading has been taken.
     exitCode = InitPeripheralsAndHandlers();
 
     // Main loop
@@ -42,14 +42,15 @@ int main(int argc, char* argv[]) {
 
     ClosePeripheralsAndHandlers();
 
-    Log_Debug("Application exiting.\n");
+    LOG_INFO("Application exiting.\n");
 
     return exitCode;
 }
 
-// Set up SIGTERM termination handler, initialize peripherals, and set up event handlers.
-// Return ExitCode_Success if all resources were allocated successfully; otherwise return
-// another ExitCode value to indicate the specific failure.
+// Set up SIGTERM termination handler, initialize the peripherals and handlers which sampling,
+// dosing and alerts need, and schedule the startup job for everything else. Return
+// ExitCode_Success if all resources were allocated successfully; otherwise return another
+// ExitCode value to indicate the specific failure.
 static ExitCode InitPeripheralsAndHandlers(void) {
     struct sigaction action;
     memset(&action, 0, sizeof(struct sigaction));
@@ -58,171 +59,234 @@ static ExitCode InitPeripheralsAndHandlers(void) {
 
     eventLoop = EventLoop_Create();
     if (eventLoop == NULL) {
-        Log_Debug("Could not create event loop.\n");
+        LOG_ERROR("Could not create event loop.\n");
         return ExitCode_Init_EventLoop;
     }
 
-    // Open SAMPLE_BUTTON_1 GPIO as input
-    Log_Debug("Opening SAMPLE_BUTTON_1 as input.\n");
-    sendMessageButtonGpioFd = GPIO_OpenAsInput(SAMPLE_BUTTON_1);
-    if (sendMessageButtonGpioFd == -1) {
-        Log_Debug("ERROR: Could not open SAMPLE_BUTTON_1: %s (%d).\n", strerror(errno), errno);
-        return ExitCode_Init_MessageButton;
-    }
-
     // SAMPLE_LED is used to show Device Twin settings state
-    Log_Debug("Opening SAMPLE_LED as output.\n");
+    LOG_DEBUG("Opening SAMPLE_LED as output.\n");
     deviceTwinStatusLedGpioFd =
         GPIO_OpenAsOutput(SAMPLE_LED, GPIO_OutputMode_PushPull, GPIO_Value_High);
     if (deviceTwinStatusLedGpioFd == -1) {
-        Log_Debug("ERROR: Could not open SAMPLE_LED: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("ERROR: Could not open SAMPLE_LED: %s (%d).\n", strerror(errno), errno);
         return ExitCode_Init_TwinStatusLed;
     }
 
-    // Open the ADC controller
-    adcControllerFd = ADC_Open(SAMPLE_POTENTIOMETER_ADC_CONTROLLER);
-    if (adcControllerFd == -1) {
-        Log_Debug("ADC_Open failed with error: %s (%d)\n", strerror(errno), errno);
-        return ExitCode_Init_AdcOpen;
+    // SAMPLE_RGBLED_GREEN completes the RGB LED used to show glucose alerts
+    LOG_DEBUG("Opening SAMPLE_RGBLED_GREEN as output.\n");
+    alertGreenLedGpioFd =
+        GPIO_OpenAsOutput(SAMPLE_RGBLED_GREEN, GPIO_OutputMode_PushPull, GPIO_Value_High);
+    if (alertGreenLedGpioFd == -1) {
+        LOG_ERROR("ERROR: Could not open SAMPLE_RGBLED_GREEN: %s (%d).\n", strerror(errno),
+            errno);
+        return ExitCode_Init_AlertLed;
     }
 
-    // Get the sample bit count for the ADC controller
-    sampleBitCount = ADC_GetSampleBitCount(adcControllerFd, SAMPLE_POTENTIOMETER_ADC_CHANNEL);
-    if (sampleBitCount == -1) {
-        Log_Debug("ADC_GetSampleBitCount failed with error : %s (%d)\n", strerror(errno), errno);
-        return ExitCode_Init_GetBitCount;
+    // The sample job, or the sampler thread, oversamples the ADC into the channels' sample rings,
+    // independently of the connectivity jobs.
+    ExitCode channelsExitCode = InitSensorChannels();
+    if (channelsExitCode != ExitCode_Success) {
+        return channelsExitCode;
     }
-    if (sampleBitCount == 0) {
-        Log_Debug("ADC_GetSampleBitCount returned sample size of 0 bits.\n");
-        return ExitCode_Init_UnexpectedBitCount;
+    JsonArena_Install();
+
+    if (simulatedTracePath != NULL) {
+        LOG_WARNING("WARNING: Ignoring --SimulatedTrace on real hardware.\n");
     }
 
-    int result = ADC_SetReferenceVoltage(adcControllerFd, SAMPLE_POTENTIOMETER_ADC_CHANNEL,
-        sampleMaxVoltage);
-    if (result == -1) {
-        Log_Debug("ADC_SetReferenceVoltage failed with error : %s (%d)\n", strerror(errno), errno);
-        return ExitCode_Init_SetRefVoltage;
+    // Either the real-time core owns the ADC and the pump, or they are driven from here.
+    if (realTimeComponentId != NULL) {
+        if (isSamplerThreaded) {
+            LOG_WARNING("WARNING: Ignoring --Sampler Thread, as the real-time core samples.\n");
+            isSamplerThreaded = false;
+        }
+        ExitCode realTimeExitCode = InitRealTimeCore();
+        if (realTimeExitCode != ExitCode_Success) {
+            return realTimeExitCode;
+        }
     }
+    else {
+        // Open the ADC controller
+        adcControllerFd = ADC_Open(SAMPLE_POTENTIOMETER_ADC_CONTROLLER);
+        if (adcControllerFd == -1) {
+            LOG_ERROR("ADC_Open failed with error: %s (%d)\n", strerror(errno), errno);
+            return ExitCode_Init_AdcOpen;
+        }
 
-    // Open the pins which will be used for the insulin pump
-    Log_Debug("Opening pin for insulin pump as output.\n");
-    deviceStatusPumpGpioFd =
-        GPIO_OpenAsOutput(PumpOutputPin, GPIO_OutputMode_OpenSource, GPIO_Value_Low);
-    if (deviceStatusPumpGpioFd == -1) {
-        Log_Debug("ERROR: Could not open SAMPLE_LED: %s (%d).\n", strerror(errno), errno);
-        return ExitCode_Init_TwinStatusLed;
+        // Get the sample bit count and set the reference voltage of each channel
+        for (size_t i = 0; i < SensorChannel_Count; i++) {
+            int sampleBitCount =
+                ADC_GetSampleBitCount(adcControllerFd, SensorChannels_AdcChannel(i));
+            if (sampleBitCount == -1) {
+                LOG_ERROR("ADC_GetSampleBitCount failed for %s with error : %s (%d)\n",
+                    sensorChannels[i].name, strerror(errno), errno);
+                return ExitCode_Init_GetBitCount;
+            }
+            if (sampleBitCount == 0) {
+                LOG_ERROR("ADC_GetSampleBitCount returned sample size of 0 bits for %s.\n",
+                    sensorChannels[i].name);
+                return ExitCode_Init_UnexpectedBitCount;
+            }
+
+            int result = ADC_SetReferenceVoltage(adcControllerFd, SensorChannels_AdcChannel(i),
+                sampleMaxVoltage);
+            if (result == -1) {
+                LOG_ERROR("ADC_SetReferenceVoltage failed for %s with error : %s (%d)\n",
+                    sensorChannels[i].name, strerror(errno), errno);
+                return ExitCode_Init_SetRefVoltage;
+            }
+            SensorChannels_SetResolution(i, sampleBitCount, sampleMaxVoltage);
+        }
+
+        // Open the pin which drives the insulin pump, leaving the pump off.
+        LOG_DEBUG("Opening SAMPLE_INSULIN_PUMP as output.\n");
+        pumpGpioFd =
+            GPIO_OpenAsOutput(SAMPLE_INSULIN_PUMP, GPIO_OutputMode_PushPull, GPIO_Value_Low);
+        if (pumpGpioFd == -1) {
+            LOG_ERROR("ERROR: Could not open SAMPLE_INSULIN_PUMP: %s (%d).\n", strerror(errno),
+                errno);
+            return ExitCode_Init_PumpController;
+        }
+        ExitCode pumpExitCode = InitPumpController(pumpGpioFd);
+        if (pumpExitCode != ExitCode_Success) {
+            return pumpExitCode;
+        }
+    }
+
+    TelemetryBatch_Init(&telemetryBatch, batchSize);
+    OpenTelemetryStore();
+
+    ExitCode reportedPropertiesExitCode = InitReportedProperties();
+    if (reportedPropertiesExitCode != ExitCode_Success) {
+        return reportedPropertiesExitCode;
     }
+    RestoreCalibration();
 
-    // Set up a timer to poll for button events.
-    static const struct timespec buttonPressCheckPeriod = { .tv_sec = 0, .tv_nsec = 1000 * 1000 };
-    buttonPollTimer = CreateEventLoopPeriodicTimer(eventLoop, &ButtonPollTimerEventHandler,
-        &buttonPressCheckPeriod);
-    if (buttonPollTimer == NULL) {
-        return ExitCode_Init_ButtonPollTimer;
+    ExitCode alertsExitCode = InitGlucoseAlerts();
+    if (alertsExitCode != ExitCode_Success) {
+        return alertsExitCode;
     }
 
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = { .tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0 };
-    azureTimer =
-        CreateEventLoopPeriodicTimer(eventLoop, &AzureTimerEventHandler, &azureTelemetryPeriod);
-    if (azureTimer == NULL) {
-        return ExitCode_Init_AzureTimer;
+    ExitCode jobsExitCode = InitScheduledJobs();
+    if (jobsExitCode != ExitCode_Success) {
+        return jobsExitCode;
     }
 
     return ExitCode_Success;
 }
 
-// Close peripherals and event handlers.
-static void ClosePeripheralsAndHandlers(void) {
-    DisposeEventLoopTimer(buttonPollTimer);
-    DisposeEventLoopTimer(azureTimer);
-    DisposeEventLoopTimer(insulinToInject);
-    EventLoop_Close(eventLoop);
+// Connect to the real-time app which owns the ADC and the pump, and start it sampling.
+static ExitCode InitRealTimeCore(void) {
+    if (IntercoreClient_Connect(eventLoop, realTimeComponentId, &realTimeHandlers) == -1 ||
+        IntercoreClient_Configure((uint32_t)sampleRateHz, pumpMicrounitsPerMs) == -1) {
+        LOG_ERROR("ERROR: Could not start the real-time core: %s (%d).\n", strerror(errno),
+            errno);
+        return ExitCode_Init_RealTimeCore;
+    }
 
-    Log_Debug("Closing file descriptors\n");
+    return ExitCode_Success;
+}
 
-    // Leave the LEDs off
-    if (deviceTwinStatusLedGpioFd >= 0) {
-        GPIO_SetValue(deviceTwinStatusLedGpioFd, GPIO_Value_High);
+// A batch of raw ADC samples has arrived from the real-time core. They are pushed into the
+// glucose channel just as SampleJob would, so decimation and reporting are unchanged. The
+// real-time core only samples glucose, so no other channels are reported.
+static void RealTimeSamplesReceived(uint32_t firstSampleIndex, const uint16_t* samples,
+    size_t count, unsigned int bitCount) {
+    if (firstSampleIndex != nextRealTimeSampleIndex) {
+        LOG_WARNING("WARNING: Lost %u samples from the real-time core.\n",
+            (unsigned int)(firstSampleIndex - nextRealTimeSampleIndex));
     }
+    nextRealTimeSampleIndex = firstSampleIndex + (uint32_t)count;
 
-    CloseFdAndPrintError(sendMessageButtonGpioFd, "SendMessageButton");
-    CloseFdAndPrintError(deviceTwinStatusLedGpioFd, "StatusLed");
-    CloseFdAndPrintError(adcControllerFd, "ADC");
-    CloseFdAndPrintError(deviceStatusPumpGpioFd, "Pump");
+    if ((int)bitCount != SensorChannels_BitCount(SensorChannel_Glucose)) {
+        SensorChannels_SetResolution(SensorChannel_Glucose, (int)bitCount, sampleMaxVoltage);
+        ApplyCalibration();
+    }
+    for (size_t i = 0; i < count; i++) {
+        SensorChannels_PushSample(SensorChannel_Glucose, samples[i]);
+    }
+    EvaluateGlucoseAlerts();
 }
 
-// Send telemetry to Azure IoT Hub.
-void SendSimulatedTelemetry(void) {
-    static char telemetryBuffer[TELEMETRY_BUFFER_SIZE];
-
-    uint32_t value;
-    int result = ADC_Poll(adcControllerFd, SAMPLE_POTENTIOMETER_ADC_CHANNEL, &value);
-    if (result == -1) {
-        Log_Debug("ADC_Poll failed with error: %s (%d)\n", strerror(errno), errno);
-        exitCode = ExitCode_AdcTimerHandler_Poll;
-        return;
+// The real-time core has delivered a dose.
+static void RealTimeDoseCompleted(uint32_t doseId, int32_t doseHundredths, uint32_t durationMs) {
+    if (realTimeQueuedDoses > 0) {
+        realTimeQueuedDoses--;
     }
+    PumpDoseCompleted(doseId, doseHundredths, durationMs);
+}
 
-    int len =
-        snprintf(telemetryBuffer, TELEMETRY_BUFFER_SIZE, "{\"Glucose\":%3.2f}", voltage);
-    if (len < 0 || len >= TELEMETRY_BUFFER_SIZE) {
-        Log_Debug("ERROR: Cannot write telemetry to buffer.\n");
-        return;
+// The real-time core refused a dose which this app had accepted.
+static void RealTimeDoseRejected(uint32_t doseId) {
+    if (realTimeQueuedDoses > 0) {
+        realTimeQueuedDoses--;
     }
-    SendTelemetry(telemetryBuffer);
+    LOG_ERROR("ERROR: The real-time core rejected insulin dose %u.\n", (unsigned int)doseId);
+
+    DoseEvent event = { .type = DoseEvent_Rejected, .doseId = doseId };
+    QueueDoseEvent(&event);
 }
 
-// Callback invoked when a Direct Method is received from Azure IoT Hub.
-static int DeviceMethodCallback(const char* methodName, const unsigned char* payload,
-    size_t payloadSize, unsigned char** response, size_t* responseSize,
-    void* userContextCallback)
-{
-    int result;
-    char* responseString;
+// The channel to the real-time core has failed, so neither sampling nor the pump can be relied on.
+static void RealTimeCoreFailed(void) {
+    exitCode = ExitCode_RealTimeCore_Failed;
+}
+
+// Close peripherals and event handlers.
+static void ClosePeripheralsAndHandlers(void) {
+    SamplerThread_Stop();
+    IntercoreClient_Disconnect();
+    PumpController_Dispose();
+    ButtonMonitor_Dispose();
+    DpsProvisioner_Dispose();
+    ConnectivityMonitor_Dispose();
+    Scheduler_Dispose();
+    EventLoop_Close(eventLoop);
 
-    Log_Debug("Received Device Method callback: Method name %s.\n", methodName);
+    LOG_DEBUG("Closing file descriptors\n");
 
-    if (strcmp("TriggerAlarm", methodName) == 0) {
-        // Output alarm using Log_Debug
-        Log_Debug("Alarm triggered!\n");
-        responseString = "\"Alarm Triggered\""; // must be a JSON string (in quotes)
-        result = 200;
+    // Leave the LEDs off
+    if (deviceTwinStatusLedGpioFd >= 0) {
+        GPIO_SetValue(deviceTwinStatusLedGpioFd, GPIO_Value_High);
+    }
+    if (alertGreenLedGpioFd >= 0) {
+        GPIO_SetValue(alertGreenLedGpioFd, GPIO_Value_High);
     }
-    else if (strcmp("InjectInsulin", methodName) == 0) {
-        // Output insulin injection using log debug
-        int intPayload = atoi(payload);
-        Log_Debug("Injecting %d mg insulin\n", intPayload);
-        responseString = "\"Injecting insulin\""; // must be a JSON string (in quotes
 
-        // Inject the specified amount of insulin
-        GPIO_SetValue(deviceStatusPumpGpioFd, GPIO_Value_High);
-        CreateEventLoopDisarmedTimer(insulinToInject, InsulinTimerEventHandler);
-        SetEventLoopTimerOneShot(insulinToInject, intPayload);
+    CloseFdAndPrintError(sendMessageButtonGpioFd, "SendMessageButton");
+    CloseFdAndPrintError(takeReadingButtonGpioFd, "TakeReadingButton");
+    CloseFdAndPrintError(deviceTwinStatusLedGpioFd, "StatusLed");
+    CloseFdAndPrintError(alertGreenLedGpioFd, "AlertGreenLed");
+    CloseFdAndPrintError(mutableStorageFd, "MutableStorage");
+    CloseFdAndPrintError(adcControllerFd, "ADC");
+    CloseFdAndPrintError(pumpGpioFd, "Pump");
+}
 
-        result = 100;
-    }
-    else {
-        // All other method names are ignored
-        responseString = "{}";
-        result = -1;
+// Take one raw ADC sample of every channel. This runs on the sampler thread when it is used,
+// and only uses the ADC, which nothing else touches once it is set up.
+static int TakeSweep(uint32_t* outCounts) {
+    for (size_t i = 0; i < SensorChannel_Count; i++) {
+        int result = ADC_Poll(adcControllerFd, SensorChannels_AdcChannel(i), &outCounts[i]);
+        if (result == -1) {
+            LOG_ERROR("ADC_Poll failed for %s with error: %s (%d)\n", sensorChannels[i].name,
+                strerror(errno), errno);
+            return -1;
+        }
     }
+    return 0;
+}
 
-    // if 'response' is non-NULL, the Azure IoT library frees it after use, so copy it to heap
-    *responseSize = strlen(responseString);
-    *response = malloc(*responseSize);
-    memcpy(*response, responseString, *responseSize);
-    return result;
+// A real patient needs no telling that a dose has been delivered.
+static void SimulateInsulinAction(int32_t doseHundredths) {
 }
 
-// Insulin timer event: stop injecting insulin after enough has been injected.
-static void InsulinTimerEventHandler(EventLoopTimer* timer) {
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_AzureTimer_Consume;
+// Take a calibrated reading of every channel and pass it on to be reported to Azure IoT Hub.
+void SendSimulatedTelemetry(void) {
+    SensorChannelValues values;
+    if (!ReadSensorChannels(&values)) {
+        LOG_WARNING("WARNING: No ADC samples available yet. Not sending telemetry.\n");
         return;
     }
 
-    // Switch off the pump after it has injected enough insulin
-    GPIO_SetValue(deviceStatusPumpGpioFd, GPIO_Value_Low);
-    return;
-}
\ No newline at end of file
+    ReportGlucoseReading(&values);
+}
@@ -3,13 +3,34 @@
 
 static void TerminationHandler(int signalNumber);
 
-int main(int argc, char* argv[]) {
-    Log_Debug("Azure IoT Application starting.\n");
+// The simulated ADC behaves like a 12-bit converter with a 10 V reference, so that the
+// simulated signal can wander around its 5 V starting point without clipping.
+static const int SimulatedSampleBitCount = 12;
+static const float SimulatedMaxVoltage = 10.0f;
+
+// The other channels hold steady: a skin temperature of 36.60 degrees Celsius, and the
+// sensor's 2.5 V reference.
+static const uint32_t SimulatedTemperatureMillivolts = 866;
+static const uint32_t SimulatedReferenceMillivolts = 2500;
+
+// The sensor model works in hundredths of a volt, which read as hundredths of glucose. Each unit
+// of insulin lowers the level by up to 1.50, taking effect over 30 minutes.
+static const SimulatedSensorConfig simulatedSensorDefaults = {
+    .seed = 1,
+    .initialHundredths = 500,
+    .minHundredths = 0,
+    .maxHundredths = 1000,
+    .noiseHundredths = 10,
+    .insulinSensitivityHundredths = 150,
+    .insulinActionMs = 30 * 60 * 1000 };
+
+// Guards the sensor model, which the sampler thread samples while the event loop doses.
+static pthread_mutex_t simulatedSensorLock = PTHREAD_MUTEX_INITIALIZER;
+
+static ExitCode InitSimulatedSensor(void);
 
-    bool isNetworkingReady = false;
-    if ((Networking_IsNetworkingReady(&isNetworkingReady) == -1) || !isNetworkingReady) {
-        Log_Debug("WARNING: Network is not ready. Device cannot connect until network is ready.\n");
-    }
+int main(int argc, char* argv[]) {
+    LOG_INFO("Azure IoT Application starting.\n");
 
     ParseCommandLineArguments(argc, argv);
 
@@ -18,13 +39,8 @@ int main(int argc, char* argv[]) {
         return exitCode;
     }
 
-    if (connectionType == ConnectionType_IoTEdge) {
-        exitCode = ReadIoTEdgeCaCertContent();
-        if (exitCode != ExitCode_Success) {
-            return exitCode;
-        }
-    }
-
+    // Only what sampling, dosing and alerts need is set up before the main loop; the startup job
+    // brings up the rest once the first reading has been taken.
     exitCode = InitPeripheralsAndHandlers();
 
     // Main loop
@@ -38,14 +54,15 @@ int main(int argc, char* argv[]) {
 
     ClosePeripheralsAndHandlers();
 
-    Log_Debug("Application exiting.\n");
+    LOG_INFO("Application exiting.\n");
 
     return exitCode;
 }
 
-// Set up SIGTERM termination handler, initialize peripherals, and set up event handlers.
-// Return ExitCode_Success if all resources were allocated successfully; otherwise return
-// another ExitCode value to indicate the specific failure.
+// Set up SIGTERM termination handler, initialize the peripherals and handlers which sampling,
+// dosing and alerts need, and schedule the startup job for everything else. Return
+// ExitCode_Success if all resources were allocated successfully; otherwise return another
+// ExitCode value to indicate the specific failure.
 static ExitCode InitPeripheralsAndHandlers(void) {
     struct sigaction action;
     memset(&action, 0, sizeof(struct sigaction));
@@ -54,41 +71,76 @@ static ExitCode InitPeripheralsAndHandlers(void) {
 
     eventLoop = EventLoop_Create();
     if (eventLoop == NULL) {
-        Log_Debug("Could not create event loop.\n");
+        LOG_ERROR("Could not create event loop.\n");
         return ExitCode_Init_EventLoop;
     }
 
-    // Open SAMPLE_BUTTON_1 GPIO as input
-    Log_Debug("Opening SAMPLE_BUTTON_1 as input.\n");
-    sendMessageButtonGpioFd = GPIO_OpenAsInput(SAMPLE_BUTTON_1);
-    if (sendMessageButtonGpioFd == -1) {
-        Log_Debug("ERROR: Could not open SAMPLE_BUTTON_1: %s (%d).\n", strerror(errno), errno);
-        return ExitCode_Init_MessageButton;
-    }
-
     // SAMPLE_LED is used to show Device Twin settings state
-    Log_Debug("Opening SAMPLE_LED as output.\n");
+    LOG_DEBUG("Opening SAMPLE_LED as output.\n");
     deviceTwinStatusLedGpioFd =
         GPIO_OpenAsOutput(SAMPLE_LED, GPIO_OutputMode_PushPull, GPIO_Value_High);
     if (deviceTwinStatusLedGpioFd == -1) {
-        Log_Debug("ERROR: Could not open SAMPLE_LED: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("ERROR: Could not open SAMPLE_LED: %s (%d).\n", strerror(errno), errno);
         return ExitCode_Init_TwinStatusLed;
     }
 
-    // Set up a timer to poll for button events.
-    static const struct timespec buttonPressCheckPeriod = { .tv_sec = 0, .tv_nsec = 1000 * 1000 };
-    buttonPollTimer = CreateEventLoopPeriodicTimer(eventLoop, &ButtonPollTimerEventHandler,
-        &buttonPressCheckPeriod);
-    if (buttonPollTimer == NULL) {
-        return ExitCode_Init_ButtonPollTimer;
+    // SAMPLE_RGBLED_GREEN completes the RGB LED used to show glucose alerts
+    LOG_DEBUG("Opening SAMPLE_RGBLED_GREEN as output.\n");
+    alertGreenLedGpioFd =
+        GPIO_OpenAsOutput(SAMPLE_RGBLED_GREEN, GPIO_OutputMode_PushPull, GPIO_Value_High);
+    if (alertGreenLedGpioFd == -1) {
+        LOG_ERROR("ERROR: Could not open SAMPLE_RGBLED_GREEN: %s (%d).\n", strerror(errno),
+            errno);
+        return ExitCode_Init_AlertLed;
+    }
+
+    // The sample job, or the sampler thread, oversamples the simulated ADC into the channels'
+    // sample rings, independently of the connectivity jobs.
+    sampleMaxVoltage = SimulatedMaxVoltage;
+    ExitCode channelsExitCode = InitSensorChannels();
+    if (channelsExitCode != ExitCode_Success) {
+        return channelsExitCode;
+    }
+    for (size_t i = 0; i < SensorChannel_Count; i++) {
+        SensorChannels_SetResolution(i, SimulatedSampleBitCount, SimulatedMaxVoltage);
     }
+    JsonArena_Install();
 
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = { .tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0 };
-    azureTimer =
-        CreateEventLoopPeriodicTimer(eventLoop, &AzureTimerEventHandler, &azureTelemetryPeriod);
-    if (azureTimer == NULL) {
-        return ExitCode_Init_AzureTimer;
+    ExitCode sensorExitCode = InitSimulatedSensor();
+    if (sensorExitCode != ExitCode_Success) {
+        return sensorExitCode;
+    }
+
+    // There is no real-time core on the simulated hardware, so the simulated ADC and pump are
+    // always driven from here.
+    if (realTimeComponentId != NULL) {
+        LOG_WARNING("WARNING: Ignoring --RealTimeComponentId on simulated hardware.\n");
+        realTimeComponentId = NULL;
+    }
+
+    // There is no pump on the simulated hardware, so the pump controller only times doses.
+    ExitCode pumpExitCode = InitPumpController(-1);
+    if (pumpExitCode != ExitCode_Success) {
+        return pumpExitCode;
+    }
+
+    TelemetryBatch_Init(&telemetryBatch, batchSize);
+    OpenTelemetryStore();
+
+    ExitCode reportedPropertiesExitCode = InitReportedProperties();
+    if (reportedPropertiesExitCode != ExitCode_Success) {
+        return reportedPropertiesExitCode;
+    }
+    RestoreCalibration();
+
+    ExitCode alertsExitCode = InitGlucoseAlerts();
+    if (alertsExitCode != ExitCode_Success) {
+        return alertsExitCode;
+    }
+
+    ExitCode jobsExitCode = InitScheduledJobs();
+    if (jobsExitCode != ExitCode_Success) {
+        return jobsExitCode;
     }
 
     return ExitCode_Success;
@@ -96,70 +148,106 @@ static ExitCode InitPeripheralsAndHandlers(void) {
 
 // Close peripherals and event handlers.
 static void ClosePeripheralsAndHandlers(void) {
-    DisposeEventLoopTimer(buttonPollTimer);
-    DisposeEventLoopTimer(azureTimer);
+    SamplerThread_Stop();
+    PumpController_Dispose();
+    ButtonMonitor_Dispose();
+    DpsProvisioner_Dispose();
+    ConnectivityMonitor_Dispose();
+    Scheduler_Dispose();
     EventLoop_Close(eventLoop);
 
-    Log_Debug("Closing file descriptors\n");
+    LOG_DEBUG("Closing file descriptors\n");
 
     // Leave the LEDs off
     if (deviceTwinStatusLedGpioFd >= 0) {
         GPIO_SetValue(deviceTwinStatusLedGpioFd, GPIO_Value_High);
     }
+    if (alertGreenLedGpioFd >= 0) {
+        GPIO_SetValue(alertGreenLedGpioFd, GPIO_Value_High);
+    }
 
     CloseFdAndPrintError(sendMessageButtonGpioFd, "SendMessageButton");
+    CloseFdAndPrintError(takeReadingButtonGpioFd, "TakeReadingButton");
     CloseFdAndPrintError(deviceTwinStatusLedGpioFd, "StatusLed");
+    CloseFdAndPrintError(alertGreenLedGpioFd, "AlertGreenLed");
+    CloseFdAndPrintError(mutableStorageFd, "MutableStorage");
 }
 
-// Send telemetry to Azure IoT Hub.
-void SendSimulatedTelemetry(void) {
-    static char telemetryBuffer[TELEMETRY_BUFFER_SIZE];
+// Set up the sensor model, replaying the glucose trace if one was given.
+static ExitCode InitSimulatedSensor(void) {
+    SimulatedSensorConfig config = simulatedSensorDefaults;
+    config.seed = simulatedSeed;
+    if (SimulatedSensor_Init(&config) == -1) {
+        LOG_ERROR("ERROR: Could not set up the simulated sensor: %s (%d).\n", strerror(errno),
+            errno);
+        return ExitCode_Init_SimulatedSensor;
+    }
 
-    // Generate a simulated voltage.
-    float delta = ((float)(rand() % 41)) / 40.0f - 0.5f; // between -1.0 and +1.0
-    voltage += delta;
+    if (simulatedTracePath == NULL) {
+        return ExitCode_Success;
+    }
 
-    int len =
-        snprintf(telemetryBuffer, TELEMETRY_BUFFER_SIZE, "{\"Glucose\":%3.2f}", voltage);
-    if (len < 0 || len >= TELEMETRY_BUFFER_SIZE) {
-        Log_Debug("ERROR: Cannot write telemetry to buffer.\n");
-        return;
+    int traceFd = Storage_OpenFileInImagePackage(simulatedTracePath);
+    if (traceFd == -1) {
+        LOG_ERROR("ERROR: Could not open glucose trace %s: %s (%d).\n", simulatedTracePath,
+            strerror(errno), errno);
+        return ExitCode_Init_SimulatedSensor;
+    }
+    int result = SimulatedSensor_LoadTrace(traceFd);
+    int loadErrno = errno;
+    close(traceFd);
+    if (result == -1) {
+        LOG_ERROR("ERROR: Could not load glucose trace %s: %s (%d).\n", simulatedTracePath,
+            strerror(loadErrno), loadErrno);
+        return ExitCode_Init_SimulatedSensor;
     }
-    SendTelemetry(telemetryBuffer);
+
+    LOG_INFO("INFO: Replaying glucose trace %s.\n", simulatedTracePath);
+    return ExitCode_Success;
+}
+
+// Returns the raw count of the simulated ADC for a voltage.
+static uint32_t SimulatedCounts(uint32_t millivolts) {
+    uint32_t maxCounts = (1u << SimulatedSampleBitCount) - 1;
+    uint32_t fullScaleMillivolts = (uint32_t)(SimulatedMaxVoltage * 1000.0f + 0.5f);
+    return (uint32_t)(((uint64_t)millivolts * maxCounts + fullScaleMillivolts / 2) /
+        fullScaleMillivolts);
+}
+
+// Take one sample from the sensor model, as a sweep of raw ADC samples. This runs on the
+// sampler thread when it is used, so the model is locked against doses from the event loop.
+static int TakeSweep(uint32_t* outCounts) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t nowMs = (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / (1000 * 1000);
+
+    pthread_mutex_lock(&simulatedSensorLock);
+    int32_t glucoseHundredths = SimulatedSensor_Sample(nowMs);
+    pthread_mutex_unlock(&simulatedSensorLock);
+
+    outCounts[SensorChannel_Glucose] = SimulatedCounts((uint32_t)glucoseHundredths * 10);
+    outCounts[SensorChannel_Temperature] = SimulatedCounts(SimulatedTemperatureMillivolts);
+    outCounts[SensorChannel_Reference] = SimulatedCounts(SimulatedReferenceMillivolts);
+    return 0;
+}
+
+// The simulated patient responds to each dose as it is delivered.
+static void SimulateInsulinAction(int32_t doseHundredths) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t nowMs = (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / (1000 * 1000);
+    pthread_mutex_lock(&simulatedSensorLock);
+    SimulatedSensor_DeliverInsulin(nowMs, doseHundredths);
+    pthread_mutex_unlock(&simulatedSensorLock);
 }
 
-// Callback invoked when a Direct Method is received from Azure IoT Hub.
-static int DeviceMethodCallback(const char* methodName, const unsigned char* payload,
-    size_t payloadSize, unsigned char** response, size_t* responseSize,
-    void* userContextCallback)
-{
-    int result;
-    char* responseString;
-
-    Log_Debug("Received Device Method callback: Method name %s.\n", methodName);
-
-    if (strcmp("TriggerAlarm", methodName) == 0) {
-        // Output alarm using Log_Debug
-        Log_Debug("Alarm triggered!\n");
-        responseString = "\"Alarm Triggered\""; // must be a JSON string (in quotes)
-        result = 200;
-    }
-    else if (strcmp("InjectInsulin", methodName) == 0) {
-        // Output insulin injection using log debug
-        int intPayload = atoi(payload);
-        Log_Debug("Injecting %d mg insulin\n", intPayload);
-        responseString = "\"Injecting insulin\""; // must be a JSON string (in quotes)
-        result = 100;
-    }
-    else {
-        // All other method names are ignored
-        responseString = "{}";
-        result = -1;
-    }
-
-    // if 'response' is non-NULL, the Azure IoT library frees it after use, so copy it to heap
-    *responseSize = strlen(responseString);
-    *response = malloc(*responseSize);
-    memcpy(*response, responseString, *responseSize);
-    return result;
-}
\ No newline at end of file
+// Take a calibrated reading of every channel and pass it on to be reported to Azure IoT Hub.
+void SendSimulatedTelemetry(void) {
+    SensorChannelValues values;
+    if (!ReadSensorChannels(&values)) {
+        LOG_WARNING("WARNING: No ADC samples available yet. Not sending telemetry.\n");
+        return;
+    }
+
+    ReportGlucoseReading(&values);
+}
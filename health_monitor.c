@@ -0,0 +1,156 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <stddef.h>
+#include <time.h>
+
+#include "health_monitor.h"
+
+#define NANOSECONDS_PER_MILLISECOND 1000000ull
+
+// Upper bounds of all but the last lag bucket, in milliseconds.
+static const uint32_t LagBucketLimitsMs[HEALTH_MONITOR_LAG_BUCKETS - 1] = {1,  2,   5,  10,
+                                                                          50, 100, 500};
+
+// Queue time of a tracked message, or 0 if the slot is free.
+static uint64_t queuedNs[HEALTH_MONITOR_MAX_TRACKED_MESSAGES];
+
+static HealthStats stats;
+static uint64_t doWorkTotalNs = 0;
+static uint64_t sendLatencyTotalNs = 0;
+static uint32_t trackedConfirmations = 0;
+static uint64_t connectedNs = 0;      // Time connected, excluding the current connection
+static uint64_t connectedSinceNs = 0; // Start of the current connection, or 0 if disconnected
+
+static uint64_t NowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static uint32_t Saturate(uint64_t value)
+{
+    return value > UINT32_MAX ? UINT32_MAX : (uint32_t)value;
+}
+
+void HealthMonitor_RecordLoopLag(uint64_t lagNs)
+{
+    uint32_t lagMs = Saturate(lagNs / NANOSECONDS_PER_MILLISECOND);
+    size_t bucket = 0;
+    while (bucket < HEALTH_MONITOR_LAG_BUCKETS - 1 && lagMs >= LagBucketLimitsMs[bucket]) {
+        bucket++;
+    }
+    stats.loopLagCounts[bucket]++;
+    if (lagMs > stats.loopLagMaxMs) {
+        stats.loopLagMaxMs = lagMs;
+    }
+}
+
+void HealthMonitor_RecordDoWork(uint64_t durationNs)
+{
+    uint32_t durationUs = Saturate(durationNs / 1000);
+    stats.doWorkCount++;
+    doWorkTotalNs += durationNs;
+    if (durationUs > stats.doWorkMaxUs) {
+        stats.doWorkMaxUs = durationUs;
+    }
+}
+
+void* HealthMonitor_MessageQueued(void)
+{
+    stats.pendingMessages++;
+    if (stats.pendingMessages > stats.pendingHighWater) {
+        stats.pendingHighWater = stats.pendingMessages;
+    }
+
+    for (size_t i = 0; i < HEALTH_MONITOR_MAX_TRACKED_MESSAGES; i++) {
+        if (queuedNs[i] == 0) {
+            uint64_t now = NowNs();
+            queuedNs[i] = now != 0 ? now : 1;
+            return &queuedNs[i];
+        }
+    }
+    return NULL;
+}
+
+void HealthMonitor_MessageConfirmed(void* context, bool isSuccess)
+{
+    if (stats.pendingMessages > 0) {
+        stats.pendingMessages--;
+    }
+    if (isSuccess) {
+        stats.messagesConfirmed++;
+    }
+    else {
+        stats.messagesFailed++;
+    }
+
+    uint64_t* queued = context;
+    if (queued == NULL) {
+        return;
+    }
+    uint64_t latencyNs = NowNs() - *queued;
+    *queued = 0;
+    trackedConfirmations++;
+    sendLatencyTotalNs += latencyNs;
+    uint32_t latencyMs = Saturate(latencyNs / NANOSECONDS_PER_MILLISECOND);
+    if (latencyMs > stats.sendLatencyMaxMs) {
+        stats.sendLatencyMaxMs = latencyMs;
+    }
+}
+
+void HealthMonitor_MessageAbandoned(void* context)
+{
+    if (stats.pendingMessages > 0) {
+        stats.pendingMessages--;
+    }
+    uint64_t* queued = context;
+    if (queued != NULL) {
+        *queued = 0;
+    }
+}
+
+void HealthMonitor_RecordConnected(void)
+{
+    if (connectedSinceNs == 0) {
+        uint64_t now = NowNs();
+        connectedSinceNs = now != 0 ? now : 1;
+        stats.connections++;
+    }
+}
+
+void HealthMonitor_RecordDisconnected(void)
+{
+    if (connectedSinceNs != 0) {
+        connectedNs += NowNs() - connectedSinceNs;
+        connectedSinceNs = 0;
+    }
+}
+
+void HealthMonitor_TakeStats(HealthStats* outStats)
+{
+    // Split the current connection at the end of the period.
+    if (connectedSinceNs != 0) {
+        uint64_t now = NowNs();
+        connectedNs += now - connectedSinceNs;
+        connectedSinceNs = now;
+    }
+
+    *outStats = stats;
+    outStats->connectedSeconds = Saturate(connectedNs / 1000000000ull);
+    outStats->doWorkMeanUs =
+        stats.doWorkCount != 0 ? Saturate(doWorkTotalNs / stats.doWorkCount / 1000) : 0;
+    outStats->sendLatencyMeanMs =
+        trackedConfirmations != 0 ?
+            Saturate(sendLatencyTotalNs / trackedConfirmations / NANOSECONDS_PER_MILLISECOND) :
+            0;
+
+    // Pending messages are still pending; everything else starts again.
+    uint32_t pendingMessages = stats.pendingMessages;
+    stats = (HealthStats){.pendingMessages = pendingMessages, .pendingHighWater = pendingMessages};
+    doWorkTotalNs = 0;
+    sendLatencyTotalNs = 0;
+    trackedConfirmations = 0;
+    connectedNs = 0;
+}
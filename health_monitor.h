@@ -0,0 +1,89 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/// <summary>
+/// Number of event loop lag histogram buckets. The buckets hold lags below 1, 2, 5, 10, 50,
+/// 100 and 500 ms, and the last holds everything longer.
+/// </summary>
+#define HEALTH_MONITOR_LAG_BUCKETS 8
+
+/// <summary>
+/// Number of unconfirmed messages whose send latency can be tracked at once. Further messages
+/// are still counted as pending, but their latency is not measured.
+/// </summary>
+#define HEALTH_MONITOR_MAX_TRACKED_MESSAGES 32
+
+/// <summary>
+/// Health figures since the previous <see cref="HealthMonitor_TakeStats" />, apart from the
+/// pending message count, which is current.
+/// </summary>
+typedef struct {
+    uint32_t loopLagCounts[HEALTH_MONITOR_LAG_BUCKETS];
+    uint32_t loopLagMaxMs;
+    uint32_t doWorkCount;
+    uint32_t doWorkMeanUs;
+    uint32_t doWorkMaxUs;
+    uint32_t messagesConfirmed;
+    uint32_t messagesFailed;    // Confirmed with any result other than OK
+    uint32_t sendLatencyMeanMs; // From queueing to confirmation, of tracked messages
+    uint32_t sendLatencyMaxMs;
+    uint32_t pendingMessages; // Queued and not yet confirmed
+    uint32_t pendingHighWater;
+    uint32_t connections;      // Times the client authenticated with the IoT Hub
+    uint32_t connectedSeconds; // Time spent authenticated
+} HealthStats;
+
+/// <summary>
+/// Record how late the event loop woke for a deadline. Cheap enough to call on every wake.
+/// </summary>
+/// <param name="lagNs">Time from the deadline to the wake, in nanoseconds.</param>
+void HealthMonitor_RecordLoopLag(uint64_t lagNs);
+
+/// <summary>
+/// Record how long a call to IoTHubDeviceClient_LL_DoWork took.
+/// </summary>
+/// <param name="durationNs">Duration of the call, in nanoseconds.</param>
+void HealthMonitor_RecordDoWork(uint64_t durationNs);
+
+/// <summary>
+/// Record that a message is about to be queued for sending, and timestamp it.
+/// </summary>
+/// <returns>Context to pass to <see cref="HealthMonitor_MessageConfirmed" /> or
+/// <see cref="HealthMonitor_MessageAbandoned" />; NULL if too many messages are already tracked,
+/// which those functions also accept.</returns>
+void* HealthMonitor_MessageQueued(void);
+
+/// <summary>
+/// Record the confirmation of a message recorded with <see cref="HealthMonitor_MessageQueued" />.
+/// </summary>
+/// <param name="context">Context returned when the message was queued.</param>
+/// <param name="isSuccess">Whether the message was delivered.</param>
+void HealthMonitor_MessageConfirmed(void* context, bool isSuccess);
+
+/// <summary>
+/// Forget a message recorded with <see cref="HealthMonitor_MessageQueued" /> which could not be
+/// queued after all.
+/// </summary>
+/// <param name="context">Context returned when the message was queued.</param>
+void HealthMonitor_MessageAbandoned(void* context);
+
+/// <summary>
+/// Record that the IoT Hub client has authenticated.
+/// </summary>
+void HealthMonitor_RecordConnected(void);
+
+/// <summary>
+/// Record that the IoT Hub client has lost its connection, or been destroyed. Does nothing if it
+/// was not connected.
+/// </summary>
+void HealthMonitor_RecordDisconnected(void);
+
+/// <summary>
+/// Get the figures gathered since the previous call, and start gathering afresh.
+/// </summary>
+/// <param name="outStats">Receives the figures.</param>
+void HealthMonitor_TakeStats(HealthStats* outStats);
@@ -0,0 +1,102 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hub_cache.h"
+
+// Mixed into the check value, so that zero-filled (never written) storage is invalid.
+#define CACHE_MAGIC 0x474C4B48u // "GLKH"
+
+typedef struct {
+    char scopeId[HUB_CACHE_MAX_SCOPE_ID_LENGTH + 1];
+    char hostName[HUB_CACHE_MAX_HOST_NAME_LENGTH + 1];
+    uint32_t check;
+} StoredHub;
+
+_Static_assert(sizeof(StoredHub) <= HUB_CACHE_SIZE, "HUB_CACHE_SIZE is too small");
+
+// FNV-1a over the record's strings.
+static uint32_t HubCheck(const StoredHub* record)
+{
+    uint32_t hash = 2166136261u;
+    const uint8_t* bytes = (const uint8_t*)record;
+    for (size_t i = 0; i < offsetof(StoredHub, check); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash ^ CACHE_MAGIC;
+}
+
+static int WriteRecord(int fd, off_t offset, const StoredHub* record)
+{
+    if (lseek(fd, offset, SEEK_SET) == -1) {
+        return -1;
+    }
+
+    ssize_t writeSize = write(fd, record, sizeof(*record));
+    if (writeSize == -1) {
+        return -1;
+    }
+    if ((size_t)writeSize != sizeof(*record)) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    return 0;
+}
+
+int HubCache_Load(int fd, off_t offset, const char* scopeId, char* hostName, size_t size)
+{
+    StoredHub record;
+    memset(&record, 0, sizeof(record));
+    if (fd < 0 || size < sizeof(record.hostName)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (lseek(fd, offset, SEEK_SET) == -1 || read(fd, &record, sizeof(record)) == -1) {
+        return -1;
+    }
+
+    // Bytes beyond the end of the file read as zero, and so fail the check.
+    if (record.check != HubCheck(&record) ||
+        record.hostName[HUB_CACHE_MAX_HOST_NAME_LENGTH] != '\0' || record.hostName[0] == '\0' ||
+        strncmp(record.scopeId, scopeId, sizeof(record.scopeId)) != 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    memcpy(hostName, record.hostName, sizeof(record.hostName));
+    return 0;
+}
+
+int HubCache_Save(int fd, off_t offset, const char* scopeId, const char* hostName)
+{
+    StoredHub record;
+    if (fd < 0 || strlen(scopeId) > HUB_CACHE_MAX_SCOPE_ID_LENGTH ||
+        strlen(hostName) > HUB_CACHE_MAX_HOST_NAME_LENGTH) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Zero the padding too, as it is covered by the check value.
+    memset(&record, 0, sizeof(record));
+    strcpy(record.scopeId, scopeId);
+    strcpy(record.hostName, hostName);
+    record.check = HubCheck(&record);
+    return WriteRecord(fd, offset, &record);
+}
+
+int HubCache_Clear(int fd, off_t offset)
+{
+    StoredHub record;
+    if (fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(&record, 0, sizeof(record));
+    return WriteRecord(fd, offset, &record);
+}
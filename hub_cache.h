@@ -0,0 +1,47 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stddef.h>
+#include <sys/types.h>
+
+/// <summary>
+/// Longest IoT Hub hostname which can be cached.
+/// </summary>
+#define HUB_CACHE_MAX_HOST_NAME_LENGTH 127
+
+/// <summary>
+/// Longest DPS scope ID which can be cached.
+/// </summary>
+#define HUB_CACHE_MAX_SCOPE_ID_LENGTH 31
+
+/// <summary>
+/// Size of the mutable storage region used by the cache.
+/// </summary>
+#define HUB_CACHE_SIZE 176
+
+/// <summary>
+/// Read the IoT Hub hostname which DPS last assigned for the given scope, from a region of the
+/// application's mutable storage file. The record carries a check value, so a torn or never
+/// written record reads as absent, and it is only returned for the scope it was cached for.
+/// </summary>
+/// <param name="fd">File descriptor returned by Storage_OpenMutableFile.</param>
+/// <param name="offset">Start of the region within the file.</param>
+/// <param name="scopeId">DPS scope ID in use.</param>
+/// <param name="hostName">Receives the null-terminated hostname.</param>
+/// <param name="size">Size of hostName; at least HUB_CACHE_MAX_HOST_NAME_LENGTH + 1.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information. errno
+/// is ENOENT if no hostname is cached for the scope.</returns>
+int HubCache_Load(int fd, off_t offset, const char* scopeId, char* hostName, size_t size);
+
+/// <summary>
+/// Cache the IoT Hub hostname which DPS assigned for the given scope.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int HubCache_Save(int fd, off_t offset, const char* scopeId, const char* hostName);
+
+/// <summary>
+/// Forget the cached hostname, so that the next connection is provisioned through DPS.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int HubCache_Clear(int fd, off_t offset);
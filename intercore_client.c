@@ -0,0 +1,178 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <applibs/application.h>
+
+#include "app_log.h"
+#include "intercore_client.h"
+#include "intercore_protocol.h"
+
+// Large enough for any message in intercore_protocol.h.
+typedef union {
+    IntercoreHeader header;
+    IntercoreConfigureMessage configure;
+    IntercoreQueueDoseMessage queueDose;
+    IntercoreSampleBatchMessage sampleBatch;
+    IntercoreDoseCompletedMessage doseCompleted;
+    IntercoreDoseRejectedMessage doseRejected;
+} IntercoreMessage;
+
+static int socketFd = -1;
+static EventLoop* clientEventLoop = NULL;
+static EventRegistration* socketEventReg = NULL;
+static const IntercoreHandlers* clientHandlers = NULL;
+
+static void Fail(void)
+{
+    int error = errno;
+    IntercoreClient_Disconnect();
+    errno = error;
+    clientHandlers->failed();
+}
+
+// Send one message without blocking the event loop. Each send is one datagram, so a message is
+// either queued whole or not at all.
+static int SendMessage(IntercoreMessage* message, IntercoreMessageType type, size_t size)
+{
+    if (socketFd == -1) {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    message->header.type = (uint8_t)type;
+    message->header.version = INTERCORE_PROTOCOL_VERSION;
+    message->header.reserved = 0;
+    ssize_t sent = send(socketFd, message, size, MSG_DONTWAIT);
+    if (sent == -1) {
+        if (errno == EWOULDBLOCK) {
+            errno = EAGAIN;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+// Handle one message from the real-time app. Messages which are too short for their type are
+// dropped rather than treated as a failure, so that one bad message cannot stop sampling.
+static void HandleMessage(const IntercoreMessage* message, size_t size)
+{
+    if (size < sizeof(IntercoreHeader) ||
+        message->header.version != INTERCORE_PROTOCOL_VERSION) {
+        LOG_WARNING("WARNING: Dropping inter-core message of %u bytes with unknown version.\n",
+            (unsigned int)size);
+        return;
+    }
+
+    switch (message->header.type) {
+    case IntercoreMessage_SampleBatch:
+        if (size >= offsetof(IntercoreSampleBatchMessage, samples) &&
+            message->sampleBatch.count <= INTERCORE_MAX_SAMPLES_PER_BATCH &&
+            size >= offsetof(IntercoreSampleBatchMessage, samples) +
+                        message->sampleBatch.count * sizeof(uint16_t)) {
+            clientHandlers->samplesReceived(message->sampleBatch.firstSampleIndex,
+                message->sampleBatch.samples, message->sampleBatch.count,
+                message->sampleBatch.bitCount);
+            return;
+        }
+        break;
+    case IntercoreMessage_DoseCompleted:
+        if (size >= sizeof(IntercoreDoseCompletedMessage)) {
+            clientHandlers->doseCompleted(message->doseCompleted.doseId,
+                message->doseCompleted.doseHundredths, message->doseCompleted.durationMs);
+            return;
+        }
+        break;
+    case IntercoreMessage_DoseRejected:
+        if (size >= sizeof(IntercoreDoseRejectedMessage)) {
+            clientHandlers->doseRejected(message->doseRejected.doseId);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    LOG_WARNING("WARNING: Dropping malformed inter-core message of type %u.\n",
+        (unsigned int)message->header.type);
+}
+
+// Drain every message which has arrived, so that one wake-up handles a burst of batches.
+static void SocketEventHandler(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
+{
+    static IntercoreMessage message;
+
+    while (socketFd != -1) {
+        ssize_t received = recv(socketFd, &message, sizeof(message), MSG_DONTWAIT);
+        if (received == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            LOG_ERROR("ERROR: Could not receive from the real-time app: %s (%d).\n",
+                strerror(errno), errno);
+            Fail();
+            return;
+        }
+
+        HandleMessage(&message, (size_t)received);
+    }
+}
+
+int IntercoreClient_Connect(EventLoop* eventLoop, const char* componentId,
+    const IntercoreHandlers* handlers)
+{
+    clientEventLoop = eventLoop;
+    clientHandlers = handlers;
+
+    socketFd = Application_Connect(componentId);
+    if (socketFd == -1) {
+        LOG_ERROR("ERROR: Could not connect to real-time app %s: %s (%d).\n", componentId,
+            strerror(errno), errno);
+        return -1;
+    }
+
+    socketEventReg =
+        EventLoop_RegisterIo(clientEventLoop, socketFd, EventLoop_Input, &SocketEventHandler, NULL);
+    if (socketEventReg == NULL) {
+        int error = errno;
+        IntercoreClient_Disconnect();
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+int IntercoreClient_Configure(uint32_t sampleRateHz, uint32_t pumpMicrounitsPerMs)
+{
+    IntercoreMessage message = { 0 };
+    message.configure.sampleRateHz = sampleRateHz;
+    message.configure.pumpMicrounitsPerMs = pumpMicrounitsPerMs;
+    return SendMessage(&message, IntercoreMessage_Configure, sizeof(message.configure));
+}
+
+int IntercoreClient_QueueDose(uint32_t doseId, int32_t doseHundredths)
+{
+    IntercoreMessage message = { 0 };
+    message.queueDose.doseId = doseId;
+    message.queueDose.doseHundredths = doseHundredths;
+    return SendMessage(&message, IntercoreMessage_QueueDose, sizeof(message.queueDose));
+}
+
+void IntercoreClient_Disconnect(void)
+{
+    if (socketEventReg != NULL) {
+        EventLoop_UnregisterIo(clientEventLoop, socketEventReg);
+        socketEventReg = NULL;
+    }
+    if (socketFd != -1) {
+        close(socketFd);
+        socketFd = -1;
+    }
+}
@@ -0,0 +1,64 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+/// <summary>
+/// Callbacks invoked on the event loop for messages from the real-time app.
+/// </summary>
+typedef struct {
+    /// <summary>Consecutive raw ADC samples have been received. 'firstSampleIndex' counts
+    /// samples since sampling was configured, so a gap from the previous batch means samples
+    /// were lost.</summary>
+    void (*samplesReceived)(uint32_t firstSampleIndex, const uint16_t* samples, size_t count,
+        unsigned int bitCount);
+    /// <summary>A dose queued with <see cref="IntercoreClient_QueueDose" /> has been
+    /// delivered.</summary>
+    void (*doseCompleted)(uint32_t doseId, int32_t doseHundredths, uint32_t durationMs);
+    /// <summary>A dose queued with <see cref="IntercoreClient_QueueDose" /> was refused and
+    /// will not be delivered.</summary>
+    void (*doseRejected)(uint32_t doseId);
+    /// <summary>The channel failed; errno contains more information. No further callbacks are
+    /// invoked.</summary>
+    void (*failed)(void);
+} IntercoreHandlers;
+
+/// <summary>
+/// Connect to the real-time app and start receiving its messages on the event loop. The
+/// real-time app must list this app in its AllowedApplicationConnections, and this app must list
+/// it in its own.
+/// </summary>
+/// <param name="eventLoop">Event loop on which messages are received.</param>
+/// <param name="componentId">Component ID of the real-time app.</param>
+/// <param name="handlers">Callbacks for received messages. Must remain valid until
+/// <see cref="IntercoreClient_Disconnect" />.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int IntercoreClient_Connect(EventLoop* eventLoop, const char* componentId,
+    const IntercoreHandlers* handlers);
+
+/// <summary>
+/// Set the real-time app's sample rate and pump calibration. The real-time app only starts
+/// sampling, and accepts doses, once it has been configured.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int IntercoreClient_Configure(uint32_t sampleRateHz, uint32_t pumpMicrounitsPerMs);
+
+/// <summary>
+/// Ask the real-time app to deliver a dose. Its outcome is reported through the doseCompleted
+/// or doseRejected handler.
+/// </summary>
+/// <param name="doseId">Identifier passed back to the handlers.</param>
+/// <param name="doseHundredths">Dose, in hundredths of a unit.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information. errno
+/// is EAGAIN if the real-time app is not keeping up with its messages.</returns>
+int IntercoreClient_QueueDose(uint32_t doseId, int32_t doseHundredths);
+
+/// <summary>
+/// Stop receiving messages and close the channel. It is safe to call this function if
+/// <see cref="IntercoreClient_Connect" /> was not called or failed.
+/// </summary>
+void IntercoreClient_Disconnect(void);
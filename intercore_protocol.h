@@ -0,0 +1,83 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+// Messages exchanged between the high-level app and the real-time app in RealTimeApp/. This
+// header is shared by both, so it must only use C99 types which are laid out identically on the
+// A7 and M4 cores.
+
+#pragma once
+#include <stdint.h>
+
+/// <summary>
+/// Version carried in every message header. Messages with another version are dropped.
+/// </summary>
+#define INTERCORE_PROTOCOL_VERSION 1
+
+/// <summary>
+/// Largest number of ADC samples carried by one <see cref="IntercoreSampleBatchMessage" />.
+/// This keeps every message well inside the inter-core mailbox buffers.
+/// </summary>
+#define INTERCORE_MAX_SAMPLES_PER_BATCH 64
+
+typedef enum {
+    IntercoreMessage_Configure = 1,     // High-level to real-time
+    IntercoreMessage_QueueDose = 2,     // High-level to real-time
+    IntercoreMessage_SampleBatch = 3,   // Real-time to high-level
+    IntercoreMessage_DoseCompleted = 4, // Real-time to high-level
+    IntercoreMessage_DoseRejected = 5   // Real-time to high-level
+} IntercoreMessageType;
+
+typedef struct {
+    uint8_t type;    // IntercoreMessageType
+    uint8_t version; // INTERCORE_PROTOCOL_VERSION
+    uint16_t reserved;
+} IntercoreHeader;
+
+/// <summary>
+/// Start, or change the rate of, sampling and set the pump's calibration. Sampling does not
+/// start and doses are rejected until the first of these messages is received.
+/// </summary>
+typedef struct {
+    IntercoreHeader header;
+    uint32_t sampleRateHz;
+    uint32_t pumpMicrounitsPerMs; // Units delivered per ms of pump running time, in millionths
+} IntercoreConfigureMessage;
+
+/// <summary>
+/// Queue a dose for delivery. Doses with the same identifier are not deduplicated.
+/// </summary>
+typedef struct {
+    IntercoreHeader header;
+    uint32_t doseId;
+    int32_t doseHundredths;
+} IntercoreQueueDoseMessage;
+
+/// <summary>
+/// Consecutive raw ADC samples, taken at the configured rate.
+/// </summary>
+typedef struct {
+    IntercoreHeader header;
+    uint32_t firstSampleIndex; // Index of samples[0] since sampling started; gaps mean loss
+    uint16_t count;
+    uint8_t bitCount; // ADC resolution
+    uint8_t reserved;
+    uint16_t samples[INTERCORE_MAX_SAMPLES_PER_BATCH];
+} IntercoreSampleBatchMessage;
+
+/// <summary>
+/// A dose has been delivered.
+/// </summary>
+typedef struct {
+    IntercoreHeader header;
+    uint32_t doseId;
+    int32_t doseHundredths;
+    uint32_t durationMs;
+} IntercoreDoseCompletedMessage;
+
+/// <summary>
+/// A dose could not be queued: the queue was full, or the pump is not configured.
+/// </summary>
+typedef struct {
+    IntercoreHeader header;
+    uint32_t doseId;
+} IntercoreDoseRejectedMessage;
@@ -0,0 +1,58 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <stdalign.h>
+
+#include "json_arena.h"
+#include "parson.h"
+
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+static alignas(max_align_t) uint8_t arena[JSON_ARENA_SIZE];
+static size_t used = 0;
+static size_t lastAllocation = 0; // Offset of the most recent allocation
+static size_t highWater = 0;
+static uint32_t failures = 0;
+
+void JsonArena_Install(void)
+{
+    JsonArena_Reset();
+    json_set_allocation_functions(JsonArena_Malloc, JsonArena_Free);
+}
+
+void JsonArena_Reset(void)
+{
+    used = 0;
+    lastAllocation = 0;
+}
+
+void* JsonArena_Malloc(size_t size)
+{
+    size_t start = (used + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if (start > JSON_ARENA_SIZE || size > JSON_ARENA_SIZE - start) {
+        failures++;
+        return NULL;
+    }
+
+    lastAllocation = start;
+    used = start + size;
+    if (used > highWater) {
+        highWater = used;
+    }
+    return arena + start;
+}
+
+void JsonArena_Free(void* pointer)
+{
+    // Releasing the newest allocation, e.g. a temporary buffer, lets its space be reused.
+    if (pointer == arena + lastAllocation && used != 0) {
+        used = lastAllocation;
+    }
+}
+
+void JsonArena_GetStats(JsonArenaStats* outStats)
+{
+    outStats->capacity = JSON_ARENA_SIZE;
+    outStats->highWater = highWater;
+    outStats->failures = failures;
+}
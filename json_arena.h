@@ -0,0 +1,52 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Size of the statically allocated region which backs all parson allocations.
+/// </summary>
+#define JSON_ARENA_SIZE (4 * 1024)
+
+/// <summary>
+/// Usage statistics for the JSON arena.
+/// </summary>
+typedef struct {
+    size_t capacity;   // JSON_ARENA_SIZE
+    size_t highWater;  // Most bytes in use at once since startup
+    uint32_t failures; // Allocations refused because the arena was full
+} JsonArenaStats;
+
+/// <summary>
+/// Route all parson allocations to the arena, using json_set_allocation_functions.
+/// </summary>
+void JsonArena_Install(void);
+
+/// <summary>
+/// Release everything allocated from the arena. Call this at the start of each callback which
+/// uses parson; JSON values from earlier callbacks must no longer be used.
+/// </summary>
+void JsonArena_Reset(void);
+
+/// <summary>
+/// Allocate from the arena. This is parson's malloc once the arena is installed.
+/// </summary>
+/// <param name="size">Number of bytes required.</param>
+/// <returns>Memory aligned for any type, or NULL if the arena is full.</returns>
+void* JsonArena_Malloc(size_t size);
+
+/// <summary>
+/// Free an arena allocation. This is parson's free once the arena is installed. Only the most
+/// recent allocation is actually reclaimed; other memory is reclaimed by
+/// <see cref="JsonArena_Reset" />.
+/// </summary>
+/// <param name="pointer">Allocation to free, or NULL.</param>
+void JsonArena_Free(void* pointer);
+
+/// <summary>
+/// Get the arena's usage statistics.
+/// </summary>
+/// <param name="outStats">Receives the statistics.</param>
+void JsonArena_GetStats(JsonArenaStats* outStats);
@@ -9,16 +9,20 @@
 #include <ctype.h>
 #include <errno.h>
 #include <getopt.h>
+#include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "applibs_versions.h"
 #include <applibs/eventloop.h>
 #include <applibs/adc.h>
+#include <applibs/applications.h>
 #include <applibs/gpio.h>
 #include <applibs/log.h>
 #include <applibs/networking.h>
@@ -30,7 +34,35 @@
 
 // Include header utilities
 #include "eventloop_timer_utilities.h"
-#include "parson.h" // Used to parse Device Twin messages.
+#include "app_log.h"
+#include "button_monitor.h"
+#include "calibration_cache.h"
+#include "calibration_curve.h"
+#include "connection_profile.h"
+#include "connectivity_monitor.h"
+#include "deadline_scheduler.h"
+#include "delivery_window.h"
+#include "dose_events.h"
+#include "dps_provisioner.h"
+#include "glucose_alerts.h"
+#include "health_monitor.h"
+#include "hub_cache.h"
+#include "intercore_client.h"
+#include "json_arena.h"
+#include "method_dispatch.h"
+#include "parson.h" // Used to parse Direct Method payloads.
+#include "pump_controller.h"
+#include "reconnect_policy.h"
+#include "reported_state.h"
+#include "sample_ring.h"
+#include "sampler_thread.h"
+#include "sensor_channels.h"
+#include "simulated_sensor.h"
+#include "telemetry_batch.h"
+#include "telemetry_encoder.h"
+#include "telemetry_rate.h"
+#include "telemetry_store.h"
+#include "twin_parser.h"
 
 // Include the Azure IoT SDK
 #include <iothub_client_core_common.h>
@@ -39,6 +71,7 @@
 #include <iothubtransportmqtt.h>
 #include <iothub.h>
 #include <azure_sphere_provisioning.h>
+#include <azure_prov_client/prov_device_ll_client.h>
 #include <iothub_security_factory.h>
 #include <shared_util_options.h>
 
@@ -78,15 +111,28 @@ typedef enum {
     ExitCode_IoTEdgeRootCa_FileSize_TooLarge = 20,
     ExitCode_IoTEdgeRootCa_FileRead_Failed = 21,
 
-    ExitCode_PayloadSize_TooLarge = 22,
-
     ExitCode_AdcTimerHandler_Consume = 23,
     ExitCode_AdcTimerHandler_Poll = 24,
 
     ExitCode_Init_AdcOpen = 25,
     ExitCode_Init_GetBitCount = 26,
     ExitCode_Init_UnexpectedBitCount = 27,
-    ExitCode_Init_SetRefVoltage = 28
+    ExitCode_Init_SetRefVoltage = 28,
+    ExitCode_Init_SchedulerJob = 29,
+    ExitCode_Init_ReportedProperty = 30,
+    ExitCode_Init_PumpController = 31,
+    ExitCode_PumpController_Failed = 32,
+    ExitCode_Init_RealTimeCore = 33,
+    ExitCode_RealTimeCore_Failed = 34,
+    ExitCode_Init_DpsProvisioner = 35,
+    ExitCode_Init_ConnectivityMonitor = 36,
+    ExitCode_ConnectivityTimer_Consume = 37,
+    ExitCode_Init_AlertLed = 38,
+    ExitCode_Init_GlucoseAlerts = 39,
+    ExitCode_Init_DirectMethods = 40,
+    ExitCode_Init_SimulatedSensor = 41,
+    ExitCode_Init_SensorChannels = 42,
+    ExitCode_Init_SamplerThread = 43
 } ExitCode;
 
 static volatile sig_atomic_t exitCode = ExitCode_Success;
@@ -106,11 +152,24 @@ typedef enum {
     IoTHubClientAuthenticationState_Authenticated = 2               // Authenticated
 } IoTHubClientAuthenticationState;
 
+// Value of the "priority" application property of a telemetry message, which IoT Hub message
+// routing can use to deliver urgent messages first and health reports last.
+typedef enum {
+    MessagePriority_Low = 0,    // "low": device health
+    MessagePriority_Normal = 1, // No property: readings and events
+    MessagePriority_Urgent = 2  // "urgent": glucose alerts
+} MessagePriority;
+
 // Constants
-#define MAX_DEVICE_TWIN_PAYLOAD_SIZE 512
-#define TELEMETRY_BUFFER_SIZE 100
 #define MAX_ROOT_CA_CERT_CONTENT_SIZE (3 * 1024)
 
+// Layout of the mutable storage file. The size must match MutableStorage in app_manifest.json.
+#define MUTABLE_STORAGE_SIZE (9 * 1024)
+#define TELEMETRY_STORE_OFFSET 0
+#define TELEMETRY_STORE_SIZE (8 * 1024)
+#define HUB_CACHE_OFFSET (TELEMETRY_STORE_OFFSET + TELEMETRY_STORE_SIZE)
+#define CALIBRATION_CACHE_OFFSET (HUB_CACHE_OFFSET + HUB_CACHE_SIZE)
+
 // Azure IoT definitions
 static char* scopeId = NULL;  // ScopeId for DPS.
 static char* hostName = NULL; // Azure IoT Hub or IoT Edge Hostname.
@@ -125,30 +184,119 @@ IoTHubClientAuthenticationState_NotAuthenticated; // Authentication state with r
 static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
 static const int deviceIdForDaaCertUsage = 1;     // A constant used to direct the IoT SDK to use
                                                   // the DAA cert under the hood.
-static const char networkInterface[] = "wlan0";
+// Network interfaces in order of preference: Ethernet is used whenever it is connected, and
+// Wi-Fi only while it is not. An interface which the board does not have is never connected.
+static const char* const networkInterfaces[] = { "eth0", "wlan0" };
+static const unsigned int DpsProvisioningTimeoutMs = 10000;
+
+// The IoT Hub to which DPS assigned the device is cached in mutable storage, so that
+// reconnecting, including after a restart, is a single direct connection to that hub. DPS is only
+// used again if the hub rejects the device or cannot be reached before the device has
+// authenticated with it.
+static char dpsHubHostName[HUB_CACHE_MAX_HOST_NAME_LENGTH + 1]; // Empty until assigned
+static bool isDpsHubHostNameCached = false;   // Whether mutable storage holds dpsHubHostName
+static bool isDpsHubHostNameVerified = false; // Whether the device has authenticated with it
 
 // Function declarations
 static void SendEventCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* context);
 static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload,
     size_t payloadSize, void* userContextCallback);
-static void TwinReportState(const char* jsonState);
+static void ReportJob(void);
+static void ScheduleReport(void);
+static ExitCode InitReportedProperties(void);
 static void ReportedStateCallback(int result, void* context);
+static void StatusLedPropertyChanged(const TwinValue* value);
+static void LogLevelPropertyChanged(const TwinValue* value);
+static void TelemetryMinPeriodPropertyChanged(const TwinValue* value);
+static void TelemetryMaxPeriodPropertyChanged(const TwinValue* value);
+static void ApplyTelemetryPeriodBounds(void);
+static void AlertLowThresholdPropertyChanged(const TwinValue* value);
+static void AlertHighThresholdPropertyChanged(const TwinValue* value);
+static void AlertHysteresisPropertyChanged(const TwinValue* value);
+static void ApplyAlertThresholds(void);
+static void CalibrationC0PropertyChanged(const TwinValue* value);
+static void CalibrationC1PropertyChanged(const TwinValue* value);
+static void CalibrationC2PropertyChanged(const TwinValue* value);
+static void CalibrationC3PropertyChanged(const TwinValue* value);
+static void CalibrationTemperatureCoefficientPropertyChanged(const TwinValue* value);
+static void CalibrationReferenceTemperaturePropertyChanged(const TwinValue* value);
+static void ApplyCalibration(void);
+static void RestoreCalibration(void);
+static void ConnectionProfilePropertyChanged(const TwinValue* value);
+static void ApplyConnectionProfile(void);
+static bool ReadSensorChannels(SensorChannelValues* values);
+static ExitCode InitGlucoseAlerts(void);
+static void EvaluateGlucoseAlerts(void);
+static void GlucoseAlertChanged(GlucoseAlertLevel level, int32_t glucoseHundredths);
+static void SendGlucoseAlert(void);
+static void UpdateRgbLed(void);
 static int DeviceMethodCallback(const char* methodName, const unsigned char* payload,
     size_t payloadSize, unsigned char** response, size_t* responseSize,
     void* userContextCallback);
 static const char* GetReasonString(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
 static const char* GetAzureSphereProvisioningResultString(
     AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult);
-static void SendTelemetry(const char* jsonMessage);
+static bool SendTelemetry(const char* jsonMessage);
+static DeliverySlot* SendTelemetryBytes(const uint8_t* payload, size_t size,
+    TelemetryEncoding encoding);
+static DeliverySlot* SendTelemetryMessage(const uint8_t* payload, size_t size,
+    TelemetryEncoding encoding, MessagePriority priority);
+static DeliverySlot* SendReadings(const TelemetryReading* readings, size_t count,
+    bool includeTime);
+static void ReportGlucoseReading(const SensorChannelValues* values);
+static void AdaptTelemetryPeriod(int32_t glucoseHundredths);
+static void FlushTelemetryBatch(void);
+static void BatchDeadlineJob(void);
+static void TelemetryJob(void);
+static void DiagnosticsJob(void);
+static ExitCode InitPumpController(int pumpGpioFd);
+static int InjectInsulinMethod(const JSON_Value* argument, char* response, size_t responseSize);
+static int TriggerAlarmMethod(const JSON_Value* argument, char* response, size_t responseSize);
+static void PumpDoseCompleted(uint32_t doseId, int32_t doseHundredths, uint32_t durationMs);
+static void PumpControllerFailed(void);
+static void SimulateInsulinAction(int32_t doseHundredths);
+static int QueueRealTimeDose(int32_t doseHundredths, uint32_t* outDoseId);
+static void OpenTelemetryStore(void);
+static void StoreReadings(const TelemetryReading* readings, size_t count);
+static void SendLiveReadings(const TelemetryReading* readings, size_t count, bool includeTime);
+static void ReplayStoredTelemetry(void);
+static DeliverySlot* SendBulkReadings(const TelemetryReading* readings, size_t count);
+static void ConsumeStoredReadings(uint32_t endSequence);
+static void ScheduleReplay(void);
+static void QueueDoseEvent(const DoseEvent* event);
+static void SendPendingDoseEvent(void);
 static void SetUpAzureIoTHubClient(void);
 static void SendSimulatedTelemetry(void);
-static void ButtonPollTimerEventHandler(EventLoopTimer* timer);
-static bool IsButtonPressed(int fd, GPIO_Value_Type* oldState);
-static void AzureTimerEventHandler(EventLoopTimer* timer);
+static void SendMessageButtonPressed(void);
+static void TakeReadingButtonPressed(void);
+static void ButtonMonitorFailed(ButtonMonitorError error);
+static void ConnectivityChanged(const char* activeInterface);
+static void ConnectivityMonitorFailed(ConnectivityMonitorError error);
+static void ConnectionJob(void);
+static void DoWorkJob(void);
+static void ReplayJob(void);
+static void SampleJob(void);
+static int TakeSweep(uint32_t* outCounts);
+static void ProcessSweep(const uint32_t* counts);
+static void SamplerFailed(int error);
+static void SchedulerFailed(void);
+static ExitCode InitScheduledJobs(void);
+static void StartupJob(void);
+static ExitCode InitConnectivityAndInputs(void);
+static ExitCode InitSensorChannels(void);
 static ExitCode ValidateUserConfiguration(void);
 static void ParseCommandLineArguments(int argc, char* argv[]);
-static bool SetUpAzureIoTHubClientWithDaa(void);
-static bool SetUpAzureIoTHubClientWithDps(void);
+static bool SetUpAzureIoTHubClientWithDaa(const char* hubHostName);
+static void LoadDpsHubHostName(void);
+static void ForgetDpsHubHostName(void);
+static void DpsProvisioningCompleted(AZURE_SPHERE_PROV_RETURN_VALUE result,
+    const char* hubHostName);
+static void FinishAzureIoTHubClientSetUp(ReconnectFailureClass failure,
+    bool isClientSetupSuccessful);
+static ReconnectFailureClass ClassifyProvisioningFailure(AZURE_SPHERE_PROV_RETURN_VALUE result);
+static ReconnectFailureClass ClassifyConnectionFailure(
+    IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
+static uint32_t GetReconnectSeed(void);
 static bool IsConnectionReadyToSendTelemetry(void);
 static ExitCode ReadIoTEdgeCaCertContent(void);
 
@@ -158,38 +306,243 @@ static void CloseFdAndPrintError(int fd, const char* fdName);
 static void ClosePeripheralsAndHandlers(void);
 
 // File descriptors - initialized to invalid value
-// Button
+// Buttons
 static int sendMessageButtonGpioFd = -1;
+static int takeReadingButtonGpioFd = -1;
 
-// LED
+// LED. SAMPLE_LED is the RGB LED's red channel, so its green channel is opened separately, and
+// the LED shows the glucose alert while one is raised.
 static int deviceTwinStatusLedGpioFd = -1;
+static int alertGreenLedGpioFd = -1;
 
-// Timer / polling
+// Timer / polling. All periodic work is run as jobs on a single deadline scheduler timer.
 static EventLoop* eventLoop = NULL;
-static EventLoopTimer* buttonPollTimer = NULL;
-static EventLoopTimer* azureTimer = NULL;
+static SchedulerJobId startupJob = -1;    // bring up everything sampling does not need
+static SchedulerJobId connectionJob = -1; // check the network and connect to the IoT Hub
+static SchedulerJobId doWorkJob = -1;     // IoTHubDeviceClient_LL_DoWork
+static SchedulerJobId replayJob = -1;     // replay stored readings
+static SchedulerJobId telemetryJob = -1;  // take and report a reading
+static SchedulerJobId sampleJob = -1;     // take one raw ADC sample
+static SchedulerJobId batchDeadlineJob = -1; // send a partial batch which has waited too long
+static SchedulerJobId diagnosticsJob = -1; // report memory usage
+static SchedulerJobId reportJob = -1;     // send changed reported properties to the device twin
+
+// Diagnostics
+static const int DiagnosticsPeriodSeconds = 15 * 60;
 
 // Azure IoT poll periods
 static const int AzureIoTDefaultPollPeriodSeconds = 1;        // poll azure iot every second
-static const int AzureIoTPollPeriodsPerTelemetry = 5;        // only send telemetry once every 5 seconds
-static const int AzureIoTMinReconnectPeriodSeconds = 60;      // back off when reconnecting
-static const int AzureIoTMaxReconnectPeriodSeconds = 10 * 60; // back off limit
 
-static int azureIoTPollPeriodSeconds = -1;
-static int telemetryCount = 0;
+// Reconnect backoff for each class of failure. The connection job keeps checking the cached
+// connectivity every poll period while disconnected, but only retries once the policy's jittered
+// delay has elapsed, or straight away when the network comes back up.
+static const ReconnectBackoff reconnectBackoffs[ReconnectFailure_Count] = {
+    [ReconnectFailure_NetworkNotReady] = {.initialDelayMs = 2 * 1000, .maxDelayMs = 30 * 1000},
+    [ReconnectFailure_Transient] = {.initialDelayMs = 5 * 1000, .maxDelayMs = 5 * 60 * 1000},
+    [ReconnectFailure_Credential] = {.initialDelayMs = 60 * 1000, .maxDelayMs = 30 * 60 * 1000} };
+
+// Connection profiles, selected with "--ConnectionProfile" or the ConnectionProfile desired
+// property. Standard is the SDK's own keep-alive and retry policy. LowPower pings the hub once
+// every 20 minutes, within IoT Hub's limit of 29, and leaves reconnecting to the slower reconnect
+// policy above rather than the SDK, so an idle device wakes its radio only for readings; a dead
+// link takes longer to notice. LowLatency pings every minute, and gives up on a message sooner,
+// so that its readings are stored and retried sooner. Restricted is Standard over WebSockets on
+// port 443, for networks which block MQTT. The message timeout also bounds how long a message
+// holds its delivery window slot: once it expires, the message's readings are stored and retried.
+static const ConnectionProfile connectionProfiles[] = {
+    {.name = "Standard", .transport = ConnectionTransport_Mqtt, .keepAliveSeconds = 240,
+        .retryPolicy = IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER,
+        .retryTimeoutLimitSeconds = 0, .messageTimeoutMs = 60 * 1000},
+    {.name = "LowPower", .transport = ConnectionTransport_Mqtt, .keepAliveSeconds = 20 * 60,
+        .retryPolicy = IOTHUB_CLIENT_RETRY_NONE, .retryTimeoutLimitSeconds = 0,
+        .messageTimeoutMs = 120 * 1000},
+    {.name = "LowLatency", .transport = ConnectionTransport_Mqtt, .keepAliveSeconds = 60,
+        .retryPolicy = IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER,
+        .retryTimeoutLimitSeconds = 0, .messageTimeoutMs = 30 * 1000},
+    {.name = "Restricted", .transport = ConnectionTransport_MqttWebSockets,
+        .keepAliveSeconds = 240, .retryPolicy = IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER,
+        .retryTimeoutLimitSeconds = 0, .messageTimeoutMs = 60 * 1000} };
+static const ConnectionProfile* connectionProfile = &connectionProfiles[0]; // Selected
+static const ConnectionProfile* clientConnectionProfile = NULL; // The current client's profile
 
 // State variables
-static GPIO_Value_Type sendMessageButtonState = GPIO_Value_High;
 static bool statusLedOn = false;
 
-static float voltage = 5.0; // Default value for simulation purposes
-
-// The size of a sample in bits
-static int sampleBitCount = -1;
+// Desired properties handled by DeviceTwinCallback.
+static const TwinProperty twinProperties[] = {
+    {.path = "StatusLED", .type = TwinValue_Bool, .handler = StatusLedPropertyChanged},
+    {.path = "LogLevel", .type = TwinValue_String, .handler = LogLevelPropertyChanged},
+    {.path = "TelemetryMinPeriodSeconds", .type = TwinValue_Number,
+        .handler = TelemetryMinPeriodPropertyChanged},
+    {.path = "TelemetryMaxPeriodSeconds", .type = TwinValue_Number,
+        .handler = TelemetryMaxPeriodPropertyChanged},
+    {.path = "AlertLowThreshold", .type = TwinValue_Number,
+        .handler = AlertLowThresholdPropertyChanged},
+    {.path = "AlertHighThreshold", .type = TwinValue_Number,
+        .handler = AlertHighThresholdPropertyChanged},
+    {.path = "AlertHysteresis", .type = TwinValue_Number,
+        .handler = AlertHysteresisPropertyChanged},
+    {.path = "Calibration.C0", .type = TwinValue_Number,
+        .handler = CalibrationC0PropertyChanged},
+    {.path = "Calibration.C1", .type = TwinValue_Number,
+        .handler = CalibrationC1PropertyChanged},
+    {.path = "Calibration.C2", .type = TwinValue_Number,
+        .handler = CalibrationC2PropertyChanged},
+    {.path = "Calibration.C3", .type = TwinValue_Number,
+        .handler = CalibrationC3PropertyChanged},
+    {.path = "Calibration.TemperatureCoefficient", .type = TwinValue_Number,
+        .handler = CalibrationTemperatureCoefficientPropertyChanged},
+    {.path = "Calibration.ReferenceTemperature", .type = TwinValue_Number,
+        .handler = CalibrationReferenceTemperaturePropertyChanged},
+    {.path = "ConnectionProfile", .type = TwinValue_String,
+        .handler = ConnectionProfilePropertyChanged} };
+
+// Direct Methods, sorted by name for MethodDispatch's binary search.
+static const DirectMethod directMethods[] = {
+    {.name = "InjectInsulin", .argumentType = JSONNumber, .handler = InjectInsulinMethod},
+    {.name = "TriggerAlarm", .argumentType = JSONNull, .handler = TriggerAlarmMethod} };
 
 // The maximum voltage
 static float sampleMaxVoltage = 2.5f;
 
+// Sensor channels, which are sampled together in one sweep and reported together. Glucose reads
+// directly as the sensor voltage. Temperature is from a sensor giving 10 mV per degree Celsius
+// and 500 mV at 0 degrees. The channels after glucose are in TelemetryChannel order.
+typedef enum {
+    SensorChannel_Glucose = 0,
+    SensorChannel_Temperature = 1,
+    SensorChannel_Reference = 2,
+    SensorChannel_Count
+} SensorChannel;
+static const SensorChannelConfig sensorChannels[SensorChannel_Count] = {
+    {.name = "Glucose", .adcChannel = SAMPLE_POTENTIOMETER_ADC_CHANNEL,
+        .unitsPerVoltQ16 = 1 << 16, .offsetHundredths = 0},
+    {.name = "Temperature", .adcChannel = SAMPLE_TEMPERATURE_ADC_CHANNEL,
+        .unitsPerVoltQ16 = 100 << 16, .offsetHundredths = -5000},
+    {.name = "Reference", .adcChannel = SAMPLE_REFERENCE_ADC_CHANNEL,
+        .unitsPerVoltQ16 = 1 << 16, .offsetHundredths = 0} };
+
+// ADC sampling. The ADC is oversampled by its own job into each channel's sample ring, and the
+// decimated values are what get reported as telemetry.
+static const int DefaultSampleRateHz = 10;          // raw ADC samples per second
+static const int MaxSampleRateHz = 1000;            // upper limit accepted from CmdArgs
+static const size_t DefaultDecimationWindow = 16;   // samples combined into one reading
+static int sampleRateHz = -1;
+static size_t decimationWindow = 0;
+static SampleDecimationMode decimationMode = SampleDecimation_Median;
+
+// With "--Sampler Thread", sweeps are taken on a thread of their own rather than by the sample
+// job, and queued for the event loop, so that sampling keeps its pace while the loop is held up
+// by the network, such as by a TLS handshake in DoWork. Decimation, calibration, alerts and
+// batching stay on the event loop, as does the IoT Hub client, whose callbacks share its state.
+static bool isSamplerThreaded = false;
+
+// Telemetry batching. Readings are accumulated and sent as one message when the batch is full
+// or when the oldest reading has waited batchMaxLatencySeconds. Calibrated readings below the
+// low alert threshold bypass the batch and are sent immediately.
+static const size_t DefaultBatchSize = 1;                // 1 disables batching
+static const int DefaultBatchMaxLatencySeconds = 60;
+static size_t batchSize = 0;
+static int batchMaxLatencySeconds = -1;
+static TelemetryBatch telemetryBatch;
+
+// Adaptive telemetry rate. The telemetry job's period follows the glucose trend: it lengthens
+// while readings are steady, and shortens while they change, most of all while calibrated
+// readings fall towards the low alert threshold. The bounds on the period are device twin desired
+// properties, which are applied together once a whole twin update has been parsed.
+static const TelemetryRateConfig defaultTelemetryRate = {
+    .initialPeriodMs = 5 * 1000,
+    .minPeriodMs = 2 * 1000,
+    .maxPeriodMs = 60 * 1000,
+    .reportableChangeHundredths = 5,
+    .reportsBeforeThreshold = 10 }; // .lowThresholdHundredths is the low alert threshold
+static uint32_t telemetryMinPeriodMs = 0;        // Bounds in effect
+static uint32_t telemetryMaxPeriodMs = 0;
+static uint32_t desiredTelemetryMinPeriodMs = 0; // Bounds from the device twin
+static uint32_t desiredTelemetryMaxPeriodMs = 0;
+
+// On-device glucose alerts. Every decimated sample is checked against the thresholds, so an alert
+// is raised locally within one sample period, on the RGB LED and as urgent telemetry, without
+// waiting for the cloud. Dosing is still only done on the cloud's instruction. The thresholds are
+// device twin desired properties, which are applied together once a whole update has been parsed.
+// They are in reported glucose units, so samples are only checked once a calibration is compiled:
+// until then, glucose reads as the sensor voltage. The low threshold also decides which readings
+// are urgent and which level the adaptive telemetry rate watches.
+static const int32_t DefaultAlertLowHundredths = 390; // hypoglycemia, 3.90 reported units
+static const int32_t DefaultAlertHighHundredths = 1000;
+static const int32_t DefaultAlertHysteresisHundredths = 20;
+static GlucoseAlertThresholds alertThresholds;        // Thresholds in effect
+static GlucoseAlertThresholds desiredAlertThresholds; // Thresholds from the device twin
+static int32_t alertGlucoseHundredths = 0;            // Level which changed the alert
+static bool isAlertUnsent = false; // The latest alert change has not been delivered
+static uint32_t alertSequence = 0;  // Message sequence number of the latest alert sent
+
+// Glucose calibration. Until the device twin first delivers a "Calibration" object, glucose is
+// the sensor voltage. Once it does, the curve is compiled into a lookup table indexed by raw
+// counts, and each reading is a lookup, an interpolation and a temperature correction. The
+// calibration is kept in mutable storage, so that it is in effect from startup.
+static const int32_t DefaultCalibrationReferenceTemperatureHundredths = 3700;
+static CalibrationCoefficients calibration;        // Calibration in effect, if compiled
+static CalibrationCoefficients desiredCalibration; // Calibration from the device twin
+static bool isCalibrationDesired = false;          // The twin has a "Calibration" object
+
+// Wire format for glucose telemetry. Readings are fixed-point, so encoding them needs neither
+// floating-point formatting nor heap allocation.
+static TelemetryEncoding telemetryEncoding = TelemetryEncoding_Json;
+
+// Store-and-forward. Readings which cannot be sent are appended to telemetryStore in mutable
+// storage, and are replayed one message per Azure IoT poll period once the connection is back,
+// so that draining the backlog does not flood the link. A message holds at most
+// StoreReplayReadingsPerPoll readings, in the telemetry encoding, unless more than that are
+// queued, as after an outage: the backlog is then bulk uploaded, BULK_UPLOAD_MAX_READINGS
+// readings at a time, in TelemetryEncoding_Packed, which takes a few bytes per reading rather
+// than tens.
+#define BULK_UPLOAD_MAX_READINGS 128
+static const size_t StoreReplayReadingsPerPoll = TELEMETRY_BATCH_CAPACITY;
+static int mutableStorageFd = -1;
+static TelemetryStore telemetryStore = { .fd = -1 };
+
+// Device Twin reported properties. Changes are coalesced for ReportedStateCoalesceMilliseconds
+// and then only properties which differ from the IoT Hub's acknowledged values are sent. A patch
+// which the IoT Hub rejects, such as when it throttles the device, is retried after a delay
+// which doubles with each rejection, up to ReportRetryMaxDelayMs, and starts afresh once a patch
+// is accepted or the device reconnects.
+static const long ReportedStateCoalesceMilliseconds = 250;
+static const uint32_t ReportRetryInitialDelayMs = 5 * 1000;
+static const uint32_t ReportRetryMaxDelayMs = 10 * 60 * 1000;
+static uint32_t reportRetryDelayMs = 0; // Delay before retrying the last rejected patch, or 0
+static ReportedPropertyId statusLedProperty = -1;
+static ReportedPropertyId logLevelProperty = -1;
+static ReportedPropertyId telemetryMinPeriodProperty = -1;
+static ReportedPropertyId telemetryMaxPeriodProperty = -1;
+static ReportedPropertyId alertLowThresholdProperty = -1;
+static ReportedPropertyId alertHighThresholdProperty = -1;
+static ReportedPropertyId alertHysteresisProperty = -1;
+static ReportedPropertyId calibratedProperty = -1;
+static ReportedPropertyId connectionProfileProperty = -1;
+
+// Insulin pump. Doses are given in units by the InjectInsulin direct method, and the pump's
+// calibration converts them into running time.
+static const uint32_t DefaultPumpMicrounitsPerMs = 1000;  // 1 unit per second
+static const int32_t MaxDoseHundredths = 2500;            // largest dose accepted, 25.00 units
+static uint32_t pumpMicrounitsPerMs = 0;
+
+// Real-time core offload. When a real-time app's component ID is given, that app owns the ADC
+// and the pump so that sampling and dose timing are not subject to Linux scheduling; it sends
+// batches of glucose samples to be decimated here, and doses are forwarded to it instead of the
+// pump controller. Dose IDs are still assigned here, and in-flight doses counted, so that the
+// InjectInsulin response is the same either way. The connection to the real-time app, and its
+// callbacks, are in hardwarefunctions.h, as only the real hardware has one.
+static const char* realTimeComponentId = NULL;
+static uint32_t nextRealTimeDoseId = 1;
+static unsigned int realTimeQueuedDoses = 0;
+
+// Simulated sensor. On simulated hardware the glucose level comes from a deterministic model,
+// which replays a trace from the image package if one is given, and otherwise generates a
+// drifting signal from the seed. Delivered doses lower the modelled level.
+static const char* simulatedTracePath = NULL;
+static uint32_t simulatedSeed = 1;
+
 // Include different functions depending on whether the hardware is simulated.
 #define SIMULATED 1
 #if SIMULATED == 1
@@ -206,61 +559,478 @@ static const char* cmdLineArgsUsageText =
 "\"--Hostname\", \"<azureiothub_hostname>\"]\n "
 "IoTEdge connection type: \" CmdArgs \": [\"--ConnectionType\", \"IoTEdge\", "
 "\"--Hostname\", \"<iotedgedevice_hostname>\", \"--IoTEdgeRootCAPath\", "
-"\"certs/<iotedgedevice_cert_name>\"]\n";
+"\"certs/<iotedgedevice_cert_name>\"]\n"
+"Optional sampling arguments: \"--SampleRateHz\", \"<1-1000>\", \"--DecimationWindow\", "
+"\"<1-64>\", \"--Decimation\", \"Average|Median\", \"--Sampler\", \"EventLoop|Thread\"\n"
+"Optional batching arguments: \"--BatchSize\", \"<1-32>\", \"--BatchMaxLatencySeconds\", "
+"\"<seconds>\"\n"
+"Optional encoding argument: \"--TelemetryEncoding\", \"Json|Cbor\"\n"
+"Optional pump calibration argument: \"--PumpMicrounitsPerMs\", \"<microunits>\"\n"
+"Optional real-time core argument: \"--RealTimeComponentId\", \"<component_id>\"\n"
+"Optional connection argument: \"--ConnectionProfile\", "
+"\"Standard|LowPower|LowLatency|Restricted\"\n"
+"Optional simulation arguments: \"--SimulatedTrace\", \"<trace_path>\", \"--SimulatedSeed\", "
+"\"<seed>\"\n";
 
 // Signal handler for termination requests. This handler must be async-signal-safe.
 static void TerminationHandler(int signalNumber) {
-    // Don't use Log_Debug here, as it is not guaranteed to be async-signal-safe.
+    // Don't log here, as it is not guaranteed to be async-signal-safe.
     exitCode = ExitCode_TermHandler_SigTerm;
 }
 
-// Button timer event: Check the status of the button.
-static void ButtonPollTimerEventHandler(EventLoopTimer* timer) {
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_ButtonTimer_Consume;
-        return;
+// SAMPLE_BUTTON_1 press: send a button press event to the IoT Hub.
+static void SendMessageButtonPressed(void) {
+    SendTelemetry("{\"ButtonPress\" : true}");
+}
+
+// SAMPLE_BUTTON_2 press: take a reading now, without waiting for the telemetry job.
+static void TakeReadingButtonPressed(void) {
+    SendSimulatedTelemetry();
+}
+
+// The button monitor could not poll the buttons.
+static void ButtonMonitorFailed(ButtonMonitorError error) {
+    exitCode = error == ButtonMonitorError_GetValue ? ExitCode_IsButtonPressed_GetValue
+                                                    : ExitCode_ButtonTimer_Consume;
+}
+
+// The deadline scheduler's timer event could not be consumed.
+static void SchedulerFailed(void) {
+    exitCode = ExitCode_AzureTimer_Consume;
+}
+
+// Add the application's jobs to the deadline scheduler. Each job only wakes the event loop when
+// it is actually due, rather than every job being driven by one fixed-rate tick.
+static ExitCode InitScheduledJobs(void) {
+    if (Scheduler_Init(eventLoop, &SchedulerFailed) == -1) {
+        return ExitCode_Init_AzureTimer;
+    }
+
+    ReconnectPolicy_Init(reconnectBackoffs, GetReconnectSeed());
+    DeliveryWindow_Init(GetReconnectSeed());
+    TelemetryRateConfig telemetryRate = defaultTelemetryRate;
+    telemetryRate.lowThresholdHundredths = alertThresholds.lowHundredths;
+    if (TelemetryRate_Init(&telemetryRate) == -1) {
+        return ExitCode_Init_SchedulerJob;
+    }
+    const struct timespec telemetryPeriod = {
+        .tv_sec = defaultTelemetryRate.initialPeriodMs / 1000,
+        .tv_nsec = (defaultTelemetryRate.initialPeriodMs % 1000) * 1000 * 1000 };
+    long samplePeriodNs = 1000 * 1000 * 1000 / sampleRateHz;
+    const struct timespec samplePeriod = { .tv_sec = samplePeriodNs / (1000 * 1000 * 1000),
+                                           .tv_nsec = samplePeriodNs % (1000 * 1000 * 1000) };
+    const struct timespec diagnosticsPeriod = { .tv_sec = DiagnosticsPeriodSeconds, .tv_nsec = 0 };
+
+    // The DoWork and replay jobs are only scheduled while there is a client to drive, and the
+    // connection job only once the startup job has brought up connectivity.
+    startupJob = Scheduler_AddJob("Startup", &StartupJob, NULL);
+    connectionJob = Scheduler_AddJob("Connection", &ConnectionJob, NULL);
+    doWorkJob = Scheduler_AddJob("DoWork", &DoWorkJob, NULL);
+    replayJob = Scheduler_AddJob("Replay", &ReplayJob, NULL);
+    telemetryJob = Scheduler_AddJob("Telemetry", &TelemetryJob, &telemetryPeriod);
+    // Samples arrive from the real-time core when it owns the ADC, and from the sampler thread
+    // when it is used, so in those cases the job is never run.
+    sampleJob = Scheduler_AddJob("Sample", &SampleJob,
+        realTimeComponentId == NULL && !isSamplerThreaded ? &samplePeriod : NULL);
+    batchDeadlineJob = Scheduler_AddJob("BatchDeadline", &BatchDeadlineJob, NULL);
+    diagnosticsJob = Scheduler_AddJob("Diagnostics", &DiagnosticsJob, &diagnosticsPeriod);
+    reportJob = Scheduler_AddJob("Report", &ReportJob, NULL);
+    if (startupJob == -1 || connectionJob == -1 || doWorkJob == -1 || replayJob == -1 ||
+        telemetryJob == -1 || sampleJob == -1 || batchDeadlineJob == -1 ||
+        diagnosticsJob == -1 || reportJob == -1) {
+        return ExitCode_Init_SchedulerJob;
     }
 
-    if (IsButtonPressed(sendMessageButtonGpioFd, &sendMessageButtonState)) {
-        SendTelemetry("{\"ButtonPress\" : true}");
+    // Take the first reading now, rather than one telemetry period after the connection is up,
+    // so that alerts are live from the start; until then, readings are queued in the store.
+    if (realTimeComponentId == NULL) {
+        SampleJob();
+        TelemetryJob();
     }
+
+    if (realTimeComponentId == NULL && isSamplerThreaded &&
+        SamplerThread_Start(eventLoop, &samplePeriod, &TakeSweep, &ProcessSweep,
+            &SamplerFailed) == -1) {
+        LOG_ERROR("ERROR: Could not start the sampler thread: %s (%d).\n", strerror(errno),
+            errno);
+        return ExitCode_Init_SamplerThread;
+    }
+
+    Scheduler_RunJobSoon(startupJob);
+    return ExitCode_Success;
 }
 
-// Azure timer event:  Check connection status and send telemetry.
-static void AzureTimerEventHandler(EventLoopTimer* timer) {
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        exitCode = ExitCode_AzureTimer_Consume;
+// Startup job: run once, on the first event loop iteration, to bring up the network, the IoT
+// Hub connection and the buttons, which sampling, dosing and alerts do not wait for.
+static void StartupJob(void) {
+    ExitCode startupExitCode = InitConnectivityAndInputs();
+    if (startupExitCode != ExitCode_Success) {
+        exitCode = startupExitCode;
         return;
     }
 
-    // Check whether the device is connected to the internet.
-    Networking_InterfaceConnectionStatus status;
-    if (Networking_GetInterfaceConnectionStatus(networkInterface, &status) == 0) {
-        if ((status & Networking_InterfaceConnectionStatus_ConnectedToInternet) &&
-            (iotHubClientAuthenticationState == IoTHubClientAuthenticationState_NotAuthenticated)) {
-            SetUpAzureIoTHubClient();
-        }
+    // Try to connect straight away rather than after the first poll period.
+    const struct timespec azurePollPeriod = {
+        .tv_sec = AzureIoTDefaultPollPeriodSeconds, .tv_nsec = 0 };
+    Scheduler_SetJobPeriod(connectionJob, &azurePollPeriod);
+    Scheduler_RunJobSoon(connectionJob);
+}
+
+// Set up what the device needs to reach the IoT Hub and to take button presses. Return
+// ExitCode_Success if all resources were allocated successfully; otherwise return another
+// ExitCode value to indicate the specific failure.
+static ExitCode InitConnectivityAndInputs(void) {
+    bool isNetworkingReady = false;
+    if ((Networking_IsNetworkingReady(&isNetworkingReady) == -1) || !isNetworkingReady) {
+        LOG_WARNING(
+            "WARNING: Network is not ready. Device cannot connect until network is ready.\n");
     }
-    else {
-        if (errno != EAGAIN) {
-            Log_Debug("ERROR: Networking_GetInterfaceConnectionStatus: %d (%s)\n", errno,
-                strerror(errno));
-            exitCode = ExitCode_InterfaceConnectionStatus_Failed;
-            return;
+
+    if (connectionType == ConnectionType_IoTEdge) {
+        ExitCode certExitCode = ReadIoTEdgeCaCertContent();
+        if (certExitCode != ExitCode_Success) {
+            return certExitCode;
         }
     }
 
+    LoadDpsHubHostName();
+
+    if (MethodDispatch_Init(directMethods, sizeof(directMethods) / sizeof(directMethods[0])) ==
+        -1) {
+        return ExitCode_Init_DirectMethods;
+    }
+
+    if (ConnectivityMonitor_Init(eventLoop, networkInterfaces,
+            sizeof(networkInterfaces) / sizeof(networkInterfaces[0]), &ConnectivityChanged,
+            &ConnectivityMonitorFailed) == -1) {
+        LOG_ERROR("ERROR: Could not start monitoring the network: %s (%d).\n", strerror(errno),
+            errno);
+        return ExitCode_Init_ConnectivityMonitor;
+    }
+
+    if (DpsProvisioner_Init(eventLoop, &DpsProvisioningCompleted) == -1) {
+        LOG_ERROR("ERROR: Could not set up DPS provisioning: %s (%d).\n", strerror(errno), errno);
+        return ExitCode_Init_DpsProvisioner;
+    }
+
+    // Open SAMPLE_BUTTON_1 GPIO as input
+    LOG_DEBUG("Opening SAMPLE_BUTTON_1 as input.\n");
+    sendMessageButtonGpioFd = GPIO_OpenAsInput(SAMPLE_BUTTON_1);
+    if (sendMessageButtonGpioFd == -1) {
+        LOG_ERROR("ERROR: Could not open SAMPLE_BUTTON_1: %s (%d).\n", strerror(errno), errno);
+        return ExitCode_Init_MessageButton;
+    }
+
+    // Open SAMPLE_BUTTON_2 GPIO as input
+    LOG_DEBUG("Opening SAMPLE_BUTTON_2 as input.\n");
+    takeReadingButtonGpioFd = GPIO_OpenAsInput(SAMPLE_BUTTON_2);
+    if (takeReadingButtonGpioFd == -1) {
+        LOG_ERROR("ERROR: Could not open SAMPLE_BUTTON_2: %s (%d).\n", strerror(errno), errno);
+        return ExitCode_Init_OrientationButton;
+    }
+
+    // Poll the buttons adaptively, only polling quickly while debouncing an edge.
+    if (ButtonMonitor_Init(eventLoop, &ButtonMonitorFailed) == -1 ||
+        ButtonMonitor_AddButton(sendMessageButtonGpioFd, &SendMessageButtonPressed) == -1 ||
+        ButtonMonitor_AddButton(takeReadingButtonGpioFd, &TakeReadingButtonPressed) == -1) {
+        return ExitCode_Init_ButtonPollTimer;
+    }
+
+    return ExitCode_Success;
+}
+
+// Connection job: check whether the device is connected to the internet, and if so connect to
+// the IoT Hub once the reconnect policy allows. The job is disabled while the client is
+// authenticated.
+static void ConnectionJob(void) {
+    if (ConnectivityMonitor_IsConnected() &&
+        (iotHubClientAuthenticationState == IoTHubClientAuthenticationState_NotAuthenticated) &&
+        ReconnectPolicy_IsRetryDue()) {
+        SetUpAzureIoTHubClient();
+    }
+}
+
+// The device has gone on or offline, or failed over to another network interface.
+static void ConnectivityChanged(const char* activeInterface) {
+    if (activeInterface == NULL) {
+        LOG_WARNING("WARNING: The device is no longer connected to the internet.\n");
+        return;
+    }
+
+    LOG_INFO("Connected to the internet through %s.\n", activeInterface);
+
+    // An authenticated client's connection is bound to the interface which has gone, and would
+    // only notice once its keep-alive expired, so connect afresh through the new one.
     if (iotHubClientAuthenticationState == IoTHubClientAuthenticationState_Authenticated) {
-        telemetryCount++;
-        if (telemetryCount == AzureIoTPollPeriodsPerTelemetry) {
-            telemetryCount = 0;
-            SendSimulatedTelemetry();
-        }
+        iotHubClientAuthenticationState = IoTHubClientAuthenticationState_NotAuthenticated;
+        struct timespec azurePollPeriod = {
+            .tv_sec = AzureIoTDefaultPollPeriodSeconds, .tv_nsec = 0 };
+        Scheduler_SetJobPeriod(connectionJob, &azurePollPeriod);
     }
 
-    if (iothubClientHandle != NULL) {
-        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+    // Whatever failed before, the network has changed, so retry without waiting.
+    ReconnectPolicy_RetryNow();
+    Scheduler_RunJobSoon(connectionJob);
+}
+
+// The connectivity monitor could not check the network interfaces.
+static void ConnectivityMonitorFailed(ConnectivityMonitorError error) {
+    exitCode = error == ConnectivityMonitorError_GetStatus ?
+        ExitCode_InterfaceConnectionStatus_Failed : ExitCode_ConnectivityTimer_Consume;
+}
+
+// DoWork job: let the IoT Hub client send and receive. As well as running periodically while a
+// client exists, this is run as soon as anything is queued for sending.
+static void DoWorkJob(void) {
+    if (iothubClientHandle == NULL) {
+        Scheduler_DisableJob(doWorkJob);
+        return;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    HealthMonitor_RecordDoWork((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ull +
+        (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec);
+}
+
+// Replay job: forward one batch of stored readings, and the oldest undelivered dose event.
+// Disables itself once both are delivered.
+static void ReplayJob(void) {
+    if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated ||
+        (TelemetryStore_PendingCount(&telemetryStore) == 0 && DoseEvents_PendingCount() == 0)) {
+        Scheduler_DisableJob(replayJob);
+        return;
+    }
+
+    ReplayStoredTelemetry();
+    SendPendingDoseEvent();
+}
+
+// Sample job: take one raw ADC sample of every channel and add the sweep to the sample rings.
+static void SampleJob(void) {
+    uint32_t counts[SensorChannel_Count];
+    if (TakeSweep(counts) == -1) {
+        exitCode = ExitCode_AdcTimerHandler_Poll;
+        return;
+    }
+    ProcessSweep(counts);
+}
+
+// A sweep has been taken, by the sample job or by the sampler thread.
+static void ProcessSweep(const uint32_t* counts) {
+    SensorChannels_PushSweep(counts);
+    EvaluateGlucoseAlerts();
+}
+
+// The sampler thread could not take a sweep, and has stopped.
+static void SamplerFailed(int error) {
+    LOG_ERROR("ERROR: The sampler thread stopped: %s (%d).\n", strerror(error), error);
+    exitCode = ExitCode_AdcTimerHandler_Poll;
+}
+
+// Set up the sensor channel table, with empty sample rings. The hardware sets each channel's
+// resolution once it is known.
+static ExitCode InitSensorChannels(void) {
+    if (SensorChannels_Init(sensorChannels, SensorChannel_Count) == -1) {
+        LOG_ERROR("ERROR: Could not set up sensor channels: %s (%d).\n", strerror(errno), errno);
+        return ExitCode_Init_SensorChannels;
     }
+    return ExitCode_Success;
+}
+
+// Telemetry job: take a reading, whether or not the device is connected. An alert which was not
+// delivered is retried at the same pace.
+static void TelemetryJob(void) {
+    SendSimulatedTelemetry();
+    if (isAlertUnsent &&
+        iotHubClientAuthenticationState == IoTHubClientAuthenticationState_Authenticated) {
+        SendGlucoseAlert();
+    }
+}
+
+// Diagnostics job: report how the device has been coping since the last report, as low priority
+// telemetry. This covers how late the event loop has woken for deadlines (a histogram with
+// buckets below 1, 2, 5, 10, 50, 100 and 500 ms, and above), how long IoT Hub DoWork calls and
+// message confirmations have taken, how many messages await confirmation, memory use, and how
+// much of the JSON arena has been needed, so that its size can be checked against real payloads.
+// The connection profile's effect shows in how often the device connected, how long it stayed
+// connected, and, at one ping per keep-alive period, how much idle traffic that took. With the
+// sampler thread, it also counts the sweeps dropped because the event loop fell behind.
+static void DiagnosticsJob(void) {
+    static char diagnosticsBuffer[768];
+    static uint32_t lastSamplerDroppedCount = 0;
+    JsonArenaStats arenaStats;
+    HealthStats health;
+
+    JsonArena_GetStats(&arenaStats);
+    HealthMonitor_TakeStats(&health);
+    const ConnectionProfile* profile =
+        clientConnectionProfile != NULL ? clientConnectionProfile : connectionProfile;
+    uint32_t samplerDroppedCount = SamplerThread_DroppedCount();
+    uint32_t samplerDropped = samplerDroppedCount - lastSamplerDroppedCount;
+    lastSamplerDroppedCount = samplerDroppedCount;
+    const uint32_t* lag = health.loopLagCounts;
+    int len = snprintf(diagnosticsBuffer, sizeof(diagnosticsBuffer),
+        "{\"LoopLagHistogram\":[%u,%u,%u,%u,%u,%u,%u,%u],\"LoopLagMaxMs\":%u,"
+        "\"DoWorkCount\":%u,\"DoWorkMeanUs\":%u,\"DoWorkMaxUs\":%u,"
+        "\"MessagesConfirmed\":%u,\"MessagesFailed\":%u,\"SendLatencyMeanMs\":%u,"
+        "\"SendLatencyMaxMs\":%u,\"PendingMessages\":%u,\"PendingHighWater\":%u,"
+        "\"MemoryKB\":%u,\"PeakMemoryKB\":%u,"
+        "\"JsonArenaHighWater\":%u,\"JsonArenaCapacity\":%u,\"JsonArenaFailures\":%u,"
+        "\"ConnectionProfile\":\"%s\",\"KeepAliveSeconds\":%d,\"Connections\":%u,"
+        "\"ConnectedSeconds\":%u,\"SamplerDroppedSweeps\":%u}",
+        lag[0], lag[1], lag[2], lag[3], lag[4], lag[5], lag[6], lag[7], health.loopLagMaxMs,
+        health.doWorkCount, health.doWorkMeanUs, health.doWorkMaxUs, health.messagesConfirmed,
+        health.messagesFailed, health.sendLatencyMeanMs, health.sendLatencyMaxMs,
+        health.pendingMessages, health.pendingHighWater,
+        (unsigned int)Applications_GetTotalMemoryUsageInKB(),
+        (unsigned int)Applications_GetPeakUserModeMemoryUsageInKB(),
+        (unsigned int)arenaStats.highWater, (unsigned int)arenaStats.capacity,
+        (unsigned int)arenaStats.failures, profile->name, profile->keepAliveSeconds,
+        health.connections, health.connectedSeconds, (unsigned int)samplerDropped);
+    if (len < 0 || len >= (int)sizeof(diagnosticsBuffer)) {
+        LOG_ERROR("ERROR: Cannot write diagnostics to buffer.\n");
+        return;
+    }
+    SendTelemetryMessage((const uint8_t*)diagnosticsBuffer, (size_t)len, TelemetryEncoding_Json,
+        MessagePriority_Low);
+}
+
+// Start the pump controller on the given pump GPIO, or on a simulated pump if it is -1.
+static ExitCode InitPumpController(int pumpGpioFd) {
+    if (PumpController_Init(eventLoop, pumpGpioFd, &PumpDoseCompleted, &PumpControllerFailed) ==
+        -1 || PumpController_SetCalibration(pumpMicrounitsPerMs) == -1) {
+        LOG_ERROR("ERROR: Could not start the pump controller: %s (%d).\n", strerror(errno),
+            errno);
+        return ExitCode_Init_PumpController;
+    }
+
+    return ExitCode_Success;
+}
+
+// InjectInsulin direct method: queue the dose, given in units as a JSON number, and return
+// straight away. A DoseCompleted telemetry event is sent once the dose has been delivered.
+// Returns the method's status code, and writes its JSON response to 'response'.
+static int InjectInsulinMethod(const JSON_Value* argument, char* response, size_t responseSize) {
+    double units = json_value_get_number(argument);
+
+    int32_t doseHundredths = 0;
+    if (units > 0.0 && units * 100.0 <= (double)MaxDoseHundredths) {
+        doseHundredths = (int32_t)lround(units * 100.0);
+    }
+    if (doseHundredths <= 0) {
+        LOG_WARNING("WARNING: Rejecting insulin dose; expected 0.01 to %d.%02d units.\n",
+            MaxDoseHundredths / 100, MaxDoseHundredths % 100);
+        snprintf(response, responseSize, "\"Invalid dose\"");
+        return 400;
+    }
+
+    uint32_t doseId;
+    int result = realTimeComponentId != NULL ? QueueRealTimeDose(doseHundredths, &doseId)
+                                             : PumpController_QueueDose(doseHundredths, &doseId);
+    if (result == -1) {
+        // Logging can change errno, so keep it for the response.
+        int error = errno;
+        LOG_ERROR("ERROR: Could not queue insulin dose: %s (%d).\n", strerror(error), error);
+        snprintf(response, responseSize, "\"%s\"",
+            error == EBUSY ? "Too many doses queued" : "Pump unavailable");
+        return 503;
+    }
+
+    LOG_INFO("INFO: Queued insulin dose %u of %d.%02d units.\n", (unsigned int)doseId,
+        doseHundredths / 100, doseHundredths % 100);
+    snprintf(response, responseSize, "{\"DoseId\":%u,\"QueuedDoses\":%u}",
+        (unsigned int)doseId,
+        realTimeComponentId != NULL ? realTimeQueuedDoses : PumpController_QueuedDoseCount());
+    return 202;
+}
+
+// TriggerAlarm direct method: output an alarm to the log.
+static int TriggerAlarmMethod(const JSON_Value* argument, char* response, size_t responseSize) {
+    LOG_INFO("Alarm triggered!\n");
+    snprintf(response, responseSize, "\"Alarm Triggered\"");
+    return 200;
+}
+
+// The pump controller has delivered a dose: report it to the IoT Hub.
+static void PumpDoseCompleted(uint32_t doseId, int32_t doseHundredths, uint32_t durationMs) {
+    LOG_INFO("INFO: Delivered insulin dose %u in %u ms.\n", (unsigned int)doseId,
+        (unsigned int)durationMs);
+    SimulateInsulinAction(doseHundredths);
+
+    DoseEvent event = { .type = DoseEvent_Completed, .doseId = doseId,
+                        .doseHundredths = doseHundredths, .durationMs = durationMs };
+    QueueDoseEvent(&event);
+}
+
+// Queue a dose event and send it as soon as the events before it have been delivered. Dose
+// events are the only upstream record of what the pump did, so unlike other events they are
+// kept until the IoT Hub confirms them, including while the device is offline.
+static void QueueDoseEvent(const DoseEvent* event) {
+    if (!DoseEvents_Add(event)) {
+        LOG_ERROR("ERROR: Too many undelivered dose events. Dropped the oldest.\n");
+    }
+    SendPendingDoseEvent();
+}
+
+// Send the oldest undelivered dose event, unless it already awaits confirmation. If it cannot be
+// sent now, the replay job retries it.
+static void SendPendingDoseEvent(void) {
+    static char doseBuffer[80];
+
+    if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated) {
+        // Sent by the replay job once authenticated.
+        return;
+    }
+    const DoseEvent* event = DoseEvents_NextToSend();
+    if (event == NULL) {
+        return;
+    }
+
+    int len = event->type == DoseEvent_Rejected
+                  ? snprintf(doseBuffer, sizeof(doseBuffer), "{\"DoseRejected\":%u}",
+                        (unsigned int)event->doseId)
+                  : snprintf(doseBuffer, sizeof(doseBuffer),
+                        "{\"DoseCompleted\":%u,\"Insulin\":%d.%02d,\"PumpMs\":%u}",
+                        (unsigned int)event->doseId, event->doseHundredths / 100,
+                        event->doseHundredths % 100, (unsigned int)event->durationMs);
+    if (len < 0 || len >= (int)sizeof(doseBuffer)) {
+        LOG_ERROR("ERROR: Cannot write dose event to buffer.\n");
+        return;
+    }
+
+    DeliverySlot* slot = SendTelemetryBytes((const uint8_t*)doseBuffer, (size_t)len,
+        TelemetryEncoding_Json);
+    if (slot == NULL) {
+        ScheduleReplay();
+        return;
+    }
+    slot->kind = DeliveryKind_DoseEvent;
+    DoseEvents_Sent(slot->sequence);
+}
+
+// The pump controller could not time a dose, and has switched the pump off.
+static void PumpControllerFailed(void) {
+    exitCode = ExitCode_PumpController_Failed;
+}
+
+// Forward a dose to the real-time core. Like PumpController_QueueDose, this returns -1 with
+// errno set to EBUSY if PUMP_CONTROLLER_MAX_DOSES doses are already in flight.
+static int QueueRealTimeDose(int32_t doseHundredths, uint32_t* outDoseId) {
+    if (realTimeQueuedDoses >= PUMP_CONTROLLER_MAX_DOSES) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (IntercoreClient_QueueDose(nextRealTimeDoseId, doseHundredths) == -1) {
+        return -1;
+    }
+
+    realTimeQueuedDoses++;
+    *outDoseId = nextRealTimeDoseId;
+    nextRealTimeDoseId = nextRealTimeDoseId == UINT32_MAX ? 1 : nextRealTimeDoseId + 1;
+    return 0;
 }
 
 // Parse the command line arguments given in the application manifest.
@@ -271,18 +1041,30 @@ static void ParseCommandLineArguments(int argc, char* argv[]) {
         {.name = "ScopeID", .has_arg = required_argument, .flag = NULL, .val = 's'},
         {.name = "Hostname", .has_arg = required_argument, .flag = NULL, .val = 'h'},
         {.name = "IoTEdgeRootCAPath", .has_arg = required_argument, .flag = NULL, .val = 'i'},
+        {.name = "SampleRateHz", .has_arg = required_argument, .flag = NULL, .val = 'r'},
+        {.name = "DecimationWindow", .has_arg = required_argument, .flag = NULL, .val = 'w'},
+        {.name = "Decimation", .has_arg = required_argument, .flag = NULL, .val = 'd'},
+        {.name = "Sampler", .has_arg = required_argument, .flag = NULL, .val = 'm'},
+        {.name = "BatchSize", .has_arg = required_argument, .flag = NULL, .val = 'b'},
+        {.name = "BatchMaxLatencySeconds", .has_arg = required_argument, .flag = NULL, .val = 'l'},
+        {.name = "TelemetryEncoding", .has_arg = required_argument, .flag = NULL, .val = 'e'},
+        {.name = "PumpMicrounitsPerMs", .has_arg = required_argument, .flag = NULL, .val = 'p'},
+        {.name = "RealTimeComponentId", .has_arg = required_argument, .flag = NULL, .val = 't'},
+        {.name = "ConnectionProfile", .has_arg = required_argument, .flag = NULL, .val = 'f'},
+        {.name = "SimulatedTrace", .has_arg = required_argument, .flag = NULL, .val = 'g'},
+        {.name = "SimulatedSeed", .has_arg = required_argument, .flag = NULL, .val = 'x'},
         {.name = NULL, .has_arg = 0, .flag = NULL, .val = 0} };
 
     // Loop over all of the options.
-    while ((option = getopt_long(argc, argv, "c:s:h:i:", cmdLineOptions, NULL)) != -1) {
+    while ((option = getopt_long(argc, argv, "c:s:h:i:r:w:d:m:b:l:e:p:t:f:g:x:", cmdLineOptions, NULL)) != -1) {
         // Check if arguments are missing. Every option requires an argument.
         if (optarg != NULL && optarg[0] == '-') {
-            Log_Debug("WARNING: Option %c requires an argument\n", option);
+            LOG_WARNING("WARNING: Option %c requires an argument\n", option);
             continue;
         }
         switch (option) {
         case 'c':
-            Log_Debug("ConnectionType: %s\n", optarg);
+            LOG_DEBUG("ConnectionType: %s\n", optarg);
             if (strcmp(optarg, "DPS") == 0) {
                 connectionType = ConnectionType_DPS;
             }
@@ -294,17 +1076,89 @@ static void ParseCommandLineArguments(int argc, char* argv[]) {
             }
             break;
         case 's':
-            Log_Debug("ScopeID: %s\n", optarg);
+            LOG_DEBUG("ScopeID: %s\n", optarg);
             scopeId = optarg;
             break;
         case 'h':
-            Log_Debug("Hostname: %s\n", optarg);
+            LOG_DEBUG("Hostname: %s\n", optarg);
             hostName = optarg;
             break;
         case 'i':
-            Log_Debug("IoTEdgeRootCAPath: %s\n", optarg);
+            LOG_DEBUG("IoTEdgeRootCAPath: %s\n", optarg);
             iotEdgeRootCAPath = optarg;
             break;
+        case 'r':
+            LOG_DEBUG("SampleRateHz: %s\n", optarg);
+            sampleRateHz = atoi(optarg);
+            break;
+        case 'w':
+            LOG_DEBUG("DecimationWindow: %s\n", optarg);
+            decimationWindow = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            LOG_DEBUG("Decimation: %s\n", optarg);
+            if (strcmp(optarg, "Average") == 0) {
+                decimationMode = SampleDecimation_MovingAverage;
+            }
+            else if (strcmp(optarg, "Median") == 0) {
+                decimationMode = SampleDecimation_Median;
+            }
+            break;
+        case 'm':
+            LOG_DEBUG("Sampler: %s\n", optarg);
+            if (strcmp(optarg, "EventLoop") == 0) {
+                isSamplerThreaded = false;
+            }
+            else if (strcmp(optarg, "Thread") == 0) {
+                isSamplerThreaded = true;
+            }
+            break;
+        case 'b':
+            LOG_DEBUG("BatchSize: %s\n", optarg);
+            batchSize = (size_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            LOG_DEBUG("BatchMaxLatencySeconds: %s\n", optarg);
+            batchMaxLatencySeconds = atoi(optarg);
+            break;
+        case 'e':
+            LOG_DEBUG("TelemetryEncoding: %s\n", optarg);
+            if (strcmp(optarg, "Json") == 0) {
+                telemetryEncoding = TelemetryEncoding_Json;
+            }
+            else if (strcmp(optarg, "Cbor") == 0) {
+                telemetryEncoding = TelemetryEncoding_Cbor;
+            }
+            break;
+        case 'p':
+            LOG_DEBUG("PumpMicrounitsPerMs: %s\n", optarg);
+            pumpMicrounitsPerMs = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            LOG_DEBUG("RealTimeComponentId: %s\n", optarg);
+            realTimeComponentId = optarg;
+            break;
+        case 'f': {
+            LOG_DEBUG("ConnectionProfile: %s\n", optarg);
+            const ConnectionProfile* profile = ConnectionProfile_Find(connectionProfiles,
+                sizeof(connectionProfiles) / sizeof(connectionProfiles[0]), optarg,
+                strlen(optarg));
+            if (profile != NULL) {
+                connectionProfile = profile;
+            }
+            else {
+                LOG_WARNING("WARNING: Unknown connection profile \"%s\".\n", optarg);
+            }
+            break;
+        }
+        case 'g':
+            LOG_DEBUG("SimulatedTrace: %s\n", optarg);
+            simulatedTracePath = optarg;
+            break;
+        case 'x':
+            LOG_DEBUG("SimulatedSeed: %s\n", optarg);
+            simulatedSeed = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
         default:
             // Unknown options are ignored.
             break;
@@ -327,7 +1181,7 @@ static ExitCode ValidateUserConfiguration(void) {
             validationExitCode = ExitCode_Validate_ScopeId;
         }
         else {
-            Log_Debug("Using DPS Connection: Azure IoT DPS Scope ID %s\n", scopeId);
+            LOG_INFO("Using DPS Connection: Azure IoT DPS Scope ID %s\n", scopeId);
         }
     }
 
@@ -337,7 +1191,7 @@ static ExitCode ValidateUserConfiguration(void) {
         }
 
         if (validationExitCode == ExitCode_Success) {
-            Log_Debug("Using Direct Connection: Azure IoT Hub Hostname %s\n", hostName);
+            LOG_INFO("Using Direct Connection: Azure IoT Hub Hostname %s\n", hostName);
         }
     }
 
@@ -351,13 +1205,44 @@ static ExitCode ValidateUserConfiguration(void) {
         }
 
         if (validationExitCode == ExitCode_Success) {
-            Log_Debug("Using IoTEdge Connection: IoT Edge device Hostname %s, IoTEdge CA path %s\n",
+            LOG_INFO("Using IoTEdge Connection: IoT Edge device Hostname %s, IoTEdge CA path %s\n",
                 hostName, iotEdgeRootCAPath);
         }
     }
 
+    // Sampling options are optional, so fall back to the defaults rather than failing.
+    if (sampleRateHz <= 0 || sampleRateHz > MaxSampleRateHz) {
+        sampleRateHz = DefaultSampleRateHz;
+    }
+    if (decimationWindow == 0 || decimationWindow > SAMPLE_RING_CAPACITY) {
+        decimationWindow = DefaultDecimationWindow;
+    }
+    LOG_INFO("Sampling ADC at %d Hz%s, %s of %u samples per reading\n", sampleRateHz,
+        isSamplerThreaded ? " on the sampler thread" : "",
+        decimationMode == SampleDecimation_Median ? "median" : "average",
+        (unsigned int)decimationWindow);
+
+    if (batchSize == 0 || batchSize > TELEMETRY_BATCH_CAPACITY) {
+        batchSize = DefaultBatchSize;
+    }
+    if (batchMaxLatencySeconds <= 0) {
+        batchMaxLatencySeconds = DefaultBatchMaxLatencySeconds;
+    }
+    if (batchSize > 1) {
+        LOG_INFO("Batching %u readings per message, sent at least every %d seconds\n",
+            (unsigned int)batchSize, batchMaxLatencySeconds);
+    }
+
+    if (pumpMicrounitsPerMs == 0) {
+        pumpMicrounitsPerMs = DefaultPumpMicrounitsPerMs;
+    }
+    LOG_INFO("Pump calibrated at %u microunits per ms\n", (unsigned int)pumpMicrounitsPerMs);
+    if (realTimeComponentId != NULL) {
+        LOG_INFO("Sampling and pump offloaded to real-time app %s\n", realTimeComponentId);
+    }
+
     if (validationExitCode != ExitCode_Success) {
-        Log_Debug("Command line arguments for application shoud be set as below\n%s",
+        LOG_ERROR("Command line arguments for application shoud be set as below\n%s",
             cmdLineArgsUsageText);
     }
 
@@ -370,7 +1255,7 @@ static void CloseFdAndPrintError(int fd, const char* fdName) {
     if (fd >= 0) {
         int result = close(fd);
         if (result != 0) {
-            Log_Debug("ERROR: Could not close fd %s: %s (%d).\n", fdName, strerror(errno), errno);
+            LOG_ERROR("ERROR: Could not close fd %s: %s (%d).\n", fdName, strerror(errno), errno);
         }
     }
 }
@@ -382,62 +1267,138 @@ static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
     IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
     void* userContextCallback)
 {
-    Log_Debug("Azure IoT connection status: %s\n", GetReasonString(reason));
+    LOG_INFO("Azure IoT connection status: %s\n", GetReasonString(reason));
 
     if (result != IOTHUB_CLIENT_CONNECTION_AUTHENTICATED) {
         iotHubClientAuthenticationState = IoTHubClientAuthenticationState_NotAuthenticated;
+        HealthMonitor_RecordDisconnected();
+
+        // Provision again if the assigned hub has never worked, or no longer accepts the device.
+        // Network failures on a hub which has worked are retried against the same hub.
+        if (connectionType == ConnectionType_DPS && dpsHubHostName[0] != '\0' &&
+            (!isDpsHubHostNameVerified || reason == IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL ||
+                reason == IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED)) {
+            LOG_WARNING("WARNING: Could not authenticate with %s; provisioning again.\n",
+                dpsHubHostName);
+            ForgetDpsHubHostName();
+        }
+
+        // An expired SAS token is routine, so reconnect straight away; otherwise back off.
+        if (reason == IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN) {
+            ReconnectPolicy_RetryNow();
+        }
+        else {
+            uint32_t delayMs = ReconnectPolicy_Failed(ClassifyConnectionFailure(reason));
+            LOG_WARNING("WARNING: Azure IoT connection lost - will retry in %u ms.\n",
+                (unsigned int)delayMs);
+        }
+
+        // The network may have gone, or another interface become preferred, since the last
+        // heartbeat. A change found now retries straight away through the new interface.
+        ConnectivityMonitor_Refresh();
+
+        // Start checking the network again so that the client is set up afresh.
+        struct timespec azurePollPeriod = {
+            .tv_sec = AzureIoTDefaultPollPeriodSeconds, .tv_nsec = 0 };
+        Scheduler_SetJobPeriod(connectionJob, &azurePollPeriod);
         return;
     }
 
     iotHubClientAuthenticationState = IoTHubClientAuthenticationState_Authenticated;
+    HealthMonitor_RecordConnected();
+    ReconnectPolicy_Succeeded();
+
+    // The assigned hub works, so connect straight to it next time.
+    if (connectionType == ConnectionType_DPS && !isDpsHubHostNameVerified) {
+        isDpsHubHostNameVerified = true;
+        if (!isDpsHubHostNameCached) {
+            if (HubCache_Save(mutableStorageFd, HUB_CACHE_OFFSET, scopeId, dpsHubHostName) == 0) {
+                isDpsHubHostNameCached = true;
+            }
+            else {
+                LOG_WARNING("WARNING: Could not cache the IoT Hub hostname: %s (%d)\n",
+                    strerror(errno), errno);
+            }
+        }
+    }
+
+    // Nothing needs checking while authenticated, so only wake for work that is actually due.
+    Scheduler_DisableJob(connectionJob);
+    if (TelemetryStore_PendingCount(&telemetryStore) > 0 || DoseEvents_PendingCount() > 0) {
+        ScheduleReplay();
+        Scheduler_RunJobSoon(replayJob);
+    }
 
-    // Send static device twin properties when connection is established.
-    TwinReportState("{\"manufacturer\":\"Microsoft\",\"model\":\"Azure Sphere Sample Device\"}");
+    // Send the latest alert change if it was raised while the device was offline.
+    if (isAlertUnsent) {
+        SendGlucoseAlert();
+    }
+
+    // Send any reported properties which the IoT Hub has not yet acknowledged, without waiting
+    // out a retry delay from the previous connection.
+    reportRetryDelayMs = 0;
+    if (ReportedState_IsPatchPending()) {
+        Scheduler_DisableJob(reportJob);
+        ScheduleReport();
+    }
 }
 
 // Set up the Azure IoT Hub connection (creates the iothubClientHandle)
 // When the SAS Token for a device expires the connection needs to be recreated
 // which is why this is not simply a one time call.
 static void SetUpAzureIoTHubClient(void) {
-    bool isClientSetupSuccessful = false;
-
     if (iothubClientHandle != NULL) {
         IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
-    }
+        iothubClientHandle = NULL;
+        clientConnectionProfile = NULL;
+        HealthMonitor_RecordDisconnected();
 
-    if ((connectionType == ConnectionType_Direct) || (connectionType == ConnectionType_IoTEdge)) {
-        isClientSetupSuccessful = SetUpAzureIoTHubClientWithDaa();
-    }
-    else if (connectionType == ConnectionType_DPS) {
-        isClientSetupSuccessful = SetUpAzureIoTHubClientWithDps();
+        // Reports in flight on the old client will never be acknowledged, so resend them.
+        ReportedState_CancelInFlight();
     }
 
-    if (!isClientSetupSuccessful) {
-        // If we fail to connect, reduce the polling frequency, starting at
-        // AzureIoTMinReconnectPeriodSeconds and with a backoff up to
-        // AzureIoTMaxReconnectPeriodSeconds
-        if (azureIoTPollPeriodSeconds == AzureIoTDefaultPollPeriodSeconds) {
-            azureIoTPollPeriodSeconds = AzureIoTMinReconnectPeriodSeconds;
-        }
-        else {
-            azureIoTPollPeriodSeconds *= 2;
-            if (azureIoTPollPeriodSeconds > AzureIoTMaxReconnectPeriodSeconds) {
-                azureIoTPollPeriodSeconds = AzureIoTMaxReconnectPeriodSeconds;
+    if (connectionType == ConnectionType_DPS) {
+        if (dpsHubHostName[0] != '\0') {
+            LOG_INFO("Connecting to assigned IoT Hub %s\n", dpsHubHostName);
+            if (SetUpAzureIoTHubClientWithDaa(dpsHubHostName)) {
+                FinishAzureIoTHubClientSetUp(ReconnectFailure_Transient, true);
+                return;
             }
+            ForgetDpsHubHostName();
         }
 
-        struct timespec azureTelemetryPeriod = { azureIoTPollPeriodSeconds, 0 };
-        SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
+        // Provisioning can block for DpsProvisioningTimeoutMs, so it runs on a worker thread and
+        // the setup is finished by DpsProvisioningCompleted. Mark authentication as initiated
+        // meanwhile, so that the connection job does not start another attempt.
+        if (DpsProvisioner_Start(scopeId, DpsProvisioningTimeoutMs,
+            connectionProfile->transport == ConnectionTransport_MqttWebSockets) == -1) {
+            LOG_ERROR("ERROR: Could not start DPS provisioning: %s (%d).\n", strerror(errno),
+                errno);
+            FinishAzureIoTHubClientSetUp(ReconnectFailure_Transient, false);
+            return;
+        }
+        iotHubClientAuthenticationState = IoTHubClientAuthenticationState_AuthenticationInitiated;
+        return;
+    }
 
-        Log_Debug("ERROR: Failed to create IoTHub Handle - will retry in %i seconds.\n",
-            azureIoTPollPeriodSeconds);
+    FinishAzureIoTHubClientSetUp(ReconnectFailure_Transient,
+        SetUpAzureIoTHubClientWithDaa(hostName));
+}
+
+// Back off if the client could not be created, according to the class of the failure, otherwise
+// start driving it and register its callbacks.
+static void FinishAzureIoTHubClientSetUp(ReconnectFailureClass failure,
+    bool isClientSetupSuccessful) {
+    if (!isClientSetupSuccessful) {
+        uint32_t delayMs = ReconnectPolicy_Failed(failure);
+        LOG_ERROR("ERROR: Failed to create IoTHub Handle - will retry in %u ms.\n",
+            (unsigned int)delayMs);
         return;
     }
 
-    // Successfully connected, so make sure the polling frequency is back to the default
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = { .tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0 };
-    SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
+    struct timespec azurePollPeriod = { .tv_sec = AzureIoTDefaultPollPeriodSeconds, .tv_nsec = 0 };
+    Scheduler_SetJobPeriod(doWorkJob, &azurePollPeriod);
+    Scheduler_RunJobSoon(doWorkJob);
 
     // Set client authentication state to initiated. This is done to indicate that
     // SetUpAzureIoTHubClient() has been called (and so should not be called again) while the
@@ -450,23 +1411,24 @@ static void SetUpAzureIoTHubClient(void) {
         NULL);
 }
 
-// Set up the Azure IoT Hub connection (creating the iothubClientHandle) with DAA.
-static bool SetUpAzureIoTHubClientWithDaa(void) {
+// Set up the Azure IoT Hub connection (creating the iothubClientHandle) with DAA. On failure,
+// iothubClientHandle is left NULL.
+static bool SetUpAzureIoTHubClientWithDaa(const char* hubHostName) {
     bool retVal = true;
 
     // Set up auth type
     int retError = iothub_security_init(IOTHUB_SECURITY_TYPE_X509);
     if (retError != 0) {
-        Log_Debug("ERROR: iothub_security_init failed with error %d.\n", retError);
+        LOG_ERROR("ERROR: iothub_security_init failed with error %d.\n", retError);
         return false;
     }
 
     // Create Azure Iot Hub client handle
-    iothubClientHandle =
-        IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(hostName, MQTT_Protocol);
+    iothubClientHandle = IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(hubHostName,
+        ConnectionProfile_Transport(connectionProfile));
 
     if (iothubClientHandle == NULL) {
-        Log_Debug("IoTHubDeviceClient_LL_CreateFromDeviceAuth returned NULL.\n");
+        LOG_ERROR("IoTHubDeviceClient_LL_CreateFromDeviceAuth returned NULL.\n");
         retVal = false;
         goto cleanup;
     }
@@ -474,17 +1436,24 @@ static bool SetUpAzureIoTHubClientWithDaa(void) {
     // Enable DAA cert usage when X509 is invoked
     if (IoTHubDeviceClient_LL_SetOption(iothubClientHandle, "SetDeviceId",
         &deviceIdForDaaCertUsage) != IOTHUB_CLIENT_OK) {
-        Log_Debug("ERROR: Failure setting Azure IoT Hub client option \"SetDeviceId\".\n");
+        LOG_ERROR("ERROR: Failure setting Azure IoT Hub client option \"SetDeviceId\".\n");
         retVal = false;
         goto cleanup;
     }
 
+    // Set the keep-alive, retry policy and message timeout of the selected connection profile.
+    if (ConnectionProfile_Apply(iothubClientHandle, connectionProfile) == -1) {
+        retVal = false;
+        goto cleanup;
+    }
+    clientConnectionProfile = connectionProfile;
+
     if (connectionType == ConnectionType_IoTEdge) {
         // Provide the Azure IoT device client with the IoT Edge root
         // X509 CA certificate that was used to setup the Edge runtime.
         if (IoTHubDeviceClient_LL_SetOption(iothubClientHandle, OPTION_TRUSTED_CERT,
             iotEdgeRootCACertContent) != IOTHUB_CLIENT_OK) {
-            Log_Debug("ERROR: Failure setting Azure IoT Hub client option \"TrustedCerts\".\n");
+            LOG_ERROR("ERROR: Failure setting Azure IoT Hub client option \"TrustedCerts\".\n");
             retVal = false;
             goto cleanup;
         }
@@ -493,7 +1462,7 @@ static bool SetUpAzureIoTHubClientWithDaa(void) {
         bool urlEncodeOn = true;
         if (IoTHubDeviceClient_LL_SetOption(iothubClientHandle, OPTION_AUTO_URL_ENCODE_DECODE,
             &urlEncodeOn) != IOTHUB_CLIENT_OK) {
-            Log_Debug(
+            LOG_ERROR(
                 "ERROR: Failure setting Azure IoT Hub client option "
                 "\"OPTION_AUTO_URL_ENCODE_DECODE\".\n");
             retVal = false;
@@ -502,78 +1471,352 @@ static bool SetUpAzureIoTHubClientWithDaa(void) {
     }
 
 cleanup:
+    // A half set up client is not used, and callers fall back to DPS or retry, which would
+    // otherwise create another handle over this one.
+    if (!retVal && iothubClientHandle != NULL) {
+        IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
+        iothubClientHandle = NULL;
+        clientConnectionProfile = NULL;
+    }
     iothub_security_deinit();
 
     return retVal;
 }
 
-// Set up the Azure IoT Hub connection (creating the iothubClientHandle) with DPS.
-static bool SetUpAzureIoTHubClientWithDps(void) {
-    AZURE_SPHERE_PROV_RETURN_VALUE provResult =
-        IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(scopeId, 10000,
-            &iothubClientHandle);
-    Log_Debug("IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning returned '%s'.\n",
-        GetAzureSphereProvisioningResultString(provResult));
+// The DPS provisioning worker has finished: connect to the assigned hub, if any.
+static void DpsProvisioningCompleted(AZURE_SPHERE_PROV_RETURN_VALUE result,
+    const char* hubHostName) {
+    LOG_INFO("DPS provisioning returned '%s'.\n", GetAzureSphereProvisioningResultString(result));
 
-    if (provResult.result != AZURE_SPHERE_PROV_RESULT_OK) {
-        return false;
+    iotHubClientAuthenticationState = IoTHubClientAuthenticationState_NotAuthenticated;
+    if (hubHostName == NULL) {
+        FinishAzureIoTHubClientSetUp(ClassifyProvisioningFailure(result), false);
+        return;
+    }
+
+    LOG_INFO("Assigned to IoT Hub %s\n", hubHostName);
+    strncpy(dpsHubHostName, hubHostName, sizeof(dpsHubHostName) - 1);
+    isDpsHubHostNameVerified = false;
+    isDpsHubHostNameCached = false;
+    FinishAzureIoTHubClientSetUp(ReconnectFailure_Transient,
+        SetUpAzureIoTHubClientWithDaa(dpsHubHostName));
+}
+
+// Read the IoT Hub which DPS last assigned, so that the first connection can skip DPS.
+static void LoadDpsHubHostName(void) {
+    if (connectionType != ConnectionType_DPS || mutableStorageFd == -1) {
+        return;
+    }
+
+    if (HubCache_Load(mutableStorageFd, HUB_CACHE_OFFSET, scopeId, dpsHubHostName,
+        sizeof(dpsHubHostName)) == 0) {
+        isDpsHubHostNameCached = true;
+        LOG_INFO("Using cached IoT Hub %s\n", dpsHubHostName);
     }
+    else {
+        dpsHubHostName[0] = '\0';
+    }
+}
+
+// Stop using the assigned IoT Hub, so that the next connection is provisioned through DPS.
+static void ForgetDpsHubHostName(void) {
+    dpsHubHostName[0] = '\0';
+    isDpsHubHostNameVerified = false;
+    if (isDpsHubHostNameCached) {
+        isDpsHubHostNameCached = false;
+        if (HubCache_Clear(mutableStorageFd, HUB_CACHE_OFFSET) == -1) {
+            LOG_WARNING("WARNING: Could not clear the cached IoT Hub hostname: %s (%d)\n",
+                strerror(errno), errno);
+        }
+    }
+}
+
+// Device twin property "StatusLED": turn the status LED on or off.
+static void StatusLedPropertyChanged(const TwinValue* value) {
+    statusLedOn = value->boolValue;
+    UpdateRgbLed();
+    if (ReportedState_SetBool(statusLedProperty, statusLedOn)) {
+        ScheduleReport();
+    }
+}
+
+// Device twin property "LogLevel": change the runtime log level, e.g. to debug a single device.
+static void LogLevelPropertyChanged(const TwinValue* value) {
+    char name[16];
+    int logLevel;
+
+    if (value->stringLength >= sizeof(name)) {
+        LOG_WARNING("WARNING: Unknown log level.\n");
+        return;
+    }
+    memcpy(name, value->stringValue, value->stringLength);
+    name[value->stringLength] = 0;
+
+    if (AppLog_ParseLevel(name, &logLevel)) {
+        logLevel = AppLog_SetLevel(logLevel);
+        LOG_INFO("INFO: Log level set to %s.\n", AppLog_LevelName(logLevel));
 
+        // Report the level actually in effect, which is limited by the image's compiled level.
+        if (ReportedState_SetString(logLevelProperty, AppLog_LevelName(logLevel))) {
+            ScheduleReport();
+        }
+    }
+    else {
+        LOG_WARNING("WARNING: Unknown log level \"%s\".\n", name);
+    }
+}
+
+// Narrow a twin number to hundredths in an int32, for thresholds and calibrations. Numbers out
+// of range are rejected rather than wrapped, which could turn them into plausible values.
+static bool TwinValueToHundredths(const TwinValue* value, const char* name,
+    int32_t* outHundredths) {
+    if (value->numberHundredths < INT32_MIN || value->numberHundredths > INT32_MAX) {
+        LOG_WARNING("WARNING: Ignoring out of range %s.\n", name);
+        return false;
+    }
+    *outHundredths = (int32_t)value->numberHundredths;
     return true;
 }
 
-// Callback invoked when a Device Twin update is received from Azure IoT Hub.
-static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload,
-    size_t payloadSize, void* userContextCallback)
-{
-    // Statically allocate this for more predictable memory use patterns
-    static char nullTerminatedJsonString[MAX_DEVICE_TWIN_PAYLOAD_SIZE + 1];
+// Convert a twin value in seconds to milliseconds, saturating; negative values become 0.
+static uint32_t TwinSecondsToMilliseconds(const TwinValue* value) {
+    if (value->numberHundredths <= 0) {
+        return 0;
+    }
+    if (value->numberHundredths > UINT32_MAX / 10) {
+        return UINT32_MAX;
+    }
+    return (uint32_t)value->numberHundredths * 10;
+}
 
-    if (payloadSize > MAX_DEVICE_TWIN_PAYLOAD_SIZE) {
-        Log_Debug("ERROR: Device twin payload size (%u bytes) exceeds maximum (%u bytes).\n",
-            payloadSize, MAX_DEVICE_TWIN_PAYLOAD_SIZE);
+// Device twin property "TelemetryMinPeriodSeconds": the shortest adaptive telemetry period.
+static void TelemetryMinPeriodPropertyChanged(const TwinValue* value) {
+    desiredTelemetryMinPeriodMs = TwinSecondsToMilliseconds(value);
+}
+
+// Device twin property "TelemetryMaxPeriodSeconds": the longest adaptive telemetry period.
+static void TelemetryMaxPeriodPropertyChanged(const TwinValue* value) {
+    desiredTelemetryMaxPeriodMs = TwinSecondsToMilliseconds(value);
+}
 
-        exitCode = ExitCode_PayloadSize_TooLarge;
+// Apply the telemetry period bounds from the device twin, if they have changed and are valid.
+static void ApplyTelemetryPeriodBounds(void) {
+    if (desiredTelemetryMinPeriodMs == telemetryMinPeriodMs &&
+        desiredTelemetryMaxPeriodMs == telemetryMaxPeriodMs) {
         return;
     }
 
-    // Copy the payload to local buffer for null-termination.
-    memcpy(nullTerminatedJsonString, payload, payloadSize);
+    if (TelemetryRate_SetBounds(desiredTelemetryMinPeriodMs, desiredTelemetryMaxPeriodMs) == -1) {
+        LOG_WARNING("WARNING: Ignoring invalid telemetry period bounds %u-%u ms.\n",
+            (unsigned int)desiredTelemetryMinPeriodMs, (unsigned int)desiredTelemetryMaxPeriodMs);
+        desiredTelemetryMinPeriodMs = telemetryMinPeriodMs;
+        desiredTelemetryMaxPeriodMs = telemetryMaxPeriodMs;
+        return;
+    }
 
-    // Add the null terminator at the end.
-    nullTerminatedJsonString[payloadSize] = 0;
+    telemetryMinPeriodMs = desiredTelemetryMinPeriodMs;
+    telemetryMaxPeriodMs = desiredTelemetryMaxPeriodMs;
+    LOG_INFO("INFO: Telemetry period bounds set to %u-%u ms.\n",
+        (unsigned int)telemetryMinPeriodMs, (unsigned int)telemetryMaxPeriodMs);
+    bool isMinChanged = ReportedState_SetInt(telemetryMinPeriodProperty,
+        telemetryMinPeriodMs / 1000);
+    bool isMaxChanged = ReportedState_SetInt(telemetryMaxPeriodProperty,
+        telemetryMaxPeriodMs / 1000);
+    if (isMinChanged || isMaxChanged) {
+        ScheduleReport();
+    }
+}
 
-    JSON_Value* rootProperties = NULL;
-    rootProperties = json_parse_string(nullTerminatedJsonString);
-    if (rootProperties == NULL) {
-        Log_Debug("WARNING: Cannot parse the string as JSON content.\n");
-        goto cleanup;
+// Device twin property "AlertLowThreshold": the level below which the low alert is raised.
+static void AlertLowThresholdPropertyChanged(const TwinValue* value) {
+    TwinValueToHundredths(value, "AlertLowThreshold", &desiredAlertThresholds.lowHundredths);
+}
+
+// Device twin property "AlertHighThreshold": the level above which the high alert is raised.
+static void AlertHighThresholdPropertyChanged(const TwinValue* value) {
+    TwinValueToHundredths(value, "AlertHighThreshold", &desiredAlertThresholds.highHundredths);
+}
+
+// Device twin property "AlertHysteresis": how far back inside a threshold a level must be to
+// clear its alert.
+static void AlertHysteresisPropertyChanged(const TwinValue* value) {
+    TwinValueToHundredths(value, "AlertHysteresis", &desiredAlertThresholds.hysteresisHundredths);
+}
+
+// Apply the alert thresholds from the device twin, if they have changed and are valid. The low
+// threshold is also the urgent reading threshold and the one the telemetry rate watches.
+static void ApplyAlertThresholds(void) {
+    if (memcmp(&desiredAlertThresholds, &alertThresholds, sizeof(alertThresholds)) == 0) {
+        return;
     }
 
-    JSON_Object* rootObject = json_value_get_object(rootProperties);
-    JSON_Object* desiredProperties = json_object_dotget_object(rootObject, "desired");
-    if (desiredProperties == NULL) {
-        desiredProperties = rootObject;
+    if (GlucoseAlerts_SetThresholds(&desiredAlertThresholds) == -1) {
+        LOG_WARNING("WARNING: Ignoring invalid alert thresholds.\n");
+        desiredAlertThresholds = alertThresholds;
+        return;
     }
 
-    // The desired properties should have a "StatusLED" object
-    int statusLedValue = json_object_dotget_boolean(desiredProperties, "StatusLED");
-    if (statusLedValue != -1) {
-        statusLedOn = statusLedValue == 1;
-        GPIO_SetValue(deviceTwinStatusLedGpioFd, statusLedOn ? GPIO_Value_Low : GPIO_Value_High);
+    alertThresholds = desiredAlertThresholds;
+    TelemetryRate_SetLowThreshold(alertThresholds.lowHundredths);
+    bool isLowChanged =
+        ReportedState_SetHundredths(alertLowThresholdProperty, alertThresholds.lowHundredths);
+    bool isHighChanged =
+        ReportedState_SetHundredths(alertHighThresholdProperty, alertThresholds.highHundredths);
+    bool isHysteresisChanged = ReportedState_SetHundredths(alertHysteresisProperty,
+        alertThresholds.hysteresisHundredths);
+    if (isLowChanged || isHighChanged || isHysteresisChanged) {
+        ScheduleReport();
     }
+}
 
-    // Report current status LED state
-    if (statusLedOn) {
-        TwinReportState("{\"StatusLED\":true}");
+// Device twin properties "Calibration.C0" to "Calibration.C3": coefficients of the glucose
+// calibration curve, as a polynomial in the fraction of the ADC's full scale.
+static void SetDesiredCalibrationCoefficient(size_t power, const TwinValue* value) {
+    if (TwinValueToHundredths(value, "calibration coefficient",
+        &desiredCalibration.coefficientsHundredths[power])) {
+        isCalibrationDesired = true;
     }
-    else {
-        TwinReportState("{\"StatusLED\":false}");
+}
+
+static void CalibrationC0PropertyChanged(const TwinValue* value) {
+    SetDesiredCalibrationCoefficient(0, value);
+}
+
+static void CalibrationC1PropertyChanged(const TwinValue* value) {
+    SetDesiredCalibrationCoefficient(1, value);
+}
+
+static void CalibrationC2PropertyChanged(const TwinValue* value) {
+    SetDesiredCalibrationCoefficient(2, value);
+}
+
+static void CalibrationC3PropertyChanged(const TwinValue* value) {
+    SetDesiredCalibrationCoefficient(3, value);
+}
+
+// Device twin property "Calibration.TemperatureCoefficient": how much the sensor's sensitivity
+// rises per degree Celsius, in percent.
+static void CalibrationTemperatureCoefficientPropertyChanged(const TwinValue* value) {
+    if (TwinValueToHundredths(value, "Calibration.TemperatureCoefficient",
+        &desiredCalibration.temperatureCoefficientHundredths)) {
+        isCalibrationDesired = true;
     }
+}
 
-cleanup:
-    // Release the allocated memory.
-    json_value_free(rootProperties);
+// Device twin property "Calibration.ReferenceTemperature": the temperature, in degrees Celsius,
+// at which the curve needs no correction.
+static void CalibrationReferenceTemperaturePropertyChanged(const TwinValue* value) {
+    if (TwinValueToHundredths(value, "Calibration.ReferenceTemperature",
+        &desiredCalibration.referenceTemperatureHundredths)) {
+        isCalibrationDesired = true;
+    }
+}
+
+// Compile the calibration from the device twin, if it has changed or the ADC's sample size has,
+// and keep a new calibration in mutable storage. With the real-time core, the sample size is
+// only known once samples arrive, so compiling waits until then.
+static void ApplyCalibration(void) {
+    int bitCount = SensorChannels_BitCount(SensorChannel_Glucose);
+    if (!isCalibrationDesired || bitCount == 0 ||
+        (CalibrationCurve_BitCount() == bitCount &&
+            memcmp(&desiredCalibration, &calibration, sizeof(calibration)) == 0)) {
+        return;
+    }
+
+    if (CalibrationCurve_Compile(&desiredCalibration, bitCount) == -1) {
+        LOG_WARNING("WARNING: Ignoring invalid glucose calibration.\n");
+        desiredCalibration = calibration;
+        isCalibrationDesired = CalibrationCurve_IsCompiled();
+        return;
+    }
+
+    bool isChanged = memcmp(&desiredCalibration, &calibration, sizeof(calibration)) != 0;
+    calibration = desiredCalibration;
+    LOG_INFO("INFO: Glucose calibration compiled for %d-bit samples.\n", bitCount);
+    if (ReportedState_SetBool(calibratedProperty, true)) {
+        ScheduleReport();
+    }
+
+    if (isChanged && mutableStorageFd != -1 &&
+        CalibrationCache_Save(mutableStorageFd, CALIBRATION_CACHE_OFFSET, &calibration) == -1) {
+        LOG_WARNING("WARNING: Could not save glucose calibration: %s (%d).\n", strerror(errno),
+            errno);
+    }
+}
+
+// Put the calibration which was last accepted from the device twin back into effect, before the
+// first reading, so that readings and alerts after a restart are not raw sensor voltages.
+static void RestoreCalibration(void) {
+    if (mutableStorageFd == -1 ||
+        CalibrationCache_Load(mutableStorageFd, CALIBRATION_CACHE_OFFSET, &calibration) == -1) {
+        return;
+    }
+
+    LOG_INFO("INFO: Restoring glucose calibration from mutable storage.\n");
+    desiredCalibration = calibration;
+    isCalibrationDesired = true;
+    ApplyCalibration();
+}
+
+// Device twin property "ConnectionProfile": how the IoT Hub client connects, by profile name.
+static void ConnectionProfilePropertyChanged(const TwinValue* value) {
+    const ConnectionProfile* profile = ConnectionProfile_Find(connectionProfiles,
+        sizeof(connectionProfiles) / sizeof(connectionProfiles[0]), value->stringValue,
+        value->stringLength);
+    if (profile == NULL) {
+        LOG_WARNING("WARNING: Unknown connection profile \"%.*s\".\n", (int)value->stringLength,
+            value->stringValue);
+        return;
+    }
+
+    connectionProfile = profile;
+    if (ReportedState_SetString(connectionProfileProperty, connectionProfile->name)) {
+        ScheduleReport();
+    }
+}
+
+// Connect afresh if the device twin has selected a different connection profile from the one
+// the client was created with, as the transport and keep-alive are fixed when it connects. The
+// client cannot be destroyed from its own callback, so the connection job sets up the new one.
+static void ApplyConnectionProfile(void) {
+    if (clientConnectionProfile == NULL || clientConnectionProfile == connectionProfile ||
+        iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated) {
+        return;
+    }
+
+    LOG_INFO("INFO: Reconnecting with connection profile %s.\n", connectionProfile->name);
+    iotHubClientAuthenticationState = IoTHubClientAuthenticationState_NotAuthenticated;
+    struct timespec azurePollPeriod = { .tv_sec = AzureIoTDefaultPollPeriodSeconds, .tv_nsec = 0 };
+    Scheduler_SetJobPeriod(connectionJob, &azurePollPeriod);
+    ReconnectPolicy_RetryNow();
+    Scheduler_RunJobSoon(connectionJob);
+}
+
+// Callback invoked when a Device Twin update is received from Azure IoT Hub. The payload is
+// walked once in place, so it is neither copied nor limited in size.
+static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload,
+    size_t payloadSize, void* userContextCallback)
+{
+    // A complete twin holds the desired properties in its "desired" object, whereas a patch
+    // holds them at the root.
+    bool isCompleteTwin = updateState == DEVICE_TWIN_UPDATE_COMPLETE;
+    if (TwinParser_Parse(payload, payloadSize, isCompleteTwin, twinProperties,
+        sizeof(twinProperties) / sizeof(twinProperties[0])) == -1) {
+        LOG_WARNING("WARNING: Cannot parse the string as JSON content.\n");
+    }
+    ApplyTelemetryPeriodBounds();
+    ApplyAlertThresholds();
+    ApplyCalibration();
+    ApplyConnectionProfile();
+}
+
+// Callback invoked when a Direct Method is received from Azure IoT Hub.
+static int DeviceMethodCallback(const char* methodName, const unsigned char* payload,
+    size_t payloadSize, unsigned char** response, size_t* responseSize,
+    void* userContextCallback)
+{
+    LOG_INFO("Received Device Method callback: Method name %s.\n", methodName);
+    return MethodDispatch_Invoke(methodName, payload, payloadSize, response, responseSize);
 }
 
 // Converts the Azure IoT Hub connection status reason to a string.
@@ -630,24 +1873,60 @@ static const char* GetAzureSphereProvisioningResultString(
     }
 }
 
-// Check the network status.
-static bool IsConnectionReadyToSendTelemetry(void) {
-    Networking_InterfaceConnectionStatus status;
-    if (Networking_GetInterfaceConnectionStatus(networkInterface, &status) != 0) {
-        if (errno != EAGAIN) {
-            Log_Debug("ERROR: Networking_GetInterfaceConnectionStatus: %d (%s)\n", errno,
-                strerror(errno));
-            exitCode = ExitCode_InterfaceConnectionStatus_Failed;
-            return false;
-        }
-        Log_Debug(
-            "WARNING: Cannot send Azure IoT Hub telemetry because the networking stack isn't ready "
-            "yet.\n");
-        return false;
+// Decide how long to back off after provisioning fails. Errors from the provisioning client
+// itself are transient unless DPS rejected the device.
+static ReconnectFailureClass ClassifyProvisioningFailure(AZURE_SPHERE_PROV_RETURN_VALUE result) {
+    switch (result.result) {
+    case AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY:
+    case AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY:
+        return ReconnectFailure_NetworkNotReady;
+    case AZURE_SPHERE_PROV_RESULT_INVALID_PARAM:
+        return ReconnectFailure_Credential;
+    case AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR:
+        switch (result.prov_device_error) {
+        case PROV_DEVICE_RESULT_DEV_AUTH_ERROR:
+        case PROV_DEVICE_RESULT_UNAUTHORIZED:
+        case PROV_DEVICE_RESULT_DISABLED:
+        case PROV_DEVICE_RESULT_HUB_NOT_SPECIFIED:
+            return ReconnectFailure_Credential;
+        default:
+            return ReconnectFailure_Transient;
+        }
+    default:
+        return ReconnectFailure_Transient;
+    }
+}
+
+// Decide how long to back off after the IoT Hub connection fails, by the reasons that
+// GetReasonString reports.
+static ReconnectFailureClass ClassifyConnectionFailure(
+    IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason) {
+    switch (reason) {
+    case IOTHUB_CLIENT_CONNECTION_NO_NETWORK:
+        return ReconnectFailure_NetworkNotReady;
+    case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:
+    case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:
+        return ReconnectFailure_Credential;
+    default:
+        return ReconnectFailure_Transient;
     }
+}
+
+// Seed for the reconnect jitter. Devices boot at different times, so the sub-second part of the
+// clocks differs between devices even when an outage ends for all of them at once.
+static uint32_t GetReconnectSeed(void) {
+    struct timespec monotonic;
+    struct timespec realtime;
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    return (uint32_t)monotonic.tv_nsec ^ ((uint32_t)monotonic.tv_sec << 16) ^
+           (uint32_t)realtime.tv_nsec;
+}
 
-    if ((status & Networking_InterfaceConnectionStatus_ConnectedToInternet) == 0) {
-        Log_Debug(
+// Check the network status, as last seen by the connectivity monitor.
+static bool IsConnectionReadyToSendTelemetry(void) {
+    if (!ConnectivityMonitor_IsConnected()) {
+        LOG_WARNING(
             "WARNING: Cannot send Azure IoT Hub telemetry because the device is not connected to "
             "the internet.\n");
         return false;
@@ -656,86 +1935,551 @@ static bool IsConnectionReadyToSendTelemetry(void) {
     return true;
 }
 
-// Send telemetry to Azure IoT Hub.
-static void SendTelemetry(const char* jsonMessage) {
+// Send a JSON string as telemetry to Azure IoT Hub.
+// Returns true if the message was accepted for delivery.
+static bool SendTelemetry(const char* jsonMessage) {
+    return SendTelemetryBytes((const uint8_t*)jsonMessage, strlen(jsonMessage),
+        TelemetryEncoding_Json) != NULL;
+}
+
+// Send an encoded payload as telemetry to Azure IoT Hub, tagged with the content type of its
+// encoding. Returns the message's delivery window slot if it was accepted for delivery.
+static DeliverySlot* SendTelemetryBytes(const uint8_t* payload, size_t size,
+    TelemetryEncoding encoding) {
+    return SendTelemetryMessage(payload, size, encoding, MessagePriority_Normal);
+}
+
+// Send an encoded payload as telemetry, with a "priority" application property unless it is of
+// normal priority, so that the IoT Hub can route urgent messages ahead of routine telemetry and
+// health reports behind it. Each message takes a slot in the delivery window until it is
+// confirmed, and carries the slot's sequence number as its message ID. Returns the slot if the
+// message was accepted for delivery, or NULL if it was not, including when the window is full.
+static DeliverySlot* SendTelemetryMessage(const uint8_t* payload, size_t size,
+    TelemetryEncoding encoding, MessagePriority priority) {
     if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated) {
         // AzureIoT client is not authenticated. Log a warning and return.
-        Log_Debug("WARNING: Azure IoT Hub is not authenticated. Not sending telemetry.\n");
-        return;
+        LOG_WARNING("WARNING: Azure IoT Hub is not authenticated. Not sending telemetry.\n");
+        return NULL;
     }
 
-    Log_Debug("Sending Azure IoT Hub telemetry: %s.\n", jsonMessage);
+    LOG_DEBUG("Sending Azure IoT Hub telemetry: %u bytes of %s.\n", (unsigned int)size,
+        TelemetryEncoder_ContentType(encoding));
 
     // Check whether the device is connected to the internet.
     if (IsConnectionReadyToSendTelemetry() == false) {
-        return;
+        return NULL;
+    }
+
+    DeliverySlot* slot = DeliveryWindow_Acquire(priority == MessagePriority_Urgent);
+    if (slot == NULL) {
+        LOG_DEBUG("Delivery window full (%u messages awaiting confirmation). Not sending.\n",
+            (unsigned int)DeliveryWindow_InFlightCount());
+        return NULL;
     }
 
-    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString(jsonMessage);
+    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromByteArray(payload, size);
 
     if (messageHandle == 0) {
-        Log_Debug("ERROR: unable to create a new IoTHubMessage.\n");
-        return;
+        LOG_ERROR("ERROR: unable to create a new IoTHubMessage.\n");
+        DeliveryWindow_Release(slot);
+        return NULL;
+    }
+
+    char messageId[11];
+    snprintf(messageId, sizeof(messageId), "%u", (unsigned int)slot->sequence);
+    const char* contentEncoding = TelemetryEncoder_ContentEncoding(encoding);
+    if (IoTHubMessage_SetMessageId(messageHandle, messageId) != IOTHUB_MESSAGE_OK ||
+        IoTHubMessage_SetContentTypeSystemProperty(messageHandle,
+        TelemetryEncoder_ContentType(encoding)) != IOTHUB_MESSAGE_OK ||
+        (contentEncoding != NULL &&
+         IoTHubMessage_SetContentEncodingSystemProperty(messageHandle, contentEncoding) !=
+         IOTHUB_MESSAGE_OK)) {
+        LOG_ERROR("ERROR: unable to set the IoTHubMessage system properties.\n");
+        IoTHubMessage_Destroy(messageHandle);
+        DeliveryWindow_Release(slot);
+        return NULL;
     }
 
+    if (priority != MessagePriority_Normal) {
+        const char* priorityName = priority == MessagePriority_Urgent ? "urgent" : "low";
+        if (IoTHubMessage_SetProperty(messageHandle, "priority", priorityName) !=
+            IOTHUB_MESSAGE_OK) {
+            LOG_ERROR("ERROR: unable to set the IoTHubMessage priority.\n");
+            IoTHubMessage_Destroy(messageHandle);
+            DeliveryWindow_Release(slot);
+            return NULL;
+        }
+    }
+
+    // The health monitor's context timestamps the message, to time its confirmation.
+    slot->healthContext = HealthMonitor_MessageQueued();
     if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle, SendEventCallback,
-        /*&callback_param*/ NULL) != IOTHUB_CLIENT_OK) {
-        Log_Debug("ERROR: failure requesting IoTHubClient to send telemetry event.\n");
+        slot) != IOTHUB_CLIENT_OK) {
+        LOG_ERROR("ERROR: failure requesting IoTHubClient to send telemetry event.\n");
+        HealthMonitor_MessageAbandoned(slot->healthContext);
+        DeliveryWindow_Release(slot);
+        slot = NULL;
     }
     else {
-        Log_Debug("INFO: IoTHubClient accepted the telemetry event for delivery.\n");
+        LOG_DEBUG("IoTHubClient accepted telemetry message %s for delivery.\n", messageId);
+        Scheduler_RunJobSoon(doWorkJob);
     }
 
     IoTHubMessage_Destroy(messageHandle);
+    return slot;
 }
 
+// Encode readings in the configured telemetry encoding and send them as one message.
+// Returns the message's delivery window slot if it was accepted for delivery.
+static DeliverySlot* SendReadings(const TelemetryReading* readings, size_t count,
+    bool includeTime) {
+    static uint8_t encodeBuffer[TELEMETRY_ENCODER_BUFFER_SIZE];
+
+    size_t size = TelemetryEncoder_EncodeReadings(telemetryEncoding, readings, count, includeTime,
+        encodeBuffer, sizeof(encodeBuffer));
+    if (size == 0) {
+        LOG_ERROR("ERROR: Cannot write telemetry to buffer.\n");
+        return NULL;
+    }
 
-// Callback invoked when the Azure IoT Hub send event request is processed.
-static void SendEventCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* context) {
-    Log_Debug("INFO: Azure IoT Hub send telemetry event callback: status code %d.\n", result);
+    return SendTelemetryBytes(encodeBuffer, size, telemetryEncoding);
 }
 
-// Enqueue a report containing Device Twin reported properties. The report is not sent
-// immediately, but it is sent on the next invocation of IoTHubDeviceClient_LL_DoWork().
-static void TwinReportState(const char* jsonState) {
-    if (iothubClientHandle == NULL) {
-        Log_Debug("ERROR: Azure IoT Hub client not initialized.\n");
+// Send readings just taken, keeping a copy until they are confirmed. Readings which cannot be
+// sent, including while the delivery window is full, are stored instead: this is the sampling
+// pipeline's backpressure, as the store is replayed as the window drains.
+static void SendLiveReadings(const TelemetryReading* readings, size_t count, bool includeTime) {
+    DeliverySlot* slot = SendReadings(readings, count, includeTime);
+    if (slot == NULL) {
+        StoreReadings(readings, count);
+        return;
+    }
+    DeliveryWindow_HoldReadings(slot, readings, count);
+}
+
+// Report a glucose reading, and the other channels of the same sweep, either immediately or as
+// part of the current batch.
+static void ReportGlucoseReading(const SensorChannelValues* values) {
+    int32_t glucoseHundredths = values->hundredths[SensorChannel_Glucose];
+    AdaptTelemetryPeriod(glucoseHundredths);
+
+    bool isUrgent = CalibrationCurve_IsCompiled() &&
+                    glucoseHundredths < alertThresholds.lowHundredths;
+    TelemetryReading reading = { .timestamp = time(NULL), .glucoseHundredths = glucoseHundredths };
+    for (size_t i = SensorChannel_Temperature; i < SensorChannel_Count; i++) {
+        if ((values->validMask & (1u << i)) != 0) {
+            size_t channel = i - SensorChannel_Temperature;
+            reading.channelMask |= 1u << channel;
+            reading.channelHundredths[channel] = values->hundredths[i];
+        }
+    }
+    if (batchSize <= 1 || isUrgent) {
+        SendLiveReadings(&reading, 1, false);
+        return;
+    }
+
+    bool wasEmpty = telemetryBatch.count == 0;
+    if (TelemetryBatch_Add(&telemetryBatch, &reading)) {
+        FlushTelemetryBatch();
+    }
+    else if (wasEmpty) {
+        // Bound how long the first reading in a batch can wait before it is sent.
+        struct timespec maxLatency = { .tv_sec = batchMaxLatencySeconds, .tv_nsec = 0 };
+        Scheduler_RunJobAfter(batchDeadlineJob, &maxLatency);
+    }
+}
+
+// Start checking samples against the alert thresholds, which are reported to the device twin.
+// Must be called after InitReportedProperties, and before InitScheduledJobs, which watches the
+// low threshold.
+static ExitCode InitGlucoseAlerts(void) {
+    alertThresholds.lowHundredths = DefaultAlertLowHundredths;
+    alertThresholds.highHundredths = DefaultAlertHighHundredths;
+    alertThresholds.hysteresisHundredths = DefaultAlertHysteresisHundredths;
+    desiredAlertThresholds = alertThresholds;
+    if (GlucoseAlerts_Init(&alertThresholds, &GlucoseAlertChanged) == -1) {
+        return ExitCode_Init_GlucoseAlerts;
+    }
+
+    ReportedState_SetHundredths(alertLowThresholdProperty, alertThresholds.lowHundredths);
+    ReportedState_SetHundredths(alertHighThresholdProperty, alertThresholds.highHundredths);
+    ReportedState_SetHundredths(alertHysteresisProperty, alertThresholds.hysteresisHundredths);
+    return ExitCode_Success;
+}
+
+// Decimate the latest samples of every channel, and calibrate glucose if a calibration has been
+// compiled, correcting it for temperature if that was sampled. Returns false if there are no
+// glucose samples yet.
+static bool ReadSensorChannels(SensorChannelValues* values) {
+    if (!SensorChannels_Read(decimationMode, decimationWindow, values) ||
+        (values->validMask & (1u << SensorChannel_Glucose)) == 0) {
+        return false;
+    }
+
+    if (CalibrationCurve_IsCompiled()) {
+        int32_t glucoseHundredths = CalibrationCurve_Lookup(values->counts[SensorChannel_Glucose]);
+        if ((values->validMask & (1u << SensorChannel_Temperature)) != 0) {
+            glucoseHundredths = CalibrationCurve_CorrectTemperature(glucoseHundredths,
+                values->hundredths[SensorChannel_Temperature]);
+        }
+        values->hundredths[SensorChannel_Glucose] = glucoseHundredths;
+    }
+    return true;
+}
+
+// Check the latest decimated sample against the alert thresholds, once it is calibrated.
+static void EvaluateGlucoseAlerts(void) {
+    SensorChannelValues values;
+    if (CalibrationCurve_IsCompiled() && ReadSensorChannels(&values)) {
+        GlucoseAlerts_Evaluate(values.hundredths[SensorChannel_Glucose]);
+    }
+}
+
+// An alert has been raised or cleared: show it straight away, send it as urgent telemetry, and
+// take a reading now rather than at the telemetry job's next run.
+static void GlucoseAlertChanged(GlucoseAlertLevel level, int32_t glucoseHundredths) {
+    if (level == GlucoseAlert_None) {
+        LOG_INFO("INFO: Glucose alert cleared at %d hundredths.\n", (int)glucoseHundredths);
     }
     else {
-        if (IoTHubDeviceClient_LL_SendReportedState(
-            iothubClientHandle, (const unsigned char*)jsonState, strlen(jsonState),
-            ReportedStateCallback, NULL) != IOTHUB_CLIENT_OK) {
-            Log_Debug("ERROR: Azure IoT Hub client error when reporting state '%s'.\n", jsonState);
+        LOG_WARNING("WARNING: %s glucose alert raised at %d hundredths.\n",
+            GlucoseAlerts_LevelName(level), (int)glucoseHundredths);
+    }
+
+    alertGlucoseHundredths = glucoseHundredths;
+    UpdateRgbLed();
+    SendGlucoseAlert();
+    Scheduler_RunJobSoon(telemetryJob);
+}
+
+// Send the current alert level, and the level which changed it, as urgent telemetry.
+static void SendGlucoseAlert(void) {
+    char alertMessage[64];
+    int32_t magnitude = alertGlucoseHundredths < 0 ? -alertGlucoseHundredths
+                                                   : alertGlucoseHundredths;
+    int len = snprintf(alertMessage, sizeof(alertMessage),
+        "{\"Alert\":\"%s\",\"Glucose\":%s%d.%02d}", GlucoseAlerts_LevelName(GlucoseAlerts_Level()),
+        alertGlucoseHundredths < 0 ? "-" : "", (int)(magnitude / 100), (int)(magnitude % 100));
+    if (len < 0 || len >= (int)sizeof(alertMessage)) {
+        LOG_ERROR("ERROR: Cannot write alert to buffer.\n");
+        return;
+    }
+
+    DeliverySlot* slot = SendTelemetryMessage((const uint8_t*)alertMessage, (size_t)len,
+        TelemetryEncoding_Json, MessagePriority_Urgent);
+    isAlertUnsent = slot == NULL;
+    if (slot != NULL) {
+        slot->kind = DeliveryKind_Alert;
+        alertSequence = slot->sequence;
+    }
+}
+
+// Show the glucose alert on the RGB LED, red for low and yellow for high, or otherwise the
+// StatusLED device twin property on its red channel. The LED is active low.
+static void UpdateRgbLed(void) {
+    GlucoseAlertLevel level = GlucoseAlerts_Level();
+    bool red = level != GlucoseAlert_None || statusLedOn;
+    bool green = level == GlucoseAlert_High;
+    GPIO_SetValue(deviceTwinStatusLedGpioFd, red ? GPIO_Value_Low : GPIO_Value_High);
+    GPIO_SetValue(alertGreenLedGpioFd, green ? GPIO_Value_Low : GPIO_Value_High);
+}
+
+// Take the next reading sooner or later, according to the trend which this reading extends.
+static void AdaptTelemetryPeriod(int32_t glucoseHundredths) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t nowMs = (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / (1000 * 1000);
+
+    uint32_t periodMs =
+        TelemetryRate_AddReading(nowMs, glucoseHundredths, CalibrationCurve_IsCompiled());
+    struct timespec telemetryPeriod = { .tv_sec = periodMs / 1000,
+                                        .tv_nsec = (long)(periodMs % 1000) * 1000 * 1000 };
+    Scheduler_SetJobPeriod(telemetryJob, &telemetryPeriod);
+
+    int32_t trendPerMinute;
+    if (TelemetryRate_GetTrend(&trendPerMinute)) {
+        LOG_DEBUG("Glucose trend %d hundredths/min; next reading in %u ms.\n", (int)trendPerMinute,
+            (unsigned int)periodMs);
+    }
+}
+
+// Send all batched readings as a single message.
+static void FlushTelemetryBatch(void) {
+    Scheduler_DisableJob(batchDeadlineJob);
+    if (telemetryBatch.count == 0) {
+        return;
+    }
+
+    SendLiveReadings(telemetryBatch.readings, telemetryBatch.count, true);
+    TelemetryBatch_Clear(&telemetryBatch);
+}
+
+// Batch deadline job: the oldest batched reading has waited long enough, so send the batch.
+static void BatchDeadlineJob(void) {
+    FlushTelemetryBatch();
+}
+
+// Open the persistent telemetry queue in mutable storage. Failure is not fatal: the device
+// keeps working, but readings taken while offline are lost.
+static void OpenTelemetryStore(void) {
+    mutableStorageFd = Storage_OpenMutableFile();
+    if (mutableStorageFd == -1) {
+        LOG_WARNING("WARNING: Storage_OpenMutableFile failed with error: %s (%d)\n",
+            strerror(errno), errno);
+        return;
+    }
+
+    if (TelemetryStore_Open(&telemetryStore, mutableStorageFd, TELEMETRY_STORE_OFFSET,
+        TELEMETRY_STORE_SIZE) == -1) {
+        LOG_WARNING("WARNING: Could not open telemetry store: %s (%d)\n", strerror(errno), errno);
+    }
+}
+
+// Queue readings which could not be sent, so that they can be replayed later.
+static void StoreReadings(const TelemetryReading* readings, size_t count) {
+    if (!TelemetryStore_IsOpen(&telemetryStore)) {
+        LOG_WARNING("WARNING: Telemetry store unavailable. Dropping %u readings.\n",
+            (unsigned int)count);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (TelemetryStore_Append(&telemetryStore, &readings[i]) == -1) {
+            LOG_ERROR("ERROR: Could not store reading: %s (%d)\n", strerror(errno), errno);
+            return;
+        }
+    }
+    LOG_INFO("INFO: Stored %u readings for later upload (%u pending).\n", (unsigned int)count,
+        (unsigned int)TelemetryStore_PendingCount(&telemetryStore));
+
+    // While authenticated, readings are only stored because a send failed, so retry them.
+    ScheduleReplay();
+}
+
+// Run the replay job periodically if it is not already, to retry stored readings and dose
+// events. It is only needed while authenticated: it is scheduled again on authentication.
+static void ScheduleReplay(void) {
+    if (iotHubClientAuthenticationState == IoTHubClientAuthenticationState_Authenticated &&
+        !Scheduler_IsJobScheduled(replayJob)) {
+        struct timespec replayPeriod = { .tv_sec = AzureIoTDefaultPollPeriodSeconds, .tv_nsec = 0 };
+        Scheduler_SetJobPeriod(replayJob, &replayPeriod);
+    }
+}
+
+// Send stored readings in TelemetryEncoding_Packed as one message.
+// Returns the message's delivery window slot if it was accepted for delivery.
+static DeliverySlot* SendBulkReadings(const TelemetryReading* readings, size_t count) {
+    static uint8_t bulkBuffer[TELEMETRY_ENCODER_PACKED_BUFFER_SIZE(BULK_UPLOAD_MAX_READINGS)];
+
+    size_t size = TelemetryEncoder_EncodeReadings(TelemetryEncoding_Packed, readings, count,
+        true, bulkBuffer, sizeof(bulkBuffer));
+    if (size == 0) {
+        LOG_ERROR("ERROR: Cannot write bulk telemetry to buffer.\n");
+        return NULL;
+    }
+
+    LOG_INFO("INFO: Bulk uploading %u stored readings in %u bytes.\n", (unsigned int)count,
+        (unsigned int)size);
+    return SendTelemetryBytes(bulkBuffer, size, TelemetryEncoding_Packed);
+}
+
+// Send the oldest stored readings as one message, in bulk if there is a backlog. They are removed
+// from the store once the IoT Hub confirms the message, and otherwise sent again, so only one
+// replay is in flight.
+static void ReplayStoredTelemetry(void) {
+    static TelemetryReading replayReadings[BULK_UPLOAD_MAX_READINGS];
+
+    size_t pendingCount = TelemetryStore_PendingCount(&telemetryStore);
+    if (pendingCount == 0 || DeliveryWindow_IsReplayInFlight()) {
+        return;
+    }
+
+    bool isBulk = pendingCount > StoreReplayReadingsPerPoll;
+    uint32_t firstSequence = 0;
+    size_t span = 0;
+    int count = TelemetryStore_Peek(&telemetryStore, replayReadings,
+        isBulk ? BULK_UPLOAD_MAX_READINGS : StoreReplayReadingsPerPoll, &firstSequence, &span);
+    if (count == -1) {
+        LOG_ERROR("ERROR: Could not read stored readings: %s (%d)\n", strerror(errno), errno);
+        return;
+    }
+
+    if (count > 0) {
+        DeliverySlot* slot = isBulk ? SendBulkReadings(replayReadings, (size_t)count)
+                                    : SendReadings(replayReadings, (size_t)count, true);
+        if (slot != NULL) {
+            slot->kind = DeliveryKind_Replay;
+            slot->replayEndSequence = firstSequence + (uint32_t)span;
+        }
+        return;
+    }
+
+    // Nothing in the span could be read back, so there is nothing to send.
+    ConsumeStoredReadings(firstSequence + (uint32_t)span);
+}
+
+// Remove replayed readings from the store. Readings may have been stored while the replay was in
+// flight, overwriting the oldest of a full store, so they are removed through a sequence number
+// rather than by count, which would remove readings that were never sent.
+static void ConsumeStoredReadings(uint32_t endSequence) {
+    if (TelemetryStore_ConsumeThrough(&telemetryStore, endSequence) == -1) {
+        LOG_ERROR("ERROR: Could not remove replayed readings: %s (%d)\n", strerror(errno), errno);
+    }
+}
+
+// Callback invoked when the Azure IoT Hub send event request is processed, including when the
+// message times out or the client is destroyed. Readings which were not delivered are retried
+// from the store: live readings are stored, and replayed readings were never removed from it.
+// Dose events stay queued until delivered.
+static void SendEventCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* context) {
+    DeliverySlot* slot = context;
+    bool isDelivered = result == IOTHUB_CLIENT_CONFIRMATION_OK;
+    LOG_DEBUG("Azure IoT Hub send telemetry event callback: message %u, status code %d.\n",
+        (unsigned int)slot->sequence, result);
+    HealthMonitor_MessageConfirmed(slot->healthContext, isDelivered);
+
+    switch (slot->kind) {
+    case DeliveryKind_Alert:
+        if (!isDelivered && slot->sequence == alertSequence) {
+            isAlertUnsent = true;
+        }
+        break;
+    case DeliveryKind_Readings:
+        if (!isDelivered) {
+            LOG_WARNING("WARNING: Message %u was not delivered (%d). Storing its readings.\n",
+                (unsigned int)slot->sequence, result);
+            StoreReadings(slot->readings, slot->readingCount);
+        }
+        break;
+    case DeliveryKind_Replay:
+        if (isDelivered) {
+            ConsumeStoredReadings(slot->replayEndSequence);
+        }
+        break;
+    case DeliveryKind_DoseEvent:
+        DoseEvents_Confirmed(slot->sequence, isDelivered);
+        if (isDelivered) {
+            SendPendingDoseEvent();
         }
         else {
-            Log_Debug("INFO: Azure IoT Hub client accepted request to report state '%s'.\n",
-                jsonState);
+            LOG_WARNING("WARNING: Dose event message %u was not delivered (%d). Retrying.\n",
+                (unsigned int)slot->sequence, result);
+            ScheduleReplay();
         }
+        break;
+    case DeliveryKind_Event:
+        break;
     }
+    DeliveryWindow_Release(slot);
 }
 
-// Callback invoked when the Device Twin report state request is processed by Azure IoT Hub
-// client.
-static void ReportedStateCallback(int result, void* context) {
-    Log_Debug("INFO: Azure IoT Hub Device Twin reported state callback: status code %d.\n", result);
+// Register the Device Twin reported properties, and set the ones which never change.
+static ExitCode InitReportedProperties(void) {
+    ReportedPropertyId manufacturerProperty = ReportedState_AddProperty("manufacturer");
+    ReportedPropertyId modelProperty = ReportedState_AddProperty("model");
+    statusLedProperty = ReportedState_AddProperty("StatusLED");
+    logLevelProperty = ReportedState_AddProperty("LogLevel");
+    telemetryMinPeriodProperty = ReportedState_AddProperty("TelemetryMinPeriodSeconds");
+    telemetryMaxPeriodProperty = ReportedState_AddProperty("TelemetryMaxPeriodSeconds");
+    alertLowThresholdProperty = ReportedState_AddProperty("AlertLowThreshold");
+    alertHighThresholdProperty = ReportedState_AddProperty("AlertHighThreshold");
+    alertHysteresisProperty = ReportedState_AddProperty("AlertHysteresis");
+    calibratedProperty = ReportedState_AddProperty("Calibrated");
+    connectionProfileProperty = ReportedState_AddProperty("ConnectionProfile");
+    if (manufacturerProperty == -1 || modelProperty == -1 || statusLedProperty == -1 ||
+        logLevelProperty == -1 || telemetryMinPeriodProperty == -1 ||
+        telemetryMaxPeriodProperty == -1 || alertLowThresholdProperty == -1 ||
+        alertHighThresholdProperty == -1 || alertHysteresisProperty == -1 ||
+        calibratedProperty == -1 || connectionProfileProperty == -1) {
+        return ExitCode_Init_ReportedProperty;
+    }
+
+    ReportedState_SetString(manufacturerProperty, "Microsoft");
+    ReportedState_SetString(modelProperty, "Azure Sphere Sample Device");
+    ReportedState_SetBool(statusLedProperty, statusLedOn);
+    ReportedState_SetString(logLevelProperty, AppLog_LevelName(appLogLevel));
+    ReportedState_SetBool(calibratedProperty, false);
+    ReportedState_SetString(connectionProfileProperty, connectionProfile->name);
+    desiredCalibration.referenceTemperatureHundredths =
+        DefaultCalibrationReferenceTemperatureHundredths;
+
+    telemetryMinPeriodMs = desiredTelemetryMinPeriodMs = defaultTelemetryRate.minPeriodMs;
+    telemetryMaxPeriodMs = desiredTelemetryMaxPeriodMs = defaultTelemetryRate.maxPeriodMs;
+    ReportedState_SetInt(telemetryMinPeriodProperty, telemetryMinPeriodMs / 1000);
+    ReportedState_SetInt(telemetryMaxPeriodProperty, telemetryMaxPeriodMs / 1000);
+    return ExitCode_Success;
 }
 
-// Check whether a given button has just been pressed.
-static bool IsButtonPressed(int fd, GPIO_Value_Type* oldState) {
-    bool isButtonPressed = false;
-    GPIO_Value_Type newState;
-    int result = GPIO_GetValue(fd, &newState);
-    if (result != 0) {
-        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
-        exitCode = ExitCode_IsButtonPressed_GetValue;
+// Send changed reported properties after a short delay, so that a burst of changes, such as
+// those from one Device Twin update, is sent as one report.
+static void ScheduleReport(void) {
+    if (!Scheduler_IsJobScheduled(reportJob)) {
+        const struct timespec coalescePeriod = {
+            .tv_sec = 0, .tv_nsec = ReportedStateCoalesceMilliseconds * 1000 * 1000 };
+        Scheduler_RunJobAfter(reportJob, &coalescePeriod);
     }
-    else {
-        // Button is pressed if it is low and different than last known state.
-        isButtonPressed = (newState != *oldState) && (newState == GPIO_Value_Low);
-        *oldState = newState;
+}
+
+// Report job: enqueue one report holding every reported property which differs from the value
+// the IoT Hub last acknowledged. The report is sent on the next IoTHubDeviceClient_LL_DoWork().
+static void ReportJob(void) {
+    static char patchBuffer[REPORTED_STATE_PATCH_BUFFER_SIZE];
+
+    // Anything not yet acknowledged is sent once the client is authenticated.
+    if (iothubClientHandle == NULL ||
+        iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated) {
+        return;
     }
 
-    return isButtonPressed;
+    uint32_t patchId;
+    size_t length = ReportedState_BuildPatch(patchBuffer, sizeof(patchBuffer), &patchId);
+    if (length == 0) {
+        return;
+    }
+
+    if (IoTHubDeviceClient_LL_SendReportedState(iothubClientHandle,
+        (const unsigned char*)patchBuffer, length, ReportedStateCallback,
+        (void*)(uintptr_t)patchId) != IOTHUB_CLIENT_OK) {
+        LOG_ERROR("ERROR: Azure IoT Hub client error when reporting state '%s'.\n", patchBuffer);
+        ReportedState_Acknowledge(patchId, false);
+        return;
+    }
+
+    LOG_DEBUG("Azure IoT Hub client accepted request to report state '%s'.\n", patchBuffer);
+    Scheduler_RunJobSoon(doWorkJob);
+    if (ReportedState_IsPatchPending()) {
+        // The patch buffer was full, so send the remaining properties separately.
+        Scheduler_RunJobSoon(reportJob);
+    }
+}
+
+// Callback invoked when the Device Twin report state request is processed by Azure IoT Hub
+// client. The context is the identifier of the patch which was reported.
+static void ReportedStateCallback(int result, void* context) {
+    LOG_DEBUG("Azure IoT Hub Device Twin reported state callback: status code %d.\n", result);
+
+    bool isAccepted = result >= 200 && result < 300;
+    bool isPatchPending = ReportedState_Acknowledge((uint32_t)(uintptr_t)context, isAccepted);
+    if (isAccepted) {
+        reportRetryDelayMs = 0;
+        if (isPatchPending) {
+            ScheduleReport();
+        }
+        return;
+    }
+
+    // Retrying straight away would only add to throttling, so back off. The retry also sends
+    // any properties which change meanwhile, as ScheduleReport leaves a scheduled report alone.
+    reportRetryDelayMs = reportRetryDelayMs == 0 ? ReportRetryInitialDelayMs
+                                                 : reportRetryDelayMs * 2;
+    if (reportRetryDelayMs > ReportRetryMaxDelayMs) {
+        reportRetryDelayMs = ReportRetryMaxDelayMs;
+    }
+    LOG_WARNING("WARNING: IoT Hub rejected reported state (%d). Retrying in %u seconds.\n",
+        result, (unsigned int)(reportRetryDelayMs / 1000));
+    const struct timespec retryDelay = { .tv_sec = reportRetryDelayMs / 1000,
+        .tv_nsec = (long)(reportRetryDelayMs % 1000) * 1000 * 1000 };
+    Scheduler_RunJobAfter(reportJob, &retryDelay);
 }
 
 // Read the certificate file and provide a null-terminated string containing the certificate.
@@ -748,7 +2492,7 @@ static ExitCode ReadIoTEdgeCaCertContent(void) {
 
     certFd = Storage_OpenFileInImagePackage(iotEdgeRootCAPath);
     if (certFd == -1) {
-        Log_Debug("ERROR: Storage_OpenFileInImagePackage failed with error code: %d (%s).\n", errno,
+        LOG_ERROR("ERROR: Storage_OpenFileInImagePackage failed with error code: %d (%s).\n", errno,
             strerror(errno));
         return ExitCode_IoTEdgeRootCa_Open_Failed;
     }
@@ -756,26 +2500,26 @@ static ExitCode ReadIoTEdgeCaCertContent(void) {
     // Get the file size.
     fileSize = lseek(certFd, 0, SEEK_END);
     if (fileSize == -1) {
-        Log_Debug("ERROR: lseek SEEK_END: %d (%s)\n", errno, strerror(errno));
+        LOG_ERROR("ERROR: lseek SEEK_END: %d (%s)\n", errno, strerror(errno));
         close(certFd);
         return ExitCode_IoTEdgeRootCa_LSeek_Failed;
     }
 
     // Reset the pointer to start of the file.
     if (lseek(certFd, 0, SEEK_SET) < 0) {
-        Log_Debug("ERROR: lseek SEEK_SET: %d (%s)\n", errno, strerror(errno));
+        LOG_ERROR("ERROR: lseek SEEK_SET: %d (%s)\n", errno, strerror(errno));
         close(certFd);
         return ExitCode_IoTEdgeRootCa_LSeek_Failed;
     }
 
     if (fileSize == 0) {
-        Log_Debug("File size invalid for %s\r\n", iotEdgeRootCAPath);
+        LOG_ERROR("File size invalid for %s\r\n", iotEdgeRootCAPath);
         close(certFd);
         return ExitCode_IoTEdgeRootCa_FileSize_Invalid;
     }
 
     if (fileSize > MAX_ROOT_CA_CERT_CONTENT_SIZE) {
-        Log_Debug("File size for %s is %lld bytes. Max file size supported is %d bytes.\r\n",
+        LOG_ERROR("File size for %s is %lld bytes. Max file size supported is %d bytes.\r\n",
             iotEdgeRootCAPath, fileSize, MAX_ROOT_CA_CERT_CONTENT_SIZE);
         close(certFd);
         return ExitCode_IoTEdgeRootCa_FileSize_TooLarge;
@@ -784,7 +2528,7 @@ static ExitCode ReadIoTEdgeCaCertContent(void) {
     // Copy the file into the buffer.
     ssize_t read_size = read(certFd, &iotEdgeRootCACertContent, (size_t)fileSize);
     if (read_size != (size_t)fileSize) {
-        Log_Debug("Error reading file %s\r\n", iotEdgeRootCAPath);
+        LOG_ERROR("Error reading file %s\r\n", iotEdgeRootCAPath);
         close(certFd);
         return ExitCode_IoTEdgeRootCa_FileRead_Failed;
     }
@@ -0,0 +1,140 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_log.h"
+#include "json_arena.h"
+#include "method_dispatch.h"
+
+static const DirectMethod* methods = NULL;
+static size_t methodCount = 0;
+static char responseBuffer[METHOD_DISPATCH_RESPONSE_SIZE];
+
+static const DirectMethod* FindMethod(const char* name)
+{
+    size_t low = 0;
+    size_t high = methodCount;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int comparison = strcmp(name, methods[middle].name);
+        if (comparison == 0) {
+            return &methods[middle];
+        }
+        if (comparison < 0) {
+            high = middle;
+        }
+        else {
+            low = middle + 1;
+        }
+    }
+    return NULL;
+}
+
+// Parse a payload in the JSON arena, which is reset here. The payload is copied into the arena
+// to null-terminate it. Returns NULL if the payload is not valid JSON or does not fit, in which
+// case outIsArenaFull tells the two apart.
+static JSON_Value* ParsePayload(const unsigned char* payload, size_t payloadSize,
+    bool* outIsArenaFull)
+{
+    JsonArenaStats before;
+    JsonArenaStats after;
+    JsonArena_Reset();
+    JsonArena_GetStats(&before);
+
+    JSON_Value* value = NULL;
+    char* nullTerminatedPayload = JsonArena_Malloc(payloadSize + 1);
+    if (nullTerminatedPayload != NULL) {
+        memcpy(nullTerminatedPayload, payload, payloadSize);
+        nullTerminatedPayload[payloadSize] = 0;
+        value = json_parse_string(nullTerminatedPayload);
+    }
+
+    JsonArena_GetStats(&after);
+    *outIsArenaFull = after.failures != before.failures;
+    return value;
+}
+
+static int CallMethod(const DirectMethod* method, const unsigned char* payload,
+    size_t payloadSize)
+{
+    if (method->argumentType == JSONNull) {
+        return method->handler(NULL, responseBuffer, sizeof(responseBuffer));
+    }
+
+    if (payloadSize > METHOD_DISPATCH_MAX_PAYLOAD_SIZE) {
+        LOG_WARNING("WARNING: Direct Method %s payload (%u bytes) is too large.\n", method->name,
+            (unsigned int)payloadSize);
+        strcpy(responseBuffer, "\"Payload too large\"");
+        return 413;
+    }
+
+    bool isArenaFull = false;
+    JSON_Value* argument = ParsePayload(payload, payloadSize, &isArenaFull);
+    if (isArenaFull) {
+        LOG_WARNING("WARNING: Direct Method %s payload (%u bytes) does not fit the JSON arena.\n",
+            method->name, (unsigned int)payloadSize);
+        json_value_free(argument);
+        strcpy(responseBuffer, "\"Payload too large\"");
+        return 413;
+    }
+    if (json_value_get_type(argument) != method->argumentType) {
+        LOG_WARNING("WARNING: Direct Method %s has an invalid argument.\n", method->name);
+        json_value_free(argument);
+        strcpy(responseBuffer, "\"Invalid argument\"");
+        return 400;
+    }
+
+    int result = method->handler(argument, responseBuffer, sizeof(responseBuffer));
+    json_value_free(argument);
+    return result;
+}
+
+int MethodDispatch_Init(const DirectMethod* table, size_t count)
+{
+    for (size_t i = 1; i < count; i++) {
+        if (strcmp(table[i - 1].name, table[i].name) >= 0) {
+            LOG_ERROR("ERROR: Direct Method %s is out of order.\n", table[i].name);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    methods = table;
+    methodCount = count;
+    return 0;
+}
+
+int MethodDispatch_Invoke(const char* methodName, const unsigned char* payload, size_t payloadSize,
+    unsigned char** response, size_t* responseSize)
+{
+    int result;
+    responseBuffer[0] = 0;
+
+    const DirectMethod* method = FindMethod(methodName);
+    if (method == NULL) {
+        LOG_WARNING("WARNING: Unknown Direct Method %s.\n", methodName);
+        strcpy(responseBuffer, "\"Unknown method\"");
+        result = 404;
+    }
+    else {
+        result = CallMethod(method, payload, payloadSize);
+    }
+
+    if (responseBuffer[0] == 0) {
+        strcpy(responseBuffer, "{}");
+    }
+
+    *responseSize = strlen(responseBuffer);
+    *response = malloc(*responseSize);
+    if (*response == NULL) {
+        LOG_ERROR("ERROR: Could not allocate the Direct Method response.\n");
+        *responseSize = 0;
+        return result;
+    }
+    memcpy(*response, responseBuffer, *responseSize);
+    return result;
+}
@@ -0,0 +1,66 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stddef.h>
+
+#include "parson.h"
+
+/// <summary>
+/// Largest Direct Method payload which is parsed. Larger payloads are rejected with status 413
+/// without being looked at. This bounds the time spent parsing, but not the memory: a payload
+/// within the limit can still need more than the JSON arena, for example an array of a few
+/// hundred numbers, in which case it is also rejected with status 413.
+/// </summary>
+#define METHOD_DISPATCH_MAX_PAYLOAD_SIZE 1024
+
+/// <summary>
+/// Size of the buffer into which handlers write their response.
+/// </summary>
+#define METHOD_DISPATCH_RESPONSE_SIZE 128
+
+/// <summary>
+/// Function signature for a Direct Method handler.
+/// </summary>
+/// <param name="argument">The parsed payload, already checked to be of the method's argument
+/// type, or NULL if the method takes no argument. It is freed when the handler returns.</param>
+/// <param name="response">Buffer for the JSON response, which must be a complete JSON value
+/// (strings in quotes). An empty response is sent as {}.</param>
+/// <param name="responseSize">Size of response; METHOD_DISPATCH_RESPONSE_SIZE.</param>
+/// <returns>The method's HTTP-style status code.</returns>
+typedef int (*DirectMethodHandler)(const JSON_Value* argument, char* response,
+    size_t responseSize);
+
+/// <summary>
+/// One entry in the table of Direct Methods handled by the application.
+/// </summary>
+typedef struct {
+    const char* name;
+    JSON_Value_Type argumentType; // JSONNull if the method takes no argument, ignoring its payload
+    DirectMethodHandler handler;
+} DirectMethod;
+
+/// <summary>
+/// Set the table of Direct Methods. Method names are looked up by binary search, so the table
+/// must be sorted by name, in strcmp order.
+/// </summary>
+/// <param name="table">Methods, which must remain valid.</param>
+/// <param name="count">Number of entries in table.</param>
+/// <returns>0 on success, or -1 with errno set to EINVAL if the table is not sorted or has
+/// duplicate names.</returns>
+int MethodDispatch_Init(const DirectMethod* table, size_t count);
+
+/// <summary>
+/// Invoke a Direct Method, in the form expected by IoTHubDeviceClient_LL_SetDeviceMethodCallback.
+/// The payload is bounded, parsed with parson in the JSON arena and type-checked before the
+/// handler is called. The handler writes its response into a static buffer, and only the final
+/// response is copied to the heap: the IoT SDK frees it with free(), so it cannot come from a
+/// pool. Unknown methods fail with status 404, payloads which are not valid JSON or not of the
+/// method's argument type with 400, and payloads which are too large to parse with 413.
+/// </summary>
+/// <param name="response">Receives the response, allocated with malloc, or NULL if it could not
+/// be allocated.</param>
+/// <param name="responseSize">Receives the size of the response.</param>
+/// <returns>The method's status code.</returns>
+int MethodDispatch_Invoke(const char* methodName, const unsigned char* payload, size_t payloadSize,
+    unsigned char** response, size_t* responseSize);
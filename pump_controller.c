@@ -0,0 +1,203 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <applibs/gpio.h>
+
+#include "app_log.h"
+#include "eventloop_timer_utilities.h"
+#include "pump_controller.h"
+
+#define NANOSECONDS_PER_SECOND 1000000000ull
+#define NANOSECONDS_PER_MILLISECOND 1000000ull
+#define MICROUNITS_PER_HUNDREDTH 10000ull
+
+typedef struct {
+    uint32_t id;
+    int32_t doseHundredths;
+    uint64_t durationNs; // Fixed when the dose starts, from the calibration at that time
+} PumpDose;
+
+static PumpDose doses[PUMP_CONTROLLER_MAX_DOSES];
+static unsigned int firstDose = 0; // Index of the dose being delivered, if any
+static unsigned int doseCount = 0;
+static uint32_t nextDoseId = 1;
+static uint32_t microunitsPerMs = 0;
+static uint64_t doseDeadlineNs = 0; // When the dose being delivered ends, on CLOCK_MONOTONIC
+
+static int pumpFd = -1;
+static bool isPumpOn = false;
+static EventLoopTimer* doseTimer = NULL;
+static PumpDoseCompletedHandler completionHandler = NULL;
+static PumpControllerErrorHandler failureHandler = NULL;
+
+static uint64_t GetMonotonicNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)now.tv_nsec;
+}
+
+static int SetPump(bool on)
+{
+    if (on == isPumpOn) {
+        return 0;
+    }
+    if (pumpFd >= 0 && GPIO_SetValue(pumpFd, on ? GPIO_Value_High : GPIO_Value_Low) != 0) {
+        return -1;
+    }
+
+    isPumpOn = on;
+    return 0;
+}
+
+static void Fail(void)
+{
+    doseCount = 0;
+    if (SetPump(false) == -1) {
+        LOG_ERROR("ERROR: Could not switch off the pump: %s (%d).\n", strerror(errno), errno);
+    }
+    failureHandler();
+}
+
+// Arm the timer for the current dose's deadline.
+static int ArmDoseTimer(void)
+{
+    uint64_t now = GetMonotonicNs();
+    uint64_t delayNs = doseDeadlineNs > now ? doseDeadlineNs - now : 1;
+    struct timespec delay = { .tv_sec = (time_t)(delayNs / NANOSECONDS_PER_SECOND),
+                              .tv_nsec = (long)(delayNs % NANOSECONDS_PER_SECOND) };
+    return SetEventLoopTimerOneShot(doseTimer, &delay);
+}
+
+// Start the first queued dose, from 'startNs'.
+static int StartDose(uint64_t startNs)
+{
+    PumpDose* dose = &doses[firstDose];
+    // Split the division so that the intermediate product cannot overflow.
+    uint64_t microunits = (uint64_t)dose->doseHundredths * MICROUNITS_PER_HUNDREDTH;
+    uint64_t wholeMs = microunits / microunitsPerMs;
+    uint64_t remainder = microunits % microunitsPerMs;
+    dose->durationNs = wholeMs * NANOSECONDS_PER_MILLISECOND +
+                       remainder * NANOSECONDS_PER_MILLISECOND / microunitsPerMs;
+    doseDeadlineNs = startNs + dose->durationNs;
+
+    if (SetPump(true) == -1) {
+        return -1;
+    }
+    return ArmDoseTimer();
+}
+
+static void DoseTimerEventHandler(EventLoopTimer* timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        Fail();
+        return;
+    }
+    if (doseCount == 0) {
+        return;
+    }
+
+    PumpDose completed = doses[firstDose];
+    firstDose = (firstDose + 1) % PUMP_CONTROLLER_MAX_DOSES;
+    doseCount--;
+
+    // Run the next dose on from this one's deadline, leaving the pump on in between.
+    if (doseCount > 0) {
+        if (StartDose(doseDeadlineNs) == -1) {
+            LOG_ERROR("ERROR: Could not start dose: %s (%d).\n", strerror(errno), errno);
+            Fail();
+            return;
+        }
+    }
+    else if (SetPump(false) == -1) {
+        LOG_ERROR("ERROR: Could not switch off the pump: %s (%d).\n", strerror(errno), errno);
+        Fail();
+        return;
+    }
+
+    completionHandler(completed.id, completed.doseHundredths,
+        (uint32_t)(completed.durationNs / NANOSECONDS_PER_MILLISECOND));
+}
+
+int PumpController_Init(EventLoop* eventLoop, int pumpGpioFd,
+    PumpDoseCompletedHandler completedHandler, PumpControllerErrorHandler errorHandler)
+{
+    pumpFd = pumpGpioFd;
+    isPumpOn = true;
+    if (SetPump(false) == -1) {
+        LOG_ERROR("ERROR: Could not switch off the pump: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+
+    completionHandler = completedHandler;
+    failureHandler = errorHandler;
+    firstDose = 0;
+    doseCount = 0;
+
+    doseTimer = CreateEventLoopDisarmedTimer(eventLoop, &DoseTimerEventHandler);
+    if (doseTimer == NULL) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int PumpController_SetCalibration(uint32_t microunitsPerMillisecond)
+{
+    if (microunitsPerMillisecond == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    microunitsPerMs = microunitsPerMillisecond;
+    return 0;
+}
+
+int PumpController_QueueDose(int32_t doseHundredths, uint32_t* outDoseId)
+{
+    if (doseTimer == NULL || microunitsPerMs == 0 || doseHundredths <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (doseCount >= PUMP_CONTROLLER_MAX_DOSES) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    PumpDose* dose = &doses[(firstDose + doseCount) % PUMP_CONTROLLER_MAX_DOSES];
+    dose->id = nextDoseId;
+    dose->doseHundredths = doseHundredths;
+    doseCount++;
+
+    if (doseCount == 1 && StartDose(GetMonotonicNs()) == -1) {
+        int error = errno;
+        doseCount = 0;
+        SetPump(false);
+        errno = error;
+        return -1;
+    }
+
+    nextDoseId = nextDoseId == UINT32_MAX ? 1 : nextDoseId + 1;
+    *outDoseId = dose->id;
+    return 0;
+}
+
+unsigned int PumpController_QueuedDoseCount(void)
+{
+    return doseCount;
+}
+
+void PumpController_Dispose(void)
+{
+    doseCount = 0;
+    if (pumpFd >= 0) {
+        SetPump(false);
+    }
+    DisposeEventLoopTimer(doseTimer);
+    doseTimer = NULL;
+}
@@ -0,0 +1,73 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+/// <summary>
+/// Largest number of doses which can be queued, including the one being delivered.
+/// </summary>
+#define PUMP_CONTROLLER_MAX_DOSES 8
+
+/// <summary>
+/// Invoked on the event loop when a dose has been delivered.
+/// </summary>
+/// <param name="doseId">Identifier returned by <see cref="PumpController_QueueDose" />.</param>
+/// <param name="doseHundredths">Dose delivered, in hundredths of a unit.</param>
+/// <param name="durationMs">Time for which the pump ran for this dose.</param>
+typedef void (*PumpDoseCompletedHandler)(uint32_t doseId, int32_t doseHundredths,
+    uint32_t durationMs);
+
+/// <summary>
+/// Invoked on the event loop when the pump controller encounters an unrecoverable error. The
+/// pump has been switched off, and errno contains more information.
+/// </summary>
+typedef void (*PumpControllerErrorHandler)(void);
+
+/// <summary>
+/// Start the pump controller. Doses are delivered one after another by running the pump for a
+/// time derived from its calibration, and are timed by a single reusable timer. Consecutive
+/// doses are timed from the previous dose's deadline, not from when its timer event was
+/// handled, and the pump output stays on between them, so that back-to-back doses neither
+/// accumulate event loop latency nor glitch the output.
+/// </summary>
+/// <param name="eventLoop">Event loop on which doses are timed and handlers invoked.</param>
+/// <param name="pumpGpioFd">GPIO opened as an output, which drives the pump while high, or -1
+/// to only simulate the pump. The controller does not take ownership of the file
+/// descriptor.</param>
+/// <param name="completedHandler">Callback to invoke when each dose has been delivered.</param>
+/// <param name="errorHandler">Callback to invoke on failure.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int PumpController_Init(EventLoop* eventLoop, int pumpGpioFd,
+    PumpDoseCompletedHandler completedHandler, PumpControllerErrorHandler errorHandler);
+
+/// <summary>
+/// Set the pump's calibration. The change applies from the next dose to start.
+/// </summary>
+/// <param name="microunitsPerMillisecond">Units delivered per millisecond of pump running
+/// time, in millionths of a unit. Must be greater than zero.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int PumpController_SetCalibration(uint32_t microunitsPerMillisecond);
+
+/// <summary>
+/// Queue a dose for delivery. This returns straight away; delivery is reported through the
+/// completion handler.
+/// </summary>
+/// <param name="doseHundredths">Dose, in hundredths of a unit. Must be greater than zero.</param>
+/// <param name="outDoseId">Receives the identifier passed to the completion handler.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information. errno
+/// is EBUSY if PUMP_CONTROLLER_MAX_DOSES doses are already queued.</returns>
+int PumpController_QueueDose(int32_t doseHundredths, uint32_t* outDoseId);
+
+/// <summary>
+/// Returns the number of doses queued, including the one being delivered.
+/// </summary>
+unsigned int PumpController_QueuedDoseCount(void);
+
+/// <summary>
+/// Switch off the pump, discard queued doses and free the timer. It is safe to call this
+/// function if <see cref="PumpController_Init" /> was not called or failed.
+/// </summary>
+void PumpController_Dispose(void);
@@ -0,0 +1,81 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <string.h>
+#include <time.h>
+
+#include "reconnect_policy.h"
+
+static ReconnectBackoff classBackoffs[ReconnectFailure_Count];
+static ReconnectFailureClass lastFailure = ReconnectFailure_NetworkNotReady;
+static uint32_t lastDelayMs = 0; // 0 after a success
+static uint64_t retryDeadlineMs = 0;
+static uint32_t randomState = 1;
+
+static uint64_t GetMonotonicMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+}
+
+// xorshift32: ample for spreading delays, and needs no shared libc state.
+static uint32_t NextRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+void ReconnectPolicy_Init(const ReconnectBackoff backoffs[ReconnectFailure_Count], uint32_t seed)
+{
+    memcpy(classBackoffs, backoffs, sizeof(classBackoffs));
+    randomState = seed != 0 ? seed : 1;
+    lastDelayMs = 0;
+    retryDeadlineMs = 0;
+}
+
+uint32_t ReconnectPolicy_Failed(ReconnectFailureClass failure)
+{
+    const ReconnectBackoff* backoff = &classBackoffs[failure];
+    uint32_t delayMs = backoff->initialDelayMs;
+
+    if (lastDelayMs != 0 && failure == lastFailure) {
+        uint64_t upperMs = (uint64_t)lastDelayMs * 3;
+        if (upperMs > backoff->maxDelayMs) {
+            upperMs = backoff->maxDelayMs;
+        }
+        if (upperMs > delayMs) {
+            delayMs += (uint32_t)(NextRandom() % (upperMs - delayMs + 1));
+        }
+    }
+    else {
+        // Jitter the first delay too, by up to half of it, so that the first retries spread out.
+        delayMs += NextRandom() % (delayMs / 2 + 1);
+    }
+    if (delayMs > backoff->maxDelayMs) {
+        delayMs = backoff->maxDelayMs;
+    }
+
+    lastFailure = failure;
+    lastDelayMs = delayMs;
+    retryDeadlineMs = GetMonotonicMs() + delayMs;
+    return delayMs;
+}
+
+void ReconnectPolicy_Succeeded(void)
+{
+    lastDelayMs = 0;
+    retryDeadlineMs = 0;
+}
+
+void ReconnectPolicy_RetryNow(void)
+{
+    retryDeadlineMs = 0;
+}
+
+bool ReconnectPolicy_IsRetryDue(void)
+{
+    return GetMonotonicMs() >= retryDeadlineMs;
+}
@@ -0,0 +1,57 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/// <summary>
+/// Kinds of connection failure, each of which backs off independently.
+/// </summary>
+typedef enum {
+    ReconnectFailure_NetworkNotReady = 0, // No network, or device authentication not ready yet
+    ReconnectFailure_Transient = 1,       // Timeouts and communication errors
+    ReconnectFailure_Credential = 2,      // Rejected by DPS or the IoT Hub; unlikely to clear soon
+    ReconnectFailure_Count = 3
+} ReconnectFailureClass;
+
+/// <summary>
+/// Delay bounds for one failure class.
+/// </summary>
+typedef struct {
+    uint32_t initialDelayMs; // Shortest delay, and the delay range's lower bound thereafter
+    uint32_t maxDelayMs;
+} ReconnectBackoff;
+
+/// <summary>
+/// Set up the policy. Delays use decorrelated jitter: each is drawn uniformly between the class's
+/// initial delay and three times the previous delay, capped at the class's maximum, so devices
+/// which failed together spread out rather than retrying in lockstep. A failure of a different
+/// class from the previous one starts that class's backoff afresh.
+/// </summary>
+/// <param name="backoffs">Bounds for each failure class, indexed by
+/// <see cref="ReconnectFailureClass" />. Copied.</param>
+/// <param name="seed">Seed for the jitter; should differ between devices.</param>
+void ReconnectPolicy_Init(const ReconnectBackoff backoffs[ReconnectFailure_Count], uint32_t seed);
+
+/// <summary>
+/// Record a failed attempt, and schedule the next one.
+/// </summary>
+/// <returns>Delay until the next attempt, in milliseconds.</returns>
+uint32_t ReconnectPolicy_Failed(ReconnectFailureClass failure);
+
+/// <summary>
+/// Record a successful connection, so that the next failure starts from the initial delay.
+/// </summary>
+void ReconnectPolicy_Succeeded(void);
+
+/// <summary>
+/// Allow the next attempt straight away, for example because the network has just come up,
+/// without resetting the backoff.
+/// </summary>
+void ReconnectPolicy_RetryNow(void);
+
+/// <summary>
+/// Returns whether the delay since the last failure has elapsed.
+/// </summary>
+bool ReconnectPolicy_IsRetryDue(void);
@@ -0,0 +1,184 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "reported_state.h"
+
+typedef struct {
+    const char* name;
+    bool hasValue;
+    bool hasAcknowledged;
+    uint32_t inFlightPatchId; // 0 if no patch holding this property is awaiting a result
+    char value[REPORTED_STATE_MAX_VALUE_SIZE];        // Current value, JSON-encoded
+    char acknowledged[REPORTED_STATE_MAX_VALUE_SIZE]; // Value the IoT Hub last accepted
+    char inFlight[REPORTED_STATE_MAX_VALUE_SIZE];     // Value sent in inFlightPatchId
+} ReportedProperty;
+
+static ReportedProperty properties[REPORTED_STATE_MAX_PROPERTIES];
+static size_t propertyCount = 0;
+static uint32_t nextPatchId = 1;
+
+static ReportedProperty* GetProperty(ReportedPropertyId id)
+{
+    if (id < 0 || (size_t)id >= propertyCount) {
+        return NULL;
+    }
+    return &properties[id];
+}
+
+static bool NeedsSending(const ReportedProperty* property)
+{
+    if (!property->hasValue) {
+        return false;
+    }
+
+    // Patches are applied in order, so a value in flight is what the IoT Hub will hold next.
+    if (property->inFlightPatchId != 0) {
+        return strcmp(property->value, property->inFlight) != 0;
+    }
+
+    return !property->hasAcknowledged || strcmp(property->value, property->acknowledged) != 0;
+}
+
+static bool SetEncodedValue(ReportedPropertyId id, const char* encoded)
+{
+    ReportedProperty* property = GetProperty(id);
+    if (property == NULL) {
+        return false;
+    }
+
+    snprintf(property->value, sizeof(property->value), "%s", encoded);
+    property->hasValue = true;
+    return NeedsSending(property);
+}
+
+ReportedPropertyId ReportedState_AddProperty(const char* name)
+{
+    if (propertyCount >= REPORTED_STATE_MAX_PROPERTIES ||
+        strlen(name) > REPORTED_STATE_MAX_NAME_LENGTH) {
+        return -1;
+    }
+
+    memset(&properties[propertyCount], 0, sizeof(properties[propertyCount]));
+    properties[propertyCount].name = name;
+    return (ReportedPropertyId)propertyCount++;
+}
+
+bool ReportedState_SetBool(ReportedPropertyId id, bool value)
+{
+    return SetEncodedValue(id, value ? "true" : "false");
+}
+
+bool ReportedState_SetInt(ReportedPropertyId id, int64_t value)
+{
+    char encoded[24];
+    snprintf(encoded, sizeof(encoded), "%" PRId64, value);
+    return SetEncodedValue(id, encoded);
+}
+
+bool ReportedState_SetHundredths(ReportedPropertyId id, int64_t hundredths)
+{
+    char encoded[24];
+    uint64_t magnitude = hundredths < 0 ? 0 - (uint64_t)hundredths : (uint64_t)hundredths;
+    snprintf(encoded, sizeof(encoded), "%s%" PRIu64 ".%02u", hundredths < 0 ? "-" : "",
+        magnitude / 100, (unsigned int)(magnitude % 100));
+    return SetEncodedValue(id, encoded);
+}
+
+bool ReportedState_SetString(ReportedPropertyId id, const char* value)
+{
+    char encoded[REPORTED_STATE_MAX_VALUE_SIZE];
+    size_t length = 0;
+
+    // Leave room for the closing quote and the null terminator.
+    encoded[length++] = '"';
+    for (; *value != 0 && length < sizeof(encoded) - 3; value++) {
+        if (*value == '"' || *value == '\\') {
+            encoded[length++] = '\\';
+        }
+        else if ((unsigned char)*value < 0x20) {
+            continue;
+        }
+        encoded[length++] = *value;
+    }
+    encoded[length++] = '"';
+    encoded[length] = 0;
+
+    return SetEncodedValue(id, encoded);
+}
+
+bool ReportedState_IsPatchPending(void)
+{
+    for (size_t i = 0; i < propertyCount; i++) {
+        if (NeedsSending(&properties[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ReportedState_BuildPatch(char* buffer, size_t size, uint32_t* outPatchId)
+{
+    size_t length = 0;
+    uint32_t patchId = nextPatchId;
+
+    if (size < 3 || !ReportedState_IsPatchPending()) {
+        return 0;
+    }
+
+    buffer[length++] = '{';
+    for (size_t i = 0; i < propertyCount; i++) {
+        ReportedProperty* property = &properties[i];
+        if (!NeedsSending(property)) {
+            continue;
+        }
+
+        int written = snprintf(buffer + length, size - length, "%s\"%s\":%s",
+            length > 1 ? "," : "", property->name, property->value);
+        if (written < 0 || (size_t)written >= size - length - 1) {
+            // Leave the remaining properties for the next patch.
+            buffer[length] = 0;
+            break;
+        }
+        length += (size_t)written;
+
+        strcpy(property->inFlight, property->value);
+        property->inFlightPatchId = patchId;
+    }
+    if (length == 1) {
+        return 0;
+    }
+    buffer[length++] = '}';
+    buffer[length] = 0;
+
+    nextPatchId = nextPatchId == UINT32_MAX ? 1 : nextPatchId + 1;
+    *outPatchId = patchId;
+    return length;
+}
+
+bool ReportedState_Acknowledge(uint32_t patchId, bool accepted)
+{
+    for (size_t i = 0; i < propertyCount; i++) {
+        ReportedProperty* property = &properties[i];
+        if (property->inFlightPatchId != patchId) {
+            continue;
+        }
+        if (accepted) {
+            strcpy(property->acknowledged, property->inFlight);
+            property->hasAcknowledged = true;
+        }
+        property->inFlightPatchId = 0;
+    }
+
+    return ReportedState_IsPatchPending();
+}
+
+void ReportedState_CancelInFlight(void)
+{
+    for (size_t i = 0; i < propertyCount; i++) {
+        properties[i].inFlightPatchId = 0;
+    }
+}
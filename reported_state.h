@@ -0,0 +1,102 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Largest number of reported properties which can be registered.
+/// </summary>
+#define REPORTED_STATE_MAX_PROPERTIES 16
+
+/// <summary>
+/// Largest JSON-encoded value of a reported property, in bytes.
+/// </summary>
+#define REPORTED_STATE_MAX_VALUE_SIZE 48
+
+/// <summary>
+/// Longest reported property name, in bytes.
+/// </summary>
+#define REPORTED_STATE_MAX_NAME_LENGTH 32
+
+/// <summary>
+/// Buffer size which is always large enough for <see cref="ReportedState_BuildPatch" />.
+/// </summary>
+#define REPORTED_STATE_PATCH_BUFFER_SIZE \
+    (REPORTED_STATE_MAX_PROPERTIES *     \
+     (REPORTED_STATE_MAX_NAME_LENGTH + REPORTED_STATE_MAX_VALUE_SIZE + 4) + 3)
+
+/// <summary>
+/// Identifier of a property in the reported state cache. The cache remembers the value of each
+/// property last acknowledged by the IoT Hub, so that only properties which differ from it are
+/// sent, and a burst of changes is sent as one patch. A property whose report fails, or which
+/// is cleared by <see cref="ReportedState_CancelInFlight" />, is sent again with the next patch.
+/// </summary>
+typedef int ReportedPropertyId;
+
+/// <summary>
+/// Register a reported property. No value is reported until one is set.
+/// </summary>
+/// <param name="name">Property name of at most REPORTED_STATE_MAX_NAME_LENGTH bytes, which must
+/// remain valid and need no JSON escaping.</param>
+/// <returns>The property's identifier, or -1 if the name is too long or
+/// REPORTED_STATE_MAX_PROPERTIES properties are already registered.</returns>
+ReportedPropertyId ReportedState_AddProperty(const char* name);
+
+/// <summary>
+/// Set a property to a boolean value.
+/// </summary>
+/// <returns>true if a patch now needs to be sent; false otherwise.</returns>
+bool ReportedState_SetBool(ReportedPropertyId id, bool value);
+
+/// <summary>
+/// Set a property to an integer value.
+/// </summary>
+/// <returns>true if a patch now needs to be sent; false otherwise.</returns>
+bool ReportedState_SetInt(ReportedPropertyId id, int64_t value);
+
+/// <summary>
+/// Set a property to a fixed-point number, given in hundredths, e.g. 390 is reported as 3.90.
+/// </summary>
+/// <returns>true if a patch now needs to be sent; false otherwise.</returns>
+bool ReportedState_SetHundredths(ReportedPropertyId id, int64_t hundredths);
+
+/// <summary>
+/// Set a property to a string value. Strings which do not fit in
+/// REPORTED_STATE_MAX_VALUE_SIZE once encoded are truncated.
+/// </summary>
+/// <returns>true if a patch now needs to be sent; false otherwise.</returns>
+bool ReportedState_SetString(ReportedPropertyId id, const char* value);
+
+/// <summary>
+/// Returns true if any property has a value which has neither been acknowledged nor sent.
+/// </summary>
+bool ReportedState_IsPatchPending(void);
+
+/// <summary>
+/// Build a JSON patch of every property which needs to be sent, and mark those properties as
+/// in flight under a new patch identifier.
+/// </summary>
+/// <param name="buffer">Buffer which receives the null-terminated patch. It should be
+/// REPORTED_STATE_PATCH_BUFFER_SIZE bytes long.</param>
+/// <param name="size">Size of buffer in bytes.</param>
+/// <param name="outPatchId">Receives the identifier to pass to
+/// <see cref="ReportedState_Acknowledge" />.</param>
+/// <returns>The length of the patch, or 0 if there is nothing to send.</returns>
+size_t ReportedState_BuildPatch(char* buffer, size_t size, uint32_t* outPatchId);
+
+/// <summary>
+/// Record the outcome of sending a patch.
+/// </summary>
+/// <param name="patchId">Identifier from <see cref="ReportedState_BuildPatch" />.</param>
+/// <param name="accepted">Whether the IoT Hub accepted the patch.</param>
+/// <returns>true if a patch now needs to be sent; false otherwise.</returns>
+bool ReportedState_Acknowledge(uint32_t patchId, bool accepted);
+
+/// <summary>
+/// Forget every patch in flight, e.g. because the client which was sending it was destroyed, so
+/// that its properties are sent again.
+/// </summary>
+void ReportedState_CancelInFlight(void);
@@ -0,0 +1,73 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <string.h>
+
+#include "sample_ring.h"
+
+void SampleRing_Init(SampleRing* ring)
+{
+    memset(ring, 0, sizeof(*ring));
+}
+
+void SampleRing_Push(SampleRing* ring, uint32_t sample)
+{
+    ring->samples[ring->head] = sample;
+    ring->head = (ring->head + 1) % SAMPLE_RING_CAPACITY;
+    if (ring->count < SAMPLE_RING_CAPACITY) {
+        ring->count++;
+    }
+}
+
+// Copy the most recent 'window' samples into 'out', oldest first.
+static void CopyRecent(const SampleRing* ring, size_t window, uint32_t* out)
+{
+    size_t index = (ring->head + SAMPLE_RING_CAPACITY - window) % SAMPLE_RING_CAPACITY;
+    for (size_t i = 0; i < window; i++) {
+        out[i] = ring->samples[index];
+        index = (index + 1) % SAMPLE_RING_CAPACITY;
+    }
+}
+
+bool SampleRing_Decimate(const SampleRing* ring, SampleDecimationMode mode, size_t window,
+    uint32_t* outValue)
+{
+    if (window > ring->count) {
+        window = ring->count;
+    }
+    if (window == 0) {
+        return false;
+    }
+
+    uint32_t recent[SAMPLE_RING_CAPACITY];
+    CopyRecent(ring, window, recent);
+
+    if (mode == SampleDecimation_Median) {
+        // Insertion sort is cheapest for the small windows used here.
+        for (size_t i = 1; i < window; i++) {
+            uint32_t value = recent[i];
+            size_t j = i;
+            while (j > 0 && recent[j - 1] > value) {
+                recent[j] = recent[j - 1];
+                j--;
+            }
+            recent[j] = value;
+        }
+
+        if ((window % 2) == 0) {
+            *outValue = (uint32_t)(((uint64_t)recent[window / 2 - 1] + recent[window / 2]) / 2);
+        }
+        else {
+            *outValue = recent[window / 2];
+        }
+        return true;
+    }
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < window; i++) {
+        sum += recent[i];
+    }
+    // Round to nearest rather than truncating.
+    *outValue = (uint32_t)((sum + window / 2) / window);
+    return true;
+}
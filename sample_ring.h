@@ -0,0 +1,56 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Number of raw samples retained by a <see cref="SampleRing" />. This bounds both the
+/// memory used by the sampling subsystem and the largest usable decimation window.
+/// </summary>
+#define SAMPLE_RING_CAPACITY 64
+
+/// <summary>
+/// Decimation stage used to reduce the oversampled raw ADC counts to a single reading.
+/// </summary>
+typedef enum {
+    SampleDecimation_MovingAverage = 0, // Mean of the most recent N samples
+    SampleDecimation_Median = 1         // Median of the most recent N samples
+} SampleDecimationMode;
+
+/// <summary>
+/// Fixed-size ring buffer of raw ADC counts. Once full, the oldest sample is overwritten.
+/// Statically allocate one per channel and initialize it with <see cref="SampleRing_Init" />.
+/// </summary>
+typedef struct {
+    uint32_t samples[SAMPLE_RING_CAPACITY];
+    size_t head;  // Index at which the next sample will be written
+    size_t count; // Number of valid samples, up to SAMPLE_RING_CAPACITY
+} SampleRing;
+
+/// <summary>
+/// Empty the ring buffer.
+/// </summary>
+/// <param name="ring">Ring buffer to initialize.</param>
+void SampleRing_Init(SampleRing* ring);
+
+/// <summary>
+/// Append a raw sample, overwriting the oldest sample if the ring is full.
+/// </summary>
+/// <param name="ring">Ring buffer to append to.</param>
+/// <param name="sample">Raw ADC count.</param>
+void SampleRing_Push(SampleRing* ring, uint32_t sample);
+
+/// <summary>
+/// Reduce the most recent samples to a single value.
+/// </summary>
+/// <param name="ring">Ring buffer to read from. It is not modified.</param>
+/// <param name="mode">Decimation stage to apply.</param>
+/// <param name="window">Number of most recent samples to consider. Values larger than
+/// the number of samples held are clamped.</param>
+/// <param name="outValue">Receives the decimated value in raw ADC counts.</param>
+/// <returns>true on success; false if the ring is empty or window is zero.</returns>
+bool SampleRing_Decimate(const SampleRing* ring, SampleDecimationMode mode, size_t window,
+    uint32_t* outValue);
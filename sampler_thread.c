@@ -0,0 +1,197 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "app_log.h"
+#include "sampler_thread.h"
+#include "sensor_channels.h"
+#include "spsc_ring.h"
+
+#define NANOSECONDS_PER_SECOND 1000000000l
+
+typedef struct {
+    uint32_t counts[SENSOR_CHANNELS_MAX];
+} Sweep;
+
+static EventLoop* samplerEventLoop = NULL;
+static EventRegistration* sweepEventReg = NULL;
+static int sweepEventFd = -1;
+static SamplerThreadSweepHandler sweepHandler = NULL;
+static SamplerThreadFailedHandler failedHandler = NULL;
+static uint32_t reportedDroppedCount = 0;
+static pthread_t samplerThread;
+static bool isRunning = false;
+
+// Set before the thread starts, and only read by it.
+static struct timespec samplePeriod;
+static SamplerThreadTakeSweep takeSweep = NULL;
+
+// Shared with the thread. The ring needs no lock; the flags are atomic.
+static SpscRing sweepRing;
+static Sweep sweepStorage[SAMPLER_THREAD_RING_CAPACITY];
+static bool isStopping = false;
+static bool isFailed = false;
+static int failedError = 0; // Written before isFailed is set
+
+static void AddTime(struct timespec* time, const struct timespec* increment)
+{
+    time->tv_sec += increment->tv_sec;
+    time->tv_nsec += increment->tv_nsec;
+    if (time->tv_nsec >= NANOSECONDS_PER_SECOND) {
+        time->tv_sec++;
+        time->tv_nsec -= NANOSECONDS_PER_SECOND;
+    }
+}
+
+static bool IsBefore(const struct timespec* a, const struct timespec* b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void WakeEventLoop(void)
+{
+    // The counter cannot overflow: the event loop resets it on every wakeup.
+    uint64_t one = 1;
+    if (write(sweepEventFd, &one, sizeof(one)) == -1) {
+        LOG_ERROR("ERROR: Could not signal sweeps: %s (%d).\n", strerror(errno), errno);
+    }
+}
+
+static void* SamplerLoop(void* context)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (!__atomic_load_n(&isStopping, __ATOMIC_ACQUIRE)) {
+        AddTime(&deadline, &samplePeriod);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        }
+        if (__atomic_load_n(&isStopping, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        // Skip sweeps which were missed, rather than catching up in a burst.
+        struct timespec now;
+        struct timespec nextDeadline = deadline;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        AddTime(&nextDeadline, &samplePeriod);
+        if (!IsBefore(&now, &nextDeadline)) {
+            deadline = now;
+        }
+
+        Sweep sweep;
+        if (takeSweep(sweep.counts) == -1) {
+            failedError = errno;
+            __atomic_store_n(&isFailed, true, __ATOMIC_RELEASE);
+            WakeEventLoop();
+            break;
+        }
+        SpscRing_Push(&sweepRing, &sweep);
+        WakeEventLoop();
+    }
+    return NULL;
+}
+
+static void SweepEventHandler(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
+{
+    uint64_t count;
+    if (read(sweepEventFd, &count, sizeof(count)) == -1) {
+        return;
+    }
+
+    Sweep sweep;
+    while (SpscRing_Pop(&sweepRing, &sweep)) {
+        sweepHandler(sweep.counts);
+    }
+
+    uint32_t droppedCount = SpscRing_DroppedCount(&sweepRing);
+    if (droppedCount != reportedDroppedCount) {
+        LOG_WARNING("WARNING: Sampler dropped %u sweeps while the event loop was busy.\n",
+            (unsigned int)(droppedCount - reportedDroppedCount));
+        reportedDroppedCount = droppedCount;
+    }
+
+    if (isRunning && __atomic_load_n(&isFailed, __ATOMIC_ACQUIRE)) {
+        pthread_join(samplerThread, NULL);
+        isRunning = false;
+        failedHandler(failedError);
+    }
+}
+
+int SamplerThread_Start(EventLoop* eventLoop, const struct timespec* period,
+    SamplerThreadTakeSweep takeSweepFunction, SamplerThreadSweepHandler sweepHandlerFunction,
+    SamplerThreadFailedHandler failedHandlerFunction)
+{
+    if (isRunning) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (period->tv_sec < 0 || period->tv_nsec < 0 || period->tv_nsec >= NANOSECONDS_PER_SECOND ||
+        (period->tv_sec == 0 && period->tv_nsec == 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    samplerEventLoop = eventLoop;
+    samplePeriod = *period;
+    takeSweep = takeSweepFunction;
+    sweepHandler = sweepHandlerFunction;
+    failedHandler = failedHandlerFunction;
+    SpscRing_Init(&sweepRing, sweepStorage, sizeof(sweepStorage[0]),
+        SAMPLER_THREAD_RING_CAPACITY);
+    reportedDroppedCount = 0;
+    isStopping = false;
+    isFailed = false;
+
+    sweepEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (sweepEventFd == -1) {
+        return -1;
+    }
+    sweepEventReg = EventLoop_RegisterIo(samplerEventLoop, sweepEventFd, EventLoop_Input,
+        &SweepEventHandler, NULL);
+    if (sweepEventReg == NULL) {
+        int error = errno;
+        SamplerThread_Stop();
+        errno = error;
+        return -1;
+    }
+
+    int result = pthread_create(&samplerThread, NULL, &SamplerLoop, NULL);
+    if (result != 0) {
+        SamplerThread_Stop();
+        errno = result;
+        return -1;
+    }
+
+    isRunning = true;
+    return 0;
+}
+
+uint32_t SamplerThread_DroppedCount(void)
+{
+    return SpscRing_DroppedCount(&sweepRing);
+}
+
+void SamplerThread_Stop(void)
+{
+    if (isRunning) {
+        __atomic_store_n(&isStopping, true, __ATOMIC_RELEASE);
+        pthread_join(samplerThread, NULL);
+        isRunning = false;
+    }
+
+    if (sweepEventReg != NULL) {
+        EventLoop_UnregisterIo(samplerEventLoop, sweepEventReg);
+        sweepEventReg = NULL;
+    }
+    if (sweepEventFd != -1) {
+        close(sweepEventFd);
+        sweepEventFd = -1;
+    }
+}
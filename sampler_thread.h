@@ -0,0 +1,63 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdint.h>
+#include <time.h>
+
+#include <applibs/eventloop.h>
+
+/// <summary>
+/// Sweeps which can await the event loop. At the default 10 Hz this covers a stall of more than
+/// 25 seconds, such as a TLS handshake in IoTHubDeviceClient_LL_DoWork, without losing samples.
+/// </summary>
+#define SAMPLER_THREAD_RING_CAPACITY 256
+
+/// <summary>
+/// Takes one sweep of raw ADC counts, one per sensor channel. Called on the sampler thread, so
+/// it must only touch state which is not shared with the event loop, such as the ADC.
+/// </summary>
+/// <param name="outCounts">Receives SENSOR_CHANNELS_MAX counts at most.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+typedef int (*SamplerThreadTakeSweep)(uint32_t* outCounts);
+
+/// <summary>
+/// Invoked on the event loop for each sweep, oldest first.
+/// </summary>
+typedef void (*SamplerThreadSweepHandler)(const uint32_t* counts);
+
+/// <summary>
+/// Invoked on the event loop if taking a sweep failed, after the thread has stopped.
+/// </summary>
+/// <param name="error">errno from the failed sweep.</param>
+typedef void (*SamplerThreadFailedHandler)(int error);
+
+/// <summary>
+/// Start taking sweeps on a thread of their own, so that sampling keeps its pace however long
+/// the event loop is busy. Sweeps are passed to the event loop through a lock-free
+/// single-producer, single-consumer ring, and an eventfd wakes the loop. Sweeps are taken at
+/// absolute deadlines, so that jitter does not accumulate; if the thread falls more than a
+/// period behind, the missed sweeps are skipped rather than taken in a burst.
+/// </summary>
+/// <param name="eventLoop">Event loop on which sweeps are handled.</param>
+/// <param name="period">Time between sweeps.</param>
+/// <param name="takeSweep">Function which takes a sweep, on the sampler thread.</param>
+/// <param name="sweepHandler">Callback to invoke for each sweep.</param>
+/// <param name="failedHandler">Callback to invoke if taking a sweep fails.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information. errno
+/// is EBUSY if the thread is already running.</returns>
+int SamplerThread_Start(EventLoop* eventLoop, const struct timespec* period,
+    SamplerThreadTakeSweep takeSweep, SamplerThreadSweepHandler sweepHandler,
+    SamplerThreadFailedHandler failedHandler);
+
+/// <summary>
+/// Returns the number of sweeps which were dropped because the ring was full.
+/// </summary>
+uint32_t SamplerThread_DroppedCount(void);
+
+/// <summary>
+/// Stop the thread, waiting for at most one period, and free the eventfd. Sweeps which have not
+/// been handled are discarded. It is safe to call this function if
+/// <see cref="SamplerThread_Start" /> was not called or failed.
+/// </summary>
+void SamplerThread_Stop(void);
@@ -0,0 +1,110 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+
+#include "sensor_channels.h"
+
+#define DEFAULT_BIT_COUNT 12
+#define DEFAULT_REFERENCE_VOLTAGE 2.5f
+
+// Channel table in structure-of-arrays form. Scales are hundredths of the reported unit per
+// count, in Q32.32 fixed point, so that a conversion is one multiply, shift and add.
+static size_t channelCount = 0;
+static uint32_t adcChannels[SENSOR_CHANNELS_MAX];
+static int32_t unitsPerVoltQ16[SENSOR_CHANNELS_MAX];
+static int bitCounts[SENSOR_CHANNELS_MAX];
+static int64_t scalesQ32[SENSOR_CHANNELS_MAX];
+static int32_t offsetsHundredths[SENSOR_CHANNELS_MAX];
+static SampleRing rings[SENSOR_CHANNELS_MAX];
+
+int SensorChannels_Init(const SensorChannelConfig* channels, size_t count)
+{
+    if (channels == NULL || count == 0 || count > SENSOR_CHANNELS_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    channelCount = count;
+    for (size_t i = 0; i < count; i++) {
+        adcChannels[i] = channels[i].adcChannel;
+        unitsPerVoltQ16[i] = channels[i].unitsPerVoltQ16;
+        offsetsHundredths[i] = channels[i].offsetHundredths;
+        SampleRing_Init(&rings[i]);
+        SensorChannels_SetResolution(i, DEFAULT_BIT_COUNT, DEFAULT_REFERENCE_VOLTAGE);
+    }
+    return 0;
+}
+
+size_t SensorChannels_Count(void)
+{
+    return channelCount;
+}
+
+uint32_t SensorChannels_AdcChannel(size_t channel)
+{
+    return channel < channelCount ? adcChannels[channel] : 0;
+}
+
+int SensorChannels_BitCount(size_t channel)
+{
+    return channel < channelCount ? bitCounts[channel] : 0;
+}
+
+int SensorChannels_SetResolution(size_t channel, int bitCount, float referenceVoltage)
+{
+    if (channel >= channelCount || bitCount < 1 || bitCount > 31 || referenceVoltage <= 0.0f) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The reference voltage is rounded to hundredths first, so that the result is the same as
+    // converting counts to hundredths of a volt and then scaling.
+    int64_t maxCounts = ((int64_t)1 << bitCount) - 1;
+    int64_t fullScaleHundredths = (int64_t)(referenceVoltage * 100.0f + 0.5f);
+    int64_t numerator = fullScaleHundredths * unitsPerVoltQ16[channel] * 65536;
+    int64_t rounding = numerator < 0 ? -maxCounts / 2 : maxCounts / 2;
+    scalesQ32[channel] = (numerator + rounding) / maxCounts;
+    bitCounts[channel] = bitCount;
+    return 0;
+}
+
+void SensorChannels_PushSweep(const uint32_t* counts)
+{
+    for (size_t i = 0; i < channelCount; i++) {
+        SampleRing_Push(&rings[i], counts[i]);
+    }
+}
+
+void SensorChannels_PushSample(size_t channel, uint32_t count)
+{
+    if (channel < channelCount) {
+        SampleRing_Push(&rings[channel], count);
+    }
+}
+
+void SensorChannels_Convert(const uint32_t* counts, int32_t* outHundredths, size_t count)
+{
+    // Independent iterations over contiguous arrays, which the compiler can vectorize.
+    for (size_t i = 0; i < count; i++) {
+        int64_t scaled = (int64_t)counts[i] * scalesQ32[i] + ((int64_t)1 << 31);
+        outHundredths[i] = (int32_t)(scaled >> 32) + offsetsHundredths[i];
+    }
+}
+
+bool SensorChannels_Read(SampleDecimationMode mode, size_t window,
+    SensorChannelValues* outValues)
+{
+    outValues->validMask = 0;
+    for (size_t i = 0; i < channelCount; i++) {
+        if (SampleRing_Decimate(&rings[i], mode, window, &outValues->counts[i])) {
+            outValues->validMask |= 1u << i;
+        }
+        else {
+            outValues->counts[i] = 0;
+        }
+    }
+
+    SensorChannels_Convert(outValues->counts, outValues->hundredths, channelCount);
+    return outValues->validMask != 0;
+}
@@ -0,0 +1,100 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sample_ring.h"
+
+/// <summary>
+/// Largest number of ADC channels which can be swept together.
+/// </summary>
+#define SENSOR_CHANNELS_MAX 4
+
+/// <summary>
+/// An ADC channel and the linear conversion of its voltage to the reported unit.
+/// </summary>
+typedef struct {
+    const char* name;         // Used in log messages
+    uint32_t adcChannel;      // Channel of the ADC controller
+    int32_t unitsPerVoltQ16;  // Reported units per volt, in Q16.16 fixed point
+    int32_t offsetHundredths; // Added after scaling, in hundredths of the reported unit
+} SensorChannelConfig;
+
+/// <summary>
+/// One decimated value of each channel, raw and converted.
+/// </summary>
+typedef struct {
+    int32_t hundredths[SENSOR_CHANNELS_MAX]; // In hundredths of each channel's reported unit
+    uint32_t counts[SENSOR_CHANNELS_MAX];    // Decimated raw counts, for calibration
+    uint32_t validMask;                      // Bit n is set if channel n had any samples
+} SensorChannelValues;
+
+/// <summary>
+/// Set up the channels and empty their sample rings. The table is copied into a
+/// structure-of-arrays layout, so that a whole sweep is converted by one loop over contiguous
+/// counts, scales and offsets. Until <see cref="SensorChannels_SetResolution" /> is called, a
+/// channel is taken to be a 12-bit converter with a 2.5 V reference.
+/// </summary>
+/// <param name="channels">Channels in sweep order.</param>
+/// <param name="count">Number of channels, from 1 to SENSOR_CHANNELS_MAX.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int SensorChannels_Init(const SensorChannelConfig* channels, size_t count);
+
+/// <summary>
+/// Returns the number of channels set up by <see cref="SensorChannels_Init" />.
+/// </summary>
+size_t SensorChannels_Count(void);
+
+/// <summary>
+/// Returns a channel's ADC channel number.
+/// </summary>
+uint32_t SensorChannels_AdcChannel(size_t channel);
+
+/// <summary>
+/// Returns a channel's sample size in bits, as last set by
+/// <see cref="SensorChannels_SetResolution" />.
+/// </summary>
+int SensorChannels_BitCount(size_t channel);
+
+/// <summary>
+/// Set the resolution and reference voltage of a channel's converter, from which its scale
+/// from counts to hundredths is computed. Floating point is only used here, not per sample.
+/// </summary>
+/// <param name="channel">Index of the channel in the table.</param>
+/// <param name="bitCount">Sample size in bits, from 1 to 31.</param>
+/// <param name="referenceVoltage">Voltage of a full-scale sample.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int SensorChannels_SetResolution(size_t channel, int bitCount, float referenceVoltage);
+
+/// <summary>
+/// Append one raw sample of every channel, taken in the same sweep.
+/// </summary>
+/// <param name="counts">Raw ADC counts, one per channel in table order.</param>
+void SensorChannels_PushSweep(const uint32_t* counts);
+
+/// <summary>
+/// Append a raw sample of a single channel, for samples which do not arrive as a sweep.
+/// </summary>
+void SensorChannels_PushSample(size_t channel, uint32_t count);
+
+/// <summary>
+/// Decimate the most recent samples of every channel, then convert them together.
+/// </summary>
+/// <param name="mode">Decimation stage to apply.</param>
+/// <param name="window">Number of most recent samples of each channel to consider.</param>
+/// <param name="outValues">Receives the converted values.</param>
+/// <returns>true if any channel had samples; false otherwise.</returns>
+bool SensorChannels_Read(SampleDecimationMode mode, size_t window,
+    SensorChannelValues* outValues);
+
+/// <summary>
+/// Convert raw counts of the first count channels to hundredths of their reported units, using
+/// only integer arithmetic.
+/// </summary>
+/// <param name="counts">Raw ADC counts, one per channel in table order.</param>
+/// <param name="outHundredths">Receives the converted values.</param>
+/// <param name="count">Number of channels to convert.</param>
+void SensorChannels_Convert(const uint32_t* counts, int32_t* outHundredths, size_t count);
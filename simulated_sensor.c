@@ -0,0 +1,229 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "simulated_sensor.h"
+
+// The generated level is kept in fine steps, so that it can drift and return slowly.
+#define GENERATED_LEVEL_SCALE 256
+
+// One dose acting on the level.
+typedef struct {
+    uint64_t deliveredMs;
+    int32_t doseHundredths;
+} ActiveDose;
+
+static SimulatedSensorConfig sensorConfig;
+static uint32_t randomState = 1;
+static int64_t generatedLevel = 0; // In 1/GENERATED_LEVEL_SCALE hundredths
+
+static uint32_t traceTimesMs[SIMULATED_SENSOR_MAX_TRACE_POINTS];
+static int32_t traceValues[SIMULATED_SENSOR_MAX_TRACE_POINTS];
+static size_t traceCount = 0;
+static size_t traceIndex = 0; // Point at or before the last sample, to avoid searching from 0
+static bool isTraceStarted = false;
+static uint64_t traceStartMs = 0;
+static char traceText[SIMULATED_SENSOR_MAX_TRACE_BYTES + 1];
+
+static ActiveDose activeDoses[SIMULATED_SENSOR_MAX_ACTIVE_DOSES];
+static size_t nextDose = 0;
+
+// xorshift32: small, fast, and the same on every platform, unlike rand().
+static uint32_t NextRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+// Uniformly distributed in [-limit, limit].
+static int32_t RandomOffset(int32_t limit)
+{
+    if (limit <= 0) {
+        return 0;
+    }
+    return (int32_t)(NextRandom() % (uint32_t)(2 * limit + 1)) - limit;
+}
+
+// Random walk of up to half a hundredth per sample, pulled gently back towards the initial
+// level. At 10 Hz, it wanders by about a quarter either way over half an hour.
+static int32_t GeneratedLevel(void)
+{
+    int64_t initialLevel = (int64_t)sensorConfig.initialHundredths * GENERATED_LEVEL_SCALE;
+    generatedLevel += RandomOffset(GENERATED_LEVEL_SCALE / 2);
+    generatedLevel += (initialLevel - generatedLevel) / 16384;
+    return (int32_t)(generatedLevel / GENERATED_LEVEL_SCALE);
+}
+
+static int32_t TraceLevel(uint64_t timeMs)
+{
+    if (!isTraceStarted) {
+        isTraceStarted = true;
+        traceStartMs = timeMs;
+        traceIndex = 0;
+    }
+
+    uint32_t spanMs = traceTimesMs[traceCount - 1] - traceTimesMs[0];
+    uint32_t positionMs = traceTimesMs[0] + (uint32_t)((timeMs - traceStartMs) % spanMs);
+    if (positionMs < traceTimesMs[traceIndex]) {
+        traceIndex = 0; // The trace has wrapped around.
+    }
+    while (traceIndex + 2 < traceCount && traceTimesMs[traceIndex + 1] <= positionMs) {
+        traceIndex++;
+    }
+
+    int64_t fromMs = traceTimesMs[traceIndex];
+    int64_t toMs = traceTimesMs[traceIndex + 1];
+    int64_t from = traceValues[traceIndex];
+    int64_t to = traceValues[traceIndex + 1];
+    return (int32_t)(from + (to - from) * ((int64_t)positionMs - fromMs) / (toMs - fromMs));
+}
+
+// Fall in level due to the doses delivered so far: each acts linearly up to its full effect,
+// then wears off linearly.
+static int32_t InsulinEffect(uint64_t timeMs)
+{
+    uint64_t actionMs = sensorConfig.insulinActionMs;
+    int64_t effect = 0;
+    for (size_t i = 0; i < SIMULATED_SENSOR_MAX_ACTIVE_DOSES; i++) {
+        const ActiveDose* dose = &activeDoses[i];
+        if (dose->doseHundredths == 0 || timeMs < dose->deliveredMs) {
+            continue;
+        }
+
+        uint64_t elapsedMs = timeMs - dose->deliveredMs;
+        int64_t fullEffect =
+            (int64_t)dose->doseHundredths * sensorConfig.insulinSensitivityHundredths / 100;
+        if (elapsedMs < actionMs) {
+            effect += fullEffect * (int64_t)elapsedMs / (int64_t)actionMs;
+        }
+        else if (elapsedMs < 4 * actionMs) {
+            effect += fullEffect * (int64_t)(4 * actionMs - elapsedMs) / (int64_t)(3 * actionMs);
+        }
+    }
+    return (int32_t)effect;
+}
+
+int SimulatedSensor_Init(const SimulatedSensorConfig* config)
+{
+    if (config->minHundredths >= config->maxHundredths ||
+        config->initialHundredths < config->minHundredths ||
+        config->initialHundredths > config->maxHundredths || config->noiseHundredths < 0 ||
+        config->insulinSensitivityHundredths < 0 || config->insulinActionMs == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sensorConfig = *config;
+    randomState = config->seed != 0 ? config->seed : 1;
+    generatedLevel = (int64_t)config->initialHundredths * GENERATED_LEVEL_SCALE;
+    traceCount = 0;
+    isTraceStarted = false;
+    for (size_t i = 0; i < SIMULATED_SENSOR_MAX_ACTIVE_DOSES; i++) {
+        activeDoses[i].doseHundredths = 0;
+    }
+    nextDose = 0;
+    return 0;
+}
+
+int SimulatedSensor_LoadTrace(int fd)
+{
+    size_t length = 0;
+    for (;;) {
+        ssize_t readSize = read(fd, traceText + length, sizeof(traceText) - 1 - length);
+        if (readSize == -1) {
+            return -1;
+        }
+        if (readSize == 0) {
+            break;
+        }
+        length += (size_t)readSize;
+        if (length == sizeof(traceText) - 1) {
+            char extra;
+            if (read(fd, &extra, 1) > 0) {
+                errno = EFBIG;
+                return -1;
+            }
+            break;
+        }
+    }
+    traceText[length] = 0;
+
+    size_t count = 0;
+    char* line = traceText;
+    while (*line != 0) {
+        char* end;
+        if (*line == '#' || *line == '\n' || *line == '\r') {
+            while (*line != 0 && *line != '\n') {
+                line++;
+            }
+            if (*line == '\n') {
+                line++;
+            }
+            continue;
+        }
+
+        unsigned long seconds = strtoul(line, &end, 10);
+        if (end == line || *end != ',' || seconds > UINT32_MAX / 1000) {
+            errno = EINVAL;
+            return -1;
+        }
+        line = end + 1;
+        double level = strtod(line, &end);
+        if (end == line || (*end != 0 && *end != '\n' && *end != '\r')) {
+            errno = EINVAL;
+            return -1;
+        }
+        line = end;
+
+        uint32_t timeMs = (uint32_t)seconds * 1000;
+        if (count == SIMULATED_SENSOR_MAX_TRACE_POINTS) {
+            errno = EFBIG;
+            return -1;
+        }
+        if (count > 0 && timeMs <= traceTimesMs[count - 1]) {
+            errno = EINVAL;
+            return -1;
+        }
+        traceTimesMs[count] = timeMs;
+        traceValues[count] = (int32_t)lround(level * 100.0);
+        count++;
+    }
+
+    if (count < 2) {
+        errno = EINVAL;
+        return -1;
+    }
+    traceCount = count;
+    isTraceStarted = false;
+    return 0;
+}
+
+void SimulatedSensor_DeliverInsulin(uint64_t timeMs, int32_t doseHundredths)
+{
+    activeDoses[nextDose].deliveredMs = timeMs;
+    activeDoses[nextDose].doseHundredths = doseHundredths;
+    nextDose = (nextDose + 1) % SIMULATED_SENSOR_MAX_ACTIVE_DOSES;
+}
+
+int32_t SimulatedSensor_Sample(uint64_t timeMs)
+{
+    int32_t level = traceCount >= 2 ? TraceLevel(timeMs) : GeneratedLevel();
+    level -= InsulinEffect(timeMs);
+    level += RandomOffset(sensorConfig.noiseHundredths);
+
+    if (level < sensorConfig.minHundredths) {
+        return sensorConfig.minHundredths;
+    }
+    if (level > sensorConfig.maxHundredths) {
+        return sensorConfig.maxHundredths;
+    }
+    return level;
+}
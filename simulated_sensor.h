@@ -0,0 +1,65 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdint.h>
+
+/// <summary>
+/// Largest glucose trace which can be replayed, in points, and in bytes of trace file.
+/// </summary>
+#define SIMULATED_SENSOR_MAX_TRACE_POINTS 2048
+#define SIMULATED_SENSOR_MAX_TRACE_BYTES (32 * 1024)
+
+/// <summary>
+/// Insulin doses which act on the simulated level at the same time. Older doses are forgotten.
+/// </summary>
+#define SIMULATED_SENSOR_MAX_ACTIVE_DOSES 8
+
+/// <summary>
+/// Parameters of the simulated glucose sensor. Levels are in hundredths.
+/// </summary>
+typedef struct {
+    uint32_t seed;                        // Seed for the drift and noise; runs with the same seed
+                                          // and inputs produce the same samples
+    int32_t initialHundredths;            // Level at which a generated signal starts, and to
+                                          // which it slowly returns
+    int32_t minHundredths;                // Samples are clamped to this range
+    int32_t maxHundredths;
+    int32_t noiseHundredths;              // Largest per-sample noise, either way
+    int32_t insulinSensitivityHundredths; // Largest fall in level per unit of insulin
+    uint32_t insulinActionMs;             // Time for a dose to take full effect; the level then
+                                          // recovers over three times as long
+} SimulatedSensorConfig;
+
+/// <summary>
+/// Set up the sensor model, generating a slowly drifting signal until a trace is loaded.
+/// </summary>
+/// <param name="config">Model parameters. Copied.</param>
+/// <returns>0 on success, or -1 with errno set to EINVAL if the parameters are inconsistent.
+/// </returns>
+int SimulatedSensor_Init(const SimulatedSensorConfig* config);
+
+/// <summary>
+/// Replay a glucose trace instead of the generated signal. The trace is text, one point per
+/// line as "seconds,level" (for example "300,5.42"), with strictly increasing times; blank
+/// lines and lines starting with '#' are ignored. The level is interpolated between points, and
+/// the trace repeats from the start once it ends, so that short traces can drive long runs.
+/// </summary>
+/// <param name="fd">File descriptor to read the trace from. Not closed.</param>
+/// <returns>0 on success, or -1 with errno set: EINVAL if the trace is malformed or has fewer
+/// than two points, EFBIG if it is too large, or as set by read().</returns>
+int SimulatedSensor_LoadTrace(int fd);
+
+/// <summary>
+/// Tell the model that a dose has been delivered, so that later samples fall accordingly.
+/// </summary>
+/// <param name="timeMs">Monotonic time of delivery.</param>
+/// <param name="doseHundredths">Dose, in hundredths of a unit.</param>
+void SimulatedSensor_DeliverInsulin(uint64_t timeMs, int32_t doseHundredths);
+
+/// <summary>
+/// Take one sample. Samples are expected in increasing time order, at the sample rate.
+/// </summary>
+/// <param name="timeMs">Monotonic time of the sample.</param>
+/// <returns>Simulated level, in hundredths, including noise.</returns>
+int32_t SimulatedSensor_Sample(uint64_t timeMs);
@@ -0,0 +1,57 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <string.h>
+
+#include "spsc_ring.h"
+
+int SpscRing_Init(SpscRing* ring, void* storage, size_t recordSize, size_t capacity)
+{
+    if (storage == NULL || recordSize == 0 || capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ring->storage = storage;
+    ring->recordSize = recordSize;
+    ring->mask = capacity - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    return 0;
+}
+
+bool SpscRing_Push(SpscRing* ring, const void* record)
+{
+    // The producer owns head, so only the consumer's tail needs synchronizing: acquire, so that
+    // the consumer has finished reading a slot before it is overwritten.
+    size_t head = ring->head;
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail > ring->mask) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    memcpy(ring->storage + (head & ring->mask) * ring->recordSize, record, ring->recordSize);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool SpscRing_Pop(SpscRing* ring, void* outRecord)
+{
+    size_t tail = ring->tail;
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return false;
+    }
+
+    memcpy(outRecord, ring->storage + (tail & ring->mask) * ring->recordSize, ring->recordSize);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+uint32_t SpscRing_DroppedCount(const SpscRing* ring)
+{
+    return __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,64 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// Size in bytes which keeps the producer's and the consumer's indices on separate cache lines.
+/// </summary>
+#define SPSC_RING_CACHE_LINE_SIZE 64
+
+/// <summary>
+/// Lock-free queue of fixed-size records between exactly one producer thread and one consumer
+/// thread. Each index is only written by one side, and is published with release ordering
+/// after the record it covers has been written or read, so neither side ever waits for the
+/// other. The storage is supplied by the caller.
+/// </summary>
+typedef struct {
+    // Written by the producer only.
+    _Alignas(SPSC_RING_CACHE_LINE_SIZE) size_t head; // Records pushed, ever
+    uint32_t dropped;                                 // Records which did not fit
+
+    // Written by the consumer only.
+    _Alignas(SPSC_RING_CACHE_LINE_SIZE) size_t tail; // Records popped, ever
+
+    // Set once before either thread starts.
+    _Alignas(SPSC_RING_CACHE_LINE_SIZE) uint8_t* storage;
+    size_t recordSize;
+    size_t mask; // Capacity - 1
+} SpscRing;
+
+/// <summary>
+/// Set up an empty ring. Call before the producer and consumer threads use it.
+/// </summary>
+/// <param name="ring">Ring to initialize.</param>
+/// <param name="storage">capacity * recordSize bytes, which must outlive the ring.</param>
+/// <param name="recordSize">Size of each record in bytes.</param>
+/// <param name="capacity">Number of records, which must be a power of two.</param>
+/// <returns>0 on success, or -1 with errno set to EINVAL if the capacity is not a power of
+/// two.</returns>
+int SpscRing_Init(SpscRing* ring, void* storage, size_t recordSize, size_t capacity);
+
+/// <summary>
+/// Append a record. Only call from the producer thread.
+/// </summary>
+/// <returns>true on success; false if the ring is full, in which case the record is counted as
+/// dropped.</returns>
+bool SpscRing_Push(SpscRing* ring, const void* record);
+
+/// <summary>
+/// Remove the oldest record. Only call from the consumer thread.
+/// </summary>
+/// <param name="ring">Ring to read from.</param>
+/// <param name="outRecord">Receives the record.</param>
+/// <returns>true on success; false if the ring is empty.</returns>
+bool SpscRing_Pop(SpscRing* ring, void* outRecord);
+
+/// <summary>
+/// Returns the number of records which did not fit, since the ring was initialized. This may
+/// be called from either thread.
+/// </summary>
+uint32_t SpscRing_DroppedCount(const SpscRing* ring);
@@ -0,0 +1,31 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include "telemetry_batch.h"
+
+void TelemetryBatch_Init(TelemetryBatch* batch, size_t limit)
+{
+    if (limit == 0) {
+        limit = 1;
+    }
+    else if (limit > TELEMETRY_BATCH_CAPACITY) {
+        limit = TELEMETRY_BATCH_CAPACITY;
+    }
+
+    batch->count = 0;
+    batch->limit = limit;
+}
+
+bool TelemetryBatch_Add(TelemetryBatch* batch, const TelemetryReading* reading)
+{
+    if (batch->count < batch->limit) {
+        batch->readings[batch->count++] = *reading;
+    }
+
+    return batch->count >= batch->limit;
+}
+
+void TelemetryBatch_Clear(TelemetryBatch* batch)
+{
+    batch->count = 0;
+}
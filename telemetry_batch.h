@@ -0,0 +1,66 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/// <summary>
+/// Largest number of readings which can be held in one <see cref="TelemetryBatch" />.
+/// </summary>
+#define TELEMETRY_BATCH_CAPACITY 32
+
+/// <summary>
+/// Sensor channels which are reported alongside glucose, when the hardware has them.
+/// </summary>
+typedef enum {
+    TelemetryChannel_Temperature = 0, // Hundredths of a degree Celsius
+    TelemetryChannel_Reference = 1,   // Hundredths of a volt
+    TelemetryChannel_Count
+} TelemetryChannel;
+
+/// <summary>
+/// A single glucose reading together with the wall-clock time at which it was taken, and any
+/// other channels sampled in the same sweep. Readings are fixed-point, in hundredths of the
+/// reported unit.
+/// </summary>
+typedef struct {
+    time_t timestamp;
+    int32_t glucoseHundredths;
+    uint32_t channelMask; // Bit n is set if channelHundredths[n] holds a value
+    int32_t channelHundredths[TelemetryChannel_Count];
+} TelemetryReading;
+
+/// <summary>
+/// Statically allocated accumulator for glucose readings which are sent to the IoT Hub
+/// together as one message.
+/// </summary>
+typedef struct {
+    TelemetryReading readings[TELEMETRY_BATCH_CAPACITY];
+    size_t count;
+    size_t limit; // Number of readings at which the batch is considered full
+} TelemetryBatch;
+
+/// <summary>
+/// Empty the batch and set the number of readings at which it is full.
+/// </summary>
+/// <param name="batch">Batch to initialize.</param>
+/// <param name="limit">Readings per message, clamped to between 1 and
+/// TELEMETRY_BATCH_CAPACITY.</param>
+void TelemetryBatch_Init(TelemetryBatch* batch, size_t limit);
+
+/// <summary>
+/// Append a reading to the batch. The caller should flush the batch once this returns true.
+/// </summary>
+/// <param name="batch">Batch to append to. It must not already be full.</param>
+/// <param name="reading">Reading to append.</param>
+/// <returns>true if the batch is now full; false otherwise.</returns>
+bool TelemetryBatch_Add(TelemetryBatch* batch, const TelemetryReading* reading);
+
+/// <summary>
+/// Remove all readings from the batch.
+/// </summary>
+/// <param name="batch">Batch to clear.</param>
+void TelemetryBatch_Clear(TelemetryBatch* batch);
@@ -0,0 +1,275 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "telemetry_encoder.h"
+
+// Bounded output cursor. Once a write does not fit, every later write is ignored.
+typedef struct {
+    uint8_t* buffer;
+    size_t size;
+    size_t used;
+    bool overflow;
+} Writer;
+
+static void WriteBytes(Writer* writer, const void* data, size_t length)
+{
+    if (writer->overflow || length > writer->size - writer->used) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buffer + writer->used, data, length);
+    writer->used += length;
+}
+
+static void WriteByte(Writer* writer, uint8_t value)
+{
+    WriteBytes(writer, &value, 1);
+}
+
+#define WRITE_LITERAL(writer, literal) WriteBytes((writer), (literal), sizeof(literal) - 1)
+
+// Write an unsigned decimal integer.
+static void WriteDecimal(Writer* writer, uint64_t value)
+{
+    char digits[20];
+    size_t count = 0;
+    do {
+        digits[sizeof(digits) - 1 - count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    WriteBytes(writer, digits + sizeof(digits) - count, count);
+}
+
+// Write a fixed-point value with two decimal places, e.g. 512 as "5.12".
+static void WriteHundredths(Writer* writer, int32_t value)
+{
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    if (value < 0) {
+        WriteByte(writer, '-');
+    }
+    WriteDecimal(writer, magnitude / 100);
+    uint8_t fraction[3] = { '.', (uint8_t)('0' + (magnitude / 10) % 10),
+                            (uint8_t)('0' + magnitude % 10) };
+    WriteBytes(writer, fraction, sizeof(fraction));
+}
+
+// Keys of the optional channels, in TelemetryChannel order, with their leading separator.
+static const char* const JsonChannelKeys[TelemetryChannel_Count] = { ",\"Temperature\":",
+                                                                     ",\"Reference\":" };
+
+static void EncodeJsonReading(Writer* writer, const TelemetryReading* reading, bool includeTime)
+{
+    WRITE_LITERAL(writer, "{\"Glucose\":");
+    WriteHundredths(writer, reading->glucoseHundredths);
+    for (size_t i = 0; i < TelemetryChannel_Count; i++) {
+        if ((reading->channelMask & (1u << i)) != 0) {
+            WriteBytes(writer, JsonChannelKeys[i], strlen(JsonChannelKeys[i]));
+            WriteHundredths(writer, reading->channelHundredths[i]);
+        }
+    }
+    if (includeTime) {
+        WRITE_LITERAL(writer, ",\"Time\":");
+        WriteDecimal(writer, (uint64_t)reading->timestamp);
+    }
+    WriteByte(writer, '}');
+}
+
+// CBOR major types (RFC 7049 section 2.1).
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_TAG 6
+
+#define CBOR_TAG_DECIMAL_FRACTION 4
+
+// Pre-encoded text string keys.
+static const uint8_t CborKeyGlucose[] = { 0x67, 'G', 'l', 'u', 'c', 'o', 's', 'e' };
+static const uint8_t CborKeyTime[] = { 0x64, 'T', 'i', 'm', 'e' };
+static const uint8_t CborKeyTemperature[] = { 0x6B, 'T', 'e', 'm', 'p', 'e',
+                                              'r',  'a', 't', 'u', 'r', 'e' };
+static const uint8_t CborKeyReference[] = { 0x69, 'R', 'e', 'f', 'e', 'r', 'e', 'n', 'c', 'e' };
+
+static const struct {
+    const uint8_t* key;
+    size_t length;
+} CborChannelKeys[TelemetryChannel_Count] = {
+    { CborKeyTemperature, sizeof(CborKeyTemperature) },
+    { CborKeyReference, sizeof(CborKeyReference) },
+};
+
+// Write a CBOR initial byte and its argument, using the shortest form.
+static void WriteCborHead(Writer* writer, uint8_t majorType, uint64_t argument)
+{
+    uint8_t head[9];
+    size_t length;
+    uint8_t type = (uint8_t)(majorType << 5);
+
+    if (argument < 24) {
+        head[0] = type | (uint8_t)argument;
+        length = 1;
+    }
+    else if (argument <= 0xFF) {
+        head[0] = type | 24;
+        head[1] = (uint8_t)argument;
+        length = 2;
+    }
+    else if (argument <= 0xFFFF) {
+        head[0] = type | 25;
+        head[1] = (uint8_t)(argument >> 8);
+        head[2] = (uint8_t)argument;
+        length = 3;
+    }
+    else if (argument <= 0xFFFFFFFF) {
+        head[0] = type | 26;
+        for (int i = 0; i < 4; i++) {
+            head[1 + i] = (uint8_t)(argument >> (24 - 8 * i));
+        }
+        length = 5;
+    }
+    else {
+        head[0] = type | 27;
+        for (int i = 0; i < 8; i++) {
+            head[1 + i] = (uint8_t)(argument >> (56 - 8 * i));
+        }
+        length = 9;
+    }
+
+    WriteBytes(writer, head, length);
+}
+
+static void WriteCborInteger(Writer* writer, int64_t value)
+{
+    if (value < 0) {
+        WriteCborHead(writer, CBOR_NEGATIVE, (uint64_t)(-1 - value));
+    }
+    else {
+        WriteCborHead(writer, CBOR_UNSIGNED, (uint64_t)value);
+    }
+}
+
+// Write hundredths as a decimal fraction, [-2, value], so that the value is carried exactly.
+static void WriteCborHundredths(Writer* writer, int32_t value)
+{
+    WriteCborHead(writer, CBOR_TAG, CBOR_TAG_DECIMAL_FRACTION);
+    WriteCborHead(writer, CBOR_ARRAY, 2);
+    WriteCborInteger(writer, -2);
+    WriteCborInteger(writer, value);
+}
+
+static void EncodeCborReading(Writer* writer, const TelemetryReading* reading, bool includeTime)
+{
+    uint64_t pairCount = includeTime ? 2 : 1;
+    for (size_t i = 0; i < TelemetryChannel_Count; i++) {
+        pairCount += (reading->channelMask >> i) & 1u;
+    }
+    WriteCborHead(writer, CBOR_MAP, pairCount);
+
+    WriteBytes(writer, CborKeyGlucose, sizeof(CborKeyGlucose));
+    WriteCborHundredths(writer, reading->glucoseHundredths);
+    for (size_t i = 0; i < TelemetryChannel_Count; i++) {
+        if ((reading->channelMask & (1u << i)) != 0) {
+            WriteBytes(writer, CborChannelKeys[i].key, CborChannelKeys[i].length);
+            WriteCborHundredths(writer, reading->channelHundredths[i]);
+        }
+    }
+
+    if (includeTime) {
+        WriteBytes(writer, CborKeyTime, sizeof(CborKeyTime));
+        WriteCborInteger(writer, (int64_t)reading->timestamp);
+    }
+}
+
+#define PACKED_VERSION 1
+
+// Write an unsigned LEB128 varint: seven bits per byte, least significant first, with the top
+// bit set on every byte but the last.
+static void WriteVarint(Writer* writer, uint64_t value)
+{
+    while (value >= 0x80) {
+        WriteByte(writer, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    WriteByte(writer, (uint8_t)value);
+}
+
+static void WriteZigzag(Writer* writer, int64_t value)
+{
+    WriteVarint(writer, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static void EncodePacked(Writer* writer, const TelemetryReading* readings, size_t count)
+{
+    WriteByte(writer, PACKED_VERSION);
+    WriteVarint(writer, count);
+    if (count == 0) {
+        return;
+    }
+
+    WriteVarint(writer, (uint64_t)readings[0].timestamp);
+    WriteZigzag(writer, readings[0].glucoseHundredths);
+    int64_t previousInterval = 0;
+    for (size_t i = 1; i < count; i++) {
+        int64_t interval = (int64_t)readings[i].timestamp - (int64_t)readings[i - 1].timestamp;
+        WriteZigzag(writer, interval - previousInterval);
+        WriteZigzag(writer,
+            (int64_t)readings[i].glucoseHundredths - readings[i - 1].glucoseHundredths);
+        previousInterval = interval;
+    }
+}
+
+size_t TelemetryEncoder_EncodeReadings(TelemetryEncoding encoding,
+    const TelemetryReading* readings, size_t count, bool includeTime, uint8_t* buffer,
+    size_t bufferSize)
+{
+    Writer writer = { .buffer = buffer, .size = bufferSize, .used = 0, .overflow = false };
+    bool asArray = includeTime || count != 1;
+
+    if (encoding == TelemetryEncoding_Packed) {
+        EncodePacked(&writer, readings, count);
+    }
+    else if (encoding == TelemetryEncoding_Cbor) {
+        if (asArray) {
+            WriteCborHead(&writer, CBOR_ARRAY, count);
+        }
+        for (size_t i = 0; i < count; i++) {
+            EncodeCborReading(&writer, &readings[i], includeTime);
+        }
+    }
+    else {
+        if (asArray) {
+            WriteByte(&writer, '[');
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (i != 0) {
+                WriteByte(&writer, ',');
+            }
+            EncodeJsonReading(&writer, &readings[i], includeTime);
+        }
+        if (asArray) {
+            WriteByte(&writer, ']');
+        }
+    }
+
+    return writer.overflow ? 0 : writer.used;
+}
+
+const char* TelemetryEncoder_ContentType(TelemetryEncoding encoding)
+{
+    switch (encoding) {
+    case TelemetryEncoding_Cbor:
+        return "application/cbor";
+    case TelemetryEncoding_Packed:
+        return TELEMETRY_ENCODER_PACKED_CONTENT_TYPE;
+    default:
+        return "application/json";
+    }
+}
+
+const char* TelemetryEncoder_ContentEncoding(TelemetryEncoding encoding)
+{
+    return encoding == TelemetryEncoding_Json ? "utf-8" : NULL;
+}
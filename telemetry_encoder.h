@@ -0,0 +1,76 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "telemetry_batch.h"
+
+/// <summary>
+/// Wire formats supported by <see cref="TelemetryEncoder_EncodeReadings" />.
+/// </summary>
+typedef enum {
+    TelemetryEncoding_Json = 0,  // UTF-8 JSON, for IoT Hub message routing and IoT Central
+    TelemetryEncoding_Cbor = 1,  // RFC 7049 CBOR, for smaller payloads
+    TelemetryEncoding_Packed = 2 // Delta-coded binary, for bulk uploads of stored readings
+} TelemetryEncoding;
+
+/// <summary>
+/// Buffer size which is always large enough to encode TELEMETRY_BATCH_CAPACITY readings in
+/// any encoding.
+/// </summary>
+#define TELEMETRY_ENCODER_BUFFER_SIZE (TELEMETRY_BATCH_CAPACITY * 108 + 9)
+
+/// <summary>
+/// Buffer size which is always large enough to encode the given number of readings in
+/// TelemetryEncoding_Packed. Typical readings take two or three bytes each.
+/// </summary>
+#define TELEMETRY_ENCODER_PACKED_BUFFER_SIZE(count) (32 + (count) * 16)
+
+/// <summary>
+/// Encode readings without any heap allocation or floating-point formatting. The schema is
+/// fixed at compile time:
+///
+/// A single reading without a timestamp encodes as {"Glucose":5.12}. Otherwise readings encode
+/// as an array of {"Glucose":5.12,"Time":1612345678} objects, where Time is in seconds since
+/// the Unix epoch. Channels set in a reading's channelMask are added after Glucose, as
+/// "Temperature" and "Reference". In CBOR, each value is a decimal fraction (tag 4) of the form
+/// [-2, 512], so that the fixed-point value is carried exactly.
+///
+/// TelemetryEncoding_Packed always includes timestamps, and takes advantage of readings being
+/// evenly spaced and changing slowly. It is a version byte of 1, then a sequence of LEB128
+/// varints: the reading count, the first timestamp, and the first glucose value in hundredths,
+/// zigzag-encoded; then for each later reading, the change in the interval since the previous
+/// reading and the change in glucose value, both zigzag-encoded. Zigzag encoding maps 0, -1, 1,
+/// -2, 2... to 0, 1, 2, 3, 4..., so small changes take a single byte. Only glucose is packed,
+/// as stored readings carry no other channels.
+/// </summary>
+/// <param name="encoding">Wire format to use.</param>
+/// <param name="readings">Readings to encode.</param>
+/// <param name="count">Number of readings.</param>
+/// <param name="includeTime">Whether to encode timestamps and always use the array form. Packed
+/// readings always include timestamps.</param>
+/// <param name="buffer">Destination buffer.</param>
+/// <param name="bufferSize">Size of buffer in bytes.</param>
+/// <returns>Number of bytes written, or 0 if the buffer is too small. No null terminator is
+/// written.</returns>
+size_t TelemetryEncoder_EncodeReadings(TelemetryEncoding encoding,
+    const TelemetryReading* readings, size_t count, bool includeTime, uint8_t* buffer,
+    size_t bufferSize);
+
+/// <summary>
+/// Content type of TelemetryEncoding_Packed messages, by which the cloud recognises them.
+/// </summary>
+#define TELEMETRY_ENCODER_PACKED_CONTENT_TYPE "application/vnd.gluck.readings-packed"
+
+/// <summary>
+/// Returns the IoT Hub message content type for an encoding.
+/// </summary>
+const char* TelemetryEncoder_ContentType(TelemetryEncoding encoding);
+
+/// <summary>
+/// Returns the IoT Hub message content encoding for an encoding, or NULL if there is none.
+/// </summary>
+const char* TelemetryEncoder_ContentEncoding(TelemetryEncoding encoding);
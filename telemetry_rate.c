@@ -0,0 +1,174 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "telemetry_rate.h"
+
+#define MILLISECONDS_PER_MINUTE 60000
+#define DECISECONDS_PER_MINUTE 600
+
+// Shortest span of readings from which a trend is trusted.
+static const uint64_t MinTrendSpanMs = 20 * 1000;
+
+// Readings older than this, relative to the newest, say little about the current trend.
+static const uint64_t MaxTrendAgeMs = 10 * 60 * 1000;
+
+static TelemetryRateConfig rateConfig;
+static uint64_t readingTimesMs[TELEMETRY_RATE_HISTORY];
+static int32_t readingValues[TELEMETRY_RATE_HISTORY];
+static size_t head = 0;  // Index at which the next reading will be written
+static size_t count = 0; // Number of valid readings
+static uint32_t periodMs = 0;
+static bool hasTrend = false;
+static int32_t trendPerMinute = 0;
+
+// Least-squares slope of the recent readings, in hundredths per minute. Times are taken in
+// deciseconds and values relative to the newest reading, which keeps every sum well within
+// int64_t.
+static bool EstimateTrend(int32_t* outHundredthsPerMinute)
+{
+    if (count < 2) {
+        return false;
+    }
+
+    size_t newest = (head + TELEMETRY_RATE_HISTORY - 1) % TELEMETRY_RATE_HISTORY;
+    int64_t n = 0, sumT = 0, sumV = 0, sumTT = 0, sumTV = 0;
+    uint64_t spanMs = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t index = (newest + TELEMETRY_RATE_HISTORY - i) % TELEMETRY_RATE_HISTORY;
+        uint64_t ageMs = readingTimesMs[newest] - readingTimesMs[index];
+        if (ageMs > MaxTrendAgeMs) {
+            break;
+        }
+
+        int64_t t = -(int64_t)(ageMs / 100);
+        int64_t v = (int64_t)readingValues[index] - readingValues[newest];
+        n++;
+        sumT += t;
+        sumV += v;
+        sumTT += t * t;
+        sumTV += t * v;
+        spanMs = ageMs;
+    }
+
+    int64_t denominator = n * sumTT - sumT * sumT;
+    if (spanMs < MinTrendSpanMs || denominator <= 0) {
+        return false;
+    }
+
+    int64_t slope = (n * sumTV - sumT * sumV) * DECISECONDS_PER_MINUTE / denominator;
+    if (slope > INT32_MAX) {
+        slope = INT32_MAX;
+    }
+    else if (slope < -INT32_MAX) {
+        slope = -INT32_MAX;
+    }
+    *outHundredthsPerMinute = (int32_t)slope;
+    return true;
+}
+
+static uint32_t ChoosePeriod(int32_t glucoseHundredths, int32_t slopePerMinute,
+    bool isLowThresholdWatched)
+{
+    uint64_t chosenMs = rateConfig.maxPeriodMs;
+    uint64_t absSlope = slopePerMinute < 0 ? (uint64_t)-(int64_t)slopePerMinute
+                                           : (uint64_t)slopePerMinute;
+
+    // Keep the change between readings within the reportable change.
+    if (absSlope > 0) {
+        uint64_t changeMs =
+            (uint64_t)rateConfig.reportableChangeHundredths * MILLISECONDS_PER_MINUTE / absSlope;
+        if (changeMs < chosenMs) {
+            chosenMs = changeMs;
+        }
+    }
+
+    // Report hypoglycemia, and a fall towards it, as often as allowed.
+    if (isLowThresholdWatched && glucoseHundredths <= rateConfig.lowThresholdHundredths) {
+        chosenMs = rateConfig.minPeriodMs;
+    }
+    else if (isLowThresholdWatched && slopePerMinute < 0) {
+        uint64_t thresholdMs =
+            (uint64_t)(glucoseHundredths - rateConfig.lowThresholdHundredths) *
+            MILLISECONDS_PER_MINUTE / absSlope / rateConfig.reportsBeforeThreshold;
+        if (thresholdMs < chosenMs) {
+            chosenMs = thresholdMs;
+        }
+    }
+
+    if (chosenMs < rateConfig.minPeriodMs) {
+        chosenMs = rateConfig.minPeriodMs;
+    }
+    return (uint32_t)chosenMs;
+}
+
+int TelemetryRate_Init(const TelemetryRateConfig* config)
+{
+    if (config->minPeriodMs == 0 || config->minPeriodMs > config->maxPeriodMs ||
+        config->initialPeriodMs < config->minPeriodMs ||
+        config->initialPeriodMs > config->maxPeriodMs || config->reportableChangeHundredths <= 0 ||
+        config->reportsBeforeThreshold == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rateConfig = *config;
+    head = 0;
+    count = 0;
+    periodMs = config->initialPeriodMs;
+    hasTrend = false;
+    return 0;
+}
+
+int TelemetryRate_SetBounds(uint32_t minPeriodMs, uint32_t maxPeriodMs)
+{
+    if (minPeriodMs == 0 || minPeriodMs > maxPeriodMs) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rateConfig.minPeriodMs = minPeriodMs;
+    rateConfig.maxPeriodMs = maxPeriodMs;
+    if (periodMs < minPeriodMs) {
+        periodMs = minPeriodMs;
+    }
+    else if (periodMs > maxPeriodMs) {
+        periodMs = maxPeriodMs;
+    }
+    return 0;
+}
+
+void TelemetryRate_SetLowThreshold(int32_t lowThresholdHundredths)
+{
+    rateConfig.lowThresholdHundredths = lowThresholdHundredths;
+}
+
+uint32_t TelemetryRate_AddReading(uint64_t timeMs, int32_t glucoseHundredths,
+    bool isLowThresholdWatched)
+{
+    readingTimesMs[head] = timeMs;
+    readingValues[head] = glucoseHundredths;
+    head = (head + 1) % TELEMETRY_RATE_HISTORY;
+    if (count < TELEMETRY_RATE_HISTORY) {
+        count++;
+    }
+
+    hasTrend = EstimateTrend(&trendPerMinute);
+    if (hasTrend) {
+        periodMs = ChoosePeriod(glucoseHundredths, trendPerMinute, isLowThresholdWatched);
+    }
+    else if (isLowThresholdWatched && glucoseHundredths <= rateConfig.lowThresholdHundredths) {
+        periodMs = rateConfig.minPeriodMs;
+    }
+    return periodMs;
+}
+
+bool TelemetryRate_GetTrend(int32_t* outHundredthsPerMinute)
+{
+    if (hasTrend) {
+        *outHundredthsPerMinute = trendPerMinute;
+    }
+    return hasTrend;
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/// <summary>
+/// Number of recent readings from which the glucose trend is estimated.
+/// </summary>
+#define TELEMETRY_RATE_HISTORY 16
+
+/// <summary>
+/// Parameters of the adaptive telemetry rate.
+/// </summary>
+typedef struct {
+    uint32_t initialPeriodMs;           // Period used until there is a trend to go on
+    uint32_t minPeriodMs;               // Bounds on the period, which may be changed later with
+    uint32_t maxPeriodMs;               // TelemetryRate_SetBounds
+    int32_t reportableChangeHundredths; // Largest change allowed to go unreported for a period
+    int32_t lowThresholdHundredths;     // Level which a falling trend is watched against
+    uint32_t reportsBeforeThreshold;    // Readings to take while a falling trend reaches it
+} TelemetryRateConfig;
+
+/// <summary>
+/// Set up the adaptive telemetry rate and forget any previous readings. The period between
+/// readings is chosen so that the trend cannot change the level by more than the reportable
+/// change between two readings, and so that a falling level is reported at least
+/// reportsBeforeThreshold times before it is projected to cross the low threshold. Steady
+/// readings are therefore taken at the longest period, and a fall towards hypoglycemia at
+/// progressively shorter ones.
+/// </summary>
+/// <param name="config">Parameters. Copied.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int TelemetryRate_Init(const TelemetryRateConfig* config);
+
+/// <summary>
+/// Change the bounds on the period, for example from the device twin.
+/// </summary>
+/// <returns>0 on success, or -1 with errno set to EINVAL if minPeriodMs is zero or greater than
+/// maxPeriodMs.</returns>
+int TelemetryRate_SetBounds(uint32_t minPeriodMs, uint32_t maxPeriodMs);
+
+/// <summary>
+/// Change the low threshold, for example from the device twin. It takes effect from the next
+/// reading.
+/// </summary>
+/// <param name="lowThresholdHundredths">Level which a falling trend is watched against.</param>
+void TelemetryRate_SetLowThreshold(int32_t lowThresholdHundredths);
+
+/// <summary>
+/// Record a reading and choose the period until the next one. The trend is a least-squares fit
+/// over the recent readings, in integer arithmetic; until they span long enough for noise not to
+/// dominate it, the period in effect is kept.
+/// </summary>
+/// <param name="timeMs">Monotonic time of the reading, in milliseconds.</param>
+/// <param name="glucoseHundredths">Reading, in hundredths.</param>
+/// <param name="isLowThresholdWatched">Whether to shorten the period for hypoglycemia and a
+/// fall towards it. Pass false while readings are not in the threshold's unit, such as before the
+/// sensor is calibrated.</param>
+/// <returns>Period until the next reading, in milliseconds, within the bounds.</returns>
+uint32_t TelemetryRate_AddReading(uint64_t timeMs, int32_t glucoseHundredths,
+    bool isLowThresholdWatched);
+
+/// <summary>
+/// Get the current trend.
+/// </summary>
+/// <param name="outHundredthsPerMinute">Receives the rate of change, in hundredths per
+/// minute.</param>
+/// <returns>true on success; false if there is not yet a trend.</returns>
+bool TelemetryRate_GetTrend(int32_t* outHundredthsPerMinute);
@@ -0,0 +1,255 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app_log.h"
+#include "telemetry_store.h"
+
+// Mixed into every check value, so that zero-filled (never written) storage is invalid.
+#define STORE_MAGIC 0x474C4B31u // "GLK1"
+
+// Number of records read per call when recovering the queue.
+#define RECOVERY_CHUNK_RECORDS 32
+
+typedef struct {
+    uint32_t sequence;
+    uint32_t timestamp;
+    int32_t glucoseHundredths;
+    uint32_t check;
+} StoredReading;
+
+typedef struct {
+    uint32_t tailSequence;
+    uint32_t check;
+} StoredCommit;
+
+static uint32_t ReadingCheck(const StoredReading* record)
+{
+    return record->sequence ^ record->timestamp ^ (uint32_t)record->glucoseHundredths ^
+           STORE_MAGIC;
+}
+
+static uint32_t CommitCheck(const StoredCommit* commit)
+{
+    return ~commit->tailSequence ^ STORE_MAGIC;
+}
+
+static off_t CommitOffset(const TelemetryStore* store, uint32_t slot)
+{
+    return store->offset + (off_t)(slot * sizeof(StoredCommit));
+}
+
+static off_t RecordOffset(const TelemetryStore* store, uint32_t sequence)
+{
+    return store->offset + (off_t)(TELEMETRY_STORE_COMMIT_SLOTS * sizeof(StoredCommit)) +
+           (off_t)((sequence % store->capacity) * sizeof(StoredReading));
+}
+
+// Read up to 'size' bytes at 'offset'. Bytes beyond the end of the file read as zero.
+static int ReadAt(int fd, off_t offset, void* buffer, size_t size)
+{
+    memset(buffer, 0, size);
+    if (lseek(fd, offset, SEEK_SET) == -1) {
+        return -1;
+    }
+
+    ssize_t readSize = read(fd, buffer, size);
+    if (readSize == -1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int WriteAt(int fd, off_t offset, const void* buffer, size_t size)
+{
+    if (lseek(fd, offset, SEEK_SET) == -1) {
+        return -1;
+    }
+
+    ssize_t writeSize = write(fd, buffer, size);
+    if (writeSize == -1) {
+        return -1;
+    }
+    if ((size_t)writeSize != size) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    return 0;
+}
+
+int TelemetryStore_Open(TelemetryStore* store, int fd, off_t offset, size_t size)
+{
+    store->fd = -1;
+    store->offset = offset;
+
+    size_t commitSize = TELEMETRY_STORE_COMMIT_SLOTS * sizeof(StoredCommit);
+    if (fd < 0 || size < commitSize + sizeof(StoredReading)) {
+        errno = EINVAL;
+        return -1;
+    }
+    store->capacity = (uint32_t)((size - commitSize) / sizeof(StoredReading));
+
+    // Find the most recent commit record.
+    StoredCommit commits[TELEMETRY_STORE_COMMIT_SLOTS];
+    if (ReadAt(fd, offset, commits, sizeof(commits)) == -1) {
+        return -1;
+    }
+
+    bool haveCommit = false;
+    uint32_t committedTail = 0;
+    store->nextCommitSlot = 0;
+    for (uint32_t i = 0; i < TELEMETRY_STORE_COMMIT_SLOTS; i++) {
+        if (commits[i].check == CommitCheck(&commits[i]) &&
+            (!haveCommit || commits[i].tailSequence > committedTail)) {
+            haveCommit = true;
+            committedTail = commits[i].tailSequence;
+            store->nextCommitSlot = (i + 1) % TELEMETRY_STORE_COMMIT_SLOTS;
+        }
+    }
+
+    // Find the oldest and newest intact readings in the ring.
+    uint32_t minSequence = 0;
+    uint32_t maxSequence = 0;
+    StoredReading records[RECOVERY_CHUNK_RECORDS];
+    off_t recordsOffset = offset + (off_t)commitSize;
+    for (uint32_t first = 0; first < store->capacity; first += RECOVERY_CHUNK_RECORDS) {
+        uint32_t chunk = store->capacity - first;
+        if (chunk > RECOVERY_CHUNK_RECORDS) {
+            chunk = RECOVERY_CHUNK_RECORDS;
+        }
+        if (ReadAt(fd, recordsOffset + (off_t)(first * sizeof(StoredReading)), records,
+            chunk * sizeof(StoredReading)) == -1) {
+            return -1;
+        }
+
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (records[i].sequence == 0 || records[i].check != ReadingCheck(&records[i]) ||
+                records[i].sequence % store->capacity != first + i) {
+                continue;
+            }
+            if (minSequence == 0 || records[i].sequence < minSequence) {
+                minSequence = records[i].sequence;
+            }
+            if (records[i].sequence > maxSequence) {
+                maxSequence = records[i].sequence;
+            }
+        }
+    }
+
+    // Sequence numbers start at 1, so that zero-filled storage never looks like a reading.
+    store->nextSequence = maxSequence + 1;
+    store->tailSequence = haveCommit ? committedTail : (minSequence != 0 ? minSequence : 1);
+    if (store->tailSequence > store->nextSequence) {
+        store->tailSequence = store->nextSequence;
+    }
+    if (store->nextSequence - store->tailSequence > store->capacity) {
+        store->tailSequence = store->nextSequence - store->capacity;
+    }
+
+    store->fd = fd;
+    LOG_INFO("INFO: Telemetry store holds %u readings (capacity %u).\n",
+        (unsigned int)TelemetryStore_PendingCount(store), store->capacity);
+    return 0;
+}
+
+bool TelemetryStore_IsOpen(const TelemetryStore* store)
+{
+    return store->fd >= 0;
+}
+
+int TelemetryStore_Append(TelemetryStore* store, const TelemetryReading* reading)
+{
+    if (!TelemetryStore_IsOpen(store)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    StoredReading record = { .sequence = store->nextSequence,
+                             .timestamp = (uint32_t)reading->timestamp,
+                             .glucoseHundredths = reading->glucoseHundredths };
+    record.check = ReadingCheck(&record);
+
+    if (WriteAt(store->fd, RecordOffset(store, record.sequence), &record, sizeof(record)) == -1) {
+        return -1;
+    }
+
+    store->nextSequence++;
+    if (store->nextSequence - store->tailSequence > store->capacity) {
+        // The oldest reading has just been overwritten.
+        store->tailSequence = store->nextSequence - store->capacity;
+    }
+
+    return 0;
+}
+
+size_t TelemetryStore_PendingCount(const TelemetryStore* store)
+{
+    if (!TelemetryStore_IsOpen(store)) {
+        return 0;
+    }
+
+    return store->nextSequence - store->tailSequence;
+}
+
+int TelemetryStore_Peek(TelemetryStore* store, TelemetryReading* readings, size_t maxReadings,
+    uint32_t* outFirstSequence, size_t* outSpan)
+{
+    size_t count = 0;
+    uint32_t sequence = store->tailSequence;
+
+    *outFirstSequence = sequence;
+    *outSpan = 0;
+    if (!TelemetryStore_IsOpen(store)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    while (count < maxReadings && sequence != store->nextSequence) {
+        StoredReading record;
+        if (ReadAt(store->fd, RecordOffset(store, sequence), &record, sizeof(record)) == -1) {
+            return -1;
+        }
+
+        if (record.sequence == sequence && record.check == ReadingCheck(&record)) {
+            readings[count].timestamp = (time_t)record.timestamp;
+            readings[count].glucoseHundredths = record.glucoseHundredths;
+            readings[count].channelMask = 0;
+            count++;
+        }
+        sequence++;
+    }
+
+    *outSpan = sequence - store->tailSequence;
+    return (int)count;
+}
+
+int TelemetryStore_ConsumeThrough(TelemetryStore* store, uint32_t endSequence)
+{
+    if (!TelemetryStore_IsOpen(store)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // If the tail has passed endSequence, because a full queue was appended to, the difference
+    // wraps and exceeds the pending count.
+    uint32_t count = endSequence - store->tailSequence;
+    if (count == 0 || count > TelemetryStore_PendingCount(store)) {
+        return 0;
+    }
+
+    StoredCommit commit = { .tailSequence = endSequence };
+    commit.check = CommitCheck(&commit);
+    if (WriteAt(store->fd, CommitOffset(store, store->nextCommitSlot), &commit, sizeof(commit)) ==
+        -1) {
+        return -1;
+    }
+
+    store->tailSequence = commit.tailSequence;
+    store->nextCommitSlot = (store->nextCommitSlot + 1) % TELEMETRY_STORE_COMMIT_SLOTS;
+    return 0;
+}
@@ -0,0 +1,95 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "telemetry_batch.h"
+
+/// <summary>
+/// Persistent store-and-forward queue of glucose readings, kept in a region of the
+/// application's mutable storage file.
+///
+/// The region starts with TELEMETRY_STORE_COMMIT_SLOTS small commit records, which hold
+/// the sequence number of the newest reading that has been forwarded, followed by a ring of
+/// fixed-size binary reading records. Each reading is given an increasing sequence number and is
+/// written to ring slot (sequence % capacity), so the ring is written strictly sequentially and
+/// every location is rewritten only once per lap. Commit records are likewise written round-robin
+/// so that no single location absorbs every drain. Each record carries a check value so that a
+/// torn write can be detected, and on open the queue is recovered by scanning the region.
+/// </summary>
+typedef struct {
+    int fd;                // Mutable storage file descriptor, or -1 if the store is not open
+    off_t offset;          // Start of the region within the file
+    uint32_t capacity;     // Number of reading records in the ring
+    uint32_t nextSequence; // Sequence number the next appended reading will be given
+    uint32_t tailSequence; // Sequence number of the oldest reading not yet forwarded
+    uint32_t nextCommitSlot;
+} TelemetryStore;
+
+/// <summary>
+/// Number of commit records at the start of the region.
+/// </summary>
+#define TELEMETRY_STORE_COMMIT_SLOTS 8
+
+/// <summary>
+/// Open the store in the given region of a mutable storage file and recover any readings
+/// which were queued but not forwarded before the application last stopped.
+/// </summary>
+/// <param name="store">Store to initialize.</param>
+/// <param name="fd">File descriptor returned by Storage_OpenMutableFile. The store does not
+/// take ownership of it.</param>
+/// <param name="offset">Start of the region within the file.</param>
+/// <param name="size">Size of the region in bytes.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int TelemetryStore_Open(TelemetryStore* store, int fd, off_t offset, size_t size);
+
+/// <summary>
+/// Returns whether the store was opened successfully.
+/// </summary>
+bool TelemetryStore_IsOpen(const TelemetryStore* store);
+
+/// <summary>
+/// Append a reading to the queue. If the queue is full, the oldest reading is overwritten.
+/// Only the timestamp and glucose are kept; other channels are dropped, so that the on-disk
+/// record format does not depend on the hardware.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int TelemetryStore_Append(TelemetryStore* store, const TelemetryReading* reading);
+
+/// <summary>
+/// Returns the number of readings which are queued and have not been forwarded.
+/// </summary>
+size_t TelemetryStore_PendingCount(const TelemetryStore* store);
+
+/// <summary>
+/// Read the oldest queued readings without removing them from the queue.
+/// </summary>
+/// <param name="store">Store to read from.</param>
+/// <param name="readings">Receives up to maxReadings readings, oldest first.</param>
+/// <param name="maxReadings">Size of the readings array.</param>
+/// <param name="outFirstSequence">Receives the sequence number of the first queue entry
+/// covered.</param>
+/// <param name="outSpan">Receives the number of queue entries covered by the returned readings.
+/// Pass firstSequence + span to <see cref="TelemetryStore_ConsumeThrough" /> once they have been
+/// forwarded. This can exceed the number of readings returned, because readings which cannot be
+/// read back intact are skipped.</param>
+/// <returns>Number of readings read, or -1 on failure, in which case errno contains more
+/// information.</returns>
+int TelemetryStore_Peek(TelemetryStore* store, TelemetryReading* readings, size_t maxReadings,
+    uint32_t* outFirstSequence, size_t* outSpan);
+
+/// <summary>
+/// Remove the queued readings before a sequence number once they have been forwarded. This is
+/// safe if readings were appended to a full queue since they were peeked: the overwritten
+/// readings have already left the queue, and readings which were not peeked are kept.
+/// </summary>
+/// <param name="store">Store to remove readings from.</param>
+/// <param name="endSequence">Sequence number after the last entry to remove: firstSequence +
+/// span, as returned by <see cref="TelemetryStore_Peek" />. Nothing is removed if the queue has
+/// already moved past it.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int TelemetryStore_ConsumeThrough(TelemetryStore* store, uint32_t endSequence);
@@ -0,0 +1,309 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#include <errno.h>
+#include <string.h>
+
+#include "app_log.h"
+#include "twin_parser.h"
+
+typedef struct {
+    const char* text;
+    size_t length;
+} Key;
+
+typedef struct {
+    const uint8_t* next;
+    const uint8_t* end;
+    bool desiredOnly;
+    const TwinProperty* table;
+    size_t tableSize;
+    Key keys[TWIN_PARSER_MAX_DEPTH]; // Path from the root to the value being parsed
+} Parser;
+
+static bool ParseValue(Parser* parser, size_t depth, size_t nesting, bool matchable);
+
+static void SkipWhitespace(Parser* parser)
+{
+    while (parser->next < parser->end &&
+           (*parser->next == ' ' || *parser->next == '\t' || *parser->next == '\n' ||
+            *parser->next == '\r')) {
+        parser->next++;
+    }
+}
+
+static bool Consume(Parser* parser, uint8_t c)
+{
+    SkipWhitespace(parser);
+    if (parser->next < parser->end && *parser->next == c) {
+        parser->next++;
+        return true;
+    }
+    return false;
+}
+
+static bool ConsumeLiteral(Parser* parser, const char* literal)
+{
+    size_t length = strlen(literal);
+    if ((size_t)(parser->end - parser->next) < length ||
+        memcmp(parser->next, literal, length) != 0) {
+        return false;
+    }
+    parser->next += length;
+    return true;
+}
+
+// Scan a string whose opening quote has been consumed. Escapes are skipped, not decoded.
+static bool ParseString(Parser* parser, const char** outText, size_t* outLength)
+{
+    const uint8_t* start = parser->next;
+    while (parser->next < parser->end && *parser->next != '"') {
+        if (*parser->next == '\\') {
+            parser->next++;
+        }
+        parser->next++;
+    }
+    if (parser->next >= parser->end) {
+        return false;
+    }
+
+    *outText = (const char*)start;
+    *outLength = (size_t)(parser->next - start);
+    parser->next++; // Closing quote
+    return true;
+}
+
+// Parse a JSON number as fixed-point hundredths, without going through floating point.
+static bool ParseNumber(Parser* parser, int64_t* outHundredths)
+{
+    const int64_t Limit = INT64_MAX / 10;
+    bool negative = false;
+    bool haveDigits = false;
+    int64_t mantissa = 0;
+    int exponent = 0; // Decimal exponent applied to the mantissa
+
+    if (parser->next < parser->end && *parser->next == '-') {
+        negative = true;
+        parser->next++;
+    }
+    for (bool inFraction = false; parser->next < parser->end; parser->next++) {
+        uint8_t c = *parser->next;
+        if (c == '.' && !inFraction) {
+            inFraction = true;
+        }
+        else if (c >= '0' && c <= '9') {
+            haveDigits = true;
+            if (mantissa < Limit) {
+                mantissa = mantissa * 10 + (c - '0');
+                exponent -= inFraction ? 1 : 0;
+            }
+            else if (!inFraction) {
+                exponent++; // Further integer digits only scale the value
+            }
+        }
+        else {
+            break;
+        }
+    }
+    if (!haveDigits) {
+        return false;
+    }
+
+    if (parser->next < parser->end && (*parser->next == 'e' || *parser->next == 'E')) {
+        bool negativeExponent = false;
+        int value = 0;
+        parser->next++;
+        if (parser->next < parser->end && (*parser->next == '+' || *parser->next == '-')) {
+            negativeExponent = *parser->next == '-';
+            parser->next++;
+        }
+        if (parser->next >= parser->end || *parser->next < '0' || *parser->next > '9') {
+            return false;
+        }
+        while (parser->next < parser->end && *parser->next >= '0' && *parser->next <= '9') {
+            if (value < 1000) {
+                value = value * 10 + (*parser->next - '0');
+            }
+            parser->next++;
+        }
+        exponent += negativeExponent ? -value : value;
+    }
+
+    // Scale the mantissa from 10^exponent to hundredths.
+    for (exponent += 2; exponent > 0 && mantissa != 0; exponent--) {
+        if (mantissa >= Limit) {
+            mantissa = INT64_MAX;
+            break;
+        }
+        mantissa *= 10;
+    }
+    for (; exponent < 0 && mantissa != 0; exponent++) {
+        mantissa /= 10;
+    }
+
+    *outHundredths = negative ? -mantissa : mantissa;
+    return true;
+}
+
+// Match a dotted table path against the key path of a value.
+static bool PathMatches(const char* path, const Key* keys, size_t depth)
+{
+    for (size_t i = 0; i < depth; i++) {
+        const char* separator = strchr(path, '.');
+        size_t length = separator != NULL ? (size_t)(separator - path) : strlen(path);
+        if (length != keys[i].length || memcmp(path, keys[i].text, length) != 0) {
+            return false;
+        }
+        if (separator == NULL) {
+            return i == depth - 1;
+        }
+        path = separator + 1;
+    }
+
+    return false;
+}
+
+static void DeliverValue(Parser* parser, size_t depth, const TwinValue* value)
+{
+    const Key* keys = parser->keys;
+    if (parser->desiredOnly) {
+        if (depth < 2 || keys[0].length != 7 || memcmp(keys[0].text, "desired", 7) != 0) {
+            return;
+        }
+        keys++;
+        depth--;
+    }
+
+    for (size_t i = 0; i < parser->tableSize; i++) {
+        const TwinProperty* property = &parser->table[i];
+        if (!PathMatches(property->path, keys, depth)) {
+            continue;
+        }
+        if (property->type != value->type) {
+            LOG_WARNING("WARNING: Ignoring twin property %s with unexpected type.\n",
+                property->path);
+            continue;
+        }
+        property->handler(value);
+    }
+}
+
+static bool ParseObject(Parser* parser, size_t depth, size_t nesting, bool matchable)
+{
+    if (Consume(parser, '}')) {
+        return true;
+    }
+
+    do {
+        Key key;
+        if (!Consume(parser, '"') || !ParseString(parser, &key.text, &key.length) ||
+            !Consume(parser, ':')) {
+            return false;
+        }
+        parser->keys[depth] = key;
+        if (!ParseValue(parser, depth + 1, nesting + 1, matchable)) {
+            return false;
+        }
+    } while (Consume(parser, ','));
+
+    return Consume(parser, '}');
+}
+
+static bool ParseArray(Parser* parser, size_t depth, size_t nesting)
+{
+    if (Consume(parser, ']')) {
+        return true;
+    }
+
+    // Twin properties cannot hold arrays, so array elements are never delivered to handlers.
+    do {
+        if (!ParseValue(parser, depth, nesting + 1, false)) {
+            return false;
+        }
+    } while (Consume(parser, ','));
+
+    return Consume(parser, ']');
+}
+
+// Parse one value. 'depth' is the number of keys on the path to it.
+static bool ParseValue(Parser* parser, size_t depth, size_t nesting, bool matchable)
+{
+    TwinValue value;
+    memset(&value, 0, sizeof(value));
+
+    if (nesting > TWIN_PARSER_MAX_DEPTH) {
+        return false;
+    }
+
+    SkipWhitespace(parser);
+    if (parser->next >= parser->end) {
+        return false;
+    }
+
+    switch (*parser->next) {
+    case '{':
+        parser->next++;
+        return depth < TWIN_PARSER_MAX_DEPTH && ParseObject(parser, depth, nesting, matchable);
+    case '[':
+        parser->next++;
+        return ParseArray(parser, depth, nesting);
+    case '"':
+        parser->next++;
+        value.type = TwinValue_String;
+        if (!ParseString(parser, &value.stringValue, &value.stringLength)) {
+            return false;
+        }
+        break;
+    case 't':
+        value.type = TwinValue_Bool;
+        value.boolValue = true;
+        if (!ConsumeLiteral(parser, "true")) {
+            return false;
+        }
+        break;
+    case 'f':
+        value.type = TwinValue_Bool;
+        value.boolValue = false;
+        if (!ConsumeLiteral(parser, "false")) {
+            return false;
+        }
+        break;
+    case 'n':
+        // A null in a desired properties patch removes the property; there is nothing to apply.
+        return ConsumeLiteral(parser, "null");
+    default:
+        value.type = TwinValue_Number;
+        if (!ParseNumber(parser, &value.numberHundredths)) {
+            return false;
+        }
+        break;
+    }
+
+    if (matchable) {
+        DeliverValue(parser, depth, &value);
+    }
+    return true;
+}
+
+int TwinParser_Parse(const uint8_t* payload, size_t size, bool desiredOnly,
+    const TwinProperty* table, size_t tableSize)
+{
+    Parser parser = { .next = payload,
+                      .end = payload + size,
+                      .desiredOnly = desiredOnly,
+                      .table = table,
+                      .tableSize = tableSize };
+
+    if (!ParseValue(&parser, 0, 0, true)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    SkipWhitespace(&parser);
+    if (parser.next != parser.end) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
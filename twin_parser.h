@@ -0,0 +1,66 @@
+/* Copyright (c) Group Romeo 2021. All rights reserved.
+   Licensed under the MIT License. */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+/// JSON value types which can be delivered to a <see cref="TwinProperty" /> handler.
+/// </summary>
+typedef enum {
+    TwinValue_Bool = 0,
+    TwinValue_Number = 1,
+    TwinValue_String = 2
+} TwinValueType;
+
+/// <summary>
+/// A scalar value found in a device twin document. Values point into the payload being parsed
+/// and are only valid for the duration of the handler call.
+/// </summary>
+typedef struct {
+    TwinValueType type;
+    bool boolValue;
+    int64_t numberHundredths; // Number, in hundredths, truncated and saturated to int64
+    const char* stringValue;  // String contents, not null-terminated and with escapes undecoded
+    size_t stringLength;
+} TwinValue;
+
+/// <summary>
+/// Function signature for a twin property handler.
+/// </summary>
+typedef void (*TwinPropertyHandler)(const TwinValue* value);
+
+/// <summary>
+/// One entry in the table of twin properties handled by the application.
+/// </summary>
+typedef struct {
+    const char* path;            // Dotted path below the desired properties, e.g. "Alerts.Low"
+    TwinValueType type;          // Values of any other type are ignored
+    TwinPropertyHandler handler;
+} TwinProperty;
+
+/// <summary>
+/// Deepest object nesting accepted in a twin document.
+/// </summary>
+#define TWIN_PARSER_MAX_DEPTH 16
+
+/// <summary>
+/// Walk a device twin document once, in place, and call the handler of every table entry whose
+/// path matches a scalar value. Nothing is allocated or copied, so the payload may be of any
+/// size and need not be null-terminated. Handlers are called in document order, so a handler
+/// may already have run when a later syntax error is found. JSON nulls, and values of a type
+/// other than the entry's, are skipped.
+/// </summary>
+/// <param name="payload">Twin document.</param>
+/// <param name="size">Size of payload in bytes.</param>
+/// <param name="desiredOnly">true for a complete twin document, where table paths are
+/// relative to its "desired" object; false for a desired properties patch, where they are
+/// relative to the root.</param>
+/// <param name="table">Properties to look for.</param>
+/// <param name="tableSize">Number of entries in table.</param>
+/// <returns>0 on success, or -1 with errno set to EINVAL if the document is not valid JSON or
+/// is nested more than TWIN_PARSER_MAX_DEPTH deep.</returns>
+int TwinParser_Parse(const uint8_t* payload, size_t size, bool desiredOnly,
+    const TwinProperty* table, size_t tableSize);